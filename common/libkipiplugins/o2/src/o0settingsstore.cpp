@@ -11,12 +11,20 @@ static quint64 getHash(const QString &encryptionKey) {
 O0SettingsStore::O0SettingsStore(const QString &encryptionKey, QObject *parent):
     O0AbstractStore(parent), crypt_(getHash(encryptionKey)) {
     settings_ = new QSettings(this);
+    syncTimer_.setSingleShot(true);
+    connect(&syncTimer_, SIGNAL(timeout()), this, SLOT(sync()));
 }
 
 O0SettingsStore::O0SettingsStore(QSettings *settings, const QString &encryptionKey, QObject *parent):
     O0AbstractStore(parent), crypt_(getHash(encryptionKey)) {
     settings_ = settings;
     settings_->setParent(this);
+    syncTimer_.setSingleShot(true);
+    connect(&syncTimer_, SIGNAL(timeout()), this, SLOT(sync()));
+}
+
+O0SettingsStore::~O0SettingsStore() {
+    sync();
 }
 
 QString O0SettingsStore::groupKey() const {
@@ -27,21 +35,55 @@ void O0SettingsStore::setGroupKey(const QString &groupKey) {
     if (groupKey_ == groupKey) {
         return;
     }
+    sync();
+    values_.clear();
     groupKey_ = groupKey;
     Q_EMIT groupKeyChanged();
 }
 
+QString O0SettingsStore::fullKey(const QString &key) const {
+    return groupKey_.isEmpty() ? key : (groupKey_ + '/' + key);
+}
+
 QString O0SettingsStore::value(const QString &key, const QString &defaultValue) {
-    QString fullKey = groupKey_.isEmpty() ? key : (groupKey_ + '/' + key);
-    if (!settings_->contains(fullKey)) {
+    QString settingsKey = fullKey(key);
+    QMap<QString, QString>::const_iterator it = values_.constFind(settingsKey);
+    if (it != values_.constEnd()) {
+        return it.value();
+    }
+    if (!settings_->contains(settingsKey)) {
         return defaultValue;
     }
-    return crypt_.decryptToString(settings_->value(fullKey).toString());
+    // Decrypt once, the tokens are read for each request
+    QString value = crypt_.decryptToString(settings_->value(settingsKey).toString());
+    values_.insert(settingsKey, value);
+    return value;
 }
 
 void O0SettingsStore::setValue(const QString &key, const QString &value) {
-    QString fullKey = groupKey_.isEmpty() ? key : (groupKey_ + '/' + key);
-    settings_->setValue(fullKey, crypt_.encryptToString(value));
+    QString settingsKey = fullKey(key);
+    QMap<QString, QString>::const_iterator it = values_.constFind(settingsKey);
+    if (it != values_.constEnd() && it.value() == value && settings_->contains(settingsKey)) {
+        return;
+    }
+    values_.insert(settingsKey, value);
+    changed_.insert(settingsKey);
+    // A token reply sets several values: write them together
+    if (!syncTimer_.isActive()) {
+        syncTimer_.start(0);
+    }
+}
+
+void O0SettingsStore::sync() {
+    syncTimer_.stop();
+    if (changed_.isEmpty()) {
+        return;
+    }
+    foreach (const QString &settingsKey, changed_) {
+        settings_->setValue(settingsKey, crypt_.encryptToString(values_.value(settingsKey)));
+    }
+    changed_.clear();
+    settings_->sync();
 
     const QSettings::Status status = settings_->status();
     if (status != QSettings::NoError) {
@@ -3,12 +3,17 @@
 
 #include <QSettings>
 #include <QString>
+#include <QMap>
+#include <QSet>
+#include <QTimer>
 
 #include "o0baseauth.h"
 #include "o0abstractstore.h"
 #include "o0simplecrypt.h"
 
 /// Persistent storage for authentication tokens, using QSettings.
+/// Values are kept decrypted in memory. Changes are encrypted and written together
+/// when control returns to the event loop, or when sync() is called.
 class O0_EXPORT O0SettingsStore: public O0AbstractStore {
     Q_OBJECT
 
@@ -19,6 +24,9 @@ public:
     /// Construct with an explicit QSettings instance
     explicit O0SettingsStore(QSettings *settings, const QString &encryptionKey, QObject *parent = 0);
 
+    /// Destructor, writes the pending changes
+    ~O0SettingsStore();
+
     /// Group key prefix
     Q_PROPERTY(QString groupKey READ groupKey WRITE setGroupKey NOTIFY groupKeyChanged)
     QString groupKey() const;
@@ -30,14 +38,25 @@ public:
     /// Set a string value for a key
     void setValue(const QString &key, const QString &value) Q_DECL_OVERRIDE;
 
+public Q_SLOTS:
+    /// Write the pending changes to the settings
+    void sync();
+
 Q_SIGNALS:
     // Property change signals
     void groupKeyChanged();
 
+protected:
+    /// Full settings key of a value
+    QString fullKey(const QString &key) const;
+
 protected:
     QSettings* settings_;
     QString groupKey_;
     O0SimpleCrypt crypt_;
+    QMap<QString, QString> values_;
+    QSet<QString> changed_;
+    QTimer syncTimer_;
 };
 
 #endif // O0SETTINGSSTORE_H
@@ -56,6 +56,15 @@ static QVariantMap parseTokenResponse(const QByteArray &data) {
 #endif
 }
 
+/// Refresh tokens this many seconds before they expire
+static const int RefreshMargin = 300;
+
+/// Instances running a token refresh, by account. Other instances of the same account wait for them.
+static QMap<QString, O2 *> &runningRefreshes() {
+    static QMap<QString, O2 *> refreshes;
+    return refreshes;
+}
+
 /// Add query parameters to a query
 static void addQueryParametersToUrl(QUrl &url,  QList<QPair<QString, QString> > parameters) {
 #if QT_VERSION < 0x050000
@@ -72,9 +81,21 @@ O2::O2(QObject *parent, QNetworkAccessManager *manager, O0AbstractStore *store):
     replyServer_ = new O2ReplyServer(this);
     grantFlow_ = GrantFlowAuthorizationCode;
     localhostPolicy_ = QString(O2_CALLBACK_URL);
+    refreshing_ = false;
+    refreshLeader_ = 0;
+    refreshTimer_.setSingleShot(true);
     qRegisterMetaType<QNetworkReply::NetworkError>("QNetworkReply::NetworkError");
     connect(replyServer_, SIGNAL(verificationReceived(QMap<QString,QString>)), this, SLOT(onVerificationReceived(QMap<QString,QString>)));
     connect(replyServer_, SIGNAL(serverClosed(bool)), this, SLOT(serverHasClosed(bool)));
+    connect(&refreshTimer_, SIGNAL(timeout()), this, SLOT(onRefreshTimer()));
+    // The client ID and the store are set after construction
+    QTimer::singleShot(0, this, SLOT(onRefreshTimer()));
+}
+
+O2::~O2() {
+    // The instances waiting for this refresh see destroyed() and run their own:
+    // nothing is emitted from here, the receivers may be partly destroyed already.
+    endRefresh();
 }
 
 O2::GrantFlow O2::grantFlow() {
@@ -156,6 +177,9 @@ void O2::link() {
 
     if (linked()) {
         qDebug() << "O2::link: Linked already";
+        if (!refreshTimer_.isActive()) {
+            scheduleRefresh();
+        }
         Q_EMIT linkingSucceeded();
         return;
     }
@@ -390,6 +414,58 @@ int O2::expires() {
 void O2::setExpires(int v) {
     QString key = QString(O2_KEY_EXPIRES).arg(clientId_);
     store_->setValue(key, QString::number(v));
+    scheduleRefresh();
+}
+
+bool O2::expiresSoon() {
+    int expiresAt = expires();
+    return (expiresAt > 0) && (QDateTime::currentMSecsSinceEpoch() / 1000 + RefreshMargin >= expiresAt);
+}
+
+bool O2::isRefreshing() {
+    return refreshing_ || runningRefreshes().contains(refreshKey());
+}
+
+void O2::scheduleRefresh() {
+    refreshTimer_.stop();
+    int expiresAt = expires();
+    if (expiresAt <= 0 || refreshToken().isEmpty() || refreshTokenUrl_.isEmpty()) {
+        return;
+    }
+    qint64 delay = (qint64)(expiresAt - RefreshMargin) * 1000 - QDateTime::currentMSecsSinceEpoch();
+    // QTimer takes an int: long delays are split, onRefreshTimer() checks the expiration again
+    refreshTimer_.start((int)qBound((qint64)0, delay, (qint64)24 * 3600 * 1000));
+}
+
+void O2::onRefreshTimer() {
+    if (refreshing_ || !linked()) {
+        return;
+    }
+    if (!expiresSoon()) {
+        scheduleRefresh();
+        return;
+    }
+    qDebug() << "O2::onRefreshTimer: Token about to expire, refreshing";
+    refresh();
+}
+
+QString O2::refreshKey() {
+    return refreshTokenUrl_.toString() + " " + clientId_ + " " + refreshToken();
+}
+
+void O2::endRefresh() {
+    refreshing_ = false;
+    if (refreshLeader_) {
+        disconnect(refreshLeader_, SIGNAL(refreshFinished(QNetworkReply::NetworkError)), this, SLOT(onSharedRefreshFinished(QNetworkReply::NetworkError)));
+        disconnect(refreshLeader_, SIGNAL(destroyed()), this, SLOT(onRefreshLeaderDestroyed()));
+        refreshLeader_ = 0;
+    }
+    QMutableMapIterator<QString, O2 *> it(runningRefreshes());
+    while (it.hasNext()) {
+        if (it.next().value() == this) {
+            it.remove();
+        }
+    }
 }
 
 QString O2::refreshToken() {
@@ -401,11 +477,17 @@ void O2::setRefreshToken(const QString &v) {
     qDebug() << "O2::setRefreshToken" << v.left(4) << "...";
     QString key = QString(O2_KEY_REFRESH_TOKEN).arg(clientId_);
     store_->setValue(key, v);
+    scheduleRefresh();
 }
 
 void O2::refresh() {
     qDebug() << "O2::refresh: Token: ..." << refreshToken().right(7);
 
+    if (refreshing_) {
+        qDebug() << "O2::refresh: Refresh running already";
+        return;
+    }
+
     if (refreshToken().isEmpty()) {
         qWarning() << "O2::refresh: No refresh token";
         onRefreshError(QNetworkReply::AuthenticationRequiredError);
@@ -417,6 +499,21 @@ void O2::refresh() {
         return;
     }
 
+    refreshTimer_.stop();
+    refreshing_ = true;
+
+    QString key = refreshKey();
+    O2 *leader = runningRefreshes().value(key);
+    if (leader && leader != this) {
+        // Another instance refreshes the same account: a second refresh could invalidate its refresh token
+        qDebug() << "O2::refresh: Waiting for the refresh of another instance";
+        refreshLeader_ = leader;
+        connect(leader, SIGNAL(refreshFinished(QNetworkReply::NetworkError)), this, SLOT(onSharedRefreshFinished(QNetworkReply::NetworkError)));
+        connect(leader, SIGNAL(destroyed()), this, SLOT(onRefreshLeaderDestroyed()));
+        return;
+    }
+    runningRefreshes().insert(key, this);
+
     QNetworkRequest refreshRequest(refreshTokenUrl_);
     refreshRequest.setHeader(QNetworkRequest::ContentTypeHeader, O2_MIME_TYPE_XFORM);
     QMap<QString, QString> parameters;
@@ -438,9 +535,15 @@ void O2::onRefreshFinished() {
     if (refreshReply->error() == QNetworkReply::NoError) {
         QByteArray reply = refreshReply->readAll();
         QVariantMap tokens = parseTokenResponse(reply);
+        endRefresh();
         setToken(tokens.value(O2_OAUTH2_ACCESS_TOKEN).toString());
-        setExpires(QDateTime::currentMSecsSinceEpoch() / 1000 + tokens.value(O2_OAUTH2_EXPIRES_IN).toInt());
-        setRefreshToken(tokens.value(O2_OAUTH2_REFRESH_TOKEN).toString());
+        bool ok = false;
+        int expiresIn = tokens.value(O2_OAUTH2_EXPIRES_IN).toInt(&ok);
+        setExpires(ok ? QDateTime::currentMSecsSinceEpoch() / 1000 + expiresIn : 0);
+        // The refresh token is only sent again by some services
+        if (tokens.contains(O2_OAUTH2_REFRESH_TOKEN)) {
+            setRefreshToken(tokens.value(O2_OAUTH2_REFRESH_TOKEN).toString());
+        }
         timedReplies_.remove(refreshReply);
         setLinked(true);
         Q_EMIT linkingSucceeded();
@@ -453,11 +556,40 @@ void O2::onRefreshFinished() {
 void O2::onRefreshError(QNetworkReply::NetworkError error) {
     QNetworkReply *refreshReply = qobject_cast<QNetworkReply *>(sender());
     qWarning() << "O2::onRefreshError: " << error;
-    unlink();
+    endRefresh();
+    if (error < QNetworkReply::ContentAccessDenied || error >= QNetworkReply::InternalServerError) {
+        // Network or server failure: the tokens may still be valid, try again later
+        refreshTimer_.start(60 * 1000);
+    } else {
+        unlink();
+    }
     timedReplies_.remove(refreshReply);
     Q_EMIT refreshFinished(error);
 }
 
+void O2::onSharedRefreshFinished(QNetworkReply::NetworkError error) {
+    O2 *leader = refreshLeader_;
+    endRefresh();
+    if (error == QNetworkReply::NoError && leader) {
+        qDebug() << "O2::onSharedRefreshFinished: Using the tokens refreshed by another instance";
+        setToken(leader->token());
+        setExpires(leader->expires());
+        setRefreshToken(leader->refreshToken());
+        setLinked(true);
+        Q_EMIT linkingSucceeded();
+        Q_EMIT refreshFinished(QNetworkReply::NoError);
+    } else {
+        onRefreshError(error);
+    }
+}
+
+void O2::onRefreshLeaderDestroyed() {
+    // The leader is gone with its refresh: run our own, once the destruction is over
+    refreshLeader_ = 0;
+    endRefresh();
+    QMetaObject::invokeMethod(this, "refresh", Qt::QueuedConnection);
+}
+
 void O2::serverHasClosed(bool paramsfound)
 {
     if ( !paramsfound ) {
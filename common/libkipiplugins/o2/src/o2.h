@@ -5,6 +5,7 @@
 #include <QNetworkRequest>
 #include <QNetworkReply>
 #include <QPair>
+#include <QTimer>
 
 #include "o0export.h"
 #include "o0baseauth.h"
@@ -96,6 +97,9 @@ public:
     /// @param  parent  Parent object.
     explicit O2(QObject *parent = 0, QNetworkAccessManager *manager = 0, O0AbstractStore *store = 0);
 
+    /// Destructor.
+    ~O2();
+
     /// Get authentication code.
     QString code();
 
@@ -105,6 +109,13 @@ public:
     /// Get token expiration time (seconds from Epoch).
     int expires();
 
+    /// Is the token about to expire, or expired?
+    /// Tokens without expiration time never expire.
+    bool expiresSoon();
+
+    /// Is a token refresh running for this account, started by this instance or by another one?
+    bool isRefreshing();
+
 public Q_SLOTS:
     /// Authenticate.
     Q_INVOKABLE void link() Q_DECL_OVERRIDE;
@@ -113,6 +124,8 @@ public Q_SLOTS:
     Q_INVOKABLE void unlink() Q_DECL_OVERRIDE;
 
     /// Refresh token.
+    /// Only one refresh runs at a time for an account: if one is running already, this call
+    /// waits for it, and refreshFinished() is emitted when it is done.
     Q_INVOKABLE void refresh();
 
     /// Handle situation where reply server has opted to close its connection
@@ -148,6 +161,15 @@ protected Q_SLOTS:
     /// Handle failure of a refresh request.
     virtual void onRefreshError(QNetworkReply::NetworkError error);
 
+    /// Handle completion of a refresh started by another instance for the same account.
+    void onSharedRefreshFinished(QNetworkReply::NetworkError error);
+
+    /// Handle the destruction of the instance running the refresh this one waits for.
+    void onRefreshLeaderDestroyed();
+
+    /// Refresh the token ahead of its expiration.
+    void onRefreshTimer();
+
 protected:
     /// Build HTTP request body.
     QByteArray buildRequestBody(const QMap<QString, QString> &parameters);
@@ -161,6 +183,15 @@ protected:
     /// Set token expiration time.
     void setExpires(int v);
 
+    /// Start the timer refreshing the token before it expires.
+    void scheduleRefresh();
+
+    /// Key of the account in the list of running refreshes.
+    QString refreshKey();
+
+    /// Stop waiting for a refresh, and let other instances wait for it.
+    void endRefresh();
+
 protected:
     QString username_;
     QString password_;
@@ -176,6 +207,10 @@ protected:
     O2ReplyServer *replyServer_;
     O2ReplyList timedReplies_;
     GrantFlow grantFlow_;
+    QTimer refreshTimer_;
+    bool refreshing_;
+    /// Instance running the refresh this one waits for, if any.
+    O2 *refreshLeader_;
 };
 
 #endif // O2_H
@@ -25,11 +25,7 @@ int O2Requestor::get(const QNetworkRequest &req) {
     if (-1 == setup(req, QNetworkAccessManager::GetOperation)) {
         return -1;
     }
-    reply_ = manager_->get(request_);
-    timedReplies_.add(reply_);
-    connect(reply_, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(onRequestError(QNetworkReply::NetworkError)), Qt::QueuedConnection);
-    connect(reply_, SIGNAL(finished()), this, SLOT(onRequestFinished()), Qt::QueuedConnection);
-    return id_;
+    return start();
 }
 
 int O2Requestor::post(const QNetworkRequest &req, const QByteArray &data) {
@@ -37,12 +33,7 @@ int O2Requestor::post(const QNetworkRequest &req, const QByteArray &data) {
         return -1;
     }
     data_ = data;
-    reply_ = manager_->post(request_, data_);
-    timedReplies_.add(reply_);
-    connect(reply_, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(onRequestError(QNetworkReply::NetworkError)), Qt::QueuedConnection);
-    connect(reply_, SIGNAL(finished()), this, SLOT(onRequestFinished()), Qt::QueuedConnection);
-    connect(reply_, SIGNAL(uploadProgress(qint64,qint64)), this, SLOT(onUploadProgress(qint64,qint64)));
-    return id_;
+    return start();
 }
 
 int O2Requestor::put(const QNetworkRequest &req, const QByteArray &data) {
@@ -50,15 +41,63 @@ int O2Requestor::put(const QNetworkRequest &req, const QByteArray &data) {
         return -1;
     }
     data_ = data;
-    reply_ = manager_->put(request_, data_);
+    return start();
+}
+
+int O2Requestor::start() {
+    if (authenticator_->isRefreshing() ||
+        (authenticator_->expiresSoon() && !authenticator_->refreshToken().isEmpty())) {
+        // Wait for fresh tokens, instead of failing with 401 and sending the request again.
+        // Only one refresh runs for the account, however many requests wait for it.
+        status_ = Refreshing;
+        if (!QMetaObject::invokeMethod(authenticator_, "refresh")) {
+            qCritical() << "O2Requestor::start: Invoking remote refresh failed";
+            status_ = Requesting;
+            send();
+        }
+        return id_;
+    }
+    send();
+    return id_;
+}
+
+void O2Requestor::send() {
+    QUrl url = url_;
+#if QT_VERSION < 0x050000
+    url.addQueryItem(O2_OAUTH2_ACCESS_TOKEN, authenticator_->token());
+#else
+    QUrlQuery query(url);
+    query.addQueryItem(O2_OAUTH2_ACCESS_TOKEN, authenticator_->token());
+    url.setQuery(query);
+#endif
+    request_.setUrl(url);
+    switch (operation_) {
+    case QNetworkAccessManager::GetOperation:
+        reply_ = manager_->get(request_);
+        break;
+    case QNetworkAccessManager::PostOperation:
+        reply_ = manager_->post(request_, data_);
+        break;
+    default:
+        reply_ = manager_->put(request_, data_);
+    }
     timedReplies_.add(reply_);
     connect(reply_, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(onRequestError(QNetworkReply::NetworkError)), Qt::QueuedConnection);
     connect(reply_, SIGNAL(finished()), this, SLOT(onRequestFinished()), Qt::QueuedConnection);
     connect(reply_, SIGNAL(uploadProgress(qint64,qint64)), this, SLOT(onUploadProgress(qint64,qint64)));
-    return id_;
 }
 
 void O2Requestor::onRefreshFinished(QNetworkReply::NetworkError error) {
+    if (status_ == Refreshing) {
+        if (QNetworkReply::NoError == error) {
+            status_ = Requesting;
+            send();
+        } else {
+            error_ = error;
+            QTimer::singleShot(10, this, SLOT(finish()));
+        }
+        return;
+    }
     if (status_ != Requesting) {
         qWarning() << "O2Requestor::onRefreshFinished: No pending request";
         return;
@@ -119,7 +158,6 @@ void O2Requestor::onUploadProgress(qint64 uploaded, qint64 total) {
 
 int O2Requestor::setup(const QNetworkRequest &req, QNetworkAccessManager::Operation operation) {
     static int currentId;
-    QUrl url;
 
     if (status_ != Idle) {
         qWarning() << "O2Requestor::setup: Another request pending";
@@ -129,15 +167,8 @@ int O2Requestor::setup(const QNetworkRequest &req, QNetworkAccessManager::Operat
     request_ = req;
     operation_ = operation;
     id_ = currentId++;
-    url_ = url = req.url();
-#if QT_VERSION < 0x050000
-    url.addQueryItem(O2_OAUTH2_ACCESS_TOKEN, authenticator_->token());
-#else
-    QUrlQuery query(url);
-    query.addQueryItem(O2_OAUTH2_ACCESS_TOKEN, authenticator_->token());
-    url.setQuery(query);
-#endif
-    request_.setUrl(url);
+    url_ = req.url();
+    reply_ = NULL;
     status_ = Requesting;
     error_ = QNetworkReply::NoError;
     return id_;
@@ -149,11 +180,14 @@ void O2Requestor::finish() {
         qWarning() << "O2Requestor::finish: No pending request";
         return;
     }
-    data = reply_->readAll();
     status_ = Idle;
-    timedReplies_.remove(reply_);
-    reply_->disconnect(this);
-    reply_->deleteLater();
+    if (reply_) {
+        data = reply_->readAll();
+        timedReplies_.remove(reply_);
+        reply_->disconnect(this);
+        reply_->deleteLater();
+        reply_ = NULL;
+    }
     Q_EMIT finished(id_, error_, data);
 }
 
@@ -165,28 +199,6 @@ void O2Requestor::retry() {
     timedReplies_.remove(reply_);
     reply_->disconnect(this);
     reply_->deleteLater();
-    QUrl url = url_;
-#if QT_VERSION < 0x050000
-    url.addQueryItem(O2_OAUTH2_ACCESS_TOKEN, authenticator_->token());
-#else
-    QUrlQuery query(url);
-    query.addQueryItem(O2_OAUTH2_ACCESS_TOKEN, authenticator_->token());
-    url.setQuery(query);
-#endif
-    request_.setUrl(url);
     status_ = ReRequesting;
-    switch (operation_) {
-    case QNetworkAccessManager::GetOperation:
-        reply_ = manager_->get(request_);
-        break;
-    case QNetworkAccessManager::PostOperation:
-        reply_ = manager_->post(request_, data_);
-        break;
-    default:
-        reply_ = manager_->put(request_, data_);
-    }
-    timedReplies_.add(reply_);
-    connect(reply_, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(onRequestError(QNetworkReply::NetworkError)), Qt::QueuedConnection);
-    connect(reply_, SIGNAL(finished()), this, SLOT(onRequestFinished()), Qt::QueuedConnection);
-    connect(reply_, SIGNAL(uploadProgress(qint64,qint64)), this, SLOT(onUploadProgress(qint64,qint64)));
+    send();
 }
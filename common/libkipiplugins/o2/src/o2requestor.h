@@ -63,8 +63,14 @@ protected Q_SLOTS:
 protected:
     int setup(const QNetworkRequest &request, QNetworkAccessManager::Operation operation);
 
+    /// Send the request, or wait for a token refresh first if the token is about to expire.
+    int start();
+
+    /// Send the request with the current token.
+    void send();
+
     enum Status {
-        Idle, Requesting, ReRequesting
+        Idle, Refreshing, Requesting, ReRequesting
     };
 
     QNetworkAccessManager *manager_;
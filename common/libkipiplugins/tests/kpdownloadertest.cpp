@@ -0,0 +1,210 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-29
+ * Description : unit tests of the file downloader.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "kpdownloadertest.h"
+
+// Qt includes
+
+#include <QNetworkRequest>
+#include <QNetworkReply>
+#include <QSignalSpy>
+#include <QFile>
+#include <QDir>
+#include <QTest>
+
+// Local includes
+
+#include "kpdownloader.h"
+#include "kpmockserver.h"
+
+using namespace KIPIPlugins;
+
+QTEST_GUILESS_MAIN(KPDownloaderTest)
+
+void KPDownloaderTest::initTestCase()
+{
+    m_dir = QDir::temp().filePath(QLatin1String("kpdownloadertest"));
+    QVERIFY(QDir().mkpath(m_dir));
+
+    m_path = m_dir + QLatin1String("/photo.jpg");
+
+    for (int i = 0 ; i < 1000 ; ++i)
+    {
+        m_content.append(char(i % 251));
+    }
+}
+
+void KPDownloaderTest::init()
+{
+    QFile::remove(m_path);
+    QFile::remove(m_path + QLatin1String(".part"));
+}
+
+void KPDownloaderTest::cleanupTestCase()
+{
+    QDir(m_dir).removeRecursively();
+}
+
+QByteArray KPDownloaderTest::readFile(const QString& path) const
+{
+    QFile file(path);
+
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    return file.readAll();
+}
+
+bool KPDownloaderTest::writeFile(const QString& path, const QByteArray& data) const
+{
+    QFile file(path);
+    return (file.open(QIODevice::WriteOnly) && file.write(data) == data.size());
+}
+
+void KPDownloaderTest::testDownload()
+{
+    KPMockServer server;
+    server.addAnswer(200, m_content);
+
+    KPDownloader downloader;
+    QSignalSpy done(&downloader, SIGNAL(signalDownloadDone(QString,int,QString)));
+    QSignalSpy finished(&downloader, SIGNAL(signalFinished()));
+
+    downloader.download(QNetworkRequest(server.url(QLatin1String("/photo.jpg"))), m_path);
+    QCOMPARE(downloader.pending(), 1);
+
+    QVERIFY(finished.wait(5000));
+    QCOMPARE(done.count(), 1);
+    QCOMPARE(done.at(0).at(0).toString(), m_path);
+    QCOMPARE(done.at(0).at(1).toInt(), 0);
+    QCOMPARE(downloader.pending(), 0);
+
+    QCOMPARE(readFile(m_path), m_content);
+    QVERIFY(!QFile::exists(m_path + QLatin1String(".part")));
+    QVERIFY(KPMockServer::requestHeader(server.requests().first(), "Range").isNull());
+}
+
+void KPDownloaderTest::testResume()
+{
+    // A previous download stopped after 400 bytes.
+    QVERIFY(writeFile(m_path + QLatin1String(".part"), m_content.left(400)));
+
+    KPMockServer server;
+    server.addAnswer(206, m_content.mid(400),
+                     QList<QByteArray>() << "Content-Range: bytes 400-999/1000");
+
+    KPDownloader downloader;
+    QSignalSpy done(&downloader, SIGNAL(signalDownloadDone(QString,int,QString)));
+    QSignalSpy finished(&downloader, SIGNAL(signalFinished()));
+
+    downloader.download(QNetworkRequest(server.url(QLatin1String("/photo.jpg"))), m_path);
+
+    QVERIFY(finished.wait(5000));
+    QCOMPARE(done.at(0).at(1).toInt(), 0);
+    QCOMPARE(KPMockServer::requestHeader(server.requests().first(), "Range"), QByteArray("bytes=400-"));
+    QCOMPARE(readFile(m_path), m_content);
+}
+
+void KPDownloaderTest::testResumeAfterServerError()
+{
+    QVERIFY(writeFile(m_path + QLatin1String(".part"), m_content.left(400)));
+
+    // The error page must not be written in the partial file, nor move the resume offset.
+    KPMockServer server;
+    server.addAnswer(503, "<html>Service Unavailable</html>");
+    server.addAnswer(206, m_content.mid(400),
+                     QList<QByteArray>() << "Content-Range: bytes 400-999/1000");
+
+    KPDownloader downloader;
+    QSignalSpy done(&downloader, SIGNAL(signalDownloadDone(QString,int,QString)));
+    QSignalSpy finished(&downloader, SIGNAL(signalFinished()));
+
+    downloader.download(QNetworkRequest(server.url(QLatin1String("/photo.jpg"))), m_path);
+
+    QVERIFY(finished.wait(5000));
+    QCOMPARE(done.count(), 1);
+    QCOMPARE(done.at(0).at(1).toInt(), 0);
+    QCOMPARE(server.requests().count(), 2);
+    QCOMPARE(KPMockServer::requestHeader(server.requests().at(1), "Range"), QByteArray("bytes=400-"));
+    QCOMPARE(readFile(m_path), m_content);
+}
+
+void KPDownloaderTest::testRangeIgnored()
+{
+    QVERIFY(writeFile(m_path + QLatin1String(".part"), m_content.left(400)));
+
+    // The server sends the whole file again: the partial data must not be kept.
+    KPMockServer server;
+    server.addAnswer(200, m_content);
+
+    KPDownloader downloader;
+    QSignalSpy finished(&downloader, SIGNAL(signalFinished()));
+
+    downloader.download(QNetworkRequest(server.url(QLatin1String("/photo.jpg"))), m_path);
+
+    QVERIFY(finished.wait(5000));
+    QCOMPARE(readFile(m_path), m_content);
+}
+
+void KPDownloaderTest::testRangeNotSatisfiable()
+{
+    // The partial file is larger than the remote one, which was replaced meanwhile.
+    QVERIFY(writeFile(m_path + QLatin1String(".part"), QByteArray(2000, 'x')));
+
+    KPMockServer server;
+    server.addAnswer(416, QByteArray(), QList<QByteArray>() << "Content-Range: bytes */1000");
+    server.addAnswer(200, m_content);
+
+    KPDownloader downloader;
+    QSignalSpy done(&downloader, SIGNAL(signalDownloadDone(QString,int,QString)));
+    QSignalSpy finished(&downloader, SIGNAL(signalFinished()));
+
+    downloader.download(QNetworkRequest(server.url(QLatin1String("/photo.jpg"))), m_path);
+
+    QVERIFY(finished.wait(5000));
+    QCOMPARE(done.count(), 1);
+    QCOMPARE(done.at(0).at(1).toInt(), 0);
+
+    // The download is started again from scratch, once.
+    QCOMPARE(server.requests().count(), 2);
+    QCOMPARE(KPMockServer::requestHeader(server.requests().at(0), "Range"), QByteArray("bytes=2000-"));
+    QVERIFY(KPMockServer::requestHeader(server.requests().at(1), "Range").isNull());
+    QCOMPARE(readFile(m_path), m_content);
+}
+
+void KPDownloaderTest::testNotFound()
+{
+    KPMockServer server;
+    server.addAnswer(404, "Not found");
+
+    KPDownloader downloader;
+    QSignalSpy done(&downloader, SIGNAL(signalDownloadDone(QString,int,QString)));
+    QSignalSpy finished(&downloader, SIGNAL(signalFinished()));
+
+    downloader.download(QNetworkRequest(server.url(QLatin1String("/photo.jpg"))), m_path);
+
+    QVERIFY(finished.wait(5000));
+    QCOMPARE(done.count(), 1);
+    QCOMPARE(done.at(0).at(1).toInt(), int(QNetworkReply::ContentNotFoundError));
+    QVERIFY(!QFile::exists(m_path));
+    QVERIFY(!QFile::exists(m_path + QLatin1String(".part")));
+}
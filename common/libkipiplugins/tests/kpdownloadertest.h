@@ -0,0 +1,61 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-29
+ * Description : unit tests of the file downloader.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef KPDOWNLOADER_TEST_H
+#define KPDOWNLOADER_TEST_H
+
+// Qt includes
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+
+class KPDownloaderTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+
+    void initTestCase();
+    void init();
+    void cleanupTestCase();
+
+    void testDownload();
+    void testResume();
+    void testResumeAfterServerError();
+    void testRangeIgnored();
+    void testRangeNotSatisfiable();
+    void testNotFound();
+
+private:
+
+    QByteArray readFile(const QString& path) const;
+    bool writeFile(const QString& path, const QByteArray& data) const;
+
+private:
+
+    QString    m_dir;
+    QString    m_path;
+    QByteArray m_content;
+};
+
+#endif // KPDOWNLOADER_TEST_H
@@ -0,0 +1,178 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-29
+ * Description : unit tests of the cache of remote listings.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "kplistingcachetest.h"
+
+// Qt includes
+
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+#include <QStandardPaths>
+#include <QSignalSpy>
+#include <QFile>
+#include <QTest>
+
+// Local includes
+
+#include "kplistingcache.h"
+#include "kpmockserver.h"
+
+using namespace KIPIPlugins;
+
+QTEST_GUILESS_MAIN(KPListingCacheTest)
+
+static const QString s_service = QLatin1String("UnitTest");
+
+void KPListingCacheTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+}
+
+void KPListingCacheTest::init()
+{
+    QFile::remove(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) +
+                  QLatin1String("/kipiplugins/listings/unittest.dat"));
+}
+
+void KPListingCacheTest::cleanupTestCase()
+{
+    init();
+}
+
+QNetworkReply* KPListingCacheTest::get(QNetworkAccessManager& manager, const QNetworkRequest& request)
+{
+    QNetworkReply* const reply = manager.get(request);
+    QSignalSpy finished(reply, SIGNAL(finished()));
+
+    if (!reply->isFinished())
+        finished.wait(5000);
+
+    return reply;
+}
+
+void KPListingCacheTest::testStore()
+{
+    KPListingCache cache(s_service);
+
+    QVERIFY(cache.data(QLatin1String("user"), QLatin1String("albums")).isEmpty());
+
+    // Only a listing which changed is reported.
+    QVERIFY(cache.store(QLatin1String("user"), QLatin1String("albums"), "[1,2]"));
+    QVERIFY(!cache.store(QLatin1String("user"), QLatin1String("albums"), "[1,2]"));
+    QVERIFY(cache.store(QLatin1String("user"), QLatin1String("albums"), "[1,2,3]"));
+
+    QCOMPARE(cache.data(QLatin1String("user"), QLatin1String("albums")), QByteArray("[1,2,3]"));
+    QVERIFY(cache.data(QLatin1String("user"), QLatin1String("categories")).isEmpty());
+    QVERIFY(cache.data(QLatin1String("other"), QLatin1String("albums")).isEmpty());
+}
+
+void KPListingCacheTest::testUpdate()
+{
+    KPListingCache cache(s_service);
+
+    // Nothing shown from the cache: the listing is always reported.
+    QVERIFY(cache.update(QLatin1String("user"), QLatin1String("albums"), "[1,2]", false));
+    QVERIFY(cache.update(QLatin1String("user"), QLatin1String("albums"), "[1,2]", false));
+
+    // The cached listing is shown: it is only reported if it changed, and is stored anyway.
+    QVERIFY(!cache.update(QLatin1String("user"), QLatin1String("albums"), "[1,2]", true));
+    QVERIFY(cache.update(QLatin1String("user"), QLatin1String("albums"), "[1,2,3]", true));
+    QCOMPARE(cache.data(QLatin1String("user"), QLatin1String("albums")), QByteArray("[1,2,3]"));
+}
+
+void KPListingCacheTest::testValidators()
+{
+    KPMockServer server;
+    server.addAnswer(200, "[1,2]", QList<QByteArray>() << "ETag: \"v1\""
+                                                       << "Last-Modified: Thu, 29 Mar 2018 10:00:00 GMT");
+    server.addAnswer(304, QByteArray());
+
+    QNetworkAccessManager manager;
+    KPListingCache cache(s_service);
+
+    // Nothing is cached: the request is not conditional.
+    QNetworkRequest request(server.url(QLatin1String("/albums")));
+    cache.prepareRequest(request, QLatin1String("user"), QLatin1String("albums"));
+    QVERIFY(!request.hasRawHeader("If-None-Match"));
+
+    QNetworkReply* reply = get(manager, request);
+    QVERIFY(!KPListingCache::isNotModified(reply));
+    QVERIFY(cache.store(QLatin1String("user"), QLatin1String("albums"), reply->readAll(), reply));
+    reply->deleteLater();
+
+    // The validators of the last answer are sent back.
+    request = QNetworkRequest(server.url(QLatin1String("/albums")));
+    cache.prepareRequest(request, QLatin1String("user"), QLatin1String("albums"));
+    QCOMPARE(request.rawHeader("If-None-Match"),     QByteArray("\"v1\""));
+    QCOMPARE(request.rawHeader("If-Modified-Since"), QByteArray("Thu, 29 Mar 2018 10:00:00 GMT"));
+
+    reply = get(manager, request);
+    QVERIFY(KPListingCache::isNotModified(reply));
+    reply->deleteLater();
+
+    QCOMPARE(KPMockServer::requestHeader(server.requests().at(1), "If-None-Match"), QByteArray("\"v1\""));
+
+    // The validators are per listing.
+    request = QNetworkRequest(server.url(QLatin1String("/categories")));
+    cache.prepareRequest(request, QLatin1String("user"), QLatin1String("categories"));
+    QVERIFY(!request.hasRawHeader("If-None-Match"));
+    QVERIFY(!request.hasRawHeader("If-Modified-Since"));
+}
+
+void KPListingCacheTest::testPersistence()
+{
+    KPMockServer server;
+    server.addAnswer(200, "[1,2]", QList<QByteArray>() << "ETag: \"v2\"");
+
+    QNetworkAccessManager manager;
+
+    {
+        KPListingCache cache(s_service);
+        QNetworkReply* const reply = get(manager, QNetworkRequest(server.url(QLatin1String("/albums"))));
+        cache.store(QLatin1String("user"), QLatin1String("albums"), reply->readAll(), reply);
+        reply->deleteLater();
+        QVERIFY(cache.save());
+    }
+
+    KPListingCache cache(s_service);
+    QCOMPARE(cache.data(QLatin1String("user"), QLatin1String("albums")), QByteArray("[1,2]"));
+
+    QNetworkRequest request(server.url(QLatin1String("/albums")));
+    cache.prepareRequest(request, QLatin1String("user"), QLatin1String("albums"));
+    QCOMPARE(request.rawHeader("If-None-Match"), QByteArray("\"v2\""));
+    QVERIFY(!request.hasRawHeader("If-Modified-Since"));
+}
+
+void KPListingCacheTest::testClear()
+{
+    KPListingCache cache(s_service);
+    cache.store(QLatin1String("user"),  QLatin1String("albums"),     "[1]");
+    cache.store(QLatin1String("user"),  QLatin1String("categories"), "[2]");
+    cache.store(QLatin1String("user2"), QLatin1String("albums"),     "[3]");
+
+    cache.clear(QLatin1String("user"));
+
+    QVERIFY(cache.data(QLatin1String("user"),  QLatin1String("albums")).isEmpty());
+    QVERIFY(cache.data(QLatin1String("user"),  QLatin1String("categories")).isEmpty());
+    QCOMPARE(cache.data(QLatin1String("user2"), QLatin1String("albums")), QByteArray("[3]"));
+}
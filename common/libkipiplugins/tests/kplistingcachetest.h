@@ -0,0 +1,55 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-29
+ * Description : unit tests of the cache of remote listings.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef KPLISTINGCACHE_TEST_H
+#define KPLISTINGCACHE_TEST_H
+
+// Qt includes
+
+#include <QObject>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+class QNetworkRequest;
+
+class KPListingCacheTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+
+    void initTestCase();
+    void init();
+    void cleanupTestCase();
+
+    void testStore();
+    void testUpdate();
+    void testValidators();
+    void testPersistence();
+    void testClear();
+
+private:
+
+    QNetworkReply* get(QNetworkAccessManager& manager, const QNetworkRequest& request);
+};
+
+#endif // KPLISTINGCACHE_TEST_H
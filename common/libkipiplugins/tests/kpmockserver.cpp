@@ -0,0 +1,198 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-29
+ * Description : a local HTTP server answering scripted responses,
+ *               used by the unit tests of the web service tools.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "kpmockserver.h"
+
+// Qt includes
+
+#include <QTcpSocket>
+#include <QTimer>
+
+namespace KIPIPlugins
+{
+
+KPMockServer::KPMockServer(QObject* const parent)
+    : QTcpServer(parent)
+{
+    connect(this, SIGNAL(newConnection()),
+            this, SLOT(slotNewConnection()));
+
+    listen(QHostAddress::LocalHost);
+}
+
+KPMockServer::~KPMockServer()
+{
+}
+
+void KPMockServer::addAnswer(int status, const QByteArray& body, const QList<QByteArray>& headers,
+                             const QString& path, int delay)
+{
+    Answer answer;
+    answer.path  = path;
+    answer.delay = delay;
+
+    answer.data  = "HTTP/1.1 " + QByteArray::number(status) + " Mock\r\n";
+
+    foreach (const QByteArray& header, headers)
+    {
+        answer.data.append(header + "\r\n");
+    }
+
+    answer.data.append("Content-Length: " + QByteArray::number(body.size()) + "\r\n");
+    answer.data.append("Connection: close\r\n\r\n");
+    answer.data.append(body);
+
+    m_answers.append(answer);
+}
+
+QUrl KPMockServer::url(const QString& path) const
+{
+    return QUrl(QString::fromLatin1("http://127.0.0.1:%1%2").arg(serverPort()).arg(path));
+}
+
+QList<QByteArray> KPMockServer::requests() const
+{
+    return m_requests;
+}
+
+QString KPMockServer::requestPath(const QByteArray& request)
+{
+    // GET /path?query HTTP/1.1
+    return QString::fromLatin1(request.left(request.indexOf("\r\n")).split(' ').value(1));
+}
+
+QByteArray KPMockServer::requestHeader(const QByteArray& request, const QByteArray& name)
+{
+    const QByteArray head = request.left(request.indexOf("\r\n\r\n"));
+    const QByteArray key  = name.toLower() + ':';
+
+    foreach (const QByteArray& line, head.split('\n'))
+    {
+        if (line.toLower().startsWith(key))
+            return line.mid(key.size()).trimmed();
+    }
+
+    return QByteArray();
+}
+
+QByteArray KPMockServer::requestBody(const QByteArray& request)
+{
+    return request.mid(request.indexOf("\r\n\r\n") + 4);
+}
+
+void KPMockServer::slotNewConnection()
+{
+    while (hasPendingConnections())
+    {
+        QTcpSocket* const socket = nextPendingConnection();
+
+        connect(socket, SIGNAL(readyRead()),
+                this, SLOT(slotReadyRead()));
+
+        connect(socket, SIGNAL(disconnected()),
+                socket, SLOT(deleteLater()));
+    }
+}
+
+void KPMockServer::slotReadyRead()
+{
+    QTcpSocket* const socket = static_cast<QTcpSocket*>(sender());
+    QByteArray& buffer       = m_buffers[socket];
+    buffer.append(socket->readAll());
+
+    const int headEnd = buffer.indexOf("\r\n\r\n");
+
+    if (headEnd < 0)
+        return;
+
+    const qint64 length = requestHeader(buffer, "Content-Length").toLongLong();
+
+    if (buffer.size() < headEnd + 4 + length)
+        return;
+
+    const QByteArray request = buffer.left(headEnd + 4 + length);
+    m_buffers.remove(socket);
+    m_requests.append(request);
+
+    // The answers of this path first, then the ones without path.
+
+    const QString path = requestPath(request);
+    int found          = -1;
+
+    for (int i = 0 ; i < m_answers.count() && found < 0 ; ++i)
+    {
+        if (m_answers.at(i).path == path)
+            found = i;
+    }
+
+    for (int i = 0 ; i < m_answers.count() && found < 0 ; ++i)
+    {
+        if (m_answers.at(i).path.isEmpty())
+            found = i;
+    }
+
+    if (found < 0)
+    {
+        send(socket, "HTTP/1.1 404 Mock\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return;
+    }
+
+    const Answer answer = m_answers.takeAt(found);
+
+    if (answer.delay <= 0)
+    {
+        send(socket, answer.data);
+        return;
+    }
+
+    QTimer* const timer = new QTimer(this);
+    timer->setSingleShot(true);
+
+    connect(timer, SIGNAL(timeout()),
+            this, SLOT(slotSendDelayed()));
+
+    m_delayed.insert(timer, socket);
+    m_delayedData.insert(timer, answer.data);
+    timer->start(answer.delay);
+}
+
+void KPMockServer::slotSendDelayed()
+{
+    QTimer* const timer = static_cast<QTimer*>(sender());
+    timer->deleteLater();
+
+    QPointer<QTcpSocket> socket = m_delayed.take(timer);
+    const QByteArray data    = m_delayedData.take(timer);
+
+    // The client may have given up meanwhile.
+    if (socket && socket->state() == QAbstractSocket::ConnectedState)
+        send(socket, data);
+}
+
+void KPMockServer::send(QTcpSocket* const socket, const QByteArray& answer)
+{
+    socket->write(answer);
+    socket->disconnectFromHost();
+}
+
+} // namespace KIPIPlugins
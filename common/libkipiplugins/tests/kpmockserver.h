@@ -0,0 +1,112 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-29
+ * Description : a local HTTP server answering scripted responses,
+ *               used by the unit tests of the web service tools.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef KPMOCKSERVER_H
+#define KPMOCKSERVER_H
+
+// Qt includes
+
+#include <QTcpServer>
+#include <QByteArray>
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QPointer>
+#include <QUrl>
+
+class QTcpSocket;
+class QTimer;
+
+namespace KIPIPlugins
+{
+
+/** A HTTP server listening on the local host. Each request is answered with the first
+ *  answer added for its path, or else with the first answer added without path. The
+ *  connection is closed after each answer.
+ */
+class KPMockServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+
+    explicit KPMockServer(QObject* const parent = 0);
+    ~KPMockServer();
+
+    /** Answer a request with 'status' and 'body', after 'delay' ms. 'headers' are raw header
+     *  lines, without the line end. If 'path' is not empty, the answer is only used for the
+     *  requests of 'path', with the query.
+     */
+    void addAnswer(int status, const QByteArray& body,
+                   const QList<QByteArray>& headers = QList<QByteArray>(),
+                   const QString& path = QString(), int delay = 0);
+
+    /** Return the URL of 'path' on the server.
+     */
+    QUrl url(const QString& path = QLatin1String("/")) const;
+
+    /** Return the requests received so far, with their header and body.
+     */
+    QList<QByteArray> requests() const;
+
+    /** Return the path with the query of 'request'.
+     */
+    static QString requestPath(const QByteArray& request);
+
+    /** Return the value of the header 'name' of 'request', or a null array.
+     */
+    static QByteArray requestHeader(const QByteArray& request, const QByteArray& name);
+
+    /** Return the body of 'request'.
+     */
+    static QByteArray requestBody(const QByteArray& request);
+
+private Q_SLOTS:
+
+    void slotNewConnection();
+    void slotReadyRead();
+    void slotSendDelayed();
+
+private:
+
+    void send(QTcpSocket* const socket, const QByteArray& answer);
+
+private:
+
+    struct Answer
+    {
+        QString    path;
+        QByteArray data;
+        int        delay;
+    };
+
+    QList<Answer>                         m_answers;
+    QList<QByteArray>                     m_requests;
+    QHash<QTcpSocket*, QByteArray>        m_buffers;
+    QHash<QTimer*, QPointer<QTcpSocket> > m_delayed;
+    QHash<QTimer*, QByteArray>            m_delayedData;
+};
+
+} // namespace KIPIPlugins
+
+#endif // KPMOCKSERVER_H
@@ -0,0 +1,232 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-29
+ * Description : unit tests of the fetcher of listing pages.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "kppagefetchertest.h"
+
+// Qt includes
+
+#include <QNetworkRequest>
+#include <QSignalSpy>
+#include <QTest>
+
+// Local includes
+
+#include "kppagefetcher.h"
+#include "kpmockserver.h"
+
+using namespace KIPIPlugins;
+
+QTEST_GUILESS_MAIN(KPPageFetcherTest)
+
+static QNetworkRequest pageRequest(KPMockServer* const server, int index)
+{
+    return QNetworkRequest(server->url(QString::fromLatin1("/list?page=%1").arg(index)));
+}
+
+void KPPageFetcherTest::slotPage(int index, const QByteArray& data)
+{
+    m_indexes << index;
+    m_data    << data;
+
+    if (m_cancelInPage)
+    {
+        m_fetcher->cancel();
+        return;
+    }
+
+    // With offsets, all pages are known from the first one.
+    if (index == 0)
+    {
+        for (int i = 1 ; i < m_pages ; ++i)
+        {
+            m_fetcher->fetch(i, pageRequest(m_server, i));
+        }
+    }
+}
+
+void KPPageFetcherTest::testParallelPages()
+{
+    KPMockServer server;
+    KPPageFetcher fetcher;
+    m_server       = &server;
+    m_fetcher      = &fetcher;
+    m_pages        = 4;
+    m_cancelInPage = false;
+    m_indexes.clear();
+    m_data.clear();
+
+    // The second page is the slowest: it comes last.
+    server.addAnswer(200, "page 0", QList<QByteArray>(), QLatin1String("/list?page=0"));
+    server.addAnswer(200, "page 1", QList<QByteArray>(), QLatin1String("/list?page=1"), 300);
+    server.addAnswer(200, "page 2", QList<QByteArray>(), QLatin1String("/list?page=2"));
+    server.addAnswer(200, "page 3", QList<QByteArray>(), QLatin1String("/list?page=3"));
+
+    connect(&fetcher, SIGNAL(signalPage(int,QByteArray)),
+            this, SLOT(slotPage(int,QByteArray)));
+
+    QSignalSpy done(&fetcher, SIGNAL(signalDone()));
+    QSignalSpy failed(&fetcher, SIGNAL(signalFailed(QString)));
+
+    fetcher.start(pageRequest(&server, 0));
+
+    QVERIFY(done.wait(5000));
+    QCOMPARE(done.count(), 1);
+    QCOMPARE(failed.count(), 0);
+    QVERIFY(!fetcher.isRunning());
+
+    // Each page comes with its index, whatever the order.
+    QCOMPARE(m_indexes.count(), 4);
+    QCOMPARE(m_indexes.first(), 0);
+    QCOMPARE(m_indexes.last(), 1);
+
+    for (int i = 0 ; i < m_indexes.count() ; ++i)
+    {
+        QCOMPARE(m_data.at(i), QByteArray("page ") + QByteArray::number(m_indexes.at(i)));
+    }
+}
+
+void KPPageFetcherTest::testSequentialPages()
+{
+    KPMockServer server;
+    KPPageFetcher fetcher;
+    m_server       = &server;
+    m_fetcher      = &fetcher;
+    m_pages        = 4;
+    m_cancelInPage = false;
+    m_indexes.clear();
+    m_data.clear();
+
+    for (int i = 0 ; i < m_pages ; ++i)
+    {
+        server.addAnswer(200, "page " + QByteArray::number(i));
+    }
+
+    fetcher.setMaxParallel(1);
+
+    connect(&fetcher, SIGNAL(signalPage(int,QByteArray)),
+            this, SLOT(slotPage(int,QByteArray)));
+
+    QSignalSpy done(&fetcher, SIGNAL(signalDone()));
+
+    fetcher.start(pageRequest(&server, 0));
+
+    QVERIFY(done.wait(5000));
+
+    // One request at a time, in the order of the queue.
+    QCOMPARE(m_indexes, QList<int>() << 0 << 1 << 2 << 3);
+    QCOMPARE(server.requests().count(), 4);
+
+    for (int i = 0 ; i < m_pages ; ++i)
+    {
+        QCOMPARE(KPMockServer::requestPath(server.requests().at(i)), QString::fromLatin1("/list?page=%1").arg(i));
+    }
+}
+
+void KPPageFetcherTest::testCancel()
+{
+    KPMockServer server;
+    KPPageFetcher fetcher;
+    m_server       = &server;
+    m_fetcher      = &fetcher;
+    m_pages        = 1;
+    m_cancelInPage = false;
+    m_indexes.clear();
+    m_data.clear();
+
+    server.addAnswer(200, "page 0", QList<QByteArray>(), QString(), 200);
+
+    connect(&fetcher, SIGNAL(signalPage(int,QByteArray)),
+            this, SLOT(slotPage(int,QByteArray)));
+
+    QSignalSpy done(&fetcher, SIGNAL(signalDone()));
+    QSignalSpy failed(&fetcher, SIGNAL(signalFailed(QString)));
+
+    fetcher.start(pageRequest(&server, 0));
+    QVERIFY(fetcher.isRunning());
+
+    fetcher.cancel();
+    QVERIFY(!fetcher.isRunning());
+
+    // Nothing is reported for a cancelled listing, not even the abort.
+    QTest::qWait(500);
+    QVERIFY(m_indexes.isEmpty());
+    QCOMPARE(done.count(), 0);
+    QCOMPARE(failed.count(), 0);
+}
+
+void KPPageFetcherTest::testCancelFromPage()
+{
+    KPMockServer server;
+    KPPageFetcher fetcher;
+    m_server       = &server;
+    m_fetcher      = &fetcher;
+    m_pages        = 3;
+    m_cancelInPage = true;
+    m_indexes.clear();
+    m_data.clear();
+
+    server.addAnswer(200, "page 0");
+
+    connect(&fetcher, SIGNAL(signalPage(int,QByteArray)),
+            this, SLOT(slotPage(int,QByteArray)));
+
+    QSignalSpy done(&fetcher, SIGNAL(signalDone()));
+
+    fetcher.start(pageRequest(&server, 0));
+
+    QTRY_COMPARE(m_indexes.count(), 1);
+    QTest::qWait(200);
+    QCOMPARE(done.count(), 0);
+    QVERIFY(!fetcher.isRunning());
+}
+
+void KPPageFetcherTest::testFailure()
+{
+    KPMockServer server;
+    KPPageFetcher fetcher;
+    m_server       = &server;
+    m_fetcher      = &fetcher;
+    m_pages        = 3;
+    m_cancelInPage = false;
+    m_indexes.clear();
+    m_data.clear();
+
+    server.addAnswer(200, "page 0", QList<QByteArray>(), QLatin1String("/list?page=0"));
+    server.addAnswer(500, "",       QList<QByteArray>(), QLatin1String("/list?page=1"));
+    server.addAnswer(200, "page 2", QList<QByteArray>(), QLatin1String("/list?page=2"), 300);
+
+    connect(&fetcher, SIGNAL(signalPage(int,QByteArray)),
+            this, SLOT(slotPage(int,QByteArray)));
+
+    QSignalSpy done(&fetcher, SIGNAL(signalDone()));
+    QSignalSpy failed(&fetcher, SIGNAL(signalFailed(QString)));
+
+    fetcher.start(pageRequest(&server, 0));
+
+    // A failing page aborts the other ones.
+    QVERIFY(failed.wait(5000));
+    QTest::qWait(500);
+    QCOMPARE(failed.count(), 1);
+    QCOMPARE(done.count(), 0);
+    QCOMPARE(m_indexes, QList<int>() << 0);
+    QVERIFY(!fetcher.isRunning());
+}
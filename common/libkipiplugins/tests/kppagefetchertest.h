@@ -0,0 +1,63 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-29
+ * Description : unit tests of the fetcher of listing pages.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef KPPAGEFETCHER_TEST_H
+#define KPPAGEFETCHER_TEST_H
+
+// Qt includes
+
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+
+namespace KIPIPlugins
+{
+    class KPPageFetcher;
+    class KPMockServer;
+}
+
+class KPPageFetcherTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+
+    void testParallelPages();
+    void testSequentialPages();
+    void testCancel();
+    void testCancelFromPage();
+    void testFailure();
+
+    /// Receiver of the pages, queues the next ones like a talker.
+    void slotPage(int index, const QByteArray& data);
+
+private:
+
+    KIPIPlugins::KPPageFetcher* m_fetcher;
+    KIPIPlugins::KPMockServer*  m_server;
+    int                         m_pages;
+    bool                        m_cancelInPage;
+    QList<int>                  m_indexes;
+    QList<QByteArray>           m_data;
+};
+
+#endif // KPPAGEFETCHER_TEST_H
@@ -0,0 +1,193 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-29
+ * Description : unit tests of the upload history.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "kpuploadhistorytest.h"
+
+// Qt includes
+
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QSignalSpy>
+#include <QDateTime>
+#include <QFile>
+#include <QDir>
+#include <QTest>
+
+// Local includes
+
+#include "kpuploadhistory.h"
+
+using namespace KIPIPlugins;
+
+QTEST_GUILESS_MAIN(KPUploadHistoryTest)
+
+static const QString s_service = QLatin1String("UnitTest");
+
+void KPUploadHistoryTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+
+    m_dir = QDir::temp().filePath(QLatin1String("kpuploadhistorytest"));
+    QVERIFY(QDir().mkpath(m_dir));
+}
+
+void KPUploadHistoryTest::init()
+{
+    QFile::remove(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) +
+                  QLatin1String("/kipiplugins/uploadhistory/unittest.dat"));
+}
+
+void KPUploadHistoryTest::cleanupTestCase()
+{
+    QDir(m_dir).removeRecursively();
+    init();
+}
+
+QString KPUploadHistoryTest::writeFile(const QString& name, const QByteArray& data)
+{
+    const QString path = m_dir + QLatin1Char('/') + name;
+    QFile file(path);
+
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size())
+        return QString();
+
+    return path;
+}
+
+void KPUploadHistoryTest::testRoundTrip()
+{
+    const QString path = writeFile(QLatin1String("a.jpg"), "content of a");
+    QVERIFY(!path.isEmpty());
+
+    {
+        KPUploadHistory history(s_service);
+        QVERIFY(!history.isUploaded(path, QLatin1String("user"), QLatin1String("album")));
+
+        history.addUpload(path, QLatin1String("user"), QLatin1String("album"), QLatin1String("id1"));
+        QVERIFY(history.save());
+    }
+
+    KPUploadHistory history(s_service);
+
+    QVERIFY(history.isUploaded(path, QLatin1String("user"), QLatin1String("album")));
+    QCOMPARE(history.remoteId(path, QLatin1String("user"), QLatin1String("album")), QLatin1String("id1"));
+
+    // Other targets do not hold the file.
+    QVERIFY(!history.isUploaded(path, QLatin1String("user"), QLatin1String("other")));
+    QVERIFY(!history.isUploaded(path, QLatin1String("other"), QLatin1String("album")));
+
+    // The same content under another name is the same upload.
+    const QString copy = writeFile(QLatin1String("copy of a.jpg"), "content of a");
+    QVERIFY(history.isUploaded(copy, QLatin1String("user"), QLatin1String("album")));
+}
+
+void KPUploadHistoryTest::testChangedFile()
+{
+    const QString path = writeFile(QLatin1String("b.jpg"), "content of b");
+
+    KPUploadHistory history(s_service);
+    history.addUpload(path, QLatin1String("user"), QString(), QString());
+    QVERIFY(history.isUploaded(path, QLatin1String("user")));
+
+    // An edited file is sent again: its cached sum is not used anymore.
+    QVERIFY(!writeFile(QLatin1String("b.jpg"), "edited content of b").isEmpty());
+    QVERIFY(!history.isUploaded(path, QLatin1String("user")));
+}
+
+void KPUploadHistoryTest::testHashFiles()
+{
+    const QByteArray data = "content of c";
+    const QString path    = writeFile(QLatin1String("c.jpg"), data);
+    const QString missing = m_dir + QLatin1String("/missing.jpg");
+
+    KPUploadHistory history(s_service);
+    QSignalSpy spy(&history, SIGNAL(filesHashed(QStringList)));
+
+    const QStringList paths = QStringList() << path << missing;
+    history.hashFiles(paths);
+
+    QVERIFY(spy.wait());
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.at(0).at(0).toStringList(), paths);
+
+    QCOMPARE(history.contentHash(path), QCryptographicHash::hash(data, QCryptographicHash::Md5));
+    QVERIFY(history.contentHash(missing).isEmpty());
+
+    // Cached sums are not computed again, the signal still comes.
+    history.hashFiles(QStringList() << path);
+    QVERIFY(spy.wait());
+    QCOMPARE(spy.count(), 2);
+}
+
+void KPUploadHistoryTest::testReconcileTarget()
+{
+    const QString path1 = writeFile(QLatin1String("d1.jpg"), "content of d1");
+    const QString path2 = writeFile(QLatin1String("d2.jpg"), "content of d2");
+
+    KPUploadHistory history(s_service);
+    history.addUpload(path1, QLatin1String("user"), QLatin1String("album"), QLatin1String("id1"));
+    history.addUpload(path2, QLatin1String("user"), QLatin1String("album"), QLatin1String("id2"));
+    history.addUpload(path2, QLatin1String("user"), QLatin1String("other"), QLatin1String("id2"));
+
+    // id2 was deleted on the service.
+    history.reconcileTarget(QLatin1String("user"), QLatin1String("album"),
+                            QSet<QString>() << QLatin1String("id1"));
+
+    QVERIFY(history.isUploaded(path1, QLatin1String("user"), QLatin1String("album")));
+    QVERIFY(!history.isUploaded(path2, QLatin1String("user"), QLatin1String("album")));
+    QVERIFY(history.isUploaded(path2, QLatin1String("user"), QLatin1String("other")));
+}
+
+void KPUploadHistoryTest::testRebuildTarget()
+{
+    const QByteArray data = "content of e";
+    const QString path1   = writeFile(QLatin1String("e1.jpg"), data);
+    const QString path2   = writeFile(QLatin1String("e2.jpg"), "content of e2");
+
+    KPUploadHistory history(s_service);
+    history.addUpload(path2, QLatin1String("user"), QLatin1String("album"), QLatin1String("id2"));
+
+    QMap<QByteArray, QString> remoteItems;
+    remoteItems.insert(QCryptographicHash::hash(data, QCryptographicHash::Md5), QLatin1String("r1"));
+    history.rebuildTarget(QLatin1String("user"), QLatin1String("album"), remoteItems);
+
+    QCOMPARE(history.remoteId(path1, QLatin1String("user"), QLatin1String("album")), QLatin1String("r1"));
+    QVERIFY(!history.isUploaded(path2, QLatin1String("user"), QLatin1String("album")));
+}
+
+void KPUploadHistoryTest::testClearTarget()
+{
+    const QString path = writeFile(QLatin1String("f.jpg"), "content of f");
+
+    KPUploadHistory history(s_service);
+    history.addUpload(path, QLatin1String("user"),  QLatin1String("album1"), QLatin1String("id1"));
+    history.addUpload(path, QLatin1String("user"),  QLatin1String("album2"), QLatin1String("id2"));
+    history.addUpload(path, QLatin1String("user2"), QLatin1String("album1"), QLatin1String("id3"));
+
+    history.clearTarget(QLatin1String("user"), QLatin1String("album1"));
+    QVERIFY(!history.isUploaded(path, QLatin1String("user"),  QLatin1String("album1")));
+    QVERIFY(history.isUploaded(path,  QLatin1String("user"),  QLatin1String("album2")));
+
+    history.clearTarget(QLatin1String("user"));
+    QVERIFY(!history.isUploaded(path, QLatin1String("user"),  QLatin1String("album2")));
+    QVERIFY(history.isUploaded(path,  QLatin1String("user2"), QLatin1String("album1")));
+}
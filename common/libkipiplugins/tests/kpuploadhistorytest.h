@@ -0,0 +1,57 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-29
+ * Description : unit tests of the upload history.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef KPUPLOADHISTORY_TEST_H
+#define KPUPLOADHISTORY_TEST_H
+
+// Qt includes
+
+#include <QObject>
+#include <QString>
+
+class KPUploadHistoryTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+
+    void initTestCase();
+    void init();
+    void cleanupTestCase();
+
+    void testRoundTrip();
+    void testChangedFile();
+    void testHashFiles();
+    void testReconcileTarget();
+    void testRebuildTarget();
+    void testClearTarget();
+
+private:
+
+    QString writeFile(const QString& name, const QByteArray& data);
+
+private:
+
+    QString m_dir;
+};
+
+#endif // KPUPLOADHISTORY_TEST_H
@@ -0,0 +1,321 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-16
+ * Description : parallel downloads streamed to disk, with
+ *               resume of partial files.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "kpdownloader.h"
+
+// Qt includes
+
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QFile>
+#include <QHash>
+#include <QList>
+
+// KDE includes
+
+#include <klocalizedstring.h>
+
+// Local includes
+
+#include "kipiplugins_debug.h"
+
+namespace KIPIPlugins
+{
+
+/// Data kept in memory for each running download, before being written to disk.
+static const qint64 s_readBufferSize = 1024 * 1024;
+
+/// Number of times a download is resumed after a network error.
+static const int    s_maxResumes     = 3;
+
+class Q_DECL_HIDDEN KPDownloader::Private
+{
+public:
+
+    struct Job
+    {
+        Job()
+        {
+            resumes   = 0;
+            restarted = false;
+            checked   = false;
+        }
+
+        QNetworkRequest request;
+        QString         path;
+        QFile           file;
+        QString         writeError;
+        int             resumes;
+        bool            restarted;
+        /// True once the status of the reply, 200 or 206, tells its body is part of the file.
+        bool            checked;
+    };
+
+public:
+
+    Private()
+    {
+        netMngr     = 0;
+        maxParallel = 4;
+    }
+
+    static QString partPath(const QString& path)
+    {
+        return path + QLatin1String(".part");
+    }
+
+public:
+
+    QNetworkAccessManager*      netMngr;
+    int                         maxParallel;
+
+    QList<Job*>                 queue;
+    QHash<QNetworkReply*, Job*> running;
+};
+
+KPDownloader::KPDownloader(QObject* const parent)
+    : QObject(parent),
+      d(new Private)
+{
+    d->netMngr = new QNetworkAccessManager(this);
+}
+
+KPDownloader::~KPDownloader()
+{
+    cancel();
+    delete d;
+}
+
+void KPDownloader::setMaxParallel(int count)
+{
+    d->maxParallel = qMax(1, count);
+}
+
+void KPDownloader::download(const QNetworkRequest& request, const QString& path)
+{
+    Private::Job* const job = new Private::Job;
+    job->request            = request;
+    job->path               = path;
+
+    d->queue.append(job);
+    startNext();
+}
+
+void KPDownloader::cancel()
+{
+    qDeleteAll(d->queue);
+    d->queue.clear();
+
+    QHash<QNetworkReply*, Private::Job*> running = d->running;
+    d->running.clear();
+
+    for (QHash<QNetworkReply*, Private::Job*>::const_iterator it = running.constBegin() ;
+         it != running.constEnd() ; ++it)
+    {
+        disconnect(it.key(), 0, this, 0);
+        it.key()->abort();
+        it.key()->deleteLater();
+
+        // The partial file is kept, to be resumed by the next import.
+        delete it.value();
+    }
+}
+
+int KPDownloader::pending() const
+{
+    return d->queue.count() + d->running.count();
+}
+
+void KPDownloader::startNext()
+{
+    while (d->running.count() < d->maxParallel && !d->queue.isEmpty())
+    {
+        Private::Job* const job = d->queue.takeFirst();
+        job->file.setFileName(Private::partPath(job->path));
+
+        if (!job->file.open(QIODevice::ReadWrite))
+        {
+            emit signalDownloadDone(job->path, -1, job->file.errorString());
+            delete job;
+            continue;
+        }
+
+        const qint64 offset = job->file.size();
+        job->file.seek(offset);
+        job->checked        = false;
+
+        QNetworkRequest request = job->request;
+        request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+
+        if (offset > 0)
+        {
+            qCDebug(KIPIPLUGINS_LOG) << "Resuming download of" << job->path << "at" << offset;
+            request.setRawHeader("Range", "bytes=" + QByteArray::number(offset) + '-');
+        }
+
+        QNetworkReply* const reply = d->netMngr->get(request);
+
+        // Do not let Qt buffer more than this when the disk is slower than the network.
+        reply->setReadBufferSize(s_readBufferSize);
+
+        connect(reply, SIGNAL(metaDataChanged()),
+                this, SLOT(slotMetaDataChanged()));
+
+        connect(reply, SIGNAL(readyRead()),
+                this, SLOT(slotReadyRead()));
+
+        connect(reply, SIGNAL(finished()),
+                this, SLOT(slotFinished()));
+
+        d->running.insert(reply, job);
+    }
+}
+
+void KPDownloader::slotMetaDataChanged()
+{
+    QNetworkReply* const reply = qobject_cast<QNetworkReply*>(sender());
+    Private::Job* const job    = d->running.value(reply);
+
+    if (!job || job->checked)
+        return;
+
+    int code = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    if (code == 206)
+    {
+        job->checked = true;
+    }
+    else if (code == 200)
+    {
+        // The server ignored the Range header and sends the whole file.
+        if (job->file.pos() > 0)
+        {
+            job->file.resize(0);
+            job->file.seek(0);
+        }
+
+        job->checked = true;
+    }
+}
+
+void KPDownloader::slotReadyRead()
+{
+    QNetworkReply* const reply = qobject_cast<QNetworkReply*>(sender());
+    Private::Job* const job    = d->running.value(reply);
+
+    if (!job || !job->writeError.isEmpty())
+        return;
+
+    const QByteArray data = reply->readAll();
+
+    // The body of a redirection or of an error page is not part of the file.
+    if (!job->checked)
+        return;
+
+    if (job->file.write(data) != data.size())
+    {
+        job->writeError = job->file.errorString();
+        reply->abort();
+    }
+}
+
+void KPDownloader::slotFinished()
+{
+    QNetworkReply* const reply = qobject_cast<QNetworkReply*>(sender());
+    Private::Job* const job    = d->running.take(reply);
+
+    if (!job)
+        return;
+
+    reply->deleteLater();
+
+    // Write what was received since the last readyRead().
+    if (job->writeError.isEmpty() && job->checked && reply->error() == QNetworkReply::NoError)
+    {
+        const QByteArray data = reply->readAll();
+
+        if (job->file.write(data) != data.size())
+            job->writeError = job->file.errorString();
+    }
+
+    const int code                          = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    const QNetworkReply::NetworkError error = reply->error();
+    const qint64 received                   = job->file.size();
+    job->file.close();
+
+    if (!job->writeError.isEmpty())
+    {
+        emit signalDownloadDone(job->path, -1, job->writeError);
+        delete job;
+    }
+    else if (code == 416 && !job->restarted)
+    {
+        // The partial file does not match the remote one anymore: start from scratch.
+        QFile::remove(Private::partPath(job->path));
+        job->restarted = true;
+        d->queue.prepend(job);
+    }
+    else if (error != QNetworkReply::NoError)
+    {
+        // Connection errors are resumed from what was received so far.
+        bool transient = (error < QNetworkReply::ContentAccessDenied || code >= 500);
+
+        if (transient && received > 0 && job->resumes < s_maxResumes)
+        {
+            job->resumes++;
+            d->queue.prepend(job);
+        }
+        else
+        {
+            if (!transient)
+                QFile::remove(Private::partPath(job->path));
+
+            emit signalDownloadDone(job->path, error, reply->errorString());
+            delete job;
+        }
+    }
+    else
+    {
+        QFile::remove(job->path);
+
+        if (!QFile::rename(Private::partPath(job->path), job->path))
+        {
+            emit signalDownloadDone(job->path, -1, i18n("Cannot rename %1", Private::partPath(job->path)));
+        }
+        else
+        {
+            emit signalDownloadDone(job->path, 0, QString());
+        }
+
+        delete job;
+    }
+
+    startNext();
+
+    if (d->running.isEmpty() && d->queue.isEmpty())
+    {
+        emit signalFinished();
+    }
+}
+
+} // namespace KIPIPlugins
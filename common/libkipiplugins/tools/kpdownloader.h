@@ -0,0 +1,102 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-16
+ * Description : parallel downloads streamed to disk, with
+ *               resume of partial files.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef KPDOWNLOADER_H
+#define KPDOWNLOADER_H
+
+// Qt includes
+
+#include <QObject>
+#include <QString>
+#include <QNetworkRequest>
+
+// Local includes
+
+#include "kipiplugins_export.h"
+
+namespace KIPIPlugins
+{
+
+/** Download files from web services directly to disk. Data are written to "<path>.part"
+ *  as soon as they are received, so memory use does not depend on the file size, and the
+ *  file is renamed to its final path once complete. Several downloads run in parallel.
+ *
+ *  If a partial file is found, for ex. after a network error or a previous cancelled import,
+ *  the download is resumed with an HTTP Range request.
+ */
+class KIPIPLUGINS_EXPORT KPDownloader : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit KPDownloader(QObject* const parent = 0);
+    ~KPDownloader();
+
+    /** Set the number of downloads running at the same time. Default is 4.
+     */
+    void setMaxParallel(int count);
+
+    /** Queue the download of 'request' to the local file 'path'. The request can hold
+     *  the headers needed by the web service, the Range header is set by the downloader.
+     */
+    void download(const QNetworkRequest& request, const QString& path);
+
+    /** Abort all running downloads and drop the queued ones. Partial files are kept.
+     */
+    void cancel();
+
+    /** Return the number of downloads queued or running.
+     */
+    int pending() const;
+
+Q_SIGNALS:
+
+    /** Emitted when the download to 'path' is done. 'errCode' is 0 on success, else
+     *  a QNetworkReply::NetworkError code, or -1 if the local file cannot be written.
+     */
+    void signalDownloadDone(const QString& path, int errCode, const QString& errMsg);
+
+    /** Emitted when all downloads are done.
+     */
+    void signalFinished();
+
+private Q_SLOTS:
+
+    void slotMetaDataChanged();
+    void slotReadyRead();
+    void slotFinished();
+
+private:
+
+    void startNext();
+
+private:
+
+    class Private;
+    Private* const d;
+};
+
+} // namespace KIPIPlugins
+
+#endif // KPDOWNLOADER_H
@@ -0,0 +1,263 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-21
+ * Description : on-disk cache of remote listings, revalidated
+ *               in background with conditional requests.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "kplistingcache.h"
+
+// Qt includes
+
+#include <QNetworkReply>
+#include <QDataStream>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QHash>
+#include <QStandardPaths>
+
+// Local includes
+
+#include "kipiplugins_debug.h"
+
+namespace KIPIPlugins
+{
+
+static const quint32 s_cacheMagic   = 0x4b504c43; // "KPLC"
+static const quint32 s_cacheVersion = 1;
+
+class Q_DECL_HIDDEN KPListingCache::Private
+{
+public:
+
+    struct Entry
+    {
+        QByteArray data;
+        QByteArray etag;
+        QByteArray lastModified;
+    };
+
+public:
+
+    Private()
+    {
+        dirty = false;
+    }
+
+    static QString entryKey(const QString& account, const QString& listing)
+    {
+        return account + QLatin1Char('\n') + listing;
+    }
+
+    void load();
+
+public:
+
+    bool                  dirty;
+    QString               file;
+
+    /// Account + listing name -> last listing received.
+    QHash<QString, Entry> entries;
+};
+
+void KPListingCache::Private::load()
+{
+    QFile data(file);
+
+    if (!data.exists())
+        return;
+
+    if (!data.open(QIODevice::ReadOnly))
+    {
+        qCWarning(KIPIPLUGINS_LOG) << "Cannot open listing cache" << file << ":" << data.errorString();
+        return;
+    }
+
+    QDataStream stream(&data);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic   = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+
+    if (magic != s_cacheMagic || version != s_cacheVersion)
+    {
+        qCWarning(KIPIPLUGINS_LOG) << "Ignoring listing cache with unknown format" << file;
+        return;
+    }
+
+    quint32 count = 0;
+    stream >> count;
+
+    for (quint32 i = 0 ; i < count && stream.status() == QDataStream::Ok ; ++i)
+    {
+        QString key;
+        Entry   entry;
+        stream >> key >> entry.data >> entry.etag >> entry.lastModified;
+        entries.insert(key, entry);
+    }
+
+    if (stream.status() != QDataStream::Ok)
+    {
+        qCWarning(KIPIPLUGINS_LOG) << "Listing cache" << file << "is truncated, dropping it";
+        entries.clear();
+    }
+}
+
+// ---------------------------------------------------------------------------------------
+
+KPListingCache::KPListingCache(const QString& service)
+    : d(new Private)
+{
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) +
+                  QLatin1String("/kipiplugins/listings");
+
+    d->file     = dir + QLatin1Char('/') + service.toLower() + QLatin1String(".dat");
+    d->load();
+}
+
+KPListingCache::~KPListingCache()
+{
+    save();
+    delete d;
+}
+
+QByteArray KPListingCache::data(const QString& account, const QString& listing) const
+{
+    return d->entries.value(Private::entryKey(account, listing)).data;
+}
+
+void KPListingCache::prepareRequest(QNetworkRequest& request, const QString& account,
+                                    const QString& listing) const
+{
+    QHash<QString, Private::Entry>::const_iterator it = d->entries.constFind(Private::entryKey(account, listing));
+
+    if (it == d->entries.constEnd())
+        return;
+
+    if (!it->etag.isEmpty())
+        request.setRawHeader("If-None-Match", it->etag);
+
+    if (!it->lastModified.isEmpty())
+        request.setRawHeader("If-Modified-Since", it->lastModified);
+}
+
+bool KPListingCache::isNotModified(QNetworkReply* const reply)
+{
+    return (reply && reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 304);
+}
+
+bool KPListingCache::store(const QString& account, const QString& listing, const QByteArray& data,
+                           QNetworkReply* const reply)
+{
+    Private::Entry& entry = d->entries[Private::entryKey(account, listing)];
+
+    if (reply)
+    {
+        QByteArray etag         = reply->rawHeader("ETag");
+        QByteArray lastModified = reply->rawHeader("Last-Modified");
+
+        if (etag != entry.etag || lastModified != entry.lastModified)
+        {
+            entry.etag         = etag;
+            entry.lastModified = lastModified;
+            d->dirty           = true;
+        }
+    }
+
+    if (data == entry.data)
+    {
+        return false;
+    }
+
+    entry.data = data;
+    d->dirty   = true;
+
+    return true;
+}
+
+bool KPListingCache::update(const QString& account, const QString& listing, const QByteArray& data,
+                            bool shown, QNetworkReply* const reply)
+{
+    const bool changed = store(account, listing, data, reply);
+
+    return (changed || !shown);
+}
+
+void KPListingCache::clear(const QString& account)
+{
+    const QString prefix = account + QLatin1Char('\n');
+    QHash<QString, Private::Entry>::iterator it = d->entries.begin();
+
+    while (it != d->entries.end())
+    {
+        if (it.key().startsWith(prefix))
+        {
+            it       = d->entries.erase(it);
+            d->dirty = true;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+bool KPListingCache::save()
+{
+    if (!d->dirty)
+    {
+        return true;
+    }
+
+    QDir().mkpath(QFileInfo(d->file).absolutePath());
+    QSaveFile data(d->file);
+
+    if (!data.open(QIODevice::WriteOnly))
+    {
+        qCWarning(KIPIPLUGINS_LOG) << "Cannot write listing cache" << d->file << ":" << data.errorString();
+        return false;
+    }
+
+    QDataStream stream(&data);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << s_cacheMagic << s_cacheVersion;
+
+    stream << quint32(d->entries.count());
+
+    for (QHash<QString, Private::Entry>::const_iterator it = d->entries.constBegin() ;
+         it != d->entries.constEnd() ; ++it)
+    {
+        stream << it.key() << it->data << it->etag << it->lastModified;
+    }
+
+    if (!data.commit())
+    {
+        qCWarning(KIPIPLUGINS_LOG) << "Cannot commit listing cache" << d->file << ":" << data.errorString();
+        return false;
+    }
+
+    d->dirty = false;
+
+    return true;
+}
+
+} // namespace KIPIPlugins
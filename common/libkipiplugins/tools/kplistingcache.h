@@ -0,0 +1,105 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-21
+ * Description : on-disk cache of remote listings, revalidated
+ *               in background with conditional requests.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef KPLISTINGCACHE_H
+#define KPLISTINGCACHE_H
+
+// Qt includes
+
+#include <QByteArray>
+#include <QString>
+#include <QNetworkRequest>
+
+// Local includes
+
+#include "kipiplugins_export.h"
+
+class QNetworkReply;
+
+namespace KIPIPlugins
+{
+
+/** An on-disk cache of the raw listings returned by one web service: albums, categories,
+ *  templates... Entries are keyed by account and listing name. A talker parses the cached
+ *  listing first, so the window is filled without waiting for the network, then asks the
+ *  service again and only reports the listing if update() tells it has changed.
+ *
+ *  The ETag and Last-Modified validators of the last response are kept, and sent back with
+ *  prepareRequest(), so services supporting conditional requests answer "304 Not Modified"
+ *  without a body when nothing changed.
+ */
+class KIPIPLUGINS_EXPORT KPListingCache
+{
+
+public:
+
+    /** Open the listing cache of the web service named 'service', for ex. "SmugMug".
+     *  The cache is loaded from the user cache location.
+     */
+    explicit KPListingCache(const QString& service);
+
+    /** The cache is written back to disk if it has been changed.
+     */
+    ~KPListingCache();
+
+    /** Return the cached listing 'listing' of 'account', or an empty array if there is none.
+     */
+    QByteArray data(const QString& account, const QString& listing) const;
+
+    /** Add to 'request' the validators of the cached listing, if any.
+     */
+    void prepareRequest(QNetworkRequest& request, const QString& account, const QString& listing) const;
+
+    /** Return true if the service answered that the cached listing is still valid.
+     */
+    static bool isNotModified(QNetworkReply* const reply);
+
+    /** Record 'data' as the listing 'listing' of 'account'. If 'reply' is set, its validators
+     *  are kept for the next request. Return true if the listing differs from the cached one.
+     */
+    bool store(const QString& account, const QString& listing, const QByteArray& data,
+               QNetworkReply* const reply = 0);
+
+    /** Record 'data' as store() does, and return true if the talker must report it: 'shown' tells
+     *  if the window shows the cached listing, in which case it is only reported if it changed.
+     */
+    bool update(const QString& account, const QString& listing, const QByteArray& data,
+                bool shown, QNetworkReply* const reply = 0);
+
+    /** Drop all listings of 'account', for ex. when the user logs out.
+     */
+    void clear(const QString& account);
+
+    /** Write the cache to disk. Return false on error.
+     */
+    bool save();
+
+private:
+
+    class Private;
+    Private* const d;
+};
+
+} // namespace KIPIPlugins
+
+#endif // KPLISTINGCACHE_H
@@ -0,0 +1,185 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-19
+ * Description : fetch the pages of a paginated remote listing,
+ *               several at once when the service allows it.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "kppagefetcher.h"
+
+// Qt includes
+
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QHash>
+#include <QList>
+
+// Local includes
+
+#include "kipiplugins_debug.h"
+
+namespace KIPIPlugins
+{
+
+class Q_DECL_HIDDEN KPPageFetcher::Private
+{
+public:
+
+    struct Page
+    {
+        int             index;
+        QNetworkRequest request;
+        QByteArray      postData;
+    };
+
+public:
+
+    Private()
+    {
+        netMngr     = 0;
+        maxParallel = 4;
+        generation  = 0;
+    }
+
+public:
+
+    QNetworkAccessManager*     netMngr;
+    int                        maxParallel;
+
+    /// Incremented each time the listing is cancelled, to detect it while a page is handled.
+    int                        generation;
+
+    QList<Page>                queue;
+    QHash<QNetworkReply*, int> running;
+};
+
+KPPageFetcher::KPPageFetcher(QObject* const parent)
+    : QObject(parent),
+      d(new Private)
+{
+    d->netMngr = new QNetworkAccessManager(this);
+}
+
+KPPageFetcher::~KPPageFetcher()
+{
+    cancel();
+    delete d;
+}
+
+void KPPageFetcher::setMaxParallel(int count)
+{
+    d->maxParallel = qMax(1, count);
+}
+
+void KPPageFetcher::start(const QNetworkRequest& request, const QByteArray& postData)
+{
+    cancel();
+    fetch(0, request, postData);
+}
+
+void KPPageFetcher::fetch(int index, const QNetworkRequest& request, const QByteArray& postData)
+{
+    Private::Page page;
+    page.index    = index;
+    page.request  = request;
+    page.postData = postData;
+
+    d->queue.append(page);
+    startNext();
+}
+
+void KPPageFetcher::cancel()
+{
+    d->generation++;
+    d->queue.clear();
+
+    QList<QNetworkReply*> running = d->running.keys();
+    d->running.clear();
+
+    foreach (QNetworkReply* const reply, running)
+    {
+        disconnect(reply, 0, this, 0);
+        reply->abort();
+        reply->deleteLater();
+    }
+}
+
+bool KPPageFetcher::isRunning() const
+{
+    return (!d->queue.isEmpty() || !d->running.isEmpty());
+}
+
+void KPPageFetcher::startNext()
+{
+    while (d->running.count() < d->maxParallel && !d->queue.isEmpty())
+    {
+        Private::Page page = d->queue.takeFirst();
+        QNetworkReply* reply;
+
+        if (page.postData.isNull())
+            reply = d->netMngr->get(page.request);
+        else
+            reply = d->netMngr->post(page.request, page.postData);
+
+        connect(reply, SIGNAL(finished()),
+                this, SLOT(slotFinished()));
+
+        d->running.insert(reply, page.index);
+    }
+}
+
+void KPPageFetcher::slotFinished()
+{
+    QNetworkReply* const reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (!reply || !d->running.contains(reply))
+        return;
+
+    const int index = d->running.take(reply);
+    reply->deleteLater();
+
+    if (reply->error() != QNetworkReply::NoError)
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "Listing page" << index << "failed:" << reply->errorString();
+
+        cancel();
+        emit signalFailed(reply->errorString());
+        return;
+    }
+
+    const int generation = d->generation;
+
+    // The receiver queues the following pages from here.
+    emit signalPage(index, reply->readAll());
+
+    if (generation != d->generation)
+    {
+        // Cancelled or restarted while the page was handled.
+        return;
+    }
+
+    startNext();
+
+    if (!isRunning())
+    {
+        emit signalDone();
+    }
+}
+
+} // namespace KIPIPlugins
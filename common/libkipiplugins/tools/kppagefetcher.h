@@ -0,0 +1,112 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-19
+ * Description : fetch the pages of a paginated remote listing,
+ *               several at once when the service allows it.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef KPPAGEFETCHER_H
+#define KPPAGEFETCHER_H
+
+// Qt includes
+
+#include <QObject>
+#include <QByteArray>
+#include <QNetworkRequest>
+
+// Local includes
+
+#include "kipiplugins_export.h"
+
+namespace KIPIPlugins
+{
+
+/** Fetch the pages of a remote listing: albums, folders or photos. The talker starts the
+ *  listing with the request of the first page, and parses each page when signalPage() is
+ *  emitted. While parsing a page, it queues the requests of the following pages with fetch():
+ *
+ *  - with a cursor or a "next" link, the next page is only known once a page is parsed, and
+ *    pages are fetched one after the other;
+ *  - with offsets and a total count, all remaining pages can be queued at once from the
+ *    first page, and they are fetched in parallel.
+ *
+ *  Pages of parallel requests can arrive in any order, their index tells where they belong.
+ *  signalDone() is emitted when the last page has been handled.
+ */
+class KIPIPLUGINS_EXPORT KPPageFetcher : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit KPPageFetcher(QObject* const parent = 0);
+    ~KPPageFetcher();
+
+    /** Set the number of pages fetched at the same time. Default is 4.
+     */
+    void setMaxParallel(int count);
+
+    /** Cancel the current listing, and fetch the first page with 'request'.
+     *  If 'postData' is not null, the request is sent with POST, else with GET.
+     */
+    void start(const QNetworkRequest& request, const QByteArray& postData = QByteArray());
+
+    /** Queue the request of the page 'index' of the current listing.
+     */
+    void fetch(int index, const QNetworkRequest& request, const QByteArray& postData = QByteArray());
+
+    /** Abort the current listing. No signal is emitted anymore for it.
+     */
+    void cancel();
+
+    /** Return true while pages of the current listing are queued or running.
+     */
+    bool isRunning() const;
+
+Q_SIGNALS:
+
+    /** Emitted for each page received, with the raw response data.
+     */
+    void signalPage(int index, const QByteArray& data);
+
+    /** Emitted when a page cannot be fetched. The listing is aborted.
+     */
+    void signalFailed(const QString& errMsg);
+
+    /** Emitted when all pages of the listing have been handled.
+     */
+    void signalDone();
+
+private Q_SLOTS:
+
+    void slotFinished();
+
+private:
+
+    void startNext();
+
+private:
+
+    class Private;
+    Private* const d;
+};
+
+} // namespace KIPIPlugins
+
+#endif // KPPAGEFETCHER_H
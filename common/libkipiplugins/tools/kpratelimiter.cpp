@@ -0,0 +1,352 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-14
+ * Description : retry and pacing policy for web services
+ *               throttling requests.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "kpratelimiter.h"
+
+// C++ includes
+
+#include <limits>
+
+// Qt includes
+
+#include <QNetworkReply>
+#include <QLocale>
+
+// Local includes
+
+#include "kipiplugins_debug.h"
+
+namespace KIPIPlugins
+{
+
+class Q_DECL_HIDDEN KPRateLimiter::Private
+{
+public:
+
+    Private()
+    {
+        maxRetries = 0;
+        baseDelay  = 0;
+        maxDelay   = 0;
+        retries    = 0;
+        remaining  = -1;
+        limit      = -1;
+        lowRatio   = 0.1;
+        seed       = 0;
+    }
+
+    /** Return a pseudo random number for the jitter of the delays. The generator is local to
+     *  the limiter, the global one of qrand() belongs to the host application.
+     */
+    quint32 random()
+    {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16);
+    }
+
+    /** Read one budget announced with the headers 'remainingHeader', 'limitHeader' and
+     *  'resetHeader', and keep it if it is more consumed than the current one.
+     */
+    void readBudget(QNetworkReply* const reply, const char* remainingHeader,
+                    const char* limitHeader, const char* resetHeader);
+
+    static QDateTime parseReset(const QByteArray& value);
+    static QDateTime parseRetryAfter(const QByteArray& value);
+
+public:
+
+    int       maxRetries;
+    int       baseDelay;
+    int       maxDelay;
+    int       retries;
+
+    int       remaining;
+    int       limit;
+    double    lowRatio;
+    QDateTime reset;
+    QDateTime retryAfter;
+
+    quint32   seed;
+};
+
+void KPRateLimiter::Private::readBudget(QNetworkReply* const reply, const char* remainingHeader,
+                                        const char* limitHeader, const char* resetHeader)
+{
+    if (!reply->hasRawHeader(remainingHeader))
+        return;
+
+    bool ok     = false;
+    int  remain = reply->rawHeader(remainingHeader).trimmed().toInt(&ok);
+
+    if (!ok)
+        return;
+
+    int total = -1;
+
+    if (limitHeader && reply->hasRawHeader(limitHeader))
+    {
+        total = reply->rawHeader(limitHeader).trimmed().toInt(&ok);
+
+        if (!ok)
+            total = -1;
+    }
+
+    // Compare the budgets by their remaining ratio, or by the remaining count if the size is unknown.
+    double ratio   = (total > 0)     ? (double)remain    / total     : remain;
+    double current = (remaining < 0) ? std::numeric_limits<double>::max()
+                                     : (limit > 0) ? (double)remaining / limit : remaining;
+
+    if (ratio >= current)
+        return;
+
+    remaining = remain;
+    limit     = total;
+    reset     = (resetHeader && reply->hasRawHeader(resetHeader)) ? parseReset(reply->rawHeader(resetHeader))
+                                                                  : QDateTime();
+}
+
+QDateTime KPRateLimiter::Private::parseReset(const QByteArray& value)
+{
+    bool   ok   = false;
+    qint64 secs = value.trimmed().toLongLong(&ok);
+
+    if (!ok)
+        return QDateTime();
+
+    // Some services send an epoch time, others a number of seconds from now.
+    if (secs > 1000000000)
+        return QDateTime::fromMSecsSinceEpoch(secs * 1000);
+
+    return QDateTime::currentDateTimeUtc().addSecs(secs);
+}
+
+QDateTime KPRateLimiter::Private::parseRetryAfter(const QByteArray& value)
+{
+    bool   ok   = false;
+    qint64 secs = value.trimmed().toLongLong(&ok);
+
+    if (ok)
+        return QDateTime::currentDateTimeUtc().addSecs(secs);
+
+    // HTTP date, as "Wed, 21 Oct 2015 07:28:00 GMT".
+    QDateTime date = QLocale::c().toDateTime(QString::fromLatin1(value.trimmed()),
+                                             QLatin1String("ddd, dd MMM yyyy HH:mm:ss 'GMT'"));
+    date.setTimeSpec(Qt::UTC);
+
+    return date;
+}
+
+// ---------------------------------------------------------------------------------------
+
+KPRateLimiter::KPRateLimiter(int maxRetries, int baseDelay, int maxDelay)
+    : d(new Private)
+{
+    d->maxRetries = maxRetries;
+    d->baseDelay  = qMax(1, baseDelay);
+    d->maxDelay   = qMax(d->baseDelay, maxDelay);
+    d->seed       = (quint32)QDateTime::currentMSecsSinceEpoch() ^ (quint32)(quintptr)this;
+}
+
+KPRateLimiter::~KPRateLimiter()
+{
+    delete d;
+}
+
+bool KPRateLimiter::isThrottled(QNetworkReply* const reply)
+{
+    if (!reply)
+        return false;
+
+    // A POST may have been done by the service before a gateway or a connection failed:
+    // it is only sent again when the service tells it was not handled.
+    const bool idempotent = (reply->operation() == QNetworkAccessManager::GetOperation  ||
+                             reply->operation() == QNetworkAccessManager::HeadOperation ||
+                             reply->operation() == QNetworkAccessManager::PutOperation  ||
+                             reply->operation() == QNetworkAccessManager::DeleteOperation);
+
+    switch (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt())
+    {
+        case 429: // Too Many Requests
+            return true;
+
+        case 503: // Service Unavailable
+            return (idempotent || reply->hasRawHeader("Retry-After"));
+
+        case 502: // Bad Gateway
+        case 504: // Gateway Timeout
+            return idempotent;
+
+        default:
+            break;
+    }
+
+    if (!idempotent)
+        return false;
+
+    switch (reply->error())
+    {
+        case QNetworkReply::TemporaryNetworkFailureError:
+        case QNetworkReply::NetworkSessionFailedError:
+        case QNetworkReply::RemoteHostClosedError:
+        case QNetworkReply::TimeoutError:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+void KPRateLimiter::updateFromReply(QNetworkReply* const reply)
+{
+    if (!reply)
+        return;
+
+    // The budgets are announced again in each reply: start from scratch.
+    d->remaining = -1;
+    d->limit     = -1;
+    d->reset     = QDateTime();
+
+    d->readBudget(reply, "X-RateLimit-Remaining",       "X-RateLimit-Limit",       "X-RateLimit-Reset");
+    d->readBudget(reply, "X-RateLimit-UserRemaining",   "X-RateLimit-UserLimit",   "X-RateLimit-UserReset");
+    d->readBudget(reply, "X-RateLimit-ClientRemaining", "X-RateLimit-ClientLimit", 0);
+    d->readBudget(reply, "X-Post-Rate-Limit-Remaining", "X-Post-Rate-Limit-Limit", "X-Post-Rate-Limit-Reset");
+
+    if (reply->hasRawHeader("Retry-After"))
+    {
+        d->retryAfter = Private::parseRetryAfter(reply->rawHeader("Retry-After"));
+    }
+
+    if (d->remaining >= 0)
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "Rate limit:" << d->remaining << "of" << d->limit
+                                 << "requests remaining until" << d->reset;
+    }
+}
+
+int KPRateLimiter::nextRetryDelay()
+{
+    int delay = retryDelay(d->retries);
+
+    if (delay >= 0)
+    {
+        d->retries++;
+    }
+
+    return delay;
+}
+
+int KPRateLimiter::retryDelay(int retries)
+{
+    if (retries >= d->maxRetries)
+    {
+        return -1;
+    }
+
+    QDateTime now = QDateTime::currentDateTimeUtc();
+
+    // The service told us when to come back.
+    if (d->retryAfter.isValid() && d->retryAfter > now)
+    {
+        qint64 delay  = now.msecsTo(d->retryAfter);
+        d->retryAfter = QDateTime();
+
+        return (int)qMin(delay, (qint64)std::numeric_limits<int>::max());
+    }
+
+    d->retryAfter = QDateTime();
+
+    if (d->remaining == 0 && d->reset.isValid() && d->reset > now)
+    {
+        return (int)qMin(now.msecsTo(d->reset), (qint64)std::numeric_limits<int>::max());
+    }
+
+    // Exponential backoff, with half of the delay randomized to not retry all at the same time.
+    qint64 delay = qMin((qint64)d->baseDelay << qMin(retries, 20), (qint64)d->maxDelay);
+    qint64 half  = delay / 2;
+
+    return (int)(half + d->random() % (half + 1));
+}
+
+void KPRateLimiter::resetRetries()
+{
+    d->retries    = 0;
+    d->retryAfter = QDateTime();
+}
+
+int KPRateLimiter::retryCount() const
+{
+    return d->retries;
+}
+
+int KPRateLimiter::pacingDelay() const
+{
+    if (d->remaining < 0)
+    {
+        return 0;
+    }
+
+    QDateTime now  = QDateTime::currentDateTimeUtc();
+    qint64 toReset = (d->reset.isValid() && d->reset > now) ? now.msecsTo(d->reset) : -1;
+
+    if (d->remaining == 0)
+    {
+        // Budget exhausted: wait for the reset, or back off if we do not know when it happens.
+        return (toReset >= 0) ? (int)qMin(toReset, (qint64)std::numeric_limits<int>::max())
+                              : d->maxDelay;
+    }
+
+    if (d->limit <= 0 || (double)d->remaining / d->limit >= d->lowRatio)
+    {
+        return 0;
+    }
+
+    if (toReset < 0)
+    {
+        return d->baseDelay;
+    }
+
+    // Spread the remaining requests until the reset.
+    return (int)qMin(toReset / (d->remaining + 1), (qint64)d->maxDelay);
+}
+
+void KPRateLimiter::setLowBudgetRatio(double ratio)
+{
+    d->lowRatio = ratio;
+}
+
+int KPRateLimiter::remaining() const
+{
+    return d->remaining;
+}
+
+int KPRateLimiter::limit() const
+{
+    return d->limit;
+}
+
+QDateTime KPRateLimiter::resetTime() const
+{
+    return d->reset;
+}
+
+} // namespace KIPIPlugins
@@ -0,0 +1,123 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-14
+ * Description : retry and pacing policy for web services
+ *               throttling requests.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef KPRATELIMITER_H
+#define KPRATELIMITER_H
+
+// Qt includes
+
+#include <QDateTime>
+
+// Local includes
+
+#include "kipiplugins_export.h"
+
+class QNetworkReply;
+
+namespace KIPIPlugins
+{
+
+/** Keep track of the request budget announced by a web service, and compute how long
+ *  a talker must wait before retrying a throttled request or sending the next one.
+ *
+ *  The budget is read from the usual headers: Retry-After, X-RateLimit-Limit/Remaining/Reset,
+ *  the Imgur X-RateLimit-User* and X-RateLimit-Client* pairs, and X-Post-Rate-Limit-*.
+ *  When several budgets are announced, the most consumed one is used.
+ *
+ *  A throttled request is retried with an exponential backoff with jitter, unless the service
+ *  told us when to come back. When the remaining budget gets low, the requests are spread
+ *  until the reset time, so a long export slows down instead of hitting the limit.
+ */
+class KIPIPLUGINS_EXPORT KPRateLimiter
+{
+    Q_DISABLE_COPY(KPRateLimiter)
+
+public:
+
+    /** 'maxRetries' is the number of retries allowed for one request. Backoff delays
+     *  start from 'baseDelay' and are capped to 'maxDelay', both in milliseconds.
+     */
+    explicit KPRateLimiter(int maxRetries = 6, int baseDelay = 2000, int maxDelay = 300000);
+    ~KPRateLimiter();
+
+    /** Return true if 'reply' was refused because the service is throttling us or is
+     *  temporarily unavailable, and the same request can be sent again later. Gateway and
+     *  connection errors are only retried for idempotent requests, not for POST ones.
+     */
+    static bool isThrottled(QNetworkReply* const reply);
+
+    /** Read the rate limit headers of 'reply'. Call this for every finished reply.
+     */
+    void updateFromReply(QNetworkReply* const reply);
+
+    /** Return the delay in milliseconds to wait before sending again the last throttled
+     *  request, or -1 if it has been retried too many times. Each call counts as a retry.
+     */
+    int nextRetryDelay();
+
+    /** Return the delay in milliseconds to wait before sending again a throttled request
+     *  already retried 'retries' times, or -1 if it has been retried too many times.
+     *  The retries are not counted here: use this when several requests are in flight
+     *  and each of them keeps its own count, the budget and backoff policy being shared.
+     */
+    int retryDelay(int retries);
+
+    /** Reset the retry counter. Call this when a request has succeeded.
+     */
+    void resetRetries();
+
+    /** Return the number of retries done for the current request.
+     */
+    int retryCount() const;
+
+    /** Return the delay in milliseconds to wait before sending the next request, so that
+     *  the remaining budget lasts until it is reset. Return 0 if there is no need to slow down.
+     */
+    int pacingDelay() const;
+
+    /** Below this ratio of remaining requests, pacingDelay() starts to slow down the queue.
+     *  Default is 0.1.
+     */
+    void setLowBudgetRatio(double ratio);
+
+    /** Return the remaining requests announced by the service, or -1 if unknown.
+     */
+    int remaining() const;
+
+    /** Return the size of the budget announced by the service, or -1 if unknown.
+     */
+    int limit() const;
+
+    /** Return the time the budget will be reset, or an invalid date if unknown.
+     */
+    QDateTime resetTime() const;
+
+private:
+
+    class Private;
+    Private* const d;
+};
+
+} // namespace KIPIPlugins
+
+#endif // KPRATELIMITER_H
@@ -0,0 +1,468 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-12
+ * Description : persistent local index of files already sent to
+ *               a web service, used to skip duplicate uploads.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "kpuploadhistory.h"
+
+// Qt includes
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QHash>
+#include <QList>
+#include <QStandardPaths>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
+
+// Local includes
+
+#include "kipiplugins_debug.h"
+
+namespace KIPIPlugins
+{
+
+static const quint32 s_historyMagic   = 0x4b505548; // "KPUH"
+static const quint32 s_historyVersion = 1;
+
+/// Size, date and MD5 sum of a local file when it was hashed.
+struct KPFileFingerprint
+{
+    KPFileFingerprint()
+    {
+        size     = 0;
+        modified = 0;
+    }
+
+    QString    path;
+    qint64     size;
+    qint64     modified;
+    QByteArray hash;
+};
+
+typedef QList<KPFileFingerprint> KPFileFingerprints;
+
+/** Read the file 'path' to compute its fingerprint. The hash is empty if the file cannot be read.
+ */
+static KPFileFingerprint fingerprintFile(const QString& path)
+{
+    KPFileFingerprint fp;
+    fp.path = path;
+
+    QFileInfo info(path);
+
+    if (!info.isFile())
+    {
+        return fp;
+    }
+
+    fp.size     = info.size();
+    fp.modified = info.lastModified().toMSecsSinceEpoch();
+
+    QFile file(path);
+
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return fp;
+    }
+
+    // Hash the file by blocks, do not load it in memory at once.
+    QCryptographicHash md5(QCryptographicHash::Md5);
+
+    if (md5.addData(&file))
+    {
+        fp.hash = md5.result();
+    }
+
+    return fp;
+}
+
+/** Compute the fingerprints of 'paths'. Run on a worker thread.
+ */
+static KPFileFingerprints fingerprintFiles(const QStringList& paths)
+{
+    KPFileFingerprints fps;
+
+    foreach (const QString& path, paths)
+    {
+        fps.append(fingerprintFile(path));
+    }
+
+    return fps;
+}
+
+class Q_DECL_HIDDEN KPUploadHistory::Private
+{
+public:
+
+    typedef KPFileFingerprint Fingerprint;
+
+public:
+
+    Private()
+    {
+        dirty = false;
+    }
+
+    static QString targetPrefix(const QString& account, const QString& album)
+    {
+        return account + QLatin1Char('\n') + album + QLatin1Char('\n');
+    }
+
+    static QString entryKey(const QByteArray& hash, const QString& account, const QString& album)
+    {
+        return targetPrefix(account, album) + QString::fromLatin1(hash.toHex());
+    }
+
+    /** Return true if the sum of 'path' is cached for its current size and date.
+     */
+    bool isHashed(const QString& path) const
+    {
+        QFileInfo info(path);
+        QHash<QString, Fingerprint>::const_iterator it = fingerprints.constFind(path);
+
+        return (it != fingerprints.constEnd()                &&
+                it->size     == info.size()                  &&
+                it->modified == info.lastModified().toMSecsSinceEpoch());
+    }
+
+    void addFingerprint(const Fingerprint& fp)
+    {
+        if (fp.hash.isEmpty())
+            return;
+
+        fingerprints.insert(fp.path, fp);
+        dirty = true;
+    }
+
+    void load();
+
+public:
+
+    bool                        dirty;
+    QString                     file;
+
+    /// Target + content hash -> remote ID.
+    QHash<QString, QString>     entries;
+
+    /// Local path -> size, date and MD5 sum of the file when it was last hashed.
+    QHash<QString, Fingerprint> fingerprints;
+
+    /// Running hashFiles() calls -> their paths.
+    QHash<QFutureWatcher<KPFileFingerprints>*, QStringList> hashing;
+};
+
+void KPUploadHistory::Private::load()
+{
+    QFile data(file);
+
+    if (!data.exists())
+        return;
+
+    if (!data.open(QIODevice::ReadOnly))
+    {
+        qCWarning(KIPIPLUGINS_LOG) << "Cannot open upload history" << file << ":" << data.errorString();
+        return;
+    }
+
+    QDataStream stream(&data);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic   = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+
+    if (magic != s_historyMagic || version != s_historyVersion)
+    {
+        qCWarning(KIPIPLUGINS_LOG) << "Ignoring upload history with unknown format" << file;
+        return;
+    }
+
+    quint32 count = 0;
+    stream >> count;
+
+    for (quint32 i = 0 ; i < count && stream.status() == QDataStream::Ok ; ++i)
+    {
+        QString key;
+        QString id;
+        stream >> key >> id;
+        entries.insert(key, id);
+    }
+
+    stream >> count;
+
+    for (quint32 i = 0 ; i < count && stream.status() == QDataStream::Ok ; ++i)
+    {
+        QString     path;
+        Fingerprint fp;
+        stream >> path >> fp.size >> fp.modified >> fp.hash;
+        fp.path = path;
+        fingerprints.insert(path, fp);
+    }
+
+    if (stream.status() != QDataStream::Ok)
+    {
+        qCWarning(KIPIPLUGINS_LOG) << "Upload history" << file << "is truncated, dropping it";
+        entries.clear();
+        fingerprints.clear();
+    }
+
+    qCDebug(KIPIPLUGINS_LOG) << "Upload history" << file << "loaded with" << entries.count() << "entries";
+}
+
+// ---------------------------------------------------------------------------------------
+
+KPUploadHistory::KPUploadHistory(const QString& service, QObject* const parent)
+    : QObject(parent),
+      d(new Private)
+{
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) +
+                  QLatin1String("/kipiplugins/uploadhistory");
+
+    d->file     = dir + QLatin1Char('/') + service.toLower() + QLatin1String(".dat");
+    d->load();
+}
+
+KPUploadHistory::~KPUploadHistory()
+{
+    // The files being hashed cannot be interrupted, wait for them before their watchers are deleted.
+    foreach (QFutureWatcher<KPFileFingerprints>* const watcher, d->hashing.keys())
+    {
+        watcher->waitForFinished();
+
+        foreach (const KPFileFingerprint& fp, watcher->result())
+        {
+            d->addFingerprint(fp);
+        }
+    }
+
+    save();
+    delete d;
+}
+
+void KPUploadHistory::hashFiles(const QStringList& paths)
+{
+    QStringList missing;
+
+    foreach (const QString& path, paths)
+    {
+        if (!d->isHashed(path))
+            missing << path;
+    }
+
+    QFutureWatcher<KPFileFingerprints>* const watcher = new QFutureWatcher<KPFileFingerprints>(this);
+
+    connect(watcher, SIGNAL(finished()),
+            this, SLOT(slotFilesHashed()));
+
+    d->hashing.insert(watcher, paths);
+    watcher->setFuture(QtConcurrent::run(fingerprintFiles, missing));
+}
+
+void KPUploadHistory::slotFilesHashed()
+{
+    QFutureWatcher<KPFileFingerprints>* const watcher = static_cast<QFutureWatcher<KPFileFingerprints>*>(sender());
+
+    if (!d->hashing.contains(watcher))
+        return;
+
+    const QStringList paths = d->hashing.take(watcher);
+
+    foreach (const KPFileFingerprint& fp, watcher->result())
+    {
+        d->addFingerprint(fp);
+    }
+
+    watcher->deleteLater();
+
+    emit filesHashed(paths);
+}
+
+QByteArray KPUploadHistory::contentHash(const QString& path)
+{
+    if (!d->isHashed(path))
+    {
+        d->addFingerprint(fingerprintFile(path));
+    }
+
+    QHash<QString, Private::Fingerprint>::const_iterator it = d->fingerprints.constFind(path);
+
+    if (it == d->fingerprints.constEnd() || !QFileInfo(path).isFile())
+    {
+        return QByteArray();
+    }
+
+    return it->hash;
+}
+
+QString KPUploadHistory::remoteId(const QString& path, const QString& account, const QString& album)
+{
+    QByteArray hash = contentHash(path);
+
+    if (hash.isEmpty())
+    {
+        return QString();
+    }
+
+    return d->entries.value(Private::entryKey(hash, account, album));
+}
+
+bool KPUploadHistory::isUploaded(const QString& path, const QString& account, const QString& album)
+{
+    return !remoteId(path, account, album).isNull();
+}
+
+void KPUploadHistory::addUpload(const QString& path, const QString& account, const QString& album,
+                                const QString& remoteId)
+{
+    addRemoteItem(contentHash(path), account, album, remoteId);
+}
+
+void KPUploadHistory::addRemoteItem(const QByteArray& hash, const QString& account, const QString& album,
+                                    const QString& remoteId)
+{
+    if (hash.isEmpty())
+    {
+        return;
+    }
+
+    // Services without remote IDs still need a non-null value to mark the entry.
+    d->entries.insert(Private::entryKey(hash, account, album),
+                      remoteId.isNull() ? QLatin1String("") : remoteId);
+    d->dirty = true;
+}
+
+void KPUploadHistory::rebuildTarget(const QString& account, const QString& album,
+                                    const QMap<QByteArray, QString>& remoteItems)
+{
+    clearTarget(account, album);
+
+    for (QMap<QByteArray, QString>::const_iterator it = remoteItems.constBegin() ;
+         it != remoteItems.constEnd() ; ++it)
+    {
+        addRemoteItem(it.key(), account, album, it.value());
+    }
+}
+
+void KPUploadHistory::reconcileTarget(const QString& account, const QString& album,
+                                      const QSet<QString>& remoteIds)
+{
+    const QString prefix = Private::targetPrefix(account, album);
+    QHash<QString, QString>::iterator it = d->entries.begin();
+
+    while (it != d->entries.end())
+    {
+        if (it.key().startsWith(prefix) && !remoteIds.contains(it.value()))
+        {
+            it       = d->entries.erase(it);
+            d->dirty = true;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void KPUploadHistory::clearTarget(const QString& account, const QString& album)
+{
+    const QString prefix = album.isNull() ? account + QLatin1Char('\n')
+                                          : Private::targetPrefix(account, album);
+    QHash<QString, QString>::iterator it = d->entries.begin();
+
+    while (it != d->entries.end())
+    {
+        if (it.key().startsWith(prefix))
+        {
+            it       = d->entries.erase(it);
+            d->dirty = true;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+bool KPUploadHistory::save()
+{
+    if (!d->dirty)
+    {
+        return true;
+    }
+
+    QDir().mkpath(QFileInfo(d->file).absolutePath());
+    QSaveFile data(d->file);
+
+    if (!data.open(QIODevice::WriteOnly))
+    {
+        qCWarning(KIPIPLUGINS_LOG) << "Cannot write upload history" << d->file << ":" << data.errorString();
+        return false;
+    }
+
+    QDataStream stream(&data);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << s_historyMagic << s_historyVersion;
+
+    stream << quint32(d->entries.count());
+
+    for (QHash<QString, QString>::const_iterator it = d->entries.constBegin() ;
+         it != d->entries.constEnd() ; ++it)
+    {
+        stream << it.key() << it.value();
+    }
+
+    // Forget fingerprints of files which do not exist anymore.
+    QHash<QString, Private::Fingerprint>::iterator it = d->fingerprints.begin();
+
+    while (it != d->fingerprints.end())
+    {
+        if (!QFile::exists(it.key()))
+            it = d->fingerprints.erase(it);
+        else
+            ++it;
+    }
+
+    stream << quint32(d->fingerprints.count());
+
+    for (QHash<QString, Private::Fingerprint>::const_iterator it = d->fingerprints.constBegin() ;
+         it != d->fingerprints.constEnd() ; ++it)
+    {
+        stream << it.key() << it->size << it->modified << it->hash;
+    }
+
+    if (!data.commit())
+    {
+        qCWarning(KIPIPLUGINS_LOG) << "Cannot commit upload history" << d->file << ":" << data.errorString();
+        return false;
+    }
+
+    d->dirty = false;
+
+    return true;
+}
+
+} // namespace KIPIPlugins
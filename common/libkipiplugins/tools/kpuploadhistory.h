@@ -0,0 +1,136 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-12
+ * Description : persistent local index of files already sent to
+ *               a web service, used to skip duplicate uploads.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef KPUPLOADHISTORY_H
+#define KPUPLOADHISTORY_H
+
+// Qt includes
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QSet>
+#include <QMap>
+
+// Local includes
+
+#include "kipiplugins_export.h"
+
+namespace KIPIPlugins
+{
+
+/** An on-disk index of uploads done to one web service. Entries are keyed by the
+ *  MD5 sum of the original file content plus the target account and album, and
+ *  hold the remote ID returned by the service. Tools query it before preparing an
+ *  item, so files already sent to the same place are skipped without a round trip.
+ *
+ *  The MD5 sum of a local file is cached with its size and modification time,
+ *  so unchanged files are not read again on the next export. Call hashFiles()
+ *  before the queries to read the new files on a worker thread, not on the GUI.
+ */
+class KIPIPLUGINS_EXPORT KPUploadHistory : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    /** Open the history of the web service named 'service', for ex. "Flickr".
+     *  The index is loaded from the user data location.
+     */
+    explicit KPUploadHistory(const QString& service, QObject* const parent = 0);
+
+    /** The index is written back to disk if it has been changed.
+     *  Wait for the running hashFiles() calls.
+     */
+    ~KPUploadHistory();
+
+    /** Compute on a worker thread the MD5 sums of the local files of 'paths' which are not cached yet.
+     *  filesHashed() is emitted with 'paths' when they are known: contentHash(), isUploaded() and
+     *  remoteId() then answer for these files without reading them. If all sums are cached already,
+     *  filesHashed() is emitted from the event loop.
+     */
+    void hashFiles(const QStringList& paths);
+
+    /** Return the MD5 sum of the local file 'path', or an empty array if it cannot be read.
+     *  The file is read in the calling thread if its sum is not cached: see hashFiles().
+     */
+    QByteArray contentHash(const QString& path);
+
+    /** Return the remote ID of the file 'path' if it has already been uploaded into 'album'
+     *  of 'account', else a null string.
+     */
+    QString remoteId(const QString& path, const QString& account, const QString& album = QString());
+
+    /** Return true if the file 'path' has already been uploaded into 'album' of 'account'.
+     */
+    bool isUploaded(const QString& path, const QString& account, const QString& album = QString());
+
+    /** Record that the local file 'path' has been uploaded as 'remoteId'.
+     */
+    void addUpload(const QString& path, const QString& account, const QString& album,
+                   const QString& remoteId);
+
+    /** Record a remote item whose content hash is known from a service listing.
+     */
+    void addRemoteItem(const QByteArray& hash, const QString& account, const QString& album,
+                       const QString& remoteId);
+
+    /** Rebuild all entries of 'album' from a remote listing mapping content hashes to remote IDs.
+     */
+    void rebuildTarget(const QString& account, const QString& album,
+                       const QMap<QByteArray, QString>& remoteItems);
+
+    /** Drop entries of 'album' whose remote ID is not part of 'remoteIds' anymore. Use this
+     *  with services listing remote items without a content hash.
+     */
+    void reconcileTarget(const QString& account, const QString& album,
+                         const QSet<QString>& remoteIds);
+
+    /** Drop all entries of 'album'. If 'album' is null, all entries of 'account' are dropped.
+     */
+    void clearTarget(const QString& account, const QString& album = QString());
+
+    /** Write the index to disk. Return false on error.
+     */
+    bool save();
+
+Q_SIGNALS:
+
+    /** Emitted when the MD5 sums of the files of 'paths' given to hashFiles() are cached.
+     */
+    void filesHashed(const QStringList& paths);
+
+private Q_SLOTS:
+
+    void slotFilesHashed();
+
+private:
+
+    class Private;
+    Private* const d;
+};
+
+} // namespace KIPIPlugins
+
+#endif // KPUPLOADHISTORY_H
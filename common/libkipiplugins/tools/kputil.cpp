@@ -29,6 +29,7 @@
 #include <QByteArray>
 #include <QBuffer>
 #include <QImage>
+#include <QImageReader>
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 #include <QApplication>
@@ -82,6 +83,45 @@ void removeTemporaryDir(const char* prefix)
     }
 }
 
+QImage loadScaledImage(const QString& path, int maxDimension, QSize* const originalSize)
+{
+    QImageReader reader(path);
+    reader.setAutoTransform(true);
+
+    QSize fullSize = reader.size();
+
+    if (!fullSize.isValid() || fullSize.isEmpty())
+    {
+        return QImage();
+    }
+
+    // The size is the one of the stored image, scaled before the rotation: the box is square.
+    if (maxDimension > 0 && (fullSize.width() > maxDimension || fullSize.height() > maxDimension))
+    {
+        reader.setScaledSize(fullSize.scaled(maxDimension, maxDimension, Qt::KeepAspectRatio));
+    }
+
+    QImage image = reader.read();
+
+    if (image.isNull())
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "Cannot read" << path << ":" << reader.errorString();
+        return image;
+    }
+
+    if (reader.transformation() & QImageIOHandler::TransformationRotate90)
+    {
+        fullSize.transpose();
+    }
+
+    if (originalSize)
+    {
+        *originalSize = fullSize;
+    }
+
+    return image;
+}
+
 // ------------------------------------------------------------------------------------
 
 KPHBox::KPHBox(QWidget* const parent)
@@ -334,15 +374,9 @@ void KPFileSelector::setFileDlgOptions(QFileDialog::Options opts)
 
 void KPFileSelector::slotBtnClicked()
 {
-    if (d->fdMode == QFileDialog::ExistingFiles)
-    {
-        qCDebug(KIPIPLUGINS_LOG) << "Multiple selection is not supported";
-        return;
-    }
-
     QFileDialog* const fileDlg = new QFileDialog();
     fileDlg->setOptions(d->fdOptions);
-    fileDlg->setDirectory(QFileInfo(d->edit->text()).filePath());
+    fileDlg->setDirectory(QFileInfo(d->edit->text().section(QLatin1Char(';'), 0, 0)).filePath());
     fileDlg->setFileMode(d->fdMode);
 
     if (!d->fdFilter.isNull())
@@ -359,7 +393,11 @@ void KPFileSelector::slotBtnClicked()
 
         if (!sel.isEmpty())
         {
-            d->edit->setText(sel.first());
+            if (d->fdMode == QFileDialog::ExistingFiles)
+                d->edit->setText(sel.join(QLatin1Char(';')));
+            else
+                d->edit->setText(sel.first());
+
             emit signalUrlSelected(QUrl::fromLocalFile(sel.first()));
         }
     }
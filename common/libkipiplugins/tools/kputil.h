@@ -32,6 +32,7 @@
 #include <QFrame>
 #include <QLineEdit>
 #include <QSize>
+#include <QImage>
 #include <QPixmap>
 #include <QFileDialog>
 #include <QColor>
@@ -48,6 +49,15 @@ namespace KIPIPlugins
 QDir KIPIPLUGINS_EXPORT makeTemporaryDir(const char* prefix);
 void KIPIPLUGINS_EXPORT removeTemporaryDir(const char* prefix);
 
+/** Read the image 'path' with QImageReader, rotated following its orientation, and
+ *  scaled down to fit in 'maxDimension' if it is not 0. 'originalSize' is set to the
+ *  size of the rotated image before scaling.
+ *  Unlike the host preview, this can be called from a worker thread. The image is null
+ *  if the format is not handled, for ex. RAW files: the host preview must then be used,
+ *  from the GUI thread.
+ */
+QImage KIPIPLUGINS_EXPORT loadScaledImage(const QString& path, int maxDimension, QSize* const originalSize = 0);
+
 // ------------------------------------------------------------------------------------
 
 /** An Horizontal widget to host children widgets
@@ -129,6 +139,8 @@ public:
 
     QLineEdit* lineEdit() const;
 
+    /** In QFileDialog::ExistingFiles mode, the files selected are separated by ';' in the line edit.
+     */
     void setFileDlgMode(QFileDialog::FileMode mode);
     void setFileDlgFilter(const QString& filter);
     void setFileDlgTitle(const QString& title);
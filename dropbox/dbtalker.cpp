@@ -49,10 +49,13 @@
 #include "kipiplugins_debug.h"
 #include "kpversion.h"
 #include "kputil.h"
+#include "kppagefetcher.h"
 #include "dbwindow.h"
 #include "dbitem.h"
 #include "mpform.h"
 
+using namespace KIPIPlugins;
+
 namespace KIPIDropboxPlugin
 {
 
@@ -70,8 +73,10 @@ DBTalker::DBTalker(QWidget* const parent)
     m_iface                = 0;
     m_netMngr              = 0;
     m_reply                = 0;
+    m_listPages            = 0;
     m_o2                   = 0;
     m_store                = 0;
+    m_remoteFilesComplete  = false;
 
     PluginLoader* const pl = PluginLoader::instance();
 
@@ -88,6 +93,18 @@ DBTalker::DBTalker(QWidget* const parent)
     connect(m_netMngr, SIGNAL(finished(QNetworkReply*)),
             this, SLOT(slotFinished(QNetworkReply*)));
 
+    // Large folder trees are listed in several pages, following the cursor.
+    m_listPages = new KPPageFetcher(this);
+
+    connect(m_listPages, SIGNAL(signalPage(int,QByteArray)),
+            this, SLOT(slotListFoldersPage(int,QByteArray)));
+
+    connect(m_listPages, SIGNAL(signalFailed(QString)),
+            this, SLOT(slotListFoldersFailed(QString)));
+
+    connect(m_listPages, SIGNAL(signalDone()),
+            this, SLOT(slotListFoldersDone()));
+
     m_o2     = new O2(this);
 
     m_o2->setClientId(m_apikey);
@@ -132,6 +149,9 @@ void DBTalker::unLink()
 {
     m_o2->unlink();
 
+    // The store writes its values later: flush them before the group is removed.
+    m_store->sync();
+
     m_settings->beginGroup(QLatin1String("Dropbox"));
     m_settings->remove(QString());
     m_settings->endGroup();
@@ -167,6 +187,27 @@ bool DBTalker::authenticated()
     return m_o2->linked();
 }
 
+/** Return the remote path of the last uploaded file
+ */
+QString DBTalker::getLastUploadPath() const
+{
+    return m_lastUploadPath;
+}
+
+/** Return the remote paths of all files seen by the last folders listing
+ */
+QSet<QString> DBTalker::getRemoteFiles() const
+{
+    return m_remoteFiles;
+}
+
+/** Return true if the last folders listing returned all remote files
+ */
+bool DBTalker::remoteFilesComplete() const
+{
+    return m_remoteFilesComplete;
+}
+
 /** Creates folder at specified path
  */
 void DBTalker::createFolder(const QString& path)
@@ -189,6 +230,13 @@ void DBTalker::createFolder(const QString& path)
     emit signalBusy(true);
 }
 
+/** Return the id of the linked Dropbox account, given with the access token.
+ */
+QString DBTalker::getAccountId()
+{
+    return m_o2->extraTokens()[QLatin1String("account_id")].toString();
+}
+
 /** Get username of dropbox user
  */
 void DBTalker::getUserName()
@@ -217,10 +265,13 @@ void DBTalker::listFolders(const QString& path)
 
     QByteArray postData = QString::fromUtf8("{\"path\": \"%1\",\"recursive\": true}").arg(path).toUtf8();
 
-    m_reply = m_netMngr->post(netRequest, postData);
+    m_folders.clear();
+    m_folders.append(qMakePair(QLatin1String(""), QLatin1String("root")));
+    m_remoteFiles.clear();
+    m_remoteFilesComplete = false;
+
+    m_listPages->start(netRequest, postData);
 
-    m_state = DB_LISTFOLDERS;
-    m_buffer.resize(0);
     emit signalBusy(true);
 }
 
@@ -296,6 +347,8 @@ void DBTalker::cancel()
         m_reply = 0;
     }
 
+    m_listPages->cancel();
+
     emit signalBusy(false);
 }
 
@@ -325,10 +378,6 @@ void DBTalker::slotFinished(QNetworkReply* reply)
 
     switch (m_state)
     {
-        case (DB_LISTFOLDERS):
-            qCDebug(KIPIPLUGINS_LOG) << "In DB_LISTFOLDERS";
-            parseResponseListFolders(m_buffer);
-            break;
         case (DB_CREATEFOLDER):
             qCDebug(KIPIPLUGINS_LOG) << "In DB_CREATEFOLDER";
             parseResponseCreateFolder(m_buffer);
@@ -361,6 +410,7 @@ void DBTalker::parseResponseAddPhoto(const QByteArray& data)
     }
     else
     {
+        m_lastUploadPath = jsonObject[QLatin1String("path_display")].toString();
         emit signalAddPhotoSucceeded();
     }
 }
@@ -376,13 +426,17 @@ void DBTalker::parseResponseUserName(const QByteArray& data)
     emit signalSetUserName(name);
 }
 
-void DBTalker::parseResponseListFolders(const QByteArray& data)
+/** Handle one page of the folders listing. The folders found so far are sent to the
+ *  window, and the next page is requested while Dropbox reports more entries.
+ */
+void DBTalker::slotListFoldersPage(int index, const QByteArray& data)
 {
     QJsonParseError err;
     QJsonDocument doc = QJsonDocument::fromJson(data, &err);
 
     if (err.error != QJsonParseError::NoError)
     {
+        m_listPages->cancel();
         emit signalBusy(false);
         emit signalListAlbumsFailed(i18n("Failed to list folders"));
         return;
@@ -391,9 +445,6 @@ void DBTalker::parseResponseListFolders(const QByteArray& data)
     QJsonObject jsonObject = doc.object();
     QJsonArray jsonArray   = jsonObject[QLatin1String("entries")].toArray();
 
-    QList<QPair<QString, QString> > list;
-    list.append(qMakePair(QLatin1String(""), QLatin1String("root")));
-
     foreach (const QJsonValue& value, jsonArray)
     {
         QString path;
@@ -407,12 +458,44 @@ void DBTalker::parseResponseListFolders(const QByteArray& data)
         {
             qCDebug(KIPIPLUGINS_LOG) << "Path is" << path;
             QString name = path.section(QLatin1Char('/'), -1);
-            list.append(qMakePair(path, name));
+            m_folders.append(qMakePair(path, name));
         }
+        else if (folder == QLatin1String("file"))
+        {
+            m_remoteFiles.insert(path);
+        }
+    }
+
+    if (jsonObject[QLatin1String("has_more")].toBool())
+    {
+        QUrl url(QLatin1String("https://api.dropboxapi.com/2/files/list_folder/continue"));
+
+        QNetworkRequest netRequest(url);
+        netRequest.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String(O2_MIME_TYPE_JSON));
+        netRequest.setRawHeader("Authorization", QString::fromLatin1("Bearer %1").arg(m_o2->token()).toUtf8());
+
+        QJsonObject cursor;
+        cursor[QLatin1String("cursor")] = jsonObject[QLatin1String("cursor")].toString();
+
+        m_listPages->fetch(index + 1, netRequest, QJsonDocument(cursor).toJson(QJsonDocument::Compact));
+
+        // Show what we have while the next page is coming.
+        emit signalListAlbumsDone(m_folders);
     }
+}
+
+void DBTalker::slotListFoldersFailed(const QString& msg)
+{
+    emit signalBusy(false);
+    emit signalListAlbumsFailed(msg);
+}
+
+void DBTalker::slotListFoldersDone()
+{
+    m_remoteFilesComplete = true;
 
     emit signalBusy(false);
-    emit signalListAlbumsDone(list);
+    emit signalListAlbumsDone(m_folders);
 }
 
 void DBTalker::parseResponseCreateFolder(const QByteArray& data)
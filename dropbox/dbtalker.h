@@ -27,6 +27,7 @@
 
 #include <QList>
 #include <QPair>
+#include <QSet>
 #include <QString>
 #include <QNetworkReply>
 #include <QNetworkAccessManager>
@@ -42,6 +43,11 @@
 #include "o0globals.h"
 #include "o0settingsstore.h"
 
+namespace KIPIPlugins
+{
+    class KPPageFetcher;
+}
+
 using namespace KIPI;
 
 namespace KIPIDropboxPlugin
@@ -67,6 +73,11 @@ public:
     bool addPhoto(const QString& imgPath, const QString& uploadFolder, bool rescale, int maxDim, int imageQuality);
     void createFolder(const QString& path);
 
+    QString       getAccountId();
+    QString       getLastUploadPath() const;
+    QSet<QString> getRemoteFiles() const;
+    bool          remoteFilesComplete() const;
+
 Q_SIGNALS:
 
     void signalBusy(bool val);
@@ -86,11 +97,13 @@ private Q_SLOTS:
     void slotLinkingSucceeded();
     void slotOpenBrowser(const QUrl& url); 
     void slotFinished(QNetworkReply* reply);
+    void slotListFoldersPage(int index, const QByteArray& data);
+    void slotListFoldersFailed(const QString& msg);
+    void slotListFoldersDone();
 
 private:
 
     void parseResponseUserName(const QByteArray& data);
-    void parseResponseListFolders(const QByteArray& data);
     void parseResponseCreateFolder(const QByteArray& data);
     void parseResponseAddPhoto(const QByteArray& data);
 
@@ -99,7 +112,6 @@ private:
     enum State
     {
         DB_USERNAME = 0,
-        DB_LISTFOLDERS,
         DB_CREATEFOLDER,
         DB_ADDPHOTO
     };
@@ -117,12 +129,19 @@ private:
 
     QNetworkReply*         m_reply;
 
+    KIPIPlugins::KPPageFetcher* m_listPages;
+
     QSettings*             m_settings;
 
     State                  m_state;
 
     QByteArray             m_buffer;
 
+    QString                m_lastUploadPath;
+    QList<QPair<QString, QString> > m_folders;
+    QSet<QString>          m_remoteFiles;
+    bool                   m_remoteFilesComplete;
+
     Interface*             m_iface;
 
     MetadataProcessor*     m_meta;
@@ -29,6 +29,7 @@
 #include <QCheckBox>
 #include <QMessageBox>
 #include <QCloseEvent>
+#include <QStringList>
 
 // KDE includes
 
@@ -48,6 +49,7 @@
 #include "kpimageinfo.h"
 #include "kpversion.h"
 #include "kpprogresswidget.h"
+#include "kpuploadhistory.h"
 #include "dbtalker.h"
 #include "dbitem.h"
 #include "dbalbum.h"
@@ -62,6 +64,8 @@ DBWindow::DBWindow(const QString& tmpFolder, QWidget* const /*parent*/)
     m_tmp         = tmpFolder;
     m_imagesCount = 0;
     m_imagesTotal = 0;
+    m_hashing     = false;
+    m_history     = new KPUploadHistory(QLatin1String("Dropbox"));
 
     m_widget      = new DropboxWidget(this, iface(), QLatin1String("Dropbox"));
     setMainWidget(m_widget);
@@ -74,6 +78,9 @@ DBWindow::DBWindow(const QString& tmpFolder, QWidget* const /*parent*/)
 
     m_widget->setMinimumSize(700, 500);
 
+    connect(m_history, SIGNAL(filesHashed(QStringList)),
+            this, SLOT(slotFilesHashed()));
+
     connect(m_widget->imagesList(), SIGNAL(signalImageListChanged()),
             this, SLOT(slotImageListChanged()));
 
@@ -153,6 +160,7 @@ DBWindow::~DBWindow()
     delete m_widget;
     delete m_albumDlg;
     delete m_talker;
+    delete m_history;
 }
 
 void DBWindow::reactivate()
@@ -228,10 +236,21 @@ void DBWindow::slotListAlbumsDone(const QList<QPair<QString,QString> >& list)
         {
             m_widget->getAlbumsCoB()->setCurrentIndex(i);
         }
+
+        // Forget uploads which were removed from Dropbox since.
+        if (m_talker->remoteFilesComplete())
+        {
+            m_history->reconcileTarget(m_talker->getAccountId(), list.value(i).first, m_talker->getRemoteFiles());
+        }
     }
 
     buttonStateChange(true);
-    m_talker->getUserName();
+
+    // Partial lists are sent while the next pages are fetched.
+    if (m_talker->remoteFilesComplete())
+    {
+        m_talker->getUserName();
+    }
 }
 
 void DBWindow::slotBusy(bool val)
@@ -296,6 +315,27 @@ void DBWindow::slotStartTransfer()
     m_widget->progressBar()->progressThumbnailChanged(
         QIcon(QLatin1String(":/icons/kipi-icon.svg")).pixmap(22, 22));
 
+    // Read the new files on a worker thread, the upload starts in slotFilesHashed().
+
+    QStringList paths;
+
+    foreach (const QUrl& url, m_transferQueue)
+    {
+        paths << url.toLocalFile();
+    }
+
+    m_hashing = true;
+    m_history->hashFiles(paths);
+}
+
+void DBWindow::slotFilesHashed()
+{
+    if (!m_hashing)
+    {
+        return;
+    }
+
+    m_hashing = false;
     uploadNextPhoto();
 }
 
@@ -310,6 +350,22 @@ void DBWindow::uploadNextPhoto()
         return;
     }
 
+    // Skip files already sent to this folder, before preparing anything.
+    while (m_history->isUploaded(m_transferQueue.first().toLocalFile(), m_talker->getAccountId(), m_currentAlbumName))
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "Skipping" << m_transferQueue.first() << "already uploaded";
+        m_widget->imagesList()->removeItemByUrl(m_transferQueue.first());
+        m_transferQueue.pop_front();
+        m_imagesCount++;
+        m_widget->progressBar()->setValue(m_imagesCount);
+
+        if (m_transferQueue.isEmpty())
+        {
+            m_widget->progressBar()->progressCompleted();
+            return;
+        }
+    }
+
     QString imgPath = m_transferQueue.first().toLocalFile();
     QString temp = m_currentAlbumName + QLatin1String("/");
 
@@ -346,6 +402,9 @@ void DBWindow::slotAddPhotoFailed(const QString& msg)
 
 void DBWindow::slotAddPhotoSucceeded()
 {
+    m_history->addUpload(m_transferQueue.first().toLocalFile(), m_talker->getAccountId(),
+                         m_currentAlbumName, m_talker->getLastUploadPath());
+
     // Remove photo uploaded from the list
     m_widget->imagesList()->removeItemByUrl(m_transferQueue.first());
     m_transferQueue.pop_front();
@@ -413,6 +472,7 @@ void DBWindow::slotCreateFolderSucceeded()
 
 void DBWindow::slotTransferCancel()
 {
+    m_hashing = false;
     m_transferQueue.clear();
     m_widget->progressBar()->hide();
     m_talker->cancel();
@@ -48,6 +48,7 @@ namespace KIPI
 namespace KIPIPlugins
 {
     class KPAboutData;
+    class KPUploadHistory;
 }
 
 using namespace KIPI;
@@ -89,6 +90,7 @@ private Q_SLOTS:
     void slotNewAlbumRequest();
     void slotReloadAlbumsRequest();
     void slotStartTransfer();
+    void slotFilesHashed();
 
     void slotBusy(bool);
     void slotSignalLinkingFailed();
@@ -109,11 +111,15 @@ private:
     unsigned int         m_imagesCount;
     unsigned int         m_imagesTotal;
 
+    /// True while the files of m_transferQueue are hashed, before the upload.
+    bool                 m_hashing;
+
     QString              m_tmp;
 
     DropboxWidget*       m_widget;
     DBNewAlbum*          m_albumDlg;
     DBTalker*            m_talker;
+    KPUploadHistory*     m_history;
 
     QString              m_currentAlbumName;
 
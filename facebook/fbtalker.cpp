@@ -53,10 +53,13 @@
 // Local includes
 
 #include "kpversion.h"
+#include "kppagefetcher.h"
 #include "fbitem.h"
 #include "mpform.h"
 #include "kipiplugins_debug.h"
 
+using namespace KIPIPlugins;
+
 namespace KIPIFacebookPlugin
 {
 
@@ -85,11 +88,24 @@ FbTalker::FbTalker(QWidget* const parent)
     m_appID           = QString::fromLatin1("400589753481372");
     m_dialog          = 0;
     m_reply           = 0;
+    m_batchCount      = 0;
 
     m_netMngr         = new QNetworkAccessManager(this);
 
     connect(m_netMngr, SIGNAL(finished(QNetworkReply*)),
             this, SLOT(slotFinished(QNetworkReply*)));
+
+    // Albums are listed in several pages, following the "next" links.
+    m_listPages       = new KPPageFetcher(this);
+
+    connect(m_listPages, SIGNAL(signalPage(int,QByteArray)),
+            this, SLOT(slotListAlbumsPage(int,QByteArray)));
+
+    connect(m_listPages, SIGNAL(signalFailed(QString)),
+            this, SLOT(slotListAlbumsFailed(QString)));
+
+    connect(m_listPages, SIGNAL(signalDone()),
+            this, SLOT(slotListAlbumsDone()));
 }
 
 FbTalker::~FbTalker()
@@ -130,6 +146,8 @@ void FbTalker::cancel()
         m_reply = 0;
     }
 
+    m_listPages->cancel();
+
     emit signalBusy(false);
 }
 
@@ -366,21 +384,63 @@ void FbTalker::getLoggedInUser()
     emit signalBusy(true);
     emit signalLoginProgress(3);
 
-    QUrl url(QString::fromLatin1("https://graph.facebook.com/me"));
-    QUrlQuery q;
-    q.addQueryItem(QString::fromLatin1("access_token"), m_accessToken);
-    q.addQueryItem(QString::fromLatin1("fields"), QString::fromLatin1("id,name,link"));
-    url.setQuery(q);
-
-    QNetworkRequest netRequest(url);
-    netRequest.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/x-www-form-urlencoded"));
+    // The albums are listed right after the login: their first page comes with the user.
+    QJsonArray batch;
+    batch.append(batchRequest(QString::fromLatin1("GET"), QString::fromLatin1("me?fields=id,name,link")));
+    batch.append(batchRequest(QString::fromLatin1("GET"), albumsRequest()));
 
-    m_reply = m_netMngr->get(netRequest);
+    m_albumsPage.clear();
+    postBatch(batch);
 
     m_state = FB_GETLOGGEDINUSER;
+}
+
+/** Relative URL of the first page of the albums of the user.
+ */
+QString FbTalker::albumsRequest() const
+{
+    return QString::fromLatin1("me/albums?fields=id,name,description,privacy,link,location&limit=100");
+}
+
+QJsonObject FbTalker::batchRequest(const QString& method, const QString& relativeUrl, const QString& body) const
+{
+    QJsonObject request;
+    request[QString::fromLatin1("method")]       = method;
+    request[QString::fromLatin1("relative_url")] = relativeUrl;
+
+    if (!body.isEmpty())
+        request[QString::fromLatin1("body")]     = body;
+
+    return request;
+}
+
+/** Send several Graph API requests at once. The response is an array holding
+ *  the response of each request, in order, see batchBody().
+ */
+void FbTalker::postBatch(const QJsonArray& batch)
+{
+    QByteArray postData;
+    postData += "access_token=" + QUrl::toPercentEncoding(m_accessToken);
+    postData += "&include_headers=false";
+    postData += "&batch=" + QUrl::toPercentEncoding(QString::fromUtf8(QJsonDocument(batch).toJson(QJsonDocument::Compact)));
+
+    qCDebug(KIPIPLUGINS_LOG) << "BATCH: " << batch;
+
+    QNetworkRequest netRequest(m_apiURL);
+    netRequest.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/x-www-form-urlencoded"));
+
+    m_reply = m_netMngr->post(netRequest, postData);
     m_buffer.resize(0);
 }
 
+/** Body of the response to the request 'index' of a batch. It is empty if the request
+ *  has not been run, for ex. when the request it depends on failed.
+ */
+QByteArray FbTalker::batchBody(const QJsonArray& batch, int index) const
+{
+    return batch.at(index).toObject()[QString::fromLatin1("body")].toString().toUtf8();
+}
+
 void FbTalker::logout()
 {
     if (m_reply)
@@ -408,28 +468,34 @@ void FbTalker::listAlbums(long long userID)
 {
     qCDebug(KIPIPLUGINS_LOG) << "Requesting albums for user " << userID;
 
-    if (m_reply)
-    {
-        m_reply->abort();
-        m_reply = 0;
-    }
+    m_listPages->cancel();
+    m_albums.clear();
 
     emit signalBusy(true);
 
-    QUrl url(QString::fromLatin1("https://graph.facebook.com/me/albums"));
-    QUrlQuery q;
-    q.addQueryItem(QString::fromLatin1("fields"),
-                     QString::fromLatin1("id,name,description,privacy,link,location"));
+    if (!m_albumsPage.isEmpty())
+    {
+        // Only the next pages have to be requested.
+        const QByteArray page = m_albumsPage;
+        m_albumsPage.clear();
+
+        if (parseAlbumsPage(0, page) && !m_listPages->isRunning())
+        {
+            slotListAlbumsDone();
+        }
+
+        return;
+    }
+
+    QUrl url(m_apiURL.toString() + QLatin1Char('/') + albumsRequest());
+    QUrlQuery q(url);
     q.addQueryItem(QString::fromLatin1("access_token"), m_accessToken);
     url.setQuery(q);
 
     QNetworkRequest netRequest(url);
     netRequest.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/x-www-form-urlencoded"));
 
-    m_reply = m_netMngr->get(netRequest);
-
-    m_state = FB_LISTALBUMS;
-    m_buffer.resize(0);
+    m_listPages->start(netRequest);
 }
 
 void FbTalker::createAlbum(const FbAlbum& album)
@@ -443,7 +509,6 @@ void FbTalker::createAlbum(const FbAlbum& album)
     emit signalBusy(true);
 
     QMap<QString, QString> args;
-    args[QString::fromLatin1("access_token")] = m_accessToken;
     args[QString::fromLatin1("name")]         = album.title;
 
     if (!album.location.isEmpty())
@@ -475,15 +540,24 @@ void FbTalker::createAlbum(const FbAlbum& album)
             break;
     }
 
-    QByteArray tmp(getCallString(args).toUtf8());
+    // The albums are listed again once the album is created: their first page is
+    // requested in the same batch.
+    QJsonObject create = batchRequest(QString::fromLatin1("POST"), QString::fromLatin1("me/albums"),
+                                      getCallString(args));
+    create[QString::fromLatin1("name")]                     = QString::fromLatin1("create");
+    create[QString::fromLatin1("omit_response_on_success")] = false;
 
-    QNetworkRequest netRequest(QUrl(QLatin1String("https://graph.facebook.com/me/albums")));
-    netRequest.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/x-www-form-urlencoded"));
+    QJsonObject list   = batchRequest(QString::fromLatin1("GET"), albumsRequest());
+    list[QString::fromLatin1("depends_on")]                 = QString::fromLatin1("create");
 
-    m_reply = m_netMngr->post(netRequest, tmp);
+    QJsonArray batch;
+    batch.append(create);
+    batch.append(list);
+
+    m_albumsPage.clear();
+    postBatch(batch);
 
     m_state = FB_CREATEALBUM;
-    m_buffer.resize(0);
 }
 
 bool FbTalker::addPhoto(const QString& imgPath, const QString& albumID, const QString& caption)
@@ -530,7 +604,70 @@ bool FbTalker::addPhoto(const QString& imgPath, const QString& albumID, const QS
 
     m_reply = m_netMngr->post(netRequest, form.formData());
 
-    m_state = FB_ADDPHOTO;
+    m_state      = FB_ADDPHOTO;
+    m_batchCount = 0;
+    m_buffer.resize(0);
+    return true;
+}
+
+bool FbTalker::addPhotos(const QStringList& imgPaths, const QString& albumID, const QStringList& captions)
+{
+    if (imgPaths.count() == 1)
+    {
+        return addPhoto(imgPaths.first(), albumID, captions.value(0));
+    }
+
+    qCDebug(KIPIPLUGINS_LOG) << "Adding " << imgPaths.count() << " photos to album with id " << albumID;
+
+    if (m_reply)
+    {
+        m_reply->abort();
+        m_reply = 0;
+    }
+
+    emit signalBusy(true);
+
+    // Each photo of the batch refers to its file, attached to the form.
+    const QString relativeUrl = (albumID.isEmpty() ? QString::fromLatin1("me") : albumID) +
+                                QString::fromLatin1("/photos");
+    QJsonArray batch;
+
+    for (int i = 0 ; i < imgPaths.count() ; ++i)
+    {
+        QString body;
+
+        if (!captions.value(i).isEmpty())
+            body = QString::fromLatin1("message=") + QString::fromLatin1(QUrl::toPercentEncoding(captions.at(i)));
+
+        QJsonObject request = batchRequest(QString::fromLatin1("POST"), relativeUrl, body);
+        request[QString::fromLatin1("attached_files")] = QString::fromLatin1("file%1").arg(i);
+        batch.append(request);
+    }
+
+    MPForm form;
+    form.addPair(QString::fromLatin1("access_token"),    m_accessToken);
+    form.addPair(QString::fromLatin1("include_headers"), QString::fromLatin1("false"));
+    form.addPair(QString::fromLatin1("batch"),           QString::fromUtf8(QJsonDocument(batch).toJson(QJsonDocument::Compact)));
+
+    for (int i = 0 ; i < imgPaths.count() ; ++i)
+    {
+        if (!form.addFile(QUrl::fromLocalFile(imgPaths.at(i)).fileName(), imgPaths.at(i),
+                          QString::fromLatin1("file%1").arg(i)))
+        {
+            emit signalBusy(false);
+            return false;
+        }
+    }
+
+    form.finish();
+
+    QNetworkRequest netRequest(m_apiURL);
+    netRequest.setHeader(QNetworkRequest::ContentTypeHeader, form.contentType());
+
+    m_reply = m_netMngr->post(netRequest, form.formData());
+
+    m_state      = FB_ADDPHOTO;
+    m_batchCount = imgPaths.count();
     m_buffer.resize(0);
     return true;
 }
@@ -591,8 +728,13 @@ void FbTalker::slotFinished(QNetworkReply* reply)
         }
         else if (m_state == FB_ADDPHOTO)
         {
+            const int count = qMax(1, m_batchCount);
             emit signalBusy(false);
-            emit signalAddPhotoDone(reply->error(), reply->errorString());
+
+            for (int i = 0 ; i < count ; ++i)
+            {
+                emit signalAddPhotoDone(reply->error(), reply->errorString());
+            }
         }
         else
         {
@@ -615,14 +757,14 @@ void FbTalker::slotFinished(QNetworkReply* reply)
         case (FB_GETLOGGEDINUSER):
             parseResponseGetLoggedInUser(m_buffer);
             break;
-        case (FB_LISTALBUMS):
-            parseResponseListAlbums(m_buffer);
-            break;
         case (FB_CREATEALBUM):
             parseResponseCreateAlbum(m_buffer);
             break;
         case (FB_ADDPHOTO):
-            parseResponseAddPhoto(m_buffer);
+            if (m_batchCount)
+                parseResponseAddPhotos(m_buffer);
+            else
+                parseResponseAddPhoto(m_buffer);
             break;
     }
 
@@ -713,7 +855,15 @@ void FbTalker::parseResponseGetLoggedInUser(const QByteArray& data)
         return;
     }
 
-    QJsonObject jsonObject = doc.object();
+    // Batch of the user and of the first page of its albums, see getLoggedInUser().
+    QJsonObject jsonObject = doc.isArray() ? QJsonDocument::fromJson(batchBody(doc.array(), 0)).object()
+                                           : doc.object();
+
+    if (doc.isArray())
+    {
+        m_albumsPage = batchBody(doc.array(), 1);
+    }
+
     m_user.id = jsonObject[QString::fromLatin1("id")].toString().toLongLong();
 
     if (!(QString::compare(jsonObject[QString::fromLatin1("id")].toString(),
@@ -771,6 +921,50 @@ void FbTalker::parseResponseAddPhoto(const QByteArray& data)
     emit signalAddPhotoDone(errCode, errorToText(errCode, errMsg));
 }
 
+void FbTalker::parseResponseAddPhotos(const QByteArray& data)
+{
+    qCDebug(KIPIPLUGINS_LOG) <<"Parse Add Photos data is "<<data;
+    const int count   = m_batchCount;
+    QJsonParseError err;
+    QJsonDocument doc = QJsonDocument::fromJson(data, &err);
+    QList<int>  errCodes;
+    QStringList errMsgs;
+
+    for (int i = 0 ; i < count ; ++i)
+    {
+        int errCode = -1;
+        QString errMsg;
+
+        // The whole batch fails with an error object, else each photo has its response.
+        QJsonObject jsonObject = doc.isArray() ? QJsonDocument::fromJson(batchBody(doc.array(), i)).object()
+                                               : doc.object();
+
+        if(jsonObject.contains(QString::fromLatin1("id")))
+        {
+            qCDebug(KIPIPLUGINS_LOG) << "Id of photo exported is" << jsonObject[QString::fromLatin1("id")].toString();
+            errCode = 0;
+        }
+
+        if(jsonObject.contains(QString::fromLatin1("error")))
+        {
+            QJsonObject obj = jsonObject[QString::fromLatin1("error")].toObject();
+            errCode = obj[QString::fromLatin1("code")].toInt();
+            errMsg  = obj[QString::fromLatin1("message")].toString();
+        }
+
+        errCodes << errCode;
+        errMsgs  << errorToText(errCode, errMsg);
+    }
+
+    // The next photos can be sent from the slots: the results are all collected first.
+    emit signalBusy(false);
+
+    for (int i = 0 ; i < count ; ++i)
+    {
+        emit signalAddPhotoDone(errCodes.at(i), errMsgs.at(i));
+    }
+}
+
 void FbTalker::parseResponseCreateAlbum(const QByteArray& data)
 {
     qCDebug(KIPIPLUGINS_LOG) <<"Parse Create album data is"<<data;
@@ -786,7 +980,9 @@ void FbTalker::parseResponseCreateAlbum(const QByteArray& data)
         return;
     }
 
-    QJsonObject jsonObject = doc.object();
+    // Batch of the new album and of the first page of the albums, see createAlbum().
+    QJsonObject jsonObject = doc.isArray() ? QJsonDocument::fromJson(batchBody(doc.array(), 0)).object()
+                                           : doc.object();
 
     if(jsonObject.contains(QString::fromLatin1("id")))
     {
@@ -802,23 +998,30 @@ void FbTalker::parseResponseCreateAlbum(const QByteArray& data)
         errMsg  = obj[QString::fromLatin1("message")].toString();
     }
 
+    if (errCode == 0 && doc.isArray())
+    {
+        m_albumsPage = batchBody(doc.array(), 1);
+    }
+
     emit signalBusy(false);
     emit signalCreateAlbumDone(errCode, errorToText(errCode, errMsg),
                                newAlbumID);
 }
 
-void FbTalker::parseResponseListAlbums(const QByteArray& data)
+/** Parse one page of the albums. The albums found so far are sent to the window,
+ *  and the next page is requested while there is one. Return false on error.
+ */
+bool FbTalker::parseAlbumsPage(int index, const QByteArray& data)
 {
     int errCode = -1;
     QString errMsg;
     QJsonParseError err;
-    QList <FbAlbum> albumsList;
     QJsonDocument doc = QJsonDocument::fromJson(data, &err);
 
     if(err.error != QJsonParseError::NoError)
     {
-        emit signalBusy(false);
-        return;
+        slotListAlbumsFailed(i18n("Failed to list albums"));
+        return false;
     }
 
     QJsonObject jsonObject = doc.object();
@@ -851,7 +1054,7 @@ void FbTalker::parseResponseListAlbums(const QByteArray& data)
                 album.privacy = FB_EVERYONE;
             }
 
-            albumsList.append(album);
+            m_albums.append(album);
         }
         errCode = 0;
     }
@@ -863,11 +1066,52 @@ void FbTalker::parseResponseListAlbums(const QByteArray& data)
         errMsg  = obj[QString::fromLatin1("message")].toString();
     }
 
+    if (errCode != 0)
+    {
+        slotListAlbumsFailed(errorToText(errCode, errMsg));
+        return false;
+    }
+
+    const QString next = jsonObject[QString::fromLatin1("paging")].toObject()
+                                   [QString::fromLatin1("next")].toString();
+
+    if (!next.isEmpty())
+    {
+        QNetworkRequest netRequest((QUrl(next)));
+        netRequest.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/x-www-form-urlencoded"));
+
+        m_listPages->fetch(index + 1, netRequest);
+
+        // Show what we have while the next page is coming.
+        QList<FbAlbum> albumsList = m_albums;
+        std::sort(albumsList.begin(), albumsList.end());
+
+        emit signalListAlbumsDone(0, QString(), albumsList);
+    }
+
+    return true;
+}
+
+void FbTalker::slotListAlbumsPage(int index, const QByteArray& data)
+{
+    parseAlbumsPage(index, data);
+}
+
+void FbTalker::slotListAlbumsFailed(const QString& errMsg)
+{
+    m_listPages->cancel();
+
+    emit signalBusy(false);
+    emit signalListAlbumsDone(-1, errMsg, QList<FbAlbum>());
+}
+
+void FbTalker::slotListAlbumsDone()
+{
+    QList<FbAlbum> albumsList = m_albums;
     std::sort(albumsList.begin(), albumsList.end());
 
     emit signalBusy(false);
-    emit signalListAlbumsDone(errCode, errorToText(errCode, errMsg),
-                              albumsList);
+    emit signalListAlbumsDone(0, QString(), albumsList);
 }
 
 void FbTalker::slotAccept()
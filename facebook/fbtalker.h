@@ -32,6 +32,9 @@
 #include <QUrl>
 #include <QNetworkReply>
 #include <QNetworkAccessManager>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QStringList>
 
 // local includes
 
@@ -40,6 +43,11 @@
 class QDomElement;
 class QDialog;
 
+namespace KIPIPlugins
+{
+    class KPPageFetcher;
+}
+
 namespace KIPIFacebookPlugin
 {
 
@@ -63,6 +71,9 @@ public:
     void    exchangeSession(const QString& sessionKey);
     void    logout();
 
+    /** List the albums page by page. signalListAlbumsDone() is emitted with the albums
+     *  found so far for each page, and with all albums when the listing is complete.
+     */
     void    listAlbums(long long userID = 0);
 
     void    createAlbum(const FbAlbum& album);
@@ -70,6 +81,12 @@ public:
     bool    addPhoto(const QString& imgPath, const QString& albumID,
                      const QString& caption);
 
+    /** Upload several photos with one batch request. signalAddPhotoDone() is emitted
+     *  for each photo, in order.
+     */
+    bool    addPhotos(const QStringList& imgPaths, const QString& albumID,
+                      const QStringList& captions);
+
 Q_SIGNALS:
 
     void signalBusy(bool val);
@@ -84,7 +101,6 @@ private:
     enum State
     {
         FB_GETLOGGEDINUSER = 0,
-        FB_LISTALBUMS,
         FB_CREATEALBUM,
         FB_ADDPHOTO,
         FB_EXCHANGESESSION
@@ -98,17 +114,27 @@ private:
     void    doOAuth();
     void    getLoggedInUser();
 
+    QString    albumsRequest() const;
+    QJsonObject batchRequest(const QString& method, const QString& relativeUrl,
+                             const QString& body = QString()) const;
+    void       postBatch(const QJsonArray& batch);
+    QByteArray batchBody(const QJsonArray& batch, int index) const;
+    bool       parseAlbumsPage(int index, const QByteArray& data);
+
     QString errorToText(int errCode, const QString& errMsg);
     int parseErrorResponse(const QDomElement& e, QString& errMsg);
     void parseExchangeSession(const QByteArray& data);
     void parseResponseGetLoggedInUser(const QByteArray& data);
     void parseResponseAddPhoto(const QByteArray& data);
+    void parseResponseAddPhotos(const QByteArray& data);
     void parseResponseCreateAlbum(const QByteArray& data);
-    void parseResponseListAlbums(const QByteArray& data);
 
 private Q_SLOTS:
 
     void slotFinished(QNetworkReply* reply);
+    void slotListAlbumsPage(int index, const QByteArray& data);
+    void slotListAlbumsFailed(const QString& errMsg);
+    void slotListAlbumsDone();
     void slotAccept();
     void slotReject();
 
@@ -140,6 +166,15 @@ private:
     QNetworkReply*         m_reply;
 
     State                  m_state;
+
+    /// Photos of the batch being uploaded, 0 for a single photo.
+    int                    m_batchCount;
+
+    KIPIPlugins::KPPageFetcher* m_listPages;
+    QList<FbAlbum>         m_albums;
+
+    /// First page of the albums, received with the user or with a new album.
+    QByteArray             m_albumsPage;
 };
 
 } // namespace KIPIFacebookPlugin
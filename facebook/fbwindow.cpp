@@ -35,6 +35,9 @@
 #include <QSpinBox>
 #include <QMessageBox>
 #include <QPointer>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QtConcurrentRun>
 
 // KDE includes
 
@@ -45,6 +48,7 @@
 // Libkipi includes
 
 #include <KIPI/Interface>
+#include <KIPI/PluginLoader>
 
 // Local includes
 
@@ -53,6 +57,7 @@
 #include "kpaboutdata.h"
 #include "kpimageinfo.h"
 #include "kpversion.h"
+#include "kputil.h"
 #include "kpprogresswidget.h"
 #include "fbitem.h"
 #include "fbtalker.h"
@@ -62,6 +67,151 @@
 namespace KIPIFacebookPlugin
 {
 
+/// Number of images prepared ahead of the upload.
+static const int    s_prepareAhead  = 4;
+
+/// Maximum number of images sent in one batch request, and their maximum total size.
+static const int    s_maxBatchCount = 4;
+static const qint64 s_maxBatchSize  = 8 * 1024 * 1024;
+
+/** An image ready to be uploaded.
+ */
+class FbPreparedPhoto
+{
+public:
+
+    FbPreparedPhoto()
+    {
+        temporary = false;
+        saved     = false;
+        maxDim    = 0;
+        quality   = 0;
+        size      = 0;
+    }
+
+    QUrl    url;
+    QString path;       // file to upload, empty if the image cannot be read
+    QString caption;
+    bool    temporary;  // path is a scaled copy, removed once uploaded
+    bool    saved;      // the scaled copy is written, without its metadata yet
+    int     maxDim;
+    int     quality;
+    QSize   imageSize;
+    qint64  size;
+};
+
+/** Write the scaled copy of 'photo'.
+ */
+static bool saveImageForUpload(FbPreparedPhoto& photo, const QImage& image)
+{
+    qCDebug(KIPIPLUGINS_LOG) << "Saving to temp file: " << photo.path;
+
+    if (!image.save(photo.path, "JPEG", photo.quality))
+    {
+        QFile::remove(photo.path);
+        photo.path.clear();
+        return false;
+    }
+
+    photo.imageSize = image.size();
+    photo.saved     = true;
+    return true;
+}
+
+/** Scale the image of 'photo' to its temporary file. This runs on a worker thread,
+ *  while the previous images are uploaded: only QImageReader is used here, the host
+ *  interface is left to completeImageForUpload().
+ */
+static FbPreparedPhoto prepareImageForUpload(FbPreparedPhoto photo)
+{
+    const QString imgPath = photo.url.toLocalFile();
+
+    if (!photo.temporary)
+    {
+        const QFileInfo info(imgPath);
+
+        if (info.isReadable())
+            photo.size = info.size();
+        else
+            photo.path.clear();
+
+        return photo;
+    }
+
+    const QImage image = loadScaledImage(imgPath, photo.maxDim);
+
+    if (!image.isNull())
+    {
+        saveImageForUpload(photo, image);
+    }
+
+    return photo;
+}
+
+/** End the preparation of 'photo' on the GUI thread: the images QImageReader cannot
+ *  read are taken from the host preview, and the metadata are copied to the scaled image.
+ */
+static void completeImageForUpload(FbPreparedPhoto& photo)
+{
+    if (!photo.temporary || photo.path.isEmpty())
+    {
+        return;
+    }
+
+    PluginLoader* const pl = PluginLoader::instance();
+    Interface* const iface = pl ? pl->interface() : 0;
+
+    if (!photo.saved)
+    {
+        QImage image;
+
+        if (iface)
+        {
+            image = iface->preview(photo.url);
+        }
+
+        if (image.isNull())
+        {
+            photo.path.clear();
+            return;
+        }
+
+        // rescale image if requested
+        if (image.width() > photo.maxDim || image.height() > photo.maxDim)
+        {
+            qCDebug(KIPIPLUGINS_LOG) << "Resizing to " << photo.maxDim;
+            image = image.scaled(photo.maxDim, photo.maxDim, Qt::KeepAspectRatio,
+                                 Qt::SmoothTransformation);
+        }
+
+        if (!saveImageForUpload(photo, image))
+        {
+            return;
+        }
+    }
+
+    // copy meta data to temporary image
+
+    if (iface)
+    {
+        QPointer<MetadataProcessor> meta = iface->createMetadataProcessor();
+
+        if (meta && meta->load(photo.url))
+        {
+            meta->setImageDimensions(photo.imageSize);
+            meta->setImageOrientation(MetadataProcessor::NORMAL);
+            meta->setImageProgramId(QString::fromLatin1("Kipi-plugins"), kipipluginsVersion());
+            meta->save(QUrl::fromLocalFile(photo.path), true);
+        }
+
+        delete meta;
+    }
+
+    photo.size = QFileInfo(photo.path).size();
+}
+
+// -----------------------------------------------------------------------------
+
 class FbWindow::Private
 {
 public:
@@ -78,6 +228,7 @@ public:
         m_resizeChB       = m_widget->getResizeCheckBox();
         m_dimensionSpB    = m_widget->getDimensionSpB();
         m_imageQualitySpB = m_widget->getImgQualitySpB();
+        m_tmpIndex        = 0;
     }
 
     FbWidget*                      m_widget;
@@ -90,6 +241,14 @@ public:
     QSpinBox*                      m_dimensionSpB;
     QSpinBox*                      m_imageQualitySpB;
     KPProgressWidget*              m_progressBar;
+
+    /// Images being prepared, in upload order, and images of the batch being uploaded.
+    QList<QFutureWatcher<FbPreparedPhoto>*> m_preparing;
+    QHash<QFutureWatcher<FbPreparedPhoto>*, FbPreparedPhoto> m_prepared;   // completed, see slotPhotoPrepared()
+    QList<FbPreparedPhoto>         m_uploading;
+
+    /// Makes the temporary files of images with the same name different.
+    int                            m_tmpIndex;
 };
 
 
@@ -97,7 +256,6 @@ FbWindow::FbWindow(const QString& tmpFolder, QWidget* const /*parent*/)
     : KPToolDialog(0),
       d(new Private(this, iface()))
 {
-    m_tmpPath.clear();
     m_tmpDir      = tmpFolder;
     m_imagesCount = 0;
     m_imagesTotal = 0;
@@ -219,7 +377,7 @@ void FbWindow::slotCancelClicked()
 {
     setRejectButtonMode(QDialogButtonBox::Close);
     m_talker->cancel();
-    m_transferQueue.clear();
+    stopTransfer();
     d->m_imgList->cancelProcess();
     d->m_progressBar->hide();
     d->m_progressBar->progressCompleted();
@@ -391,6 +549,10 @@ void FbWindow::slotListAlbumsDone(int errCode, const QString& errMsg, const QLis
         return;
     }
 
+    // The list is received in several parts: keep the album selected meanwhile.
+    const QString selectedID = (d->m_albumsCoB->currentIndex() > 0) ? d->m_albumsCoB->currentData().toString()
+                                                                     : m_currentAlbumID;
+
     d->m_albumsCoB->clear();
     d->m_albumsCoB->addItem(i18n("<auto create>"), QString());
 
@@ -430,7 +592,7 @@ void FbWindow::slotListAlbumsDone(int errCode, const QString& errMsg, const QLis
             albumsList.at(i).title,
             albumsList.at(i).id);
 
-        if (m_currentAlbumID == albumsList.at(i).id)
+        if (selectedID == albumsList.at(i).id)
         {
             d->m_albumsCoB->setCurrentIndex(i + 1);
         }
@@ -522,6 +684,7 @@ void FbWindow::slotStartTransfer()
 {
     qCDebug(KIPIPLUGINS_LOG) << "slotStartTransfer invoked";
 
+    stopTransfer();
     d->m_imgList->clearProcessedStatus();
     m_transferQueue  = d->m_imgList->imageUrls();
 
@@ -543,7 +706,7 @@ void FbWindow::slotStartTransfer()
     d->m_progressBar->progressScheduled(i18n("Facebook export"), true, true);
     d->m_progressBar->progressThumbnailChanged(QIcon(QLatin1String(":/icons/kipi-icon.svg")).pixmap(22, 22));
 
-    uploadNextPhoto();
+    prepareNextPhotos();
 }
 
 void FbWindow::setProfileAID(long long userID)
@@ -563,122 +726,198 @@ QString FbWindow::getImageCaption(const QString& fileName)
     return descriptions.join(QString::fromLatin1("\n\n"));
 }
 
-bool FbWindow::prepareImageForUpload(const QString& imgPath, QString& caption)
+void FbWindow::prepareNextPhotos()
 {
-    QImage image;
-
-    if (iface())
+    while (d->m_preparing.count() < s_prepareAhead && !m_transferQueue.isEmpty())
     {
-        image = iface()->preview(QUrl::fromLocalFile(imgPath));
-    }
+        FbPreparedPhoto photo;
+        photo.url     = m_transferQueue.takeFirst();
+        photo.caption = getImageCaption(photo.url.toLocalFile());
 
-    if (image.isNull())
-    {
-        image.load(imgPath);
+        if (d->m_resizeChB->isChecked())
+        {
+            // get temporary file name
+            photo.path      = m_tmpDir + QString::number(d->m_tmpIndex++) + QLatin1Char('_') +
+                              QFileInfo(photo.url.toLocalFile()).baseName().trimmed() + QString::fromLatin1(".jpg");
+            photo.temporary = true;
+            photo.maxDim    = d->m_dimensionSpB->value();
+            photo.quality   = d->m_imageQualitySpB->value();
+        }
+        else
+        {
+            photo.path      = photo.url.toLocalFile();
+        }
+
+        QFutureWatcher<FbPreparedPhoto>* const watcher = new QFutureWatcher<FbPreparedPhoto>(this);
+
+        connect(watcher, SIGNAL(finished()),
+                this, SLOT(slotPhotoPrepared()));
+
+        watcher->setFuture(QtConcurrent::run(prepareImageForUpload, photo));
+        d->m_preparing << watcher;
     }
+}
+
+void FbWindow::slotPhotoPrepared()
+{
+    QFutureWatcher<FbPreparedPhoto>* const watcher = static_cast<QFutureWatcher<FbPreparedPhoto>*>(sender());
 
-    if (image.isNull())
+    if (!d->m_preparing.contains(watcher))
     {
-        return false;
+        return;
     }
 
-    // get temporary file name
-    m_tmpPath = m_tmpDir + QFileInfo(imgPath).baseName().trimmed() + QString::fromLatin1(".jpg");
+    FbPreparedPhoto photo = watcher->result();
+    completeImageForUpload(photo);
+    d->m_prepared.insert(watcher, photo);
 
-    // rescale image if requested
-    int maxDim = d->m_dimensionSpB->value();
+    uploadNextPhotos();
+}
+
+void FbWindow::slotDiscardPreparedPhoto()
+{
+    QFutureWatcher<FbPreparedPhoto>* const watcher = static_cast<QFutureWatcher<FbPreparedPhoto>*>(sender());
 
-    if (d->m_resizeChB->isChecked()
-        && (image.width() > maxDim || image.height() > maxDim))
+    if (watcher->result().temporary)
     {
-        qCDebug(KIPIPLUGINS_LOG) << "Resizing to " << maxDim;
-        image = image.scaled(maxDim, maxDim, Qt::KeepAspectRatio,
-                             Qt::SmoothTransformation);
+        QFile::remove(watcher->result().path);
     }
 
-    qCDebug(KIPIPLUGINS_LOG) << "Saving to temp file: " << m_tmpPath;
-    image.save(m_tmpPath, "JPEG", d->m_imageQualitySpB->value());
+    watcher->deleteLater();
+}
+
+void FbWindow::uploadNextPhotos()
+{
+    // One batch is uploaded at a time.
+    if (!d->m_uploading.isEmpty())
+    {
+        return;
+    }
 
-    // copy meta data to temporary image
+    // The images prepared, in order, go in the next batch.
+    QStringList paths;
+    QStringList captions;
+    qint64      size = 0;
 
-    if (iface())
+    while (!d->m_preparing.isEmpty() && d->m_prepared.contains(d->m_preparing.first()))
     {
-        QPointer<MetadataProcessor> meta = iface()->createMetadataProcessor();
+        const FbPreparedPhoto photo = d->m_prepared.value(d->m_preparing.first());
 
-        if (meta && meta->load(QUrl::fromLocalFile(imgPath)))
+        if (!paths.isEmpty() &&
+            (photo.path.isEmpty() || paths.count() >= s_maxBatchCount || size + photo.size > s_maxBatchSize))
         {
-            caption = getImageCaption(imgPath);
-            meta->setImageDimensions(image.size());
-            meta->setImageOrientation(MetadataProcessor::NORMAL);
-            meta->setImageProgramId(QString::fromLatin1("Kipi-plugins"), kipipluginsVersion());
-            meta->save(QUrl::fromLocalFile(m_tmpPath), true);
+            break;
         }
-        else
+
+        d->m_prepared.remove(d->m_preparing.first());
+        d->m_preparing.takeFirst()->deleteLater();
+        d->m_uploading << photo;
+
+        if (photo.path.isEmpty())
         {
-            caption.clear();
+            prepareNextPhotos();
+            slotAddPhotoDone(666, i18n("Cannot open file"));
+            return;
         }
+
+        paths    << photo.path;
+        captions << photo.caption;
+        size     += photo.size;
     }
 
-    return true;
-}
+    prepareNextPhotos();
 
-void FbWindow::uploadNextPhoto()
-{
-    if (m_transferQueue.isEmpty())
+    if (d->m_uploading.isEmpty())
     {
-        setRejectButtonMode(QDialogButtonBox::Close);
-        d->m_progressBar->hide();
-        d->m_progressBar->progressCompleted();
+        if (d->m_preparing.isEmpty())
+        {
+            setRejectButtonMode(QDialogButtonBox::Close);
+            d->m_progressBar->hide();
+            d->m_progressBar->progressCompleted();
+        }
+
+        // else wait for the next image to be prepared.
         return;
     }
 
-    d->m_imgList->processing(m_transferQueue.first());
-    QString imgPath = m_transferQueue.first().toLocalFile();
+    foreach (const FbPreparedPhoto& photo, d->m_uploading)
+    {
+        d->m_imgList->processing(photo.url);
+    }
 
     d->m_progressBar->setMaximum(m_imagesTotal);
     d->m_progressBar->setValue(m_imagesCount);
 
-    QString caption;
-    bool    res;
-
-    if (d->m_resizeChB->isChecked())
+    if (!m_talker->addPhotos(paths, m_currentAlbumID, captions))
     {
-        if (!prepareImageForUpload(imgPath, caption))
+        const int count = d->m_uploading.count();
+
+        for (int i = 0 ; i < count && !d->m_uploading.isEmpty() ; ++i)
         {
             slotAddPhotoDone(666, i18n("Cannot open file"));
-            return;
         }
-
-        res = m_talker->addPhoto(m_tmpPath, m_currentAlbumID, caption);
     }
-    else
+}
+
+void FbWindow::stopTransfer()
+{
+    m_transferQueue.clear();
+
+    foreach (QFutureWatcher<FbPreparedPhoto>* const watcher, d->m_preparing)
     {
-        caption = getImageCaption(imgPath);
-        m_tmpPath.clear();
-        res     = m_talker->addPhoto(imgPath, m_currentAlbumID, caption);
+        watcher->disconnect(this);
+
+        if (watcher->isFinished())
+        {
+            if (watcher->result().temporary)
+            {
+                QFile::remove(watcher->result().path);
+            }
+
+            watcher->deleteLater();
+        }
+        else
+        {
+            // The image is removed once it is written.
+            connect(watcher, SIGNAL(finished()),
+                    this, SLOT(slotDiscardPreparedPhoto()));
+        }
     }
 
-    if (!res)
+    d->m_preparing.clear();
+    d->m_prepared.clear();
+
+    foreach (const FbPreparedPhoto& photo, d->m_uploading)
     {
-        slotAddPhotoDone(666, i18n("Cannot open file"));
-        return;
+        if (photo.temporary)
+        {
+            QFile::remove(photo.path);
+        }
     }
+
+    d->m_uploading.clear();
 }
 
 void FbWindow::slotAddPhotoDone(int errCode, const QString& errMsg)
 {
+    // The transfer has been cancelled.
+    if (d->m_uploading.isEmpty())
+    {
+        return;
+    }
+
+    const FbPreparedPhoto photo = d->m_uploading.first();
+
     // Remove temporary file if it was used
-    if (!m_tmpPath.isEmpty())
+    if (photo.temporary)
     {
-        QFile::remove(m_tmpPath);
-        m_tmpPath.clear();
+        QFile::remove(photo.path);
     }
 
-    d->m_imgList->processed(m_transferQueue.first(), (errCode == 0));
+    d->m_imgList->processed(photo.url, (errCode == 0));
 
     if (errCode == 0)
     {
-        m_transferQueue.pop_front();
         m_imagesCount++;
     }
     else
@@ -691,12 +930,18 @@ void FbWindow::slotAddPhotoDone(int errCode, const QString& errMsg)
             setRejectButtonMode(QDialogButtonBox::Close);
             d->m_progressBar->hide();
             d->m_progressBar->progressCompleted();
-            m_transferQueue.clear();
+            stopTransfer();
             return;
         }
+
+        // Try again: the image is prepared again before the next ones.
+        m_transferQueue.prepend(photo.url);
     }
 
-    uploadNextPhoto();
+    d->m_uploading.removeFirst();
+    d->m_progressBar->setValue(m_imagesCount);
+
+    uploadNextPhotos();
 }
 
 void FbWindow::slotCreateAlbumDone(int errCode, const QString& errMsg, const QString& newAlbumID)
@@ -709,6 +954,7 @@ void FbWindow::slotCreateAlbumDone(int errCode, const QString& errMsg, const QSt
 
     // reload album list and automatically select new album
     m_currentAlbumID = newAlbumID;
+    d->m_albumsCoB->setCurrentIndex(0);
     m_talker->listAlbums();
 }
 
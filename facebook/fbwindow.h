@@ -99,14 +99,17 @@ private Q_SLOTS:
 
     void slotFinished();
     void slotCancelClicked();
+    void slotPhotoPrepared();
+    void slotDiscardPreparedPhoto();
 
 private:
 
     void    setProfileAID(long long userID);
     QString getImageCaption(const QString& fileName);
-    bool    prepareImageForUpload(const QString& imgPath, QString& caption);
 
-    void    uploadNextPhoto();
+    void    prepareNextPhotos();
+    void    uploadNextPhotos();
+    void    stopTransfer();
 
     void    readSettings();
     void    writeSettings();
@@ -122,7 +125,6 @@ private:
     unsigned int m_imagesCount;
     unsigned int m_imagesTotal;
     QString      m_tmpDir;
-    QString      m_tmpPath;
 
     QString      m_profileAID;
     QString      m_currentAlbumID;
@@ -133,7 +135,7 @@ private:
     unsigned int m_sessionExpires;
     QString      m_accessToken;            // OAuth access token
 
-    QList<QUrl>  m_transferQueue;
+    QList<QUrl>  m_transferQueue;          // images not prepared yet
 
     FbTalker*    m_talker;
     FbNewAlbum*  m_albumDlg;
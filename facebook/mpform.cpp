@@ -92,7 +92,7 @@ void MPForm::addPair(const QString& name, const QString& value)
     m_buffer.append(str);
 }
 
-bool MPForm::addFile(const QString& name, const QString& path)
+bool MPForm::addFile(const QString& name, const QString& path, const QString& fieldName)
 {
     QMimeDatabase db;
     QMimeType ptr = db.mimeTypeForUrl(QUrl::fromLocalFile(path));
@@ -115,7 +115,16 @@ bool MPForm::addFile(const QString& name, const QString& path)
     str += "--";
     str += m_boundary;
     str += "\r\n";
-    str += "Content-Disposition: form-data; filename=\"";
+    str += "Content-Disposition: form-data; ";
+
+    if (!fieldName.isEmpty())
+    {
+        str += "name=\"";
+        str += fieldName.toLatin1();
+        str += "\"; ";
+    }
+
+    str += "filename=\"";
     str += QFile::encodeName(name);
     str += "\"\r\n";
     //str += "Content-Length: ";
@@ -45,7 +45,10 @@ public:
     void reset();
 
     void addPair(const QString& name, const QString& value);
-    bool addFile(const QString& name, const QString& path);
+    /** Add the file 'path' named 'name'. With a 'fieldName', the file can be referred
+     *  to by this name, as by the attached_files of a batch request.
+     */
+    bool addFile(const QString& name, const QString& path, const QString& fieldName = QString());
 
     QString    contentType() const;
     QByteArray formData()    const;
@@ -32,6 +32,7 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QImage>
+#include <QImageReader>
 #include <QMap>
 #include <QStringList>
 #include <QProgressDialog>
@@ -72,6 +73,12 @@ FlickrTalker::FlickrTalker(QWidget* const parent, const QString& serviceName)
     m_o1              = 0;
     m_store           = 0;
     m_requestor       = 0;
+    m_limiter         = new KPRateLimiter();
+    m_photoSetLimiter = new KPRateLimiter();
+    m_listingCache    = new KPListingCache(serviceName);
+    m_photoSetsCached = false;
+    m_photoSetsFound  = false;
+    m_photoSetReply   = 0;
 
     PluginLoader* const pl = PluginLoader::instance();
 
@@ -138,6 +145,18 @@ FlickrTalker::FlickrTalker(QWidget* const parent, const QString& serviceName)
             this, SLOT(slotOpenBrowser(QUrl)));
 
     m_requestor = new O1Requestor(m_netMngr, m_o1, this);
+
+    m_retryTimer = new QTimer(this);
+    m_retryTimer->setSingleShot(true);
+
+    connect(m_retryTimer, SIGNAL(timeout()),
+            this, SLOT(slotSendRequest()));
+
+    m_photoSetTimer = new QTimer(this);
+    m_photoSetTimer->setSingleShot(true);
+
+    connect(m_photoSetTimer, SIGNAL(timeout()),
+            this, SLOT(slotSendPhotoSetRequest()));
 }
 
 FlickrTalker::~FlickrTalker()
@@ -147,7 +166,17 @@ FlickrTalker::~FlickrTalker()
         m_reply->abort();
     }
 
+    if (m_photoSetReply)
+    {
+        QNetworkReply* const reply = m_photoSetReply;
+        m_photoSetReply            = 0;
+        reply->abort();
+    }
+
     delete m_photoSetsList;
+    delete m_limiter;
+    delete m_photoSetLimiter;
+    delete m_listingCache;
 
     removeTemporaryDir(m_serviceName.toLatin1().constData());
 }
@@ -177,6 +206,9 @@ void FlickrTalker::removeUserName(const QString& userName)
 {
     if (userName.startsWith(m_serviceName))
     {
+        // The store writes its values later: flush them before the group is removed.
+        m_store->sync();
+
         m_settings->beginGroup(userName);
         m_settings->remove(QString());
         m_settings->endGroup();
@@ -206,6 +238,9 @@ void FlickrTalker::slotLinkingSucceeded()
 
     if (m_store->groupKey() == m_serviceName)
     {
+        // The new tokens are copied from the settings, where the store has not written them yet.
+        m_store->sync();
+
         m_settings->beginGroup(m_serviceName);
         QStringList keys = m_settings->allKeys();
         m_settings->endGroup();
@@ -259,7 +294,7 @@ void FlickrTalker::maxAllowedFileSize()
 
     QByteArray postData = O1::createQueryParameters(reqParams);
 
-    m_reply = m_requestor->post(netRequest, reqParams, postData);
+    sendRequest(netRequest, reqParams, postData);
 
     m_state = FE_GETMAXSIZE;
     m_authProgressDlg->setLabelText(i18n("Getting the maximum allowed file size."));
@@ -282,6 +317,21 @@ void FlickrTalker::listPhotoSets()
 
     qCDebug(KIPIPLUGINS_LOG) << "List photoset invoked";
 
+    QByteArray cached = m_listingCache->data(m_userId, QLatin1String("photosets"));
+    m_photoSetsCached = false;
+
+    if (!cached.isEmpty())
+    {
+        startPhotoSets();
+        readPhotoSets(cached);
+        m_photoSetsCached = endPhotoSets();
+    }
+
+    if (m_photoSetsCached)
+    {
+        emit signalListPhotoSetsSucceeded();
+    }
+
     QUrl url(m_apiUrl);
     QNetworkRequest netRequest(url);
     QList<O0RequestParameter> reqParams = QList<O0RequestParameter>();
@@ -292,7 +342,7 @@ void FlickrTalker::listPhotoSets()
 
     QByteArray postData = O1::createQueryParameters(reqParams);
 
-    m_reply = m_requestor->post(netRequest, reqParams, postData);
+    sendRequest(netRequest, reqParams, postData);
 
     m_state = FE_LISTPHOTOSETS;
     m_buffer.resize(0);
@@ -326,7 +376,7 @@ void FlickrTalker::getPhotoProperty(const QString& method, const QStringList& ar
 
     QByteArray postData = O1::createQueryParameters(reqParams);
 
-    m_reply = m_requestor->post(netRequest, reqParams, postData);
+    sendRequest(netRequest, reqParams, postData);
 
     m_state = FE_GETPHOTOPROPERTY;
     m_buffer.resize(0);
@@ -338,19 +388,47 @@ void FlickrTalker::listPhotos(const QString& /*albumName*/)
     // TODO
 }
 
-void FlickrTalker::createPhotoSet(const QString& /*albumName*/, const QString& albumTitle,
-                                  const QString& albumDescription, const QString& primaryPhotoId)
+void FlickrTalker::addPhotoToPhotoSet(const QString& photoId,
+                                      const QString& photoSetId)
 {
-    if (m_reply)
+    qCDebug(KIPIPLUGINS_LOG) << "AddPhotoToPhotoSet queued" << photoId << photoSetId;
+
+    // The title and description are needed to create the photo set.
+    FPhotoSet photoSet = m_selectedPhotoSet;
+    QLinkedList<FPhotoSet>::const_iterator it = m_photoSetsList->constBegin();
+
+    while (it != m_photoSetsList->constEnd())
     {
-        m_reply->abort();
-        m_reply = 0;
+        if (it->id == photoSetId)
+        {
+            photoSet = *it;
+            break;
+        }
+
+        ++it;
     }
 
-    if (!m_o1->linked())
+    photoSet.id = photoSetId;
+    m_photoSetQueue.append(qMakePair(photoId, photoSet));
+
+    if (!m_photoSetReply && !m_photoSetTimer->isActive())
+    {
+        slotSendPhotoSetRequest();
+    }
+}
+
+void FlickrTalker::slotSendPhotoSetRequest()
+{
+    if (m_photoSetQueue.isEmpty() || m_photoSetReply || !m_o1->linked())
         return;
 
-    qCDebug(KIPIPLUGINS_LOG) << "Create photoset invoked";
+    QPair<QString, FPhotoSet>& request = m_photoSetQueue.first();
+
+    // The photo set may have been created by a previous request of the queue.
+    if (m_createdPhotoSets.contains(request.second.id))
+    {
+        request.second.id = m_createdPhotoSets.value(request.second.id);
+    }
 
     QUrl url(m_apiUrl);
     QNetworkRequest netRequest(url);
@@ -358,66 +436,93 @@ void FlickrTalker::createPhotoSet(const QString& /*albumName*/, const QString& a
 
     netRequest.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String(O2_MIME_TYPE_XFORM));
 
-    reqParams << O0RequestParameter("method", "flickr.photosets.create");
-    reqParams << O0RequestParameter("title", albumTitle.toLatin1());
-    reqParams << O0RequestParameter("description", albumDescription.toLatin1());
-    reqParams << O0RequestParameter("primary_photo_id", primaryPhotoId.toLatin1());
+    /* If the photoset id starts with the special string "UNDEFINED_", it means
+     * it doesn't exist yet on Flickr and needs to be created. Note that it's
+     * not necessary to subsequently add the photo to the photo set, as this
+     * is done in the set creation call to Flickr. */
+    if (request.second.id.startsWith(QLatin1String("UNDEFINED_")))
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "Create photoset invoked";
 
-    QByteArray postData = O1::createQueryParameters(reqParams);
+        reqParams << O0RequestParameter("method", "flickr.photosets.create");
+        reqParams << O0RequestParameter("title", request.second.title.toLatin1());
+        reqParams << O0RequestParameter("description", request.second.description.toLatin1());
+        reqParams << O0RequestParameter("primary_photo_id", request.first.toLatin1());
+    }
+    else
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "AddPhotoToPhotoSet invoked";
 
-    m_reply = m_requestor->post(netRequest, reqParams, postData);
+        reqParams << O0RequestParameter("method", "flickr.photosets.addPhoto");
+        reqParams << O0RequestParameter("photoset_id", request.second.id.toLatin1());
+        reqParams << O0RequestParameter("photo_id", request.first.toLatin1());
+    }
 
-    m_state = FE_CREATEPHOTOSET;
-    m_buffer.resize(0);
-    emit signalBusy(true);
+    QByteArray postData = O1::createQueryParameters(reqParams);
+
+    m_photoSetReply = m_requestor->post(netRequest, reqParams, postData);
 }
 
-void FlickrTalker::addPhotoToPhotoSet(const QString& photoId,
-                                      const QString& photoSetId)
+/** Handle the reply of the first request of the photo sets queue, and send the next one.
+ */
+void FlickrTalker::photoSetRequestFinished(QNetworkReply* reply)
 {
-    if (m_reply)
-    {
-        m_reply->abort();
-        m_reply = 0;
-    }
+    m_photoSetReply = 0;
 
-    if (!m_o1->linked())
-        return;
+    m_photoSetLimiter->updateFromReply(reply);
 
-    qCDebug(KIPIPLUGINS_LOG) << "AddPhotoToPhotoSet invoked";
+    bool throttled = KPRateLimiter::isThrottled(reply);
+    QByteArray data;
 
-    /* If the photoset id starts with the special string "UNDEFINED_", it means
-     * it doesn't exist yet on Flickr and needs to be created. Note that it's
-     * not necessary to subsequently add the photo to the photo set, as this
-     * is done in the set creation call to Flickr. */
-    if (photoSetId.startsWith(QLatin1String("UNDEFINED_")))
+    if (!throttled && reply->error() == QNetworkReply::NoError)
     {
-        createPhotoSet(QLatin1String(""), m_selectedPhotoSet.title, m_selectedPhotoSet.description, photoId);
+        data      = reply->readAll();
+        throttled = isServiceUnavailable(data);
     }
-    else
-    {
-        QUrl url(m_apiUrl);
-        QNetworkRequest netRequest(url);
-        QList<O0RequestParameter> reqParams = QList<O0RequestParameter>();
 
-        netRequest.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String(O2_MIME_TYPE_XFORM));
+    reply->deleteLater();
 
-        reqParams << O0RequestParameter("method", "flickr.photosets.addPhoto");
-        reqParams << O0RequestParameter("photoset_id", photoSetId.toLatin1());
-        reqParams << O0RequestParameter("photo_id", photoId.toLatin1());
+    if (throttled)
+    {
+        int delay = m_photoSetLimiter->nextRetryDelay();
+
+        if (delay >= 0)
+        {
+            qCDebug(KIPIPLUGINS_LOG) << "Flickr is throttling, photo set request retried in" << delay << "ms";
+            m_photoSetTimer->start(delay);
+            return;
+        }
+    }
 
-        QByteArray postData = O1::createQueryParameters(reqParams);
+    m_photoSetLimiter->resetRetries();
 
-        m_reply = m_requestor->post(netRequest, reqParams, postData);
+    const QPair<QString, FPhotoSet> request = m_photoSetQueue.takeFirst();
+    QString photoSetId                      = request.second.id;
+    QString errMsg;
 
-        m_state = FE_ADDPHOTOTOPHOTOSET;
-        m_buffer.resize(0);
-        emit signalBusy(true);
+    if (reply->error() != QNetworkReply::NoError)
+    {
+        errMsg = reply->errorString();
+    }
+    else if (throttled)
+    {
+        errMsg = i18n("Service currently unavailable");
+    }
+    else if (photoSetId.startsWith(QLatin1String("UNDEFINED_")))
+    {
+        photoSetId = parseResponseCreatePhotoSet(data, photoSetId, errMsg);
     }
+    else
+    {
+        parseResponseAddPhotoToPhotoSet(data, errMsg);
+    }
+
+    emit signalAddPhotoToPhotoSetDone(request.first, photoSetId, errMsg);
+
+    slotSendPhotoSetRequest();
 }
 
-bool FlickrTalker::addPhoto(const QString& photoPath, const FPhotoInfo& info,
-                            bool original, bool rescale, int maxDim, int imageQuality)
+bool FlickrTalker::addPhoto(const QString& photoPath, const FPhotoInfo& info)
 {
     if (m_reply)
     {
@@ -475,72 +580,6 @@ bool FlickrTalker::addPhoto(const QString& photoPath, const FPhotoInfo& info,
         reqParams << O0RequestParameter("description", info.description.toUtf8());
     }
 
-    if (!original)
-    {
-        QImage image;
-
-        if (m_iface)
-        {
-            image = m_iface->preview(QUrl::fromLocalFile(photoPath));
-        }
-
-        if (image.isNull())
-        {
-            image.load(photoPath);
-        }
-
-        if (!image.isNull())
-        {
-            if (!m_lastTmpFile.isEmpty())
-            {
-                QFile::remove(m_lastTmpFile);
-            }
-
-            path = makeTemporaryDir(m_serviceName.toLatin1().constData()).filePath(QFileInfo(photoPath)
-                                                                         .baseName().trimmed() + QLatin1String(".jpg"));
-
-            if (rescale)
-            {
-                if (image.width() > maxDim || image.height() > maxDim)
-                    image = image.scaled(maxDim, maxDim, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-            }
-
-            image.save(path, "JPEG", imageQuality);
-            m_lastTmpFile = path;
-
-            // Restore all metadata.
-
-            if (m_iface)
-            {
-                QPointer<MetadataProcessor> meta = m_iface->createMetadataProcessor();
-
-                if (meta && meta->load(QUrl::fromLocalFile(photoPath)))
-                {
-                    meta->setImageDimensions(image.size());
-                    meta->setImageOrientation(MetadataProcessor::NORMAL);
-
-                    // NOTE: see bug #153207: Flickr use IPTC keywords to create Tags in web interface
-                    //       As IPTC do not support UTF-8, we need to remove it.
-                    //       This function call remove all Application2 Tags.
-                    meta->removeIptcTags(QStringList() << QLatin1String("Application2"));
-                    // NOTE: see bug # 384260: Flickr use Xmp.dc.subject to create Tags
-                    //       in web interface, we need to remove it.
-                    //       This function call remove all Dublin Core Tags.
-                    meta->removeXmpTags(QStringList() << QLatin1String("dc"));
-
-                    meta->setImageProgramId(QLatin1String("Kipi-plugins"), kipipluginsVersion());
-                    meta->save(QUrl::fromLocalFile(path), true);
-                }
-                else
-                {
-                    qCWarning(KIPIPLUGINS_LOG) << "flickrExport::Image doesn't have metadata";
-                }
-            }
-
-            qCDebug(KIPIPLUGINS_LOG) << "Resizing and saving to temp file: " << path;
-        }
-    }
-
     QFileInfo tempFileInfo(path);
 
     qCDebug(KIPIPLUGINS_LOG) << "QUrl path is " << QUrl::fromLocalFile(path) << "Image size (in bytes) is "<< tempFileInfo.size();
@@ -560,7 +599,7 @@ bool FlickrTalker::addPhoto(const QString& photoPath, const FPhotoInfo& info,
 
     netRequest.setHeader(QNetworkRequest::ContentTypeHeader, form.contentType());
 
-    m_reply = m_requestor->post(netRequest, reqParams, form.formData());
+    sendRequest(netRequest, reqParams, form.formData());
 
     m_state = FE_ADDPHOTO;
     m_buffer.resize(0);
@@ -568,6 +607,102 @@ bool FlickrTalker::addPhoto(const QString& photoPath, const FPhotoInfo& info,
     return true;
 }
 
+QString FlickrTalker::prepareImage(const QString& photoPath, const QString& tmpPath,
+                                   bool rescale, int maxDim, int imageQuality)
+{
+    const QImage image = loadScaledImage(photoPath, rescale ? maxDim : 0);
+
+    if (image.isNull())
+    {
+        return QString();
+    }
+
+    if (!image.save(tmpPath, "JPEG", imageQuality))
+    {
+        QFile::remove(tmpPath);
+        return QString();
+    }
+
+    qCDebug(KIPIPLUGINS_LOG) << "Resizing and saving to temp file: " << tmpPath;
+
+    return tmpPath;
+}
+
+QString FlickrTalker::completeImage(const QString& photoPath, const QString& tmpPath, const QString& prepared,
+                                    bool rescale, int maxDim, int imageQuality)
+{
+    QString path = prepared;
+    QSize   size;
+
+    if (path.isEmpty())
+    {
+        // Format not read by QImageReader, for ex. RAW files.
+        QImage image;
+
+        if (m_iface)
+        {
+            image = m_iface->preview(QUrl::fromLocalFile(photoPath));
+        }
+
+        if (image.isNull())
+        {
+            return photoPath;
+        }
+
+        if (rescale)
+        {
+            if (image.width() > maxDim || image.height() > maxDim)
+                image = image.scaled(maxDim, maxDim, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+
+        if (!image.save(tmpPath, "JPEG", imageQuality))
+        {
+            QFile::remove(tmpPath);
+            return photoPath;
+        }
+
+        path = tmpPath;
+        size = image.size();
+    }
+    else
+    {
+        size = QImageReader(path).size();
+    }
+
+    // Restore all metadata.
+
+    if (m_iface)
+    {
+        QPointer<MetadataProcessor> meta = m_iface->createMetadataProcessor();
+
+        if (meta && meta->load(QUrl::fromLocalFile(photoPath)))
+        {
+            meta->setImageDimensions(size);
+            meta->setImageOrientation(MetadataProcessor::NORMAL);
+
+            // NOTE: see bug #153207: Flickr use IPTC keywords to create Tags in web interface
+            //       As IPTC do not support UTF-8, we need to remove it.
+            //       This function call remove all Application2 Tags.
+            meta->removeIptcTags(QStringList() << QLatin1String("Application2"));
+            // NOTE: see bug # 384260: Flickr use Xmp.dc.subject to create Tags
+            //       in web interface, we need to remove it.
+            //       This function call remove all Dublin Core Tags.
+            meta->removeXmpTags(QStringList() << QLatin1String("dc"));
+
+            meta->setImageProgramId(QLatin1String("Kipi-plugins"), kipipluginsVersion());
+            meta->save(QUrl::fromLocalFile(path), true);
+        }
+        else
+        {
+            qCWarning(KIPIPLUGINS_LOG) << "flickrExport::Image doesn't have metadata";
+        }
+
+        delete meta;
+    }
+
+    return path;
+}
+
 QString FlickrTalker::getUserName() const
 {
     return m_username;
@@ -578,20 +713,113 @@ QString FlickrTalker::getUserId() const
     return m_userId;
 }
 
+QString FlickrTalker::getLastPhotoId() const
+{
+    return m_lastPhotoId;
+}
+
 void FlickrTalker::cancel()
 {
+    m_retryTimer->stop();
+
     if (m_reply)
     {
         m_reply->abort();
         m_reply = 0;
     }
 
+    m_photoSetTimer->stop();
+    m_photoSetQueue.clear();
+
+    if (m_photoSetReply)
+    {
+        QNetworkReply* const reply = m_photoSetReply;
+        m_photoSetReply            = 0;
+        reply->abort();
+    }
+
     if (m_authProgressDlg && !m_authProgressDlg->isHidden())
     {
         m_authProgressDlg->hide();
     }
 }
 
+/** Send a signed request, and keep it to send it again if Flickr is throttling us.
+ */
+void FlickrTalker::sendRequest(const QNetworkRequest& request, const QList<O0RequestParameter>& params,
+                               const QByteArray& postData)
+{
+    m_retryTimer->stop();
+    m_limiter->resetRetries();
+
+    m_lastRequest  = request;
+    m_lastParams   = params;
+    m_lastPostData = postData;
+
+    int delay = m_limiter->pacingDelay();
+
+    if (delay > 0)
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "Rate limit is low, delaying request by" << delay << "ms";
+        m_retryTimer->start(delay);
+        return;
+    }
+
+    slotSendRequest();
+}
+
+void FlickrTalker::slotSendRequest()
+{
+    // The request is signed again, with a new timestamp and nonce.
+    m_reply = m_requestor->post(m_lastRequest, m_lastParams, m_lastPostData);
+
+    connect(m_reply, SIGNAL(readyRead()),
+            this, SLOT(slotReadyRead()));
+
+    startPhotoSets();
+    m_buffer.resize(0);
+    emit signalBusy(true);
+}
+
+/** Schedule the last request to be sent again. Return false if it was retried too many times.
+ */
+bool FlickrTalker::retryLater()
+{
+    int delay = m_limiter->nextRetryDelay();
+
+    if (delay < 0)
+    {
+        return false;
+    }
+
+    qCDebug(KIPIPLUGINS_LOG) << "Flickr is throttling, retry" << m_limiter->retryCount()
+                             << "in" << delay << "ms";
+    m_retryTimer->start(delay);
+    return true;
+}
+
+/** Return true if Flickr answered with the error "Service currently unavailable",
+ *  which is returned when the API is overloaded.
+ */
+bool FlickrTalker::isServiceUnavailable(const QByteArray& data) const
+{
+    if (!data.contains("stat=\"fail\""))
+    {
+        return false;
+    }
+
+    QDomDocument doc(QLatin1String("Error Response"));
+
+    if (!doc.setContent(data))
+    {
+        return false;
+    }
+
+    QDomElement err = doc.documentElement().firstChildElement(QLatin1String("err"));
+
+    return (!err.isNull() && err.attribute(QLatin1String("code")) == QLatin1String("105"));
+}
+
 void FlickrTalker::slotError(const QString& error)
 {
     QString transError;
@@ -675,6 +903,12 @@ void FlickrTalker::slotError(const QString& error)
 
 void FlickrTalker::slotFinished(QNetworkReply* reply)
 {
+    if (reply == m_photoSetReply)
+    {
+        photoSetRequestFinished(reply);
+        return;
+    }
+
     emit signalBusy(false);
 
     if (reply != m_reply)
@@ -684,6 +918,28 @@ void FlickrTalker::slotFinished(QNetworkReply* reply)
 
     m_reply = 0;
 
+    m_limiter->updateFromReply(reply);
+
+    bool throttled = KPRateLimiter::isThrottled(reply);
+    QByteArray data;
+
+    if (!throttled && reply->error() == QNetworkReply::NoError)
+    {
+        data = reply->readAll();
+        m_buffer.append(data);
+
+        if (m_state == FE_LISTPHOTOSETS)
+            readPhotoSets(data);
+
+        throttled = isServiceUnavailable(m_buffer);
+    }
+
+    if (throttled && retryLater())
+    {
+        reply->deleteLater();
+        return;
+    }
+
     if (reply->error() != QNetworkReply::NoError)
     {
         if (m_state == FE_ADDPHOTO)
@@ -700,8 +956,6 @@ void FlickrTalker::slotFinished(QNetworkReply* reply)
         return;
     }
 
-    m_buffer.append(reply->readAll());
-
     switch (m_state)
     {
         case (FE_LOGIN):
@@ -724,14 +978,6 @@ void FlickrTalker::slotFinished(QNetworkReply* reply)
             parseResponseAddPhoto(m_buffer);
             break;
 
-        case (FE_ADDPHOTOTOPHOTOSET):
-            parseResponseAddPhotoToPhotoSet(m_buffer);
-            break;
-
-        case (FE_CREATEPHOTOSET):
-            parseResponseCreatePhotoSet(m_buffer);
-            break;
-
         case (FE_GETMAXSIZE):
             parseResponseMaxSize(m_buffer);
             break;
@@ -797,17 +1043,20 @@ void FlickrTalker::parseResponseMaxSize(const QByteArray& data)
     m_authProgressDlg->hide();
 }
 
-void FlickrTalker::parseResponseCreatePhotoSet(const QByteArray& data)
+/** Return the id of the photo set created in place of 'undefinedId', or 'undefinedId'
+ *  with 'errMsg' set if it failed.
+ */
+QString FlickrTalker::parseResponseCreatePhotoSet(const QByteArray& data, const QString& undefinedId,
+                                                  QString& errMsg)
 {
     qCDebug(KIPIPLUGINS_LOG) << "Parse response create photoset received " << data;
 
-    //bool success = false;
-
     QDomDocument doc(QLatin1String("getListPhotoSets"));
 
     if (!doc.setContent(data))
     {
-        return;
+        errMsg = i18n("PhotoSet creation failed: ") + i18n("Invalid response");
+        return undefinedId;
     }
 
     QDomElement docElem = doc.documentElement();
@@ -826,7 +1075,7 @@ void FlickrTalker::parseResponseCreatePhotoSet(const QByteArray& data)
 
             while (it != m_photoSetsList->end())
             {
-                if (it->id == m_selectedPhotoSet.id)
+                if (it->id == undefinedId)
                 {
                     it->id = new_id;
                     break;
@@ -836,10 +1085,17 @@ void FlickrTalker::parseResponseCreatePhotoSet(const QByteArray& data)
             }
 
             // Set the new id in the selected photo set.
-            m_selectedPhotoSet.id = new_id;
+            if (m_selectedPhotoSet.id == undefinedId)
+            {
+                m_selectedPhotoSet.id = new_id;
+            }
+
+            // The next photos queued for this photo set are added to the new one.
+            m_createdPhotoSets.insert(undefinedId, new_id);
 
             qCDebug(KIPIPLUGINS_LOG) << "PhotoSet created successfully with id" << new_id;
             emit signalAddPhotoSetSucceeded();
+            return new_id;
         }
 
         if (node.isElement() && node.nodeName() == QLatin1String("err"))
@@ -849,108 +1105,139 @@ void FlickrTalker::parseResponseCreatePhotoSet(const QByteArray& data)
             qCDebug(KIPIPLUGINS_LOG) << "Error code=" << code;
             QString msg = node.toElement().attribute(QLatin1String("msg"));
             qCDebug(KIPIPLUGINS_LOG) << "Msg=" << msg;
-            QMessageBox::critical(QApplication::activeWindow(), i18n("Error"), i18n("PhotoSet creation failed: ") + msg);
+            errMsg = i18n("PhotoSet creation failed: ") + msg;
         }
 
         node = node.nextSibling();
     }
+
+    if (errMsg.isEmpty())
+    {
+        errMsg = i18n("PhotoSet creation failed: ") + i18n("Invalid response");
+    }
+
+    return undefinedId;
 }
 
 void FlickrTalker::parseResponseListPhotoSets(const QByteArray& data)
 {
-    qCDebug(KIPIPLUGINS_LOG) << "parseResponseListPhotosets" << data;
-    bool success = false;
-    QDomDocument doc(QLatin1String("getListPhotoSets"));
-
-    if (!doc.setContent(data))
+    if (!endPhotoSets())
     {
+        emit signalListPhotoSetsFailed(i18n("Failed to fetch list of photo sets."));
         return;
     }
 
-    QDomElement docElem = doc.documentElement();
-    QDomNode    node    = docElem.firstChild();
-    QDomElement e;
+    if (m_listingCache->update(m_userId, QLatin1String("photosets"), data, m_photoSetsCached))
+    {
+        emit signalListPhotoSetsSucceeded();
+    }
 
-    QString photoSet_id, photoSet_title, photoSet_description;
-    m_photoSetsList->clear();
+    maxAllowedFileSize();
+}
 
-    while (!node.isNull())
+void FlickrTalker::slotReadyRead()
+{
+    if (sender() != m_reply)
+        return;
+
+    const QByteArray data = m_reply->readAll();
+    m_buffer.append(data);
+
+    if (m_state == FE_LISTPHOTOSETS)
+        readPhotoSets(data);
+}
+
+void FlickrTalker::startPhotoSets()
+{
+    m_xml.clear();
+    m_xmlText.clear();
+    m_newPhotoSet    = FPhotoSet();
+    m_newPhotoSets.clear();
+    m_photoSetsFound = false;
+}
+
+/** Parse the photo sets list while it is received. When the data received so far are
+ *  consumed, the reader stops with a premature end of document error, and continues
+ *  from there with the next data.
+ */
+void FlickrTalker::readPhotoSets(const QByteArray& data)
+{
+    m_xml.addData(data);
+
+    while (!m_xml.atEnd())
     {
-        if (node.isElement() && node.nodeName() == QLatin1String("photosets"))
+        m_xml.readNext();
+
+        if (m_xml.isStartElement())
         {
-            e                    = node.toElement();
-            QDomNode details     = e.firstChild();
-            FPhotoSet fps;
-            QDomNode detailsNode = details;
+            m_xmlText.clear();
 
-            while (!detailsNode.isNull())
+            if (m_xml.name() == QLatin1String("photosets"))
             {
-                if (detailsNode.isElement())
-                {
-                    e = detailsNode.toElement();
-
-                    if (detailsNode.nodeName() == QLatin1String("photoset"))
-                    {
-                        qCDebug(KIPIPLUGINS_LOG) << "id=" << e.attribute(QLatin1String("id"));
-                        photoSet_id              = e.attribute(QLatin1String("id"));     // this is what is obtained from data.
-                        fps.id                   = photoSet_id;
-                        QDomNode photoSetDetails = detailsNode.firstChild();
-                        QDomElement e_detail;
-
-                        while (!photoSetDetails.isNull())
-                        {
-                            e_detail = photoSetDetails.toElement();
-
-                            if (photoSetDetails.nodeName() == QLatin1String("title"))
-                            {
-                                qCDebug(KIPIPLUGINS_LOG) << "Title=" << e_detail.text();
-                                photoSet_title = e_detail.text();
-                                fps.title      = photoSet_title;
-                            }
-                            else if (photoSetDetails.nodeName() == QLatin1String("description"))
-                            {
-                                qCDebug(KIPIPLUGINS_LOG) << "Description =" << e_detail.text();
-                                photoSet_description = e_detail.text();
-                                fps.description      = photoSet_description;
-                            }
-
-                            photoSetDetails = photoSetDetails.nextSibling();
-                        }
-
-                        m_photoSetsList->append(fps);
-                    }
-                }
-
-                detailsNode = detailsNode.nextSibling();
+                m_photoSetsFound = true;
+            }
+            else if (m_xml.name() == QLatin1String("photoset"))
+            {
+                qCDebug(KIPIPLUGINS_LOG) << "id=" << m_xml.attributes().value(QLatin1String("id"));
+                m_newPhotoSet    = FPhotoSet();
+                m_newPhotoSet.id = m_xml.attributes().value(QLatin1String("id")).toString();
+            }
+            else if (m_xml.name() == QLatin1String("err"))
+            {
+                qCDebug(KIPIPLUGINS_LOG) << "Checking Error in response";
+                QString code = m_xml.attributes().value(QLatin1String("code")).toString();
+                qCDebug(KIPIPLUGINS_LOG) << "Error code=" << code;
+                qCDebug(KIPIPLUGINS_LOG) << "Msg=" << m_xml.attributes().value(QLatin1String("msg"));
+                emit signalError(code);
             }
-
-            details = details.nextSibling();
-            success = true;
         }
-
-        if (node.isElement() && node.nodeName() == QLatin1String("err"))
+        else if (m_xml.isCharacters() && !m_xml.isWhitespace())
         {
-            qCDebug(KIPIPLUGINS_LOG) << "Checking Error in response";
-            QString code = node.toElement().attribute(QLatin1String("code"));
-            qCDebug(KIPIPLUGINS_LOG) << "Error code=" << code;
-            qCDebug(KIPIPLUGINS_LOG) << "Msg=" << node.toElement().attribute(QLatin1String("msg"));
-            emit signalError(code);
+            m_xmlText += m_xml.text();
         }
+        else if (m_xml.isEndElement())
+        {
+            if (m_xml.name() == QLatin1String("title"))
+            {
+                qCDebug(KIPIPLUGINS_LOG) << "Title=" << m_xmlText;
+                m_newPhotoSet.title = m_xmlText;
+            }
+            else if (m_xml.name() == QLatin1String("description"))
+            {
+                qCDebug(KIPIPLUGINS_LOG) << "Description =" << m_xmlText;
+                m_newPhotoSet.description = m_xmlText;
+            }
+            else if (m_xml.name() == QLatin1String("photoset"))
+            {
+                m_newPhotoSets.append(m_newPhotoSet);
+            }
 
-        node = node.nextSibling();
+            m_xmlText.clear();
+        }
     }
+}
 
-    qCDebug(KIPIPLUGINS_LOG) << "GetPhotoList finished";
-
-    if (!success)
+/** Return true if a complete photo sets list was read, and make it the current one.
+ */
+bool FlickrTalker::endPhotoSets()
+{
+    if (m_xml.hasError())
     {
-        emit signalListPhotoSetsFailed(i18n("Failed to fetch list of photo sets."));
+        qCDebug(KIPIPLUGINS_LOG) << "Invalid photo sets list:" << m_xml.errorString();
+        return false;
     }
-    else
+
+    if (!m_photoSetsFound)
     {
-        emit signalListPhotoSetsSucceeded();
-        maxAllowedFileSize();
+        return false;
     }
+
+    *m_photoSetsList = m_newPhotoSets;
+    m_newPhotoSets.clear();
+
+    qCDebug(KIPIPLUGINS_LOG) << "GetPhotoList finished";
+
+    return true;
 }
 
 void FlickrTalker::parseResponseListPhotos(const QByteArray& data)
@@ -1028,17 +1315,9 @@ void FlickrTalker::parseResponseAddPhoto(const QByteArray& data)
     }
     else
     {
-        QString photoSetId = m_selectedPhotoSet.id;
-
-        if (photoSetId == QLatin1String("-1"))
-        {
-            qCDebug(KIPIPLUGINS_LOG) << "PhotoSet Id not set, not adding the photo to any photoset";
-            emit signalAddPhotoSucceeded();
-        }
-        else
-        {
-            addPhotoToPhotoSet(photoId, photoSetId);
-        }
+        // The window queues the photo for its photo set, see addPhotoToPhotoSet().
+        m_lastPhotoId = photoId;
+        emit signalAddPhotoSucceeded();
     }
 }
 
@@ -1091,10 +1370,24 @@ void FlickrTalker::parseResponsePhotoProperty(const QByteArray& data)
     }
 }
 
-void FlickrTalker::parseResponseAddPhotoToPhotoSet(const QByteArray& data)
+void FlickrTalker::parseResponseAddPhotoToPhotoSet(const QByteArray& data, QString& errMsg)
 {
-    qCDebug(KIPIPLUGINS_LOG) << "parseResponseListPhotosets" << data;
-    emit signalAddPhotoSucceeded();
+    qCDebug(KIPIPLUGINS_LOG) << "parseResponseAddPhotoToPhotoSet" << data;
+
+    QDomDocument doc(QLatin1String("AddPhotoToPhotoSet Response"));
+
+    if (!doc.setContent(data))
+    {
+        return;
+    }
+
+    QDomElement err = doc.documentElement().firstChildElement(QLatin1String("err"));
+
+    if (!err.isNull())
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "Error code=" << err.attribute(QLatin1String("code"));
+        errMsg = err.attribute(QLatin1String("msg"));
+    }
 }
 
 } // namespace KIPIFlickrPlugin
@@ -32,8 +32,12 @@
 #include <QPair>
 #include <QString>
 #include <QObject>
+#include <QTimer>
 #include <QNetworkReply>
 #include <QNetworkAccessManager>
+#include <QXmlStreamReader>
+#include <QLinkedList>
+#include <QHash>
 
 // Libkipi includes
 
@@ -46,10 +50,13 @@
 #include "o0globals.h"
 #include "o1requestor.h"
 #include "o0settingsstore.h"
+#include "kpratelimiter.h"
+#include "kplistingcache.h"
 
 class QProgressDialog;
 
 using namespace KIPI;
+using namespace KIPIPlugins;
 
 namespace KIPIFlickrPlugin
 {
@@ -73,8 +80,6 @@ public:
         FE_LISTPHOTOS,
         FE_GETPHOTOPROPERTY,
         FE_ADDPHOTO,
-        FE_CREATEPHOTOSET,
-        FE_ADDPHOTOTOPHOTOSET,
         FE_GETMAXSIZE
     };
 
@@ -88,6 +93,7 @@ public:
     void    removeUserName(const QString& userName);
     QString getUserName() const;
     QString getUserId() const;
+    QString getLastPhotoId() const;
     void    maxAllowedFileSize();
     QString getMaxAllowedFileSize();
     void    getPhotoProperty(const QString& method, const QStringList& argList);
@@ -95,15 +101,34 @@ public:
 
     void    listPhotoSets();
     void    listPhotos(const QString& albumName);
-    void    createPhotoSet(const QString& name,
-                           const QString& title,
-                           const QString& desc,
-                           const QString& primaryPhotoId);
 
+    /**
+     * Queue the addition of an uploaded photo to a photo set. The photo sets requests are
+     * sent one after the other, alongside the uploads. A photo set which does not exist yet
+     * on Flickr is created with the first photo added to it.
+     */
     void    addPhotoToPhotoSet(const QString& photoId, const QString& photoSetId);
-    bool    addPhoto(const QString& photoPath, const FPhotoInfo& info,
-                     bool original = false, bool rescale = false,
-                     int maxDim = 600, int imageQuality = 85);
+
+    /**
+     * Upload a file as is. Use prepareImage() and completeImage() to upload a scaled copy.
+     */
+    bool    addPhoto(const QString& photoPath, const FPhotoInfo& info);
+
+    /**
+     * Save the image 'photoPath' as a JPEG file 'tmpPath', scaled if 'rescale' is set, and
+     * return 'tmpPath', or an empty string if QImageReader cannot read the image.
+     * This is called from a worker thread: the host interface is not used.
+     */
+    static QString prepareImage(const QString& photoPath, const QString& tmpPath,
+                                bool rescale, int maxDim, int imageQuality);
+
+    /**
+     * Complete on the GUI thread the file 'prepared' by prepareImage(): the image is
+     * taken from the host preview if it was not read, and the metadata are copied.
+     * Return the path of the file to upload, the original file if it cannot be loaded.
+     */
+    QString completeImage(const QString& photoPath, const QString& tmpPath, const QString& prepared,
+                          bool rescale, int maxDim, int imageQuality);
 
 public:
 
@@ -123,17 +148,33 @@ Q_SIGNALS:
     void signalListPhotoSetsFailed(const QString& msg);
     void signalLinkingSucceeded();
 
+    /**
+     * Emitted once a photo has been added to a photo set, see addPhotoToPhotoSet().
+     * 'errMsg' is empty on success.
+     */
+    void signalAddPhotoToPhotoSetDone(const QString& photoId, const QString& photoSetId,
+                                      const QString& errMsg);
+
 private:
 
     //  void parseResponseLogin(const QByteArray& data);
     void parseResponseMaxSize(const QByteArray& data);
+    void startPhotoSets();
+    void readPhotoSets(const QByteArray& data);
+    bool endPhotoSets();
     void parseResponseListPhotoSets(const QByteArray& data);
     void parseResponseListPhotos(const QByteArray& data);
     void parseResponseCreateAlbum(const QByteArray& data);
     void parseResponseAddPhoto(const QByteArray& data);
     void parseResponsePhotoProperty(const QByteArray& data);
-    void parseResponseCreatePhotoSet(const QByteArray& data);
-    void parseResponseAddPhotoToPhotoSet(const QByteArray& data);
+    QString parseResponseCreatePhotoSet(const QByteArray& data, const QString& undefinedId, QString& errMsg);
+    void parseResponseAddPhotoToPhotoSet(const QByteArray& data, QString& errMsg);
+    void photoSetRequestFinished(QNetworkReply* reply);
+
+    void sendRequest(const QNetworkRequest& request, const QList<O0RequestParameter>& params,
+                     const QByteArray& postData);
+    bool retryLater();
+    bool isServiceUnavailable(const QByteArray& data) const;
 
 private Q_SLOTS:
 
@@ -142,6 +183,9 @@ private Q_SLOTS:
     void slotOpenBrowser(const QUrl& url); 
     void slotError(const QString& msg);
     void slotFinished(QNetworkReply* reply);
+    void slotReadyRead();
+    void slotSendRequest();
+    void slotSendPhotoSetRequest();
 
 private:
 
@@ -159,7 +203,7 @@ private:
     QString                m_maxSize;
     QString                m_username;
     QString                m_userId;
-    QString                m_lastTmpFile;
+    QString                m_lastPhotoId;
 
     QNetworkAccessManager* m_netMngr;
     QNetworkReply*         m_reply;
@@ -173,6 +217,31 @@ private:
     O1*                    m_o1;
     O0SettingsStore*       m_store;
     O1Requestor*           m_requestor;
+
+    KPRateLimiter*         m_limiter;
+    QTimer*                m_retryTimer;
+    QNetworkRequest        m_lastRequest;
+    QList<O0RequestParameter> m_lastParams;
+    QByteArray             m_lastPostData;
+
+    KPListingCache*        m_listingCache;
+    bool                   m_photoSetsCached;
+
+    // photo sets list parsed while it is received
+    QXmlStreamReader       m_xml;
+    QString                m_xmlText;
+    FPhotoSet              m_newPhotoSet;
+    QLinkedList<FPhotoSet> m_newPhotoSets;
+    bool                   m_photoSetsFound;
+
+    // photo sets requests, sent alongside the uploads: photo id and photo set
+    QList<QPair<QString, FPhotoSet> > m_photoSetQueue;
+    QNetworkReply*         m_photoSetReply;
+    QTimer*                m_photoSetTimer;
+    KPRateLimiter*         m_photoSetLimiter;  // retries of the photo sets queue, apart from the uploads
+
+    // Flickr ids of the photo sets created, by their temporary "UNDEFINED_" ids
+    QHash<QString, QString> m_createdPhotoSets;
 };
 
 } // namespace KIPIFlickrPlugin
@@ -37,6 +37,9 @@
 #include <QMenu>
 #include <QMessageBox>
 #include <QWindow>
+#include <QFile>
+#include <QFileInfo>
+#include <QtConcurrentRun>
 
 // KDE includes
 
@@ -52,7 +55,9 @@
 #include "kpaboutdata.h"
 #include "kpimageinfo.h"
 #include "kpversion.h"
+#include "kputil.h"
 #include "kpprogresswidget.h"
+#include "kpuploadhistory.h"
 #include "flickrtalker.h"
 #include "flickritem.h"
 #include "flickrlist.h"
@@ -64,6 +69,9 @@
 namespace KIPIFlickrPlugin
 {
 
+/// Number of images of the upload queue prepared at the same time.
+static const int s_prepareAhead = 4;
+
 FlickrWindow::FlickrWindow(QWidget* const /*parent*/, const QString& serviceName, SelectUserDlg* const dlg)
     : KPToolDialog(0)
 {
@@ -92,6 +100,9 @@ FlickrWindow::FlickrWindow(QWidget* const /*parent*/, const QString& serviceName
     m_select                    = dlg;
     m_uploadCount               = 0;
     m_uploadTotal               = 0;
+    m_waitingPhoto              = false;
+    m_hashing                   = false;
+    m_tmpIndex                  = 0;
     m_widget                    = new FlickrWidget(this, iface(), serviceName);
     m_albumDlg                  = new NewAlbum(this,QString::fromLatin1("Flickr"));
     m_albumsListComboBox        = m_widget->getAlbumsCoB();
@@ -115,6 +126,7 @@ FlickrWindow::FlickrWindow(QWidget* const /*parent*/, const QString& serviceName
     m_removeAccount             = m_widget->m_removeAccount;
     m_userNameDisplayLabel      = m_widget->getUserNameLabel();
     m_imglst                    = m_widget->m_imglst;
+    m_history                   = new KPUploadHistory(m_serviceName);
 
     startButton()->setText(i18n("Start Uploading"));
     startButton()->setToolTip(QString());
@@ -122,6 +134,9 @@ FlickrWindow::FlickrWindow(QWidget* const /*parent*/, const QString& serviceName
     setMainWidget(m_widget);
     m_widget->setMinimumSize(800, 600);
 
+    connect(m_history, SIGNAL(filesHashed(QStringList)),
+            this, SLOT(slotFilesHashed()));
+
     connect(m_imglst, SIGNAL(signalImageListChanged()),
             this, SLOT(slotImageListChanged()));
 
@@ -167,6 +182,9 @@ FlickrWindow::FlickrWindow(QWidget* const /*parent*/, const QString& serviceName
     connect(m_talker, SIGNAL(signalAddPhotoSetSucceeded()),
             this, SLOT(slotAddPhotoSetSucceeded()));
 
+    connect(m_talker, SIGNAL(signalAddPhotoToPhotoSetDone(QString,QString,QString)),
+            this, SLOT(slotAddPhotoToPhotoSetDone(QString,QString,QString)));
+
     connect(m_talker, SIGNAL(signalListPhotoSetsSucceeded()),
             this, SLOT(slotPopulatePhotoSetComboBox()));
 
@@ -224,6 +242,7 @@ FlickrWindow::~FlickrWindow()
     delete m_authProgressDlg;
     delete m_talker;
     delete m_widget;
+    delete m_history;
 }
 
 void FlickrWindow::closeEvent(QCloseEvent* e)
@@ -261,7 +280,9 @@ void FlickrWindow::setUiInProgressState(bool inProgress)
 void FlickrWindow::slotCancelClicked()
 {
     m_talker->cancel();
-    m_uploadQueue.clear();
+    clearUploadQueue();
+    m_pendingPhotoSets.clear();
+    m_photoSetErrors.clear();
     setUiInProgressState(false);
 }
 
@@ -269,7 +290,9 @@ void FlickrWindow::slotAddPhotoCancelAndClose()
 {
     writeSettings();
     m_imglst->listView()->clear();
-    m_uploadQueue.clear();
+    clearUploadQueue();
+    m_pendingPhotoSets.clear();
+    m_photoSetErrors.clear();
     m_widget->progressBar()->reset();
     setUiInProgressState(false);
     m_talker->cancel();
@@ -594,7 +617,7 @@ void FlickrWindow::slotUser1()
 
     typedef QPair<QUrl, FPhotoInfo> Pair;
 
-    m_uploadQueue.clear();
+    clearUploadQueue();
 
     for (int i = 0; i < m_imglst->listView()->topLevelItemCount(); ++i)
     {
@@ -681,23 +704,40 @@ void FlickrWindow::slotUser1()
     m_uploadTotal = m_uploadQueue.count();
     m_uploadCount = 0;
     m_widget->progressBar()->reset();
-    slotAddPhotoNext();
+
+    // Read the new files on a worker thread, the upload starts in slotFilesHashed().
+
+    QStringList paths;
+
+    for (int i = 0 ; i < m_uploadQueue.count() ; ++i)
+    {
+        paths << m_uploadQueue.at(i).first.toLocalFile();
+    }
+
+    m_hashing = true;
+    m_history->hashFiles(paths);
     qCDebug(KIPIPLUGINS_LOG) << "SlotUploadImages done";
 }
 
+void FlickrWindow::slotFilesHashed()
+{
+    if (!m_hashing)
+    {
+        return;
+    }
+
+    m_hashing = false;
+    slotAddPhotoNext();
+}
+
 void FlickrWindow::slotAddPhotoNext()
 {
     if (m_uploadQueue.isEmpty())
     {
-        m_widget->progressBar()->reset();
-        setUiInProgressState(false);
+        checkUploadFinished();
         return;
     }
 
-    typedef QPair<QUrl, FPhotoInfo> Pair;
-    Pair pathComments = m_uploadQueue.first();
-    FPhotoInfo info   = pathComments.second;
-
     QString selectedPhotoSetId = m_albumsListComboBox->itemData(m_albumsListComboBox->currentIndex()).toString();
 
     if (selectedPhotoSetId.isEmpty())
@@ -720,38 +760,277 @@ void FlickrWindow::slotAddPhotoNext()
         }
     }
 
+    if (skipAlreadyUploaded())
+    {
+        return;
+    }
+
+    if (m_widget->progressBar()->isHidden())
+    {
+        setUiInProgressState(true);
+        m_widget->progressBar()->progressScheduled(i18n("Flickr Export"), true, true);
+        m_widget->progressBar()->progressThumbnailChanged(QIcon(QLatin1String(":/icons/kipi-icon.svg")).pixmap(22, 22));
+    }
+
+    typedef QPair<QUrl, FPhotoInfo> Pair;
+    Pair pathComments = m_uploadQueue.first();
+    FPhotoInfo info   = pathComments.second;
+    QString path      = pathComments.first.toLocalFile();
+
+    if (!m_originalCheckBox->isChecked())
+    {
+        // The next images are prepared while this one is uploaded.
+        prepareNextPhotos();
+
+        if (!m_prepared.contains(m_preparing.first()))
+        {
+            m_waitingPhoto = true;
+            return;
+        }
+
+        path = m_prepared.value(m_preparing.first());
+    }
+
     qCDebug(KIPIPLUGINS_LOG) << "Max allowed file size is : "<<((m_talker->getMaxAllowedFileSize()).toLongLong())<<"File Size is "<<info.size;
 
-    bool res = m_talker->addPhoto(pathComments.first.toLocalFile(), //the file path
-                                  info,
-                                  m_originalCheckBox->isChecked(),
-                                  m_resizeCheckBox->isChecked(),
-                                  m_dimensionSpinBox->value(),
-                                  m_imageQualitySpinBox->value());
+    bool res = m_talker->addPhoto(path, info);
 
     if (!res)
     {
         slotAddPhotoFailed(QString::fromLatin1(""));
         return;
     }
+}
 
-    if (m_widget->progressBar()->isHidden())
+/** Start preparing the files of the first images of the upload queue, on worker threads.
+ */
+void FlickrWindow::prepareNextPhotos()
+{
+    const QString tmpDir = makeTemporaryDir(m_serviceName.toLatin1().constData()).absolutePath() + QLatin1Char('/');
+
+    while (m_preparing.count() < qMin(s_prepareAhead, m_uploadQueue.count()))
     {
-        setUiInProgressState(true);
-        m_widget->progressBar()->progressScheduled(i18n("Flickr Export"), true, true);
-        m_widget->progressBar()->progressThumbnailChanged(QIcon(QLatin1String(":/icons/kipi-icon.svg")).pixmap(22, 22));
+        const QString photoPath = m_uploadQueue.at(m_preparing.count()).first.toLocalFile();
+
+        // Several images with the same name can be prepared at the same time.
+        const QString tmpPath   = tmpDir + QString::number(m_tmpIndex++) + QLatin1Char('_') +
+                                  QFileInfo(photoPath).baseName().trimmed() + QLatin1String(".jpg");
+
+        QFutureWatcher<QString>* const watcher = new QFutureWatcher<QString>(this);
+        watcher->setProperty("photoPath", photoPath);
+        watcher->setProperty("tmpPath",   tmpPath);
+
+        connect(watcher, SIGNAL(finished()),
+                this, SLOT(slotPhotoPrepared()));
+
+        watcher->setFuture(QtConcurrent::run(&FlickrTalker::prepareImage, photoPath, tmpPath,
+                                             m_resizeCheckBox->isChecked(),
+                                             m_dimensionSpinBox->value(),
+                                             m_imageQualitySpinBox->value()));
+        m_preparing << watcher;
+    }
+}
+
+void FlickrWindow::slotPhotoPrepared()
+{
+    QFutureWatcher<QString>* const watcher = static_cast<QFutureWatcher<QString>*>(sender());
+
+    if (!m_preparing.contains(watcher))
+    {
+        return;
+    }
+
+    // The host interface is only used here, on the GUI thread.
+    m_prepared.insert(watcher, m_talker->completeImage(watcher->property("photoPath").toString(),
+                                                       watcher->property("tmpPath").toString(),
+                                                       watcher->result(),
+                                                       m_resizeCheckBox->isChecked(),
+                                                       m_dimensionSpinBox->value(),
+                                                       m_imageQualitySpinBox->value()));
+
+    if (m_waitingPhoto && m_prepared.contains(m_preparing.first()))
+    {
+        m_waitingPhoto = false;
+        slotAddPhotoNext();
+    }
+}
+
+void FlickrWindow::slotDiscardPreparedPhoto()
+{
+    QFutureWatcher<QString>* const watcher = static_cast<QFutureWatcher<QString>*>(sender());
+
+    if (!watcher->result().isEmpty())
+    {
+        QFile::remove(watcher->result());
+    }
+
+    watcher->deleteLater();
+}
+
+/** Remove the first image of the upload queue, and the file prepared for it.
+ */
+void FlickrWindow::popUploadQueue()
+{
+    const QUrl url = m_uploadQueue.takeFirst().first;
+
+    if (!m_preparing.isEmpty())
+    {
+        QFutureWatcher<QString>* const watcher = m_preparing.takeFirst();
+        watcher->disconnect(this);
+
+        if (m_prepared.contains(watcher))
+        {
+            const QString path = m_prepared.take(watcher);
+
+            if (path != url.toLocalFile())
+            {
+                QFile::remove(path);
+            }
+        }
+        else if (!watcher->isFinished())
+        {
+            // The image is removed once it is written.
+            connect(watcher, SIGNAL(finished()),
+                    this, SLOT(slotDiscardPreparedPhoto()));
+            return;
+        }
+        else if (!watcher->result().isEmpty())
+        {
+            QFile::remove(watcher->result());
+        }
+
+        watcher->deleteLater();
+    }
+}
+
+/** Drop the upload queue, and the files prepared for it.
+ */
+void FlickrWindow::clearUploadQueue()
+{
+    while (!m_uploadQueue.isEmpty())
+    {
+        popUploadQueue();
+    }
+
+    m_waitingPhoto = false;
+    m_hashing      = false;
+}
+
+/** End the transfer once all photos are uploaded and added to their photo set.
+ */
+void FlickrWindow::checkUploadFinished()
+{
+    if (!m_uploadQueue.isEmpty() || !m_pendingPhotoSets.isEmpty())
+    {
+        return;
+    }
+
+    m_widget->progressBar()->reset();
+    setUiInProgressState(false);
+
+    if (!m_photoSetErrors.isEmpty())
+    {
+        QMessageBox::warning(this, i18n("Warning"),
+                             i18n("Some photos were uploaded to %1 but could not be added to the photo set:\n%2",
+                                  m_serviceName, m_photoSetErrors.join(QLatin1String("\n"))));
+        m_photoSetErrors.clear();
+    }
+}
+
+/** Drop from the head of the upload queue all files which were already sent to the selected
+ *  photo set, using the local upload history. Return true if the queue is now empty.
+ */
+bool FlickrWindow::skipAlreadyUploaded()
+{
+    QString photoSetId = m_talker->m_selectedPhotoSet.id;
+
+    // A photo set which is not yet created on Flickr cannot hold anything.
+    if (photoSetId.startsWith(QLatin1String("UNDEFINED_")))
+    {
+        return false;
     }
+
+    while (!m_uploadQueue.isEmpty())
+    {
+        QUrl url = m_uploadQueue.first().first;
+
+        if (!m_history->isUploaded(url.toLocalFile(), m_userId, photoSetId))
+        {
+            return false;
+        }
+
+        qCDebug(KIPIPLUGINS_LOG) << "Skipping" << url << "already uploaded to photo set" << photoSetId;
+
+        m_imglst->removeItemByUrl(url);
+        popUploadQueue();
+        m_uploadCount++;
+        m_widget->progressBar()->setMaximum(m_uploadTotal);
+        m_widget->progressBar()->setValue(m_uploadCount);
+    }
+
+    checkUploadFinished();
+    return true;
 }
 
 void FlickrWindow::slotAddPhotoSucceeded()
 {
+    const QUrl url           = m_uploadQueue.first().first;
+    const QString photoId    = m_talker->getLastPhotoId();
+    const QString photoSetId = m_talker->m_selectedPhotoSet.id;
+
+    popUploadQueue();
+
+    if (photoSetId == QLatin1String("-1"))
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "PhotoSet Id not set, not adding the photo to any photoset";
+
+        m_history->addUpload(url.toLocalFile(), m_userId, photoSetId, photoId);
+
+        // Remove photo uploaded from the list
+        m_imglst->removeItemByUrl(url);
+        m_uploadCount++;
+        m_widget->progressBar()->setMaximum(m_uploadTotal);
+        m_widget->progressBar()->setValue(m_uploadCount);
+    }
+    else
+    {
+        // The photo is added to its photo set while the next ones are uploaded.
+        m_pendingPhotoSets.insert(photoId, url);
+        m_talker->addPhotoToPhotoSet(photoId, photoSetId);
+    }
+
+    slotAddPhotoNext();
+}
+
+void FlickrWindow::slotAddPhotoToPhotoSetDone(const QString& photoId, const QString& photoSetId,
+                                              const QString& errMsg)
+{
+    if (!m_pendingPhotoSets.contains(photoId))
+    {
+        return;
+    }
+
+    const QUrl url = m_pendingPhotoSets.take(photoId);
+
+    // The photo is on Flickr even if it is not in the photo set: it is not uploaded again,
+    // only the photo set error is reported.
+    m_history->addUpload(url.toLocalFile(), m_userId, photoSetId, photoId);
+
+    if (!errMsg.isEmpty())
+    {
+        qCWarning(KIPIPLUGINS_LOG) << "Failed to add" << url << "to photo set" << photoSetId << ":" << errMsg;
+
+        m_photoSetErrors << QString::fromLatin1("%1: %2").arg(url.fileName()).arg(errMsg);
+    }
+
     // Remove photo uploaded from the list
-    m_imglst->removeItemByUrl(m_uploadQueue.first().first);
-    m_uploadQueue.pop_front();
+    m_imglst->removeItemByUrl(url);
     m_uploadCount++;
+
     m_widget->progressBar()->setMaximum(m_uploadTotal);
     m_widget->progressBar()->setValue(m_uploadCount);
-    slotAddPhotoNext();
+
+    checkUploadFinished();
 }
 
 void FlickrWindow::slotListPhotoSetsFailed(const QString& msg)
@@ -771,13 +1050,13 @@ void FlickrWindow::slotAddPhotoFailed(const QString& msg)
 
     if (warn.exec() != QMessageBox::Yes)
     {
-        m_uploadQueue.clear();
-        m_widget->progressBar()->reset();
-        setUiInProgressState(false);
+        // The photos already uploaded are still added to their photo set.
+        clearUploadQueue();
+        checkUploadFinished();
     }
     else
     {
-        m_uploadQueue.pop_front();
+        popUploadQueue();
         m_uploadTotal--;
         m_widget->progressBar()->setMaximum(m_uploadTotal);
         m_widget->progressBar()->setValue(m_uploadCount);
@@ -788,10 +1067,9 @@ void FlickrWindow::slotAddPhotoFailed(const QString& msg)
 void FlickrWindow::slotAddPhotoSetSucceeded()
 {
     /* Method called when a photo set has been successfully created on Flickr.
-     * It functions to restart the normal flow after a photo set has been created
-     * on Flickr. */
+     * The photo set combo box now shows its Flickr id, the photo is reported
+     * by slotAddPhotoToPhotoSetDone(). */
     slotPopulatePhotoSetComboBox();
-    slotAddPhotoSucceeded();
 }
 
 void FlickrWindow::slotImageListChanged()
@@ -34,6 +34,8 @@
 #include <QLineEdit>
 #include <QUrl>
 #include <QComboBox>
+#include <QStringList>
+#include <QFutureWatcher>
 
 // Libkipi includes
 
@@ -58,6 +60,7 @@ namespace KIPI
 namespace KIPIPlugins
 {
     class KPAboutData;
+    class KPUploadHistory;
 }
 
 using namespace KIPI;
@@ -99,6 +102,7 @@ private Q_SLOTS:
     void slotError(const QString& msg);
     void slotFinished();
     void slotUser1();
+    void slotFilesHashed();
     void slotCancelClicked();
 
     void slotCreateNewPhotoSet();
@@ -109,6 +113,9 @@ private Q_SLOTS:
     void slotAddPhotoSucceeded();
     void slotAddPhotoFailed(const QString& msg);
     void slotAddPhotoSetSucceeded();
+    void slotAddPhotoToPhotoSetDone(const QString& photoId, const QString& photoSetId, const QString& errMsg);
+    void slotPhotoPrepared();
+    void slotDiscardPreparedPhoto();
     void slotListPhotoSetsFailed(const QString& msg);
     void slotAddPhotoCancelAndClose();
     void slotAuthCancel();
@@ -124,6 +131,12 @@ private:
     void writeSettings();
 
     void setUiInProgressState(bool inProgress);
+    bool skipAlreadyUploaded();
+
+    void prepareNextPhotos();
+    void popUploadQueue();
+    void clearUploadQueue();
+    void checkUploadFinished();
 
 private:
 
@@ -164,6 +177,17 @@ private:
 
     QList< QPair<QUrl, FPhotoInfo> >       m_uploadQueue;
 
+    // files prepared for the first images of the upload queue
+    QList<QFutureWatcher<QString>*>        m_preparing;
+    QHash<QFutureWatcher<QString>*, QString> m_prepared;   // files to upload, see slotPhotoPrepared()
+    bool                                   m_waitingPhoto;
+    bool                                   m_hashing;      // files of the upload queue hashed, see slotFilesHashed()
+    int                                    m_tmpIndex;
+
+    // uploaded photos waiting to be added to their photo set, by photo id
+    QHash<QString, QUrl>                   m_pendingPhotoSets;
+    QStringList                            m_photoSetErrors;
+
     QLineEdit*                             m_tagsLineEdit;
 
     FlickrWidget*                          m_widget;
@@ -172,6 +196,8 @@ private:
     FlickrList*                            m_imglst;
     SelectUserDlg*                         m_select;
     NewAlbum*                              m_albumDlg;
+
+    KPUploadHistory*                       m_history;
 };
 
 } // namespace KIPIFlickrPlugin
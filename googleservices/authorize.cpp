@@ -216,6 +216,8 @@ void Authorize::getAccessTokenFromRefreshToken(const QString& msg)
     postData += msg.toLatin1();
     postData += "&grant_type=refresh_token";
 
+    m_refresh_token = msg;
+
     QNetworkRequest netRequest(url);
     netRequest.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/x-www-form-urlencoded"));
 
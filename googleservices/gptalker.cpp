@@ -56,6 +56,9 @@
 
 #include "kputil.h"
 #include "kpversion.h"
+#include "kpdownloader.h"
+#include "kppagefetcher.h"
+#include "kplistingcache.h"
 #include "gswindow.h"
 #include "mpform_gphoto.h"
 #include "kipiplugins_debug.h"
@@ -72,6 +75,13 @@ GPTalker::GPTalker(QWidget* const parent)
     : Authorize(parent, QString::fromLatin1("https://picasaweb.google.com/data/")),
       m_netMngr(0),
       m_reply(0),
+      m_downloader(0),
+      m_albumPages(0),
+      m_photoPages(0),
+      m_listingCache(0),
+      m_albumsCached(false),
+      m_albumsChanged(false),
+      m_albumPageCount(0),
       m_state(FE_LOGOUT),
       m_iface(0)
 {
@@ -90,14 +100,47 @@ GPTalker::GPTalker(QWidget* const parent)
     connect(m_netMngr, SIGNAL(finished(QNetworkReply*)),
             this, SLOT(slotFinished(QNetworkReply*)));
 
+    // Photos and videos are written to disk while they are received, several at once.
+    m_downloader = new KPDownloader(this);
+
+    connect(m_downloader, SIGNAL(signalDownloadDone(QString,int,QString)),
+            this, SLOT(slotDownloadDone(QString,int,QString)));
+
+    // The pages of the albums and photos feeds are requested in parallel.
+    m_albumPages = new KPPageFetcher(this);
+
+    connect(m_albumPages, SIGNAL(signalPage(int,QByteArray)),
+            this, SLOT(slotListAlbumsPage(int,QByteArray)));
+
+    connect(m_albumPages, SIGNAL(signalFailed(QString)),
+            this, SLOT(slotListAlbumsFailed(QString)));
+
+    connect(m_albumPages, SIGNAL(signalDone()),
+            this, SLOT(slotListAlbumsDone()));
+
+    m_photoPages = new KPPageFetcher(this);
+
+    connect(m_photoPages, SIGNAL(signalPage(int,QByteArray)),
+            this, SLOT(slotListPhotosPage(int,QByteArray)));
+
+    connect(m_photoPages, SIGNAL(signalFailed(QString)),
+            this, SLOT(slotListPhotosFailed(QString)));
+
+    connect(m_photoPages, SIGNAL(signalDone()),
+            this, SLOT(slotListPhotosDone()));
+
     connect(this, SIGNAL(signalError(QString)),
             this, SLOT(slotError(QString)));
+
+    m_listingCache = new KPListingCache(QString::fromLatin1("GooglePhotos"));
 }
 
 GPTalker::~GPTalker()
 {
     if (m_reply)
         m_reply->abort();
+
+    delete m_listingCache;
 }
 
 /**
@@ -109,12 +152,6 @@ GPTalker::~GPTalker()
  */
 void GPTalker::listAlbums()
 {
-    if (m_reply)
-    {
-        m_reply->abort();
-        m_reply = 0;
-    }
-
     QUrl url(QString::fromLatin1("https://picasaweb.google.com/data/feed/api/user/default"));
 
     QNetworkRequest netRequest(url);
@@ -125,21 +162,63 @@ void GPTalker::listAlbums()
         netRequest.setRawHeader("Authorization", m_bearer_access_token.toLatin1());
     }
 
-    m_reply = m_netMngr->get(netRequest);
+    m_albumsRequest  = netRequest;
+    m_albumsChanged  = false;
+    m_albumPageCount = 0;
 
-    m_state = FE_LISTALBUMS;
-    m_buffer.resize(0);
-    emit signalBusy(true);
+    m_albumsCached   = showCachedAlbums();
+
+    if (!m_albumsCached)
+    {
+        emit signalBusy(true);
+    }
+
+    m_albums.clear();
+    m_albumPages->start(pageRequest(m_albumsRequest, 0));
 }
 
-void GPTalker::listPhotos(const QString& albumId, const QString& imgmax)
+/** The pages of the albums feed are cached by Google user id, as "albums/<index>". The "albums"
+ *  entry holds the number of pages. The id of the last user is cached too, as the feed only
+ *  tells it with its first page.
+ */
+QString GPTalker::cacheAccount() const
 {
-    if (m_reply)
+    if (!m_username.isEmpty())
     {
-        m_reply->abort();
-        m_reply = 0;
+        return m_username;
+    }
+
+    return QString::fromUtf8(m_listingCache->data(QString(), QLatin1String("user")));
+}
+
+bool GPTalker::showCachedAlbums()
+{
+    const int pages = m_listingCache->data(cacheAccount(), QLatin1String("albums")).toInt();
+
+    if (pages <= 0)
+    {
+        return false;
+    }
+
+    QList<GSFolder> albumList;
+
+    for (int i = 0 ; i < pages ; ++i)
+    {
+        if (parseResponseListAlbums(m_listingCache->data(cacheAccount(), QString::fromLatin1("albums/%1").arg(i)),
+                                    albumList) < 0)
+        {
+            return false;
+        }
     }
 
+    std::sort(albumList.begin(), albumList.end(), gphotoLessThan);
+    emit signalListAlbumsDone(1, QString::fromLatin1(""), albumList);
+
+    return true;
+}
+
+void GPTalker::listPhotos(const QString& albumId, const QString& imgmax)
+{
     QUrl url(QString::fromLatin1("https://picasaweb.google.com/data/feed/api/user/default/albumid/") + albumId);
 
     QUrlQuery q(url);
@@ -160,13 +239,146 @@ void GPTalker::listPhotos(const QString& albumId, const QString& imgmax)
         netRequest.setRawHeader("Authorization", m_bearer_access_token.toLatin1());
     }
 
-    m_reply = m_netMngr->get(netRequest);
+    m_photosRequest = netRequest;
+    m_photos.clear();
+    m_photoPages->start(pageRequest(m_photosRequest, 0));
 
-    m_state = FE_LISTPHOTOS;
-    m_buffer.resize(0);
     emit signalBusy(true);
 }
 
+/** Return the request of the page 'index' of a feed, using start-index and max-results.
+ */
+QNetworkRequest GPTalker::pageRequest(const QNetworkRequest& request, int index) const
+{
+    QUrl url = request.url();
+    QUrlQuery q(url);
+    q.removeQueryItem(QString::fromLatin1("start-index"));
+    q.removeQueryItem(QString::fromLatin1("max-results"));
+    q.addQueryItem(QString::fromLatin1("start-index"), QString::number(index * s_pageSize + 1));
+    q.addQueryItem(QString::fromLatin1("max-results"), QString::number(s_pageSize));
+    url.setQuery(q);
+
+    QNetworkRequest netRequest(request);
+    netRequest.setUrl(url);
+
+    return netRequest;
+}
+
+/** Once the first page of a feed tells the total number of entries, all other
+ *  pages are known and requested at once.
+ */
+void GPTalker::fetchNextPages(KPPageFetcher* const pages, const QNetworkRequest& request, int total)
+{
+    for (int i = 1 ; i * s_pageSize < total ; ++i)
+    {
+        pages->fetch(i, pageRequest(request, i));
+    }
+}
+
+void GPTalker::slotListAlbumsPage(int index, const QByteArray& data)
+{
+    QList<GSFolder> albumList;
+    int total = parseResponseListAlbums(data, albumList);
+
+    if (total < 0)
+    {
+        m_albumPages->cancel();
+        emit signalBusy(false);
+        emit signalListAlbumsDone(0, i18n("Failed to fetch photo-set list"), QList<GSFolder>());
+        return;
+    }
+
+    m_albums << albumList;
+    m_albumPageCount++;
+
+    // With another user, the albums shown were the ones of the previous user.
+    if (index == 0 && m_listingCache->store(QString(), QLatin1String("user"), m_username.toUtf8()))
+    {
+        m_albumsChanged = true;
+    }
+
+    if (m_listingCache->store(cacheAccount(), QString::fromLatin1("albums/%1").arg(index), data))
+    {
+        m_albumsChanged = true;
+    }
+
+    if (index == 0)
+    {
+        fetchNextPages(m_albumPages, m_albumsRequest, total);
+    }
+
+    if (m_albumPages->isRunning() && !m_albumsCached)
+    {
+        // Show the albums found so far while the other pages are coming.
+        QList<GSFolder> partial = m_albums;
+        std::sort(partial.begin(), partial.end(), gphotoLessThan);
+        emit signalListAlbumsDone(1, QString::fromLatin1(""), partial);
+    }
+}
+
+void GPTalker::slotListAlbumsFailed(const QString& msg)
+{
+    emit signalBusy(false);
+    emit signalListAlbumsDone(0, msg, QList<GSFolder>());
+}
+
+void GPTalker::slotListAlbumsDone()
+{
+    emit signalBusy(false);
+
+    if (!m_listingCache->update(cacheAccount(), QLatin1String("albums"), QByteArray::number(m_albumPageCount),
+                                m_albumsCached && !m_albumsChanged))
+    {
+        return;
+    }
+
+    std::sort(m_albums.begin(), m_albums.end(), gphotoLessThan);
+    emit signalListAlbumsDone(1, QString::fromLatin1(""), m_albums);
+}
+
+void GPTalker::slotListPhotosPage(int index, const QByteArray& data)
+{
+    QList<GSPhoto> photoList;
+    int total = parseResponseListPhotos(data, photoList);
+
+    if (total < 0)
+    {
+        m_photoPages->cancel();
+        emit signalBusy(false);
+        emit signalListPhotosDone(0, i18n("Failed to fetch photo-set list"), QList<GSPhoto>());
+        return;
+    }
+
+    // Pages can arrive in any order, keep them sorted by index.
+    m_photos.insert(index, photoList);
+
+    if (index == 0)
+    {
+        fetchNextPages(m_photoPages, m_photosRequest, total);
+    }
+}
+
+void GPTalker::slotListPhotosFailed(const QString& msg)
+{
+    emit signalBusy(false);
+    emit signalListPhotosDone(0, msg, QList<GSPhoto>());
+}
+
+void GPTalker::slotListPhotosDone()
+{
+    QList<GSPhoto> photoList;
+
+    foreach (const QList<GSPhoto>& page, m_photos)
+    {
+        photoList << page;
+    }
+
+    m_photos.clear();
+
+    emit signalBusy(false);
+    return total;
+}
+
 void GPTalker::createAlbum(const GSFolder& album)
 {
     if (m_reply)
@@ -512,21 +724,22 @@ bool GPTalker::updatePhoto(const QString& photoPath, GSPhoto& info/*, const QStr
     return true;
 }
 
-void GPTalker::getPhoto(const QString& imgPath)
+void GPTalker::getPhoto(const QString& imgPath, const QString& localPath)
 {
-    if (m_reply)
-    {
-        m_reply->abort();
-        m_reply = 0;
-    }
-
     emit signalBusy(true);
 
     QUrl url(imgPath);
-    m_reply = m_netMngr->get(QNetworkRequest(url));
+    m_downloader->download(QNetworkRequest(url), localPath);
+}
 
-    m_state = FE_GETPHOTO;
-    m_buffer.resize(0);
+void GPTalker::slotDownloadDone(const QString& path, int errCode, const QString& errMsg)
+{
+    if (m_downloader->pending() == 0)
+    {
+        emit signalBusy(false);
+    }
+
+    emit signalGetPhotoDone((errCode == 0) ? 1 : 0, errMsg, path);
 }
 
 QString GPTalker::getUserName() const
@@ -552,6 +765,10 @@ void GPTalker::cancel()
         m_reply = 0;
     }
 
+    m_downloader->cancel();
+    m_albumPages->cancel();
+    m_photoPages->cancel();
+
     emit signalBusy(false);
 }
 
@@ -657,28 +874,21 @@ void GPTalker::slotFinished(QNetworkReply* reply)
         case (FE_CREATEALBUM):
             parseResponseCreateAlbum(m_buffer);
             break;
-        case (FE_LISTALBUMS):
-            parseResponseListAlbums(m_buffer);
-            break;
-        case (FE_LISTPHOTOS):
-            parseResponseListPhotos(m_buffer);
-            break;
         case (FE_ADDPHOTO):
             parseResponseAddPhoto(m_buffer);
             break;
         case (FE_UPDATEPHOTO):
             emit signalAddPhotoDone(1, QString::fromLatin1(""), QString::fromLatin1(""));
             break;
-        case (FE_GETPHOTO):
-            // all we get is data of the image
-            emit signalGetPhotoDone(1, QString(), m_buffer);
-            break;
     }
 
     reply->deleteLater();
 }
 
-void GPTalker::parseResponseListAlbums(const QByteArray& data)
+/** Parse one page of the albums feed into 'albumList'. Return the total number of albums
+ *  in the feed, or -1 on error.
+ */
+int GPTalker::parseResponseListAlbums(const QByteArray& data, QList<GSFolder>& albumList)
 {
     QDomDocument doc(QString::fromLatin1("feed"));
     QString      err;
@@ -688,18 +898,21 @@ void GPTalker::parseResponseListAlbums(const QByteArray& data)
     if ( !doc.setContent( data, false, &err, &line, &columns ) )
     {
         qCCritical(KIPIPLUGINS_LOG) << "error is "<< err << " at line " << line << " at columns " << columns;
-        emit signalListAlbumsDone(0, i18n("Failed to fetch photo-set list"), QList<GSFolder>());
-        return;
+        return -1;
     }
 
     QDomElement docElem = doc.documentElement();
     QDomNode node       = docElem.firstChild();
     QDomElement e;
-
-    QList<GSFolder> albumList;
+    int total           = 0;
 
     while (!node.isNull())
     {
+        if (node.isElement() && node.nodeName() == QString::fromLatin1("openSearch:totalResults"))
+        {
+            total = node.toElement().text().toInt();
+        }
+
         if (node.isElement() && node.nodeName() == QString::fromLatin1("gphoto:nickname"))
         {
             m_loginName = node.toElement().text();
@@ -745,27 +958,32 @@ void GPTalker::parseResponseListAlbums(const QByteArray& data)
         node = node.nextSibling();
     }
 
-    std::sort(albumList.begin(), albumList.end(), gphotoLessThan);
-    emit signalListAlbumsDone(1, QString::fromLatin1(""), albumList);
+    return total;
 }
 
-void GPTalker::parseResponseListPhotos(const QByteArray& data)
+/** Parse one page of the photos feed of an album into 'photoList'. Return the total
+ *  number of photos in the album, or -1 on error.
+ */
+int GPTalker::parseResponseListPhotos(const QByteArray& data, QList<GSPhoto>& photoList)
 {
     QDomDocument doc(QString::fromLatin1("feed"));
 
     if ( !doc.setContent( data ) )
     {
-        emit signalListPhotosDone(0, i18n("Failed to fetch photo-set list"), QList<GSPhoto>());
-        return;
+        return -1;
     }
 
     QDomElement docElem = doc.documentElement();
     QDomNode node       = docElem.firstChild();
-
-    QList<GSPhoto> photoList;
+    int total           = 0;
 
     while (!node.isNull())
     {
+        if (node.isElement() && node.nodeName() == QString::fromLatin1("openSearch:totalResults"))
+        {
+            total = node.toElement().text().toInt();
+        }
+
         if (node.isElement() && node.nodeName() == QString::fromLatin1("entry"))
         {
             QDomNode details     = node.firstChild();
@@ -31,6 +31,7 @@
 #include <QHash>
 #include <QObject>
 #include <QPointer>
+#include <QNetworkRequest>
 
 // Libkipi includes
 
@@ -41,7 +42,15 @@
 #include "gsitem.h"
 #include "authorize.h"
 
+namespace KIPIPlugins
+{
+    class KPDownloader;
+    class KPPageFetcher;
+    class KPListingCache;
+}
+
 using namespace KIPI;
+using namespace KIPIPlugins;
 
 namespace KIPIGoogleServicesPlugin
 {
@@ -55,11 +64,8 @@ public:
     enum State
     {
         FE_LOGOUT = -1,
-        FE_LISTALBUMS = 0,
-        FE_LISTPHOTOS,
-        FE_ADDPHOTO,
+        FE_ADDPHOTO = 0,
         FE_UPDATEPHOTO,
-        FE_GETPHOTO,
         FE_CREATEALBUM
     };
 
@@ -80,7 +86,7 @@ public:
     bool updatePhoto(const QString& photoPath, GSPhoto& info/*, const QString& albumId*/,
                      bool rescale, int maxDim, int imageQuality);
 
-    void getPhoto(const QString& imgPath);
+    void getPhoto(const QString& imgPath, const QString& localPath);
 
     QString getLoginName()   const;
     QString getUserName()    const;
@@ -101,19 +107,33 @@ Q_SIGNALS:
     void signalCreateAlbumDone(int, const QString&, const QString&);
     void signalAddPhotoDone(int, const QString&, const QString&);
     void signalGetPhotoDone(int errCode, const QString& errMsg,
-                            const QByteArray& photoData);
+                            const QString& localPath);
 
 private:
 
-    void parseResponseListAlbums(const QByteArray& data);
-    void parseResponseListPhotos(const QByteArray& data);
+    int  parseResponseListAlbums(const QByteArray& data, QList<GSFolder>& albumList);
+    int  parseResponseListPhotos(const QByteArray& data, QList<GSPhoto>& photoList);
     void parseResponseCreateAlbum(const QByteArray& data);
     void parseResponseAddPhoto(const QByteArray& data);
 
+    QString cacheAccount() const;
+    bool showCachedAlbums();
+
+    QNetworkRequest pageRequest(const QNetworkRequest& request, int index) const;
+    void fetchNextPages(KPPageFetcher* const pages, const QNetworkRequest& request, int total);
+
 private Q_SLOTS:
 
     void slotError( const QString& msg );
     void slotFinished(QNetworkReply* reply);
+    void slotDownloadDone(const QString& path, int errCode, const QString& errMsg);
+
+    void slotListAlbumsPage(int index, const QByteArray& data);
+    void slotListAlbumsFailed(const QString& msg);
+    void slotListAlbumsDone();
+    void slotListPhotosPage(int index, const QByteArray& data);
+    void slotListPhotosFailed(const QString& msg);
+    void slotListPhotosDone();
 
 private:
 
@@ -124,6 +144,22 @@ private:
 
     QNetworkAccessManager*      m_netMngr;
     QNetworkReply*              m_reply;
+    KPDownloader*               m_downloader;
+
+    /// Number of entries requested with each page of the albums and photos feeds.
+    static const int            s_pageSize = 1000;
+
+    KPPageFetcher*              m_albumPages;
+    KPPageFetcher*              m_photoPages;
+    QNetworkRequest             m_albumsRequest;
+    QNetworkRequest             m_photosRequest;
+    QList<GSFolder>             m_albums;
+    QMap<int, QList<GSPhoto> >  m_photos;
+
+    KPListingCache*             m_listingCache;
+    bool                        m_albumsCached;
+    bool                        m_albumsChanged;
+    int                         m_albumPageCount;
 
     State                       m_state;
 
@@ -258,8 +258,8 @@ GSWindow::GSWindow(const QString& tmpFolder,QWidget* const /*parent*/, const QSt
             connect(m_gphoto_talker, SIGNAL(signalAddPhotoDone(int, QString, QString)),
                     this, SLOT(slotAddPhotoDone(int,QString,QString)));
 
-            connect(m_gphoto_talker, SIGNAL(signalGetPhotoDone(int, QString, QByteArray)),
-                    this, SLOT(slotGetPhotoDone(int, QString, QByteArray)));
+            connect(m_gphoto_talker, SIGNAL(signalGetPhotoDone(int, QString, QString)),
+                    this, SLOT(slotGetPhotoDone(int, QString, QString)));
 
             readSettings();
             buttonStateChange(false);
@@ -450,8 +450,8 @@ void GSWindow::slotListPhotosDoneForDownload(int errCode, const QString& errMsg,
 
     m_renamingOpt = 0;
 
-    // start download with first photo in queue
-    downloadNextPhoto();
+    // start downloads of all photos in queue
+    downloadPhotos();
 }
 
 void GSWindow::slotListPhotosDoneForUpload(int errCode, const QString& errMsg, const QList <GSPhoto>& photosList)
@@ -940,7 +940,7 @@ void GSWindow::uploadNextPhoto()
     }
 }
 
-void GSWindow::downloadNextPhoto()
+void GSWindow::downloadPhotos()
 {
     if (m_transferQueue.isEmpty())
     {
@@ -952,147 +952,126 @@ void GSWindow::downloadNextPhoto()
     m_widget->progressBar()->setMaximum(m_imagesTotal);
     m_widget->progressBar()->setValue(m_imagesCount);
 
-    QString imgPath = m_transferQueue.first().first.url();
+    // Queue all downloads at once, the talker runs several of them in parallel.
+    while (!m_transferQueue.isEmpty())
+    {
+        QPair<QUrl, GSPhoto> pair = m_transferQueue.takeFirst();
+
+        // The photo ID keeps apart the temporary files of photos with the same title.
+        QString tmpPath = m_tmp + pair.second.id + QLatin1Char('-') + downloadFileName(pair.second);
 
-    m_gphoto_talker->getPhoto(imgPath);
+        m_downloads.insert(tmpPath, pair.second);
+        m_gphoto_talker->getPhoto(pair.first.url(), tmpPath);
+    }
 }
 
-void GSWindow::slotGetPhotoDone(int errCode, const QString& errMsg, const QByteArray& photoData)
+QString GSWindow::downloadFileName(const GSPhoto& item) const
 {
-    GSPhoto item = m_transferQueue.first().second;
-    QUrl tmpUrl  = QUrl::fromLocalFile(QString(m_tmp + item.title));
-
     if (item.mimeType == QString::fromLatin1("video/mpeg4"))
     {
-        tmpUrl = tmpUrl.adjusted(QUrl::RemoveFilename);
-        tmpUrl.setPath(tmpUrl.path() + item.title + QString::fromLatin1(".mp4"));
+        return item.title + QString::fromLatin1(".mp4");
     }
 
-    if (errCode == 1)
+    return item.title;
+}
+
+void GSWindow::slotGetPhotoDone(int errCode, const QString& errMsg, const QString& tmpPath)
+{
+    if (!m_downloads.contains(tmpPath))
     {
-        QString errText;
-        QFile imgFile(tmpUrl.toLocalFile());
+        // Transfer cancelled.
+        return;
+    }
 
-        if (!imgFile.open(QIODevice::WriteOnly))
-        {
-            errText = imgFile.errorString();
-        }
-        else if (imgFile.write(photoData) != photoData.size())
-        {
-            errText = imgFile.errorString();
-        }
-        else
-        {
-            imgFile.close();
-        }
+    GSPhoto item = m_downloads.take(tmpPath);
+    QUrl tmpUrl  = QUrl::fromLocalFile(tmpPath);
+
+    m_imagesCount++;
+    m_widget->progressBar()->setValue(m_imagesCount);
 
-        if (errText.isEmpty())
+    if (errCode == 1)
+    {
+        // The file is complete on disk, metadata can be written now.
+        if (m_meta && m_meta->load(tmpUrl))
         {
-            if (m_meta && m_meta->load(tmpUrl))
+            if (m_meta->supportXmp() && m_meta->canWriteXmp(tmpUrl))
             {
-                if (m_meta->supportXmp() && m_meta->canWriteXmp(tmpUrl))
-                {
-                    m_meta->setXmpTagString(QLatin1String("Xmp.kipi.picasawebGPhotoId"), item.id);
-                    m_meta->setXmpKeywords(item.tags);
-                }
-
+                m_meta->setXmpTagString(QLatin1String("Xmp.kipi.picasawebGPhotoId"), item.id);
+                m_meta->setXmpKeywords(item.tags);
+            }
 
-                if (!item.gpsLat.isEmpty() && !item.gpsLon.isEmpty())
-                {
-                    m_meta->setGPSInfo(0.0, item.gpsLat.toDouble(), item.gpsLon.toDouble());
-                }
 
-                m_meta->save(tmpUrl, true);
+            if (!item.gpsLat.isEmpty() && !item.gpsLon.isEmpty())
+            {
+                m_meta->setGPSInfo(0.0, item.gpsLat.toDouble(), item.gpsLon.toDouble());
             }
 
-            m_transferQueue.pop_front();
-            m_imagesCount++;
+            m_meta->save(tmpUrl, true);
         }
-        else
-        {
-            QMessageBox warn(QMessageBox::Warning,
-                             i18n("Warning"),
-                             i18n("Failed to save photo: %1\n"
-                                  "Do you want to continue?", errText),
-                             QMessageBox::Yes | QMessageBox::No);
 
-            (warn.button(QMessageBox::Yes))->setText(i18n("Continue"));
-            (warn.button(QMessageBox::No))->setText(i18n("Cancel"));
+        QUrl newUrl = QUrl::fromLocalFile(QString(m_widget->getDestinationPath() + downloadFileName(item)));
+
+        QFileInfo targetInfo(newUrl.toLocalFile());
 
-            if (warn.exec() != QMessageBox::Yes)
+        if (targetInfo.exists())
+        {
+            int i          = 0;
+            bool fileFound = false;
+
+            do
             {
-                slotTransferCancel();
-                return;
+                QFileInfo newTargetInfo(newUrl.toLocalFile());
+
+                if (!newTargetInfo.exists())
+                {
+                    fileFound = false;
+                }
+                else
+                {
+                    newUrl = newUrl.adjusted(QUrl::RemoveFilename);
+                    newUrl.setPath(newUrl.path() + targetInfo.completeBaseName() +
+                                                   QString::fromUtf8("_%1.").arg(++i) +
+                                                   targetInfo.completeSuffix());
+                    fileFound = true;
+                }
             }
+            while (fileFound);
         }
-    }
-    else
-    {
-        QMessageBox warn(QMessageBox::Warning,
-                         i18n("Warning"),
-                         i18n("Failed to download photo: %1\n"
-                              "Do you want to continue?", errMsg),
-                         QMessageBox::Yes | QMessageBox::No);
 
-        (warn.button(QMessageBox::Yes))->setText(i18n("Continue"));
-        (warn.button(QMessageBox::No))->setText(i18n("Cancel"));
-
-        if (warn.exec() != QMessageBox::Yes)
+        if (!QFile::rename(tmpUrl.toLocalFile(), newUrl.toLocalFile()))
         {
-            slotTransferCancel();
-            return;
+            m_downloadErrors << i18n("Failed to save image to %1", newUrl.toLocalFile());
         }
-    }
-
-    QUrl newUrl = QUrl::fromLocalFile(QString(m_widget->getDestinationPath() + tmpUrl.fileName()));
-
-    QFileInfo targetInfo(newUrl.toLocalFile());
-
-    if (targetInfo.exists())
-    {
-        int i          = 0;
-        bool fileFound = false;
-
-        do
+        else
         {
-            QFileInfo newTargetInfo(newUrl.toLocalFile());
+            KPImageInfo info(newUrl);
+            info.setName(item.title);
+            info.setDescription(item.description);
+            info.setTagsPath(item.tags);
 
-            if (!newTargetInfo.exists())
-            {
-                fileFound = false;
-            }
-            else
+            if (!item.gpsLat.isEmpty() && !item.gpsLon.isEmpty())
             {
-                newUrl = newUrl.adjusted(QUrl::RemoveFilename);
-                newUrl.setPath(newUrl.path() + targetInfo.completeBaseName() +
-                                               QString::fromUtf8("_%1.").arg(++i) +
-                                               targetInfo.completeSuffix());
-                fileFound = true;
+                info.setLatitude(item.gpsLat.toDouble());
+                info.setLongitude(item.gpsLon.toDouble());
             }
         }
-        while (fileFound);
     }
-
-    if (!QFile::rename(tmpUrl.toLocalFile(), newUrl.toLocalFile()))
+    else
     {
-        QMessageBox::critical(this, i18nc("@title:window", "Error"),
-                              i18n("Failed to save image to %1", newUrl.toLocalFile()));
+        m_downloadErrors << i18n("Failed to download photo %1: %2", downloadFileName(item), errMsg);
     }
-    else
+
+    if (m_downloads.isEmpty())
     {
-        KPImageInfo info(newUrl);
-        info.setName(item.title);
-        info.setDescription(item.description);
-        info.setTagsPath(item.tags);
+        m_widget->progressBar()->hide();
+        m_widget->progressBar()->progressCompleted();
 
-        if (!item.gpsLat.isEmpty() && !item.gpsLon.isEmpty())
+        if (!m_downloadErrors.isEmpty())
         {
-            info.setLatitude(item.gpsLat.toDouble());
-            info.setLongitude(item.gpsLon.toDouble());
+            QMessageBox::warning(this, i18n("Warning"), m_downloadErrors.join(QLatin1Char('\n')));
+            m_downloadErrors.clear();
         }
     }
-
-    downloadNextPhoto();
 }
 
 void GSWindow::slotAddPhotoDone(int err, const QString& msg, const QString& photoId)
@@ -1260,6 +1239,8 @@ void GSWindow::slotCreateFolderDone(int code, const QString& msg, const QString&
 void GSWindow::slotTransferCancel()
 {
     m_transferQueue.clear();
+    m_downloads.clear();
+    m_downloadErrors.clear();
     m_widget->progressBar()->hide();
 
     switch (m_name)
@@ -31,6 +31,8 @@
 #include <QPair>
 #include <QUrl>
 #include <QPointer>
+#include <QHash>
+#include <QStringList>
 
 // Libkipi includes
 
@@ -72,7 +74,8 @@ private:
     void writeSettings();
 
     void uploadNextPhoto();
-    void downloadNextPhoto();
+    void downloadPhotos();
+    QString downloadFileName(const GSPhoto& item) const;
 
     void buttonStateChange(bool state);
     void closeEvent(QCloseEvent*) Q_DECL_OVERRIDE;
@@ -99,7 +102,7 @@ private Q_SLOTS:
     void slotListPhotosDoneForUpload(int errCode, const QString& errMsg, const QList <GSPhoto>& photosList);
     void slotCreateFolderDone(int,const QString& msg, const QString& = QStringLiteral("-1"));
     void slotAddPhotoDone(int,const QString& msg, const QString&);
-    void slotGetPhotoDone(int errCode, const QString& errMsg, const QByteArray& photoData);
+    void slotGetPhotoDone(int errCode, const QString& errMsg, const QString& tmpPath);
     void slotTransferCancel();
 
 private:
@@ -125,6 +128,10 @@ private:
 
     QList< QPair<QUrl, GSPhoto> > m_transferQueue;
 
+    /// Downloads in progress, by temporary file path.
+    QHash<QString, GSPhoto>       m_downloads;
+    QStringList                   m_downloadErrors;
+
     QPointer<MetadataProcessor>   m_meta;
 };
 
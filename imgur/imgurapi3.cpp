@@ -22,6 +22,10 @@
 
 #include "imgurapi3.h"
 
+// C++ includes
+
+#include <algorithm>
+
 // Qt includes
 
 #include <QFileInfo>
@@ -67,12 +71,15 @@ ImgurAPI3::ImgurAPI3(const QString& client_id, const QString& client_secret, QOb
     connect(&m_auth, &O2::linkedChanged, this, &ImgurAPI3::oauthAuthorized);
     connect(&m_auth, &O2::openBrowser,   this, &ImgurAPI3::oauthRequestPin);
     connect(&m_auth, &O2::linkingFailed, this, &ImgurAPI3::oauthFailed);
+    connect(&m_auth, &O2::refreshFinished, this, &ImgurAPI3::oauthRefreshed);
 }
 
 ImgurAPI3::~ImgurAPI3()
 {
-    /* Disconnect all signals as cancelAllWork may emit */
+    /* Disconnect all signals as cancelAllWork may emit, and the
+     * notifications of m_auth, destroyed after the other members. */
     disconnect(this, 0, 0, 0);
+    m_auth.disconnect(this);
     cancelAllWork();
 }
 
@@ -81,27 +88,50 @@ O2 &ImgurAPI3::getAuth()
     return m_auth;
 }
 
+const KIPIPlugins::KPRateLimiter& ImgurAPI3::getRateLimiter() const
+{
+    return m_limiter;
+}
+
+void ImgurAPI3::setMaxConcurrentRequests(unsigned int count)
+{
+    m_max_concurrent = std::max(1u, count);
+}
+
 unsigned int ImgurAPI3::workQueueLength()
 {
-    return m_work_queue.size();
+    return m_work_queue.size() + m_running.size();
 }
 
-void ImgurAPI3::queueWork(const ImgurAPI3Action& action)
+unsigned int ImgurAPI3::queueWork(const ImgurAPI3Action& action)
 {
-    m_work_queue.push(action);
+    m_work_queue.push_back(action);
+    m_work_queue.back().id = m_next_id++;
     startWorkTimer();
+
+    return m_work_queue.back().id;
 }
 
 void ImgurAPI3::cancelAllWork()
 {
     stopWorkTimer();
 
-    if (m_reply)
-        m_reply->abort();
-
     /* Should error be emitted for those actions? */
-    while (!m_work_queue.empty())
-        m_work_queue.pop();
+    m_work_queue.clear();
+    m_running.clear();
+    m_retries.clear();
+
+    auto replies = m_replies;
+    m_replies.clear();
+
+    for (auto& running : replies)
+    {
+        disconnect(running.first, 0, this, 0);
+        running.first->abort();
+        running.first->deleteLater();
+    }
+
+    emit busy(false);
 }
 
 QUrl ImgurAPI3::urlForDeletehash(const QString& deletehash)
@@ -132,30 +162,86 @@ void ImgurAPI3::oauthFailed()
     emit authError(i18n("Could not authorize"));
 }
 
+void ImgurAPI3::oauthRefreshed(QNetworkReply::NetworkError error)
+{
+    if (error == QNetworkReply::NoError)
+    {
+        startWorkTimer();
+        return;
+    }
+
+    /* Don't send the actions again with a refused token. */
+    emit authError(i18n("Could not refresh the authorization"));
+    cancelAllWork();
+}
+
 void ImgurAPI3::uploadProgress(qint64 sent, qint64 total)
 {
-    if (total > 0) /* Don't divide by 0 */
-        emit progress((sent * 100) / total, m_work_queue.front());
+    auto found = m_replies.find(qobject_cast<QNetworkReply*>(sender()));
+
+    if (total <= 0 || found == m_replies.end()) /* Don't divide by 0 */
+        return;
+
+    auto running = m_running.find(found->second);
+
+    if (running != m_running.end())
+        emit progress((sent * 100) / total, running->second);
 }
 
 void ImgurAPI3::replyFinished()
 {
-    auto* reply = m_reply;
-    reply->deleteLater();
-    m_reply = nullptr;
+    auto* reply = qobject_cast<QNetworkReply*>(sender());
+    auto found  = m_replies.find(reply);
 
-    if (this->m_image)
+    if (found == m_replies.end())
     {
-        delete this->m_image;
-        this->m_image = nullptr;
+        qCDebug(KIPIPLUGINS_LOG) << "Received result without request";
+        return;
     }
 
-    if (m_work_queue.empty())
-    {
-        qCDebug(KIPIPLUGINS_LOG) << "Received result without request";
+    /* The multipart and the image file are children of the reply. */
+    reply->deleteLater();
+    unsigned int id = found->second;
+    m_replies.erase(found);
+
+    auto running = m_running.find(id);
+
+    if (running == m_running.end())
         return;
+
+    /* Keep the action in m_running while signals are emitted, so
+     * that workQueueLength() still counts it, but pass a copy as
+     * the receivers may cancel all work. */
+    const ImgurAPI3Action action = running->second;
+
+    /* Imgur sends the remaining credits with each reply. */
+    m_limiter.updateFromReply(reply);
+
+    if (KIPIPlugins::KPRateLimiter::isThrottled(reply))
+    {
+        /* The retries are counted for each action, as several
+         * requests may be throttled at the same time. */
+        int delay = m_limiter.retryDelay(m_retries[id]);
+
+        if (delay >= 0)
+        {
+            m_retries[id]++;
+
+            /* Out of credits or overloaded: put the action back in front
+             * of the queue and try again later. The requests still running
+             * finish, but no new one is sent before the delay. */
+            qCDebug(KIPIPLUGINS_LOG) << "Imgur is throttling, retry" << m_retries[id]
+                                     << "in" << delay << "ms";
+            m_running.erase(id);
+            m_work_queue.push_front(action);
+            stopWorkTimer();
+            startWorkTimer(delay);
+            return;
+        }
     }
 
+    m_retries.erase(id);
+
     /* toInt() returns 0 if conversion fails. That fits nicely already. */
     int code = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
     auto response = QJsonDocument::fromJson(reply->readAll());
@@ -164,7 +250,7 @@ void ImgurAPI3::replyFinished()
     {
         /* Success! */
         ImgurAPI3Result result;
-        result.action = &m_work_queue.front();
+        result.action = &action;
         auto data = response.object()[QLatin1String("data")].toObject();
 
         switch (result.action->type)
@@ -204,8 +290,10 @@ void ImgurAPI3::replyFinished()
         {
             /* HTTP 403 Forbidden -> Invalid token? 
              * That needs to be handled internally, so don't emit progress
-             * and keep the action in the queue for later retries. */
+             * and put the action back in the queue for later retries. */
 
+            m_running.erase(id);
+            m_work_queue.push_front(action);
             m_auth.refresh();
             return;
         }
@@ -216,12 +304,12 @@ void ImgurAPI3::replyFinished()
                        .toObject()[QLatin1String("error")]
                        .toString(QLatin1String("Could not read response."));
 
-            emit error(msg, m_work_queue.front());
+            emit error(msg, action);
         }
     }
 
     /* Next work item. */
-    m_work_queue.pop();
+    m_running.erase(id);
     startWorkTimer();
 }
 
@@ -239,14 +327,15 @@ void ImgurAPI3::timerEvent(QTimerEvent* event)
     doWork();
 }
 
-void ImgurAPI3::startWorkTimer()
+void ImgurAPI3::startWorkTimer(int delay)
 {
     if (!m_work_queue.empty() && m_work_timer == 0)
     {
-        m_work_timer = QObject::startTimer(0);
+        /* Slow down ahead of time when the credits get low. */
+        m_work_timer = QObject::startTimer(delay < 0 ? m_limiter.pacingDelay() : delay);
         emit busy(true);
     }
-    else
+    else if (m_work_queue.empty() && m_running.empty())
         emit busy(false);
 }
 
@@ -273,83 +362,112 @@ void ImgurAPI3::addAnonToken(QNetworkRequest* request)
 
 void ImgurAPI3::doWork()
 {
-    if (m_work_queue.empty() || m_reply != nullptr)
-        return;
-
-    auto &work = m_work_queue.front();
-
-    if (work.type != ImgurAPI3ActionType::ANON_IMG_UPLOAD && !m_auth.linked())
+    while (!m_work_queue.empty() && m_running.size() < m_max_concurrent)
     {
-        m_auth.link();
-        return; /* Wait for the authorized() signal. */
-    }
+        auto work = m_work_queue.front();
 
-    switch(work.type)
-    {
-        case ImgurAPI3ActionType::ACCT_INFO:
+        if (work.type != ImgurAPI3ActionType::ANON_IMG_UPLOAD)
         {
-            QNetworkRequest request(QUrl(QString::fromLatin1("https://api.imgur.com/3/account/%1")
-                                        .arg(QLatin1String(work.account.username.toUtf8().toPercentEncoding()))));
-            addAuthToken(&request);
+            if (!m_auth.linked())
+            {
+                m_auth.link();
+                return; /* Wait for the authorized() signal. */
+            }
 
-            this->m_reply = m_net.get(request);
-            break;
+            /* Refresh the token before it expires rather than after a 403,
+             * in the middle of the uploads. */
+            if (m_auth.expiresSoon() && !m_auth.refreshToken().isEmpty())
+                m_auth.refresh();
+
+            if (m_auth.isRefreshing())
+                return; /* Resumed by oauthRefreshed(). */
         }
-        case ImgurAPI3ActionType::ANON_IMG_UPLOAD:
-        case ImgurAPI3ActionType::IMG_UPLOAD:
-        {
-            this->m_image = new QFile(work.upload.imgpath);
 
-            if (!m_image->open(QIODevice::ReadOnly))
-            {
-                delete this->m_image;
-                this->m_image = nullptr;
+        m_work_queue.pop_front();
+        m_running[work.id] = work;
+
+        QNetworkReply* reply = nullptr;
 
-                /* Failed. */
-                emit error(i18n("Could not open file"), m_work_queue.front());
+        switch(work.type)
+        {
+            case ImgurAPI3ActionType::ACCT_INFO:
+            {
+                QNetworkRequest request(QUrl(QString::fromLatin1("https://api.imgur.com/3/account/%1")
+                                            .arg(QLatin1String(work.account.username.toUtf8().toPercentEncoding()))));
+                addAuthToken(&request);
 
-                m_work_queue.pop();
-                return doWork();
+                reply = m_net.get(request);
+                break;
             }
+            case ImgurAPI3ActionType::ANON_IMG_UPLOAD:
+            case ImgurAPI3ActionType::IMG_UPLOAD:
+            {
+                auto* file = new QFile(work.upload.imgpath);
+
+                if (!file->open(QIODevice::ReadOnly))
+                {
+                    delete file;
+
+                    /* Failed. */
+                    emit error(i18n("Could not open file"), work);
+
+                    m_running.erase(work.id);
+                    m_retries.erase(work.id);
+                    continue;
+                }
+
+                /* Set ownership to the multipart to delete the file as well. */
+                auto* multipart = new QHttpMultiPart(QHttpMultiPart::FormDataType);
+                file->setParent(multipart);
+
+                QHttpPart title;
+                title.setHeader(QNetworkRequest::ContentDispositionHeader,
+                                QLatin1String("form-data; name=\"title\""));
+                title.setBody(work.upload.title.toUtf8().toPercentEncoding());
+                multipart->append(title);
+
+                QHttpPart description;
+                description.setHeader(QNetworkRequest::ContentDispositionHeader,
+                                      QLatin1String("form-data; name=\"description\""));
+                description.setBody(work.upload.description.toUtf8().toPercentEncoding());
+                multipart->append(description);
+
+                QHttpPart image;
+                image.setHeader(QNetworkRequest::ContentDispositionHeader,
+                                QVariant(QString::fromLatin1("form-data; name=\"image\"; filename=\"%1\"")
+                                .arg(QLatin1String(QFileInfo(work.upload.imgpath).fileName().toUtf8().toPercentEncoding()))));
+                image.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/octet-stream"));
+                image.setBodyDevice(file);
+                multipart->append(image);
+
+                QNetworkRequest request(QUrl(QLatin1String("https://api.imgur.com/3/image")));
+
+                if (work.type == ImgurAPI3ActionType::IMG_UPLOAD)
+                    addAuthToken(&request);
+                else
+                    addAnonToken(&request);
+
+                reply = this->m_net.post(request, multipart);
+                multipart->setParent(reply);
 
-            /* Set ownership to m_image to delete that as well. */
-            auto* multipart = new QHttpMultiPart(QHttpMultiPart::FormDataType, m_image);
-            QHttpPart title;
-            title.setHeader(QNetworkRequest::ContentDispositionHeader,
-                            QLatin1String("form-data; name=\"title\""));
-            title.setBody(work.upload.title.toUtf8().toPercentEncoding());
-            multipart->append(title);
-
-            QHttpPart description;
-            description.setHeader(QNetworkRequest::ContentDispositionHeader,
-                                  QLatin1String("form-data; name=\"description\""));
-            description.setBody(work.upload.description.toUtf8().toPercentEncoding());
-            multipart->append(description);
-
-            QHttpPart image;
-            image.setHeader(QNetworkRequest::ContentDispositionHeader,
-                            QVariant(QString::fromLatin1("form-data; name=\"image\"; filename=\"%1\"")
-                            .arg(QLatin1String(QFileInfo(work.upload.imgpath).fileName().toUtf8().toPercentEncoding()))));
-            image.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/octet-stream"));
-            image.setBodyDevice(this->m_image);
-            multipart->append(image);
-
-            QNetworkRequest request(QUrl(QLatin1String("https://api.imgur.com/3/image")));
-
-            if (work.type == ImgurAPI3ActionType::IMG_UPLOAD)
-                addAuthToken(&request);
-            else
-                addAnonToken(&request);
+                break;
+            }
+        }
 
-            this->m_reply = this->m_net.post(request, multipart);
+        if (reply)
+        {
+            m_replies[reply] = work.id;
 
-            break;
+            connect(reply, &QNetworkReply::uploadProgress, this, &ImgurAPI3::uploadProgress);
+            connect(reply, &QNetworkReply::finished, this, &ImgurAPI3::replyFinished);
+        }
+        else
+        {
+            m_running.erase(work.id);
+            m_retries.erase(work.id);
         }
     }
 
-    if (this->m_reply)
-    {
-        connect(m_reply, &QNetworkReply::uploadProgress, this, &ImgurAPI3::uploadProgress);
-        connect(m_reply, &QNetworkReply::finished, this, &ImgurAPI3::replyFinished);
-    }
+    if (m_work_queue.empty() && m_running.empty())
+        emit busy(false);
 }
@@ -26,7 +26,8 @@
 // C++ includes
 
 #include <atomic>
-#include <queue>
+#include <deque>
+#include <map>
 
 // Qt includes
 
@@ -38,6 +39,7 @@
 // Local includes
 
 #include "o2.h"
+#include "kpratelimiter.h"
 
 enum class ImgurAPI3ActionType
 {
@@ -48,6 +50,8 @@ enum class ImgurAPI3ActionType
 
 struct ImgurAPI3Action
 {
+    /* Set by queueWork(), identifies the action in the results. */
+    unsigned int id = 0;
     ImgurAPI3ActionType type;
     struct
     {
@@ -102,8 +106,16 @@ public:
     /* Use this to read/write the access and refresh tokens. */
     O2 &getAuth();
 
+    /* Remaining request and upload credits, as announced by Imgur. */
+    const KIPIPlugins::KPRateLimiter& getRateLimiter() const;
+
+    /* Number of requests sent at the same time. Default is 3. */
+    void setMaxConcurrentRequests(unsigned int count);
+
+    /* Actions queued or running. */
     unsigned int workQueueLength();
-    void queueWork(const ImgurAPI3Action& action);
+    /* Returns the ID given to the action. */
+    unsigned int queueWork(const ImgurAPI3Action& action);
     void cancelAllWork();
 
     static QUrl urlForDeletehash(const QString& deletehash);
@@ -132,8 +144,10 @@ public Q_SLOTS:
     void oauthRequestPin(const QUrl& url);
     /* Connected to m_auth.linkingFailed(). */
     void oauthFailed();
+    /* Connected to m_auth.refreshFinished(). */
+    void oauthRefreshed(QNetworkReply::NetworkError error);
 
-    /* Connected to the current QNetworkReply. */
+    /* Connected to each running QNetworkReply. */
     void uploadProgress(qint64 sent, qint64 total);
     void replyFinished();
 
@@ -141,8 +155,10 @@ protected:
     void timerEvent(QTimerEvent* event) override;
 
 private:
-    /* Starts m_work_timer if m_work_queue not empty. */
-    void startWorkTimer();
+    /* Starts m_work_timer if m_work_queue not empty.
+     * If delay is negative, the delay needed to not exhaust
+     * the credits is used. */
+    void startWorkTimer(int delay = -1);
     /* Stops m_work_timer if running. */
     void stopWorkTimer();
     /* Adds the user authorization info to the request. */
@@ -150,23 +166,29 @@ private:
     /* Adds the client authorization info to the request. */
     void addAnonToken(QNetworkRequest* request);
 
-    /* Start working on the first item of m_work_queue
-     * by sending a request. */
+    /* Start working on the first items of m_work_queue
+     * by sending requests, up to m_max_concurrent at once. */
     void doWork();
 
     /* Handler for OAuth 2 related requests. */
     O2 m_auth;
 
-    /* Work queue. */
-    std::queue<ImgurAPI3Action> m_work_queue;
-    /* ID of timer triggering on idle (0ms). */
+    /* Work queue, of the actions not sent yet. */
+    std::deque<ImgurAPI3Action> m_work_queue;
+    /* Actions sent and waiting for their reply, by ID. */
+    std::map<unsigned int, ImgurAPI3Action> m_running;
+    /* ID of the action sent with each running QNetworkReply. */
+    std::map<QNetworkReply*, unsigned int> m_replies;
+    /* Retries done for the actions throttled at least once, by ID. */
+    std::map<unsigned int, int> m_retries;
+    /* ID given to the next queued action. */
+    unsigned int m_next_id = 1;
+    unsigned int m_max_concurrent = 3;
+    /* ID of timer triggering on idle (0ms), or later when throttled. */
     int m_work_timer = 0;
 
-    /* Current QNetworkReply */
-    QNetworkReply* m_reply = nullptr;
-
-    /* Current image being uploaded */
-    QFile* m_image = nullptr;
+    /* Retry and pacing policy following the Imgur credits. */
+    KIPIPlugins::KPRateLimiter m_limiter;
 
     /* The QNetworkAccessManager used for connections */
     QNetworkAccessManager m_net;
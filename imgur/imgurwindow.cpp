@@ -44,6 +44,7 @@
 #include "kpimageinfo.h"
 #include "kpaboutdata.h"
 #include "kpversion.h"
+#include "kpuploadhistory.h"
 
 static const constexpr char *IMGUR_CLIENT_ID("bd2572bce74b73d"),
                             *IMGUR_CLIENT_SECRET("300988683e99cb7b203a5889cf71de9ac891c1c1");
@@ -56,6 +57,10 @@ ImgurWindow::ImgurWindow(QWidget* const /*parent*/)
 {
     api = new ImgurAPI3(QString::fromLatin1(IMGUR_CLIENT_ID),
                         QString::fromLatin1(IMGUR_CLIENT_SECRET), this);
+    history = new KPUploadHistory(QString::fromLatin1("Imgur"));
+
+    connect(history, &KPUploadHistory::filesHashed,
+            this, &ImgurWindow::slotFilesHashed);
 
     /* Connect API signals */
     connect(api, &ImgurAPI3::authorized, this, &ImgurWindow::apiAuthorized);
@@ -149,6 +154,7 @@ ImgurWindow::ImgurWindow(QWidget* const /*parent*/)
 ImgurWindow::~ImgurWindow()
 {
     saveSettings();
+    delete history;
 }
 
 void ImgurWindow::reactivate()
@@ -166,28 +172,50 @@ void ImgurWindow::forgetButtonClicked()
 
 void ImgurWindow::slotUpload()
 {
-    QList<const ImgurImageListViewItem*> pending = this->list->getPendingItems();
+    hashPendingItems(ImgurAPI3ActionType::IMG_UPLOAD);
+}
 
-    for (auto item : pending)
-    {
-        ImgurAPI3Action action;
-        action.type = ImgurAPI3ActionType::IMG_UPLOAD;
-        action.upload.imgpath = item->url().toLocalFile();
-        action.upload.title = item->Title();
-        action.upload.description = item->Description();
+void ImgurWindow::slotAnonUpload()
+{
+    hashPendingItems(ImgurAPI3ActionType::ANON_IMG_UPLOAD);
+}
 
-        api->queueWork(action);
-    }
+void ImgurWindow::hashPendingItems(ImgurAPI3ActionType type)
+{
+    // The upload starts in slotFilesHashed().
+    if (hashing)
+        return;
+
+    QStringList paths;
+
+    for (auto item : list->getPendingItems())
+        paths << item->url().toLocalFile();
+
+    uploadType = type;
+    hashing    = true;
+    history->hashFiles(paths);
 }
 
-void ImgurWindow::slotAnonUpload()
+void ImgurWindow::slotFilesHashed()
 {
+    if (!hashing)
+        return;
+
+    hashing = false;
+
     QList<const ImgurImageListViewItem*> pending = this->list->getPendingItems();
 
     for (auto item : pending)
     {
+        if (history->isUploaded(item->url().toLocalFile(), historyAccount(uploadType)))
+        {
+            qCDebug(KIPIPLUGINS_LOG) << "Skipping" << item->url() << ", already uploaded";
+            list->processed(item->url(), true);
+            continue;
+        }
+
         ImgurAPI3Action action;
-        action.type = ImgurAPI3ActionType::ANON_IMG_UPLOAD;
+        action.type = uploadType;
         action.upload.imgpath = item->url().toLocalFile();
         action.upload.title = item->Title();
         action.upload.description = item->Description();
@@ -199,10 +227,21 @@ void ImgurWindow::slotAnonUpload()
 void ImgurWindow::slotFinished()
 {
     saveSettings();
+    history->save();
+}
+
+QString ImgurWindow::historyAccount(ImgurAPI3ActionType type) const
+{
+    // Anonymous uploads are not attached to the logged in account.
+    if (type == ImgurAPI3ActionType::ANON_IMG_UPLOAD || username.isEmpty())
+        return QString::fromLatin1("anonymous");
+
+    return username;
 }
 
 void ImgurWindow::slotCancel()
 {
+    hashing = false;
     api->cancelAllWork();
 }
 
@@ -240,6 +279,8 @@ void ImgurWindow::apiRequestPin(const QUrl& url)
 
 void ImgurWindow::apiSuccess(const ImgurAPI3Result& result)
 {
+    history->addUpload(result.action->upload.imgpath, historyAccount(result.action->type),
+                       QString(), result.image.hash);
     list->slotSuccess(result);
 }
 
@@ -292,6 +333,8 @@ void ImgurWindow::readSettings()
     KConfigGroup groupDialog = config.group("Imgur Dialog");
     KWindowConfig::restoreWindowSize(windowHandle(), groupDialog);
     resize(windowHandle()->size());
+
+    api->setMaxConcurrentRequests(groupDialog.readEntry("Parallel Uploads", 3));
 }
 
 void ImgurWindow::saveSettings()
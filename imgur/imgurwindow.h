@@ -43,6 +43,11 @@ namespace KIPI
     class Interface;
 }
 
+namespace KIPIPlugins
+{
+    class KPUploadHistory;
+}
+
 using namespace KIPI;
 using namespace KIPIPlugins;
 
@@ -66,6 +71,7 @@ public Q_SLOTS:
     void slotAnonUpload();
     void slotFinished();
     void slotCancel();
+    void slotFilesHashed();
 
     /* ImgurAPI3 callbacks */
     void apiAuthorized(bool success, const QString& username);
@@ -81,10 +87,16 @@ private:
     void setContinueUpload(bool state);
     void readSettings();
     void saveSettings();
+    QString historyAccount(ImgurAPI3ActionType type) const;
+    void hashPendingItems(ImgurAPI3ActionType type);
 
 private:
     ImgurImagesList* list = nullptr;
     ImgurAPI3*       api  = nullptr;
+    KPUploadHistory* history = nullptr;
+    /* The type of the upload started when the pending files are hashed. */
+    ImgurAPI3ActionType uploadType = ImgurAPI3ActionType::IMG_UPLOAD;
+    bool             hashing = false;
     QPushButton*     forgetButton = nullptr;
     QPushButton*     uploadAnonButton = nullptr;
     QLabel*          userLabel = nullptr;
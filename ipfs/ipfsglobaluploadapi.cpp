@@ -22,6 +22,10 @@
 
 #include "ipfsglobaluploadapi.h"
 
+// C++ includes
+
+#include <algorithm>
+
 // Qt includes
 
 #include <QFileInfo>
@@ -56,53 +60,118 @@ IPFSGLOBALUPLOADAPI::~IPFSGLOBALUPLOADAPI()
     cancelAllWork();
 }
 
+void IPFSGLOBALUPLOADAPI::setMaxConcurrentRequests(unsigned int count)
+{
+    m_max_concurrent = std::max(1u, count);
+}
+
+QUrl IPFSGLOBALUPLOADAPI::endpoint() const
+{
+    return QUrl(ipfs_upload_url);
+}
+
 unsigned int IPFSGLOBALUPLOADAPI::workQueueLength()
 {
-    return m_work_queue.size();
+    return m_work_queue.size() + m_running.size();
 }
 
-void IPFSGLOBALUPLOADAPI::queueWork(const IPFSGLOBALUPLOADAPIAction& action)
+unsigned int IPFSGLOBALUPLOADAPI::queueWork(const IPFSGLOBALUPLOADAPIAction& action)
 {
-    m_work_queue.push(action);
+    m_work_queue.push_back(action);
+    m_work_queue.back().id = m_next_id++;
     startWorkTimer();
+
+    return m_work_queue.back().id;
 }
 
 void IPFSGLOBALUPLOADAPI::cancelAllWork()
 {
     stopWorkTimer();
 
-    if (m_reply)
-        m_reply->abort();
-
     /* Should error be emitted for those actions? */
-    while (!m_work_queue.empty())
-        m_work_queue.pop();
+    m_work_queue.clear();
+    m_running.clear();
+    m_retries.clear();
+    m_forbidden.clear();
+
+    auto replies = m_replies;
+    m_replies.clear();
+
+    for (auto& running : replies)
+    {
+        disconnect(running.first, 0, this, 0);
+        running.first->abort();
+        running.first->deleteLater();
+    }
+
+    emit busy(false);
 }
 
 void IPFSGLOBALUPLOADAPI::uploadProgress(qint64 sent, qint64 total)
 {
-    if (total > 0) /* Don't divide by 0 */
-        emit progress((sent * 100) / total, m_work_queue.front());
+    auto found = m_replies.find(qobject_cast<QNetworkReply*>(sender()));
+
+    if (total <= 0 || found == m_replies.end()) /* Don't divide by 0 */
+        return;
+
+    auto running = m_running.find(found->second);
+
+    if (running != m_running.end())
+        emit progress((sent * 100) / total, running->second);
 }
 
 void IPFSGLOBALUPLOADAPI::replyFinished()
 {
-    auto* reply = m_reply;
-    reply->deleteLater();
-    m_reply = nullptr;
+    auto* reply = qobject_cast<QNetworkReply*>(sender());
+    auto found  = m_replies.find(reply);
 
-    if (this->m_image)
+    if (found == m_replies.end())
     {
-        delete this->m_image;
-        this->m_image = nullptr;
+        qCDebug(KIPIPLUGINS_LOG) << "Received result without request";
+        return;
     }
 
-    if (m_work_queue.empty())
-    {
-        qCDebug(KIPIPLUGINS_LOG) << "Received result without request";
+    /* The multipart and the image file are children of the reply. */
+    reply->deleteLater();
+    unsigned int id = found->second;
+    m_replies.erase(found);
+
+    auto running = m_running.find(id);
+
+    if (running == m_running.end())
         return;
+
+    /* Keep the action in m_running while signals are emitted, so
+     * that workQueueLength() still counts it, but pass a copy as
+     * the receivers may cancel all work. */
+    const IPFSGLOBALUPLOADAPIAction action = running->second;
+
+    m_limiter.updateFromReply(reply);
+
+    if (KIPIPlugins::KPRateLimiter::isThrottled(reply))
+    {
+        /* The retries are counted for each action, as several
+         * requests may be throttled at the same time. */
+        int delay = m_limiter.retryDelay(m_retries[id]);
+
+        if (delay >= 0)
+        {
+            m_retries[id]++;
+
+            /* Gateway overloaded: put the action back in front of
+             * the queue and try again later. */
+            qCDebug(KIPIPLUGINS_LOG) << "Upload gateway is throttling, retry" << m_retries[id]
+                                     << "in" << delay << "ms";
+            m_running.erase(id);
+            m_work_queue.push_front(action);
+            stopWorkTimer();
+            startWorkTimer(delay);
+            return;
+        }
     }
 
+    m_retries.erase(id);
+
     /* toInt() returns 0 if conversion fails. That fits nicely already. */
     int code = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
     auto response = QJsonDocument::fromJson(reply->readAll());
@@ -110,7 +179,7 @@ void IPFSGLOBALUPLOADAPI::replyFinished()
     {
         /* Success! */
         IPFSGLOBALUPLOADAPIResult result;
-        result.action = &m_work_queue.front();
+        result.action = &action;
         switch (result.action->type)
         {
             case IPFSGLOBALUPLOADAPIActionType::IMG_UPLOAD:
@@ -128,13 +197,20 @@ void IPFSGLOBALUPLOADAPI::replyFinished()
     }
     else
     {
-        if (code == 403)
+        if (code == 403 && m_forbidden.insert(id).second)
         {
-            /* HTTP 403 Forbidden -> Invalid token? 
-             * That needs to be handled internally, so don't emit progress
-             * and keep the action in the queue for later retries. */
+            /* HTTP 403 Forbidden -> The gateway has no token to refresh,
+             * so send the action once more after the pacing delay and
+             * give up on it if that is refused again. */
+            m_running.erase(id);
+            m_work_queue.push_front(action);
+            startWorkTimer();
             return;
         }
+        else if (code == 403)
+        {
+            emit error(i18n("Access denied by the upload gateway"), action);
+        }
         else
         {
             /* Failed. */
@@ -142,12 +218,13 @@ void IPFSGLOBALUPLOADAPI::replyFinished()
                        .toObject()[QLatin1String("error")]
                        .toString(QLatin1String("Could not read response."));
 
-            emit error(msg, m_work_queue.front());
+            emit error(msg, action);
         }
     }
 
     /* Next work item. */
-    m_work_queue.pop();
+    m_forbidden.erase(id);
+    m_running.erase(id);
     startWorkTimer();
 }
 
@@ -165,14 +242,14 @@ void IPFSGLOBALUPLOADAPI::timerEvent(QTimerEvent* event)
     doWork();
 }
 
-void IPFSGLOBALUPLOADAPI::startWorkTimer()
+void IPFSGLOBALUPLOADAPI::startWorkTimer(int delay)
 {
     if (!m_work_queue.empty() && m_work_timer == 0)
     {
-        m_work_timer = QObject::startTimer(0);
+        m_work_timer = QObject::startTimer(delay < 0 ? m_limiter.pacingDelay() : delay);
         emit busy(true);
     }
-    else
+    else if (m_work_queue.empty() && m_running.empty())
         emit busy(false);
 }
 
@@ -187,58 +264,75 @@ void IPFSGLOBALUPLOADAPI::stopWorkTimer()
 
 void IPFSGLOBALUPLOADAPI::doWork()
 {
-    if (m_work_queue.empty() || m_reply != nullptr)
-        return;
+    while (!m_work_queue.empty() && m_running.size() < m_max_concurrent)
+    {
+        auto work = m_work_queue.front();
+        m_work_queue.pop_front();
+        m_running[work.id] = work;
 
-    auto &work = m_work_queue.front();
+        QNetworkReply* reply = nullptr;
 
-    switch(work.type)
-    {
-        case IPFSGLOBALUPLOADAPIActionType::IMG_UPLOAD:
+        switch(work.type)
         {
-            this->m_image = new QFile(work.upload.imgpath);
-
-            if (!m_image->open(QIODevice::ReadOnly))
+            case IPFSGLOBALUPLOADAPIActionType::IMG_UPLOAD:
             {
-                delete this->m_image;
-                this->m_image = nullptr;
+                auto* file = new QFile(work.upload.imgpath);
+
+                if (!file->open(QIODevice::ReadOnly))
+                {
+                    delete file;
+
+                    /* Failed. */
+                    emit error(i18n("Could not open file"), work);
+
+                    m_running.erase(work.id);
+                    m_retries.erase(work.id);
+                    continue;
+                }
+
+                /* Set ownership to the multipart to delete the file as well. */
+                auto* multipart = new QHttpMultiPart(QHttpMultiPart::FormDataType);
+                file->setParent(multipart);
+
+                QHttpPart title;
+                title.setHeader(QNetworkRequest::ContentDispositionHeader,
+                                QLatin1String("form-data; name=\"keyphrase\""));
+                multipart->append(title);
+
+                QHttpPart description;
+                description.setHeader(QNetworkRequest::ContentDispositionHeader,
+                                      QLatin1String("form-data; name=\"user\""));
+                multipart->append(description);
+
+                QHttpPart image;
+                image.setHeader(QNetworkRequest::ContentDispositionHeader,
+                                QVariant(QString::fromLatin1("form-data; name=\"file\";  filename=\"%1\"")
+                                .arg(QLatin1String(QFileInfo(work.upload.imgpath).fileName().toUtf8().toPercentEncoding()))));
+                image.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("image/jpeg"));
+                image.setBodyDevice(file);
+                multipart->append(image);
+                QNetworkRequest request(endpoint());
+                reply = this->m_net.post(request, multipart);
+                multipart->setParent(reply);
 
-                /* Failed. */
-                emit error(i18n("Could not open file"), m_work_queue.front());
-
-                m_work_queue.pop();
-                return doWork();
+                break;
             }
+        }
+
+        if (reply)
+        {
+            m_replies[reply] = work.id;
 
-            /* Set ownership to m_image to delete that as well. */
-            auto* multipart = new QHttpMultiPart(QHttpMultiPart::FormDataType, m_image);
-            QHttpPart title;
-            title.setHeader(QNetworkRequest::ContentDispositionHeader,
-                            QLatin1String("form-data; name=\"keyphrase\""));
-            multipart->append(title);
-
-            QHttpPart description;
-            description.setHeader(QNetworkRequest::ContentDispositionHeader,
-                                  QLatin1String("form-data; name=\"user\""));
-            multipart->append(description);
-
-            QHttpPart image;
-            image.setHeader(QNetworkRequest::ContentDispositionHeader,
-                            QVariant(QString::fromLatin1("form-data; name=\"file\";  filename=\"%1\"")
-                            .arg(QLatin1String(QFileInfo(work.upload.imgpath).fileName().toUtf8().toPercentEncoding()))));
-            image.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("image/jpeg"));
-            image.setBodyDevice(this->m_image);
-            multipart->append(image);
-            QNetworkRequest request(QUrl(QLatin1String("https://api.globalupload.io/transport/add")));
-            this->m_reply = this->m_net.post(request, multipart);
-
-            break;
+            connect(reply, &QNetworkReply::uploadProgress, this, &IPFSGLOBALUPLOADAPI::uploadProgress);
+            connect(reply, &QNetworkReply::finished, this, &IPFSGLOBALUPLOADAPI::replyFinished);
+        }
+        else
+        {
+            m_running.erase(work.id);
+            m_retries.erase(work.id);
         }
     }
 
-    if (this->m_reply)
-    {
-        connect(m_reply, &QNetworkReply::uploadProgress, this, &IPFSGLOBALUPLOADAPI::uploadProgress);
-        connect(m_reply, &QNetworkReply::finished, this, &IPFSGLOBALUPLOADAPI::replyFinished);
-    }
+    if (m_work_queue.empty() && m_running.empty())
+        emit busy(false);
 }
@@ -26,7 +26,9 @@
 // C++ includes
 
 #include <atomic>
-#include <queue>
+#include <deque>
+#include <map>
+#include <set>
 
 // Qt includes
 
@@ -38,6 +40,7 @@
 // Local includes
 
 #include "o2.h"
+#include "kpratelimiter.h"
 
 enum class IPFSGLOBALUPLOADAPIActionType
 {
@@ -46,6 +49,8 @@ enum class IPFSGLOBALUPLOADAPIActionType
 
 struct IPFSGLOBALUPLOADAPIAction
 {
+    /* Set by queueWork(), identifies the action in the results. */
+    unsigned int id = 0;
     IPFSGLOBALUPLOADAPIActionType type;
     struct
     {
@@ -75,8 +80,16 @@ Q_OBJECT
 public:
     IPFSGLOBALUPLOADAPI(QObject* parent = nullptr);
     ~IPFSGLOBALUPLOADAPI();
+    /* Number of uploads sent at the same time. Default is 3. */
+    void setMaxConcurrentRequests(unsigned int count);
+
+    /* Address the files are uploaded to. */
+    QUrl endpoint() const;
+
+    /* Actions queued or running. */
     unsigned int workQueueLength();
-    void queueWork(const IPFSGLOBALUPLOADAPIAction& action);
+    /* Returns the ID given to the action. */
+    unsigned int queueWork(const IPFSGLOBALUPLOADAPIAction& action);
     void cancelAllWork();
 
 Q_SIGNALS:
@@ -89,7 +102,7 @@ Q_SIGNALS:
     void busy(bool b);
 
 public Q_SLOTS:
-    /* Connected to the current QNetworkReply. */
+    /* Connected to each running QNetworkReply. */
     void uploadProgress(qint64 sent, qint64 total);
     void replyFinished();
 
@@ -97,25 +110,35 @@ protected:
     void timerEvent(QTimerEvent* event) override;
 
 private:
-    /* Starts m_work_timer if m_work_queue not empty. */
-    void startWorkTimer();
+    /* Starts m_work_timer if m_work_queue not empty.
+     * If delay is negative, the delay needed to not exhaust
+     * the rate limit is used. */
+    void startWorkTimer(int delay = -1);
     /* Stops m_work_timer if running. */
     void stopWorkTimer();
 
-    /* Start working on the first item of m_work_queue
-     * by sending a request. */
+    /* Start working on the first items of m_work_queue
+     * by sending requests, up to m_max_concurrent at once. */
     void doWork();
 
-    /* Work queue. */
-    std::queue<IPFSGLOBALUPLOADAPIAction> m_work_queue;
-    /* ID of timer triggering on idle (0ms). */
+    /* Work queue, of the actions not sent yet. */
+    std::deque<IPFSGLOBALUPLOADAPIAction> m_work_queue;
+    /* Actions sent and waiting for their reply, by ID. */
+    std::map<unsigned int, IPFSGLOBALUPLOADAPIAction> m_running;
+    /* ID of the action sent with each running QNetworkReply. */
+    std::map<QNetworkReply*, unsigned int> m_replies;
+    /* IDs of the actions already sent again after a 403 reply. */
+    std::set<unsigned int> m_forbidden;
+    /* Retries done for the actions throttled at least once, by ID. */
+    std::map<unsigned int, int> m_retries;
+    /* ID given to the next queued action. */
+    unsigned int m_next_id = 1;
+    unsigned int m_max_concurrent = 3;
+    /* ID of timer triggering on idle (0ms), or later when throttled. */
     int m_work_timer = 0;
 
-    /* Current QNetworkReply */
-    QNetworkReply* m_reply = nullptr;
-
-    /* Current image being uploaded */
-    QFile* m_image = nullptr;
+    /* Retry and pacing policy of the upload gateway. */
+    KIPIPlugins::KPRateLimiter m_limiter;
 
     /* The QNetworkAccessManager used for connections */
     QNetworkAccessManager m_net;
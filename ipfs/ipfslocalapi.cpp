@@ -0,0 +1,596 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-26
+ * Description : a kipi plugin to export images to a local IPFS node
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "ipfslocalapi.h"
+
+// C++ includes
+
+#include <algorithm>
+#include <cstring>
+
+// Qt includes
+
+#include <QFile>
+#include <QFileInfo>
+#include <QIODevice>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkReply>
+#include <QTimerEvent>
+#include <QUrlQuery>
+#include <QUuid>
+
+// KDE includes
+
+#include <klocalizedstring.h>
+
+// Local includes
+
+#include "kipiplugins_debug.h"
+
+static const QString ipfs_local_endpoint = QLatin1String("http://127.0.0.1:5001");
+
+/* Multipart body of an add request. QHttpMultiPart needs all the files
+ * to be open while the request runs, which exhausts the file descriptors
+ * with large albums: here, each file is only open while it is sent. */
+class IPFSAddBody : public QIODevice
+{
+public:
+    IPFSAddBody(QObject* parent = nullptr)
+        : QIODevice(parent),
+          m_boundary("kipi-ipfs-" + QUuid::createUuid().toRfc4122().toHex())
+    {
+    }
+
+    /* Returns the offset of the part in the body. */
+    qint64 addFile(const QString& path, const QString& name)
+    {
+        qint64 offset = m_size;
+
+        addData("--" + m_boundary + "\r\n"
+                "Content-Disposition: form-data; name=\"file\"; filename=\"" +
+                QUrl::toPercentEncoding(name) + "\"\r\n"
+                "Content-Type: application/octet-stream\r\n\r\n");
+
+        Segment file;
+        file.offset = m_size;
+        file.size   = QFileInfo(path).size();
+        file.path   = path;
+        m_segments.push_back(file);
+        m_size     += file.size;
+
+        addData("\r\n");
+
+        return offset;
+    }
+
+    void finish()
+    {
+        addData("--" + m_boundary + "--\r\n");
+    }
+
+    QByteArray contentType() const
+    {
+        return "multipart/form-data; boundary=" + m_boundary;
+    }
+
+    bool isSequential() const override
+    {
+        return false;
+    }
+
+    qint64 size() const override
+    {
+        return m_size;
+    }
+
+    bool seek(qint64 pos) override
+    {
+        if (pos < 0 || pos > m_size)
+            return false;
+
+        m_pos = pos;
+        return QIODevice::seek(pos);
+    }
+
+    bool atEnd() const override
+    {
+        return m_pos >= m_size;
+    }
+
+    qint64 bytesAvailable() const override
+    {
+        return (m_size - m_pos) + QIODevice::bytesAvailable();
+    }
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override
+    {
+        qint64 done = 0;
+
+        while (done < maxSize && m_pos < m_size)
+        {
+            /* Last segment starting at or before m_pos. */
+            auto it = std::upper_bound(m_segments.begin(), m_segments.end(), m_pos,
+                                       [](qint64 pos, const Segment& segment) { return pos < segment.offset; });
+            const Segment& segment = *(--it);
+            int index              = it - m_segments.begin();
+            qint64 in              = m_pos - segment.offset;
+            qint64 len             = std::min(maxSize - done, segment.size - in);
+
+            if (len <= 0)
+                break;
+
+            if (segment.path.isEmpty())
+            {
+                std::memcpy(data + done, segment.data.constData() + in, len);
+            }
+            else
+            {
+                if (m_file_segment != index)
+                {
+                    m_file.close();
+                    m_file.setFileName(segment.path);
+                    m_file_segment = index;
+
+                    if (!m_file.open(QIODevice::ReadOnly))
+                    {
+                        setErrorString(i18n("Could not open file %1", segment.path));
+                        return -1;
+                    }
+                }
+
+                if (m_file.pos() != in)
+                    m_file.seek(in);
+
+                if (m_file.read(data + done, len) != len)
+                {
+                    setErrorString(i18n("Could not read file %1", segment.path));
+                    return -1;
+                }
+
+                if (in + len == segment.size)
+                {
+                    m_file.close();
+                    m_file_segment = -1;
+                }
+            }
+
+            done  += len;
+            m_pos += len;
+        }
+
+        return done;
+    }
+
+    qint64 writeData(const char*, qint64) override
+    {
+        return -1;
+    }
+
+private:
+    struct Segment
+    {
+        qint64     offset = 0;
+        qint64     size   = 0;
+        /* Either data, or the path of a file. */
+        QByteArray data;
+        QString    path;
+    };
+
+    void addData(const QByteArray& data)
+    {
+        Segment segment;
+        segment.offset = m_size;
+        segment.size   = data.size();
+        segment.data   = data;
+        m_segments.push_back(segment);
+        m_size        += segment.size;
+    }
+
+    QByteArray           m_boundary;
+    std::vector<Segment> m_segments;
+    qint64               m_size = 0;
+    qint64               m_pos  = 0;
+
+    /* File being read, and the index of its segment. */
+    QFile                m_file;
+    int                  m_file_segment = -1;
+};
+
+// ------------------------------------------------------------------------------------------------
+
+IPFSLOCALAPI::IPFSLOCALAPI(QObject* parent)
+    : QObject(parent),
+      m_endpoint(ipfs_local_endpoint)
+{
+}
+
+IPFSLOCALAPI::~IPFSLOCALAPI()
+{
+    /* Disconnect all signals as cancelAllWork may emit */
+    disconnect(this, 0, 0, 0);
+    cancelAllWork();
+}
+
+void IPFSLOCALAPI::setEndpoint(const QUrl& url)
+{
+    m_endpoint = url.isValid() ? url : QUrl(ipfs_local_endpoint);
+}
+
+QUrl IPFSLOCALAPI::endpoint() const
+{
+    return m_endpoint;
+}
+
+void IPFSLOCALAPI::setPin(bool pin)
+{
+    m_pin = pin;
+}
+
+void IPFSLOCALAPI::setOnlyHash(bool onlyHash)
+{
+    m_only_hash = onlyHash;
+}
+
+bool IPFSLOCALAPI::onlyHash() const
+{
+    return m_only_hash;
+}
+
+unsigned int IPFSLOCALAPI::workQueueLength()
+{
+    return m_work_queue.size() + std::count(m_added.begin(), m_added.end(), false) + m_failed.size();
+}
+
+void IPFSLOCALAPI::queueWork(const IPFSGLOBALUPLOADAPIAction& action)
+{
+    m_work_queue.push_back(action);
+
+    if (m_work_timer == 0 && !m_reply)
+    {
+        m_work_timer = QObject::startTimer(0);
+        emit busy(true);
+    }
+}
+
+void IPFSLOCALAPI::cancelAllWork()
+{
+    if (m_work_timer != 0)
+    {
+        QObject::killTimer(m_work_timer);
+        m_work_timer = 0;
+    }
+
+    /* Should error be emitted for those actions? */
+    m_work_queue.clear();
+    m_running.clear();
+    m_added.clear();
+    m_failed.clear();
+    m_names.clear();
+
+    if (m_reply)
+    {
+        disconnect(m_reply, 0, this, 0);
+        m_reply->abort();
+        m_reply->deleteLater();
+        m_reply = nullptr;
+    }
+
+    emit busy(false);
+}
+
+QUrl IPFSLOCALAPI::urlForHash(const QString& hash)
+{
+    return QUrl{QLatin1String("https://ipfs.io/ipfs/") + hash};
+}
+
+void IPFSLOCALAPI::uploadProgress(qint64 sent, qint64 /*total*/)
+{
+    if (sender() != m_reply || m_running.empty())
+        return;
+
+    /* m_offsets has one more item, the end of the last file. */
+    auto it   = std::upper_bound(m_offsets.begin(), m_offsets.end() - 1, sent);
+    int index = std::max(0, int(it - m_offsets.begin()) - 1);
+
+    qint64 size = m_offsets[index + 1] - m_offsets[index];
+    unsigned int percent = size > 0 ? std::min(qint64(100), ((sent - m_offsets[index]) * 100) / size)
+                                    : 100;
+
+    if (index == m_progress_index && percent == m_progress_percent)
+        return;
+
+    m_progress_index   = index;
+    m_progress_percent = percent;
+
+    /* The receivers may cancel all work. */
+    const IPFSGLOBALUPLOADAPIAction action = m_running[index];
+
+    emit progress(percent, action);
+}
+
+void IPFSLOCALAPI::replyReadyRead()
+{
+    if (sender() != m_reply)
+        return;
+
+    m_buffer += m_reply->readAll();
+
+    int end;
+
+    /* One JSON object per line. */
+    while (m_reply && (end = m_buffer.indexOf('\n')) >= 0)
+    {
+        QByteArray line = m_buffer.left(end);
+        m_buffer.remove(0, end + 1);
+        readEntry(line);
+    }
+}
+
+void IPFSLOCALAPI::readEntry(const QByteArray& line)
+{
+    if (line.trimmed().isEmpty())
+        return;
+
+    auto entry = QJsonDocument::fromJson(line).object();
+
+    if (entry[QLatin1String("Type")].toString() == QLatin1String("error"))
+    {
+        m_error = entry[QLatin1String("Message")].toString();
+        return;
+    }
+
+    QString name = entry[QLatin1String("Name")].toString();
+    QString hash = entry[QLatin1String("Hash")].toString();
+
+    /* Objects with the progress of a file have no hash. */
+    if (hash.isEmpty())
+        return;
+
+    auto found = m_names.constFind(name);
+
+    if (found == m_names.constEnd())
+    {
+        /* The directory comes after its files. */
+        m_root = hash;
+        return;
+    }
+
+    m_added[found.value()] = true;
+
+    /* The receivers may cancel all work. */
+    const IPFSGLOBALUPLOADAPIAction action = m_running[found.value()];
+
+    IPFSGLOBALUPLOADAPIResult result;
+    result.action     = &action;
+    result.image.name = name;
+    result.image.url  = urlForHash(hash).toString();
+    /* The size is sent as a string. */
+    result.image.size = entry[QLatin1String("Size")].toVariant().toUInt();
+
+    emit success(result);
+}
+
+void IPFSLOCALAPI::replyFinished()
+{
+    auto* reply = m_reply;
+
+    if (!reply || sender() != reply)
+        return;
+
+    replyReadyRead();
+
+    if (!m_reply)
+        return; /* Cancelled. */
+
+    if (!m_buffer.isEmpty())
+        readEntry(m_buffer);
+
+    m_buffer.clear();
+
+    if (!m_reply)
+        return;
+
+    m_reply = nullptr;
+    reply->deleteLater();
+
+    int code = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    QString msg;
+
+    if (reply->error() == QNetworkReply::ConnectionRefusedError)
+    {
+        msg = i18n("Could not connect to the IPFS node at %1. Is the daemon running?",
+                   m_endpoint.toString());
+    }
+    else if (reply->error() != QNetworkReply::NoError || code != 200)
+    {
+        msg = m_error.isEmpty() ? reply->errorString() : m_error;
+    }
+    else if (!m_error.isEmpty())
+    {
+        msg = m_error;
+    }
+
+    /* Report all the actions not added. */
+    for (size_t i = 0; i < m_running.size(); ++i)
+    {
+        if (!m_added[i])
+            m_failed.push_back(m_running[i]);
+    }
+
+    m_running.clear();
+    m_added.clear();
+    m_names.clear();
+
+    if (!m_failed.empty())
+    {
+        if (msg.isEmpty())
+            msg = i18n("The IPFS node did not add the file.");
+
+        /* The receivers may cancel all work, which drops the next ones. */
+        while (!m_failed.empty())
+        {
+            const IPFSGLOBALUPLOADAPIAction action = m_failed.front();
+
+            emit error(msg, action);
+
+            if (!m_failed.empty())
+                m_failed.erase(m_failed.begin());
+        }
+    }
+    else if (!msg.isEmpty())
+    {
+        /* All the files are on the node, not the directory holding them. */
+        emit rootFailed(msg);
+    }
+    else if (!m_root.isEmpty())
+    {
+        emit rootAdded(urlForHash(m_root).toString());
+    }
+
+    if (!m_work_queue.empty() && !m_reply && m_work_timer == 0)
+        m_work_timer = QObject::startTimer(0);
+    else if (m_work_queue.empty() && !m_reply)
+        emit busy(false);
+}
+
+void IPFSLOCALAPI::timerEvent(QTimerEvent* event)
+{
+    if (event->timerId() != m_work_timer)
+        return QObject::timerEvent(event);
+
+    event->accept();
+
+    /* One-shot only. */
+    QObject::killTimer(event->timerId());
+    m_work_timer = 0;
+
+    doWork();
+}
+
+QString IPFSLOCALAPI::entryName(const QString& path)
+{
+    QFileInfo info(path);
+    QString name = info.fileName();
+
+    for (int i = 2; m_names.contains(name); ++i)
+    {
+        name = QString::fromLatin1("%1-%2").arg(info.completeBaseName()).arg(i);
+
+        if (!info.suffix().isEmpty())
+            name += QLatin1Char('.') + info.suffix();
+    }
+
+    return name;
+}
+
+void IPFSLOCALAPI::doWork()
+{
+    if (m_work_queue.empty() || m_reply)
+        return;
+
+    m_running.clear();
+    m_names.clear();
+    m_offsets.clear();
+    m_added.clear();
+    m_buffer.clear();
+    m_root.clear();
+    m_error.clear();
+    m_progress_index   = -1;
+    m_progress_percent = 0;
+
+    auto* body = new IPFSAddBody;
+    std::vector<IPFSGLOBALUPLOADAPIAction> failed;
+
+    for (auto& work : m_work_queue)
+    {
+        if (!QFileInfo(work.upload.imgpath).isReadable())
+        {
+            failed.push_back(work);
+            continue;
+        }
+
+        QString name = entryName(work.upload.imgpath);
+        m_names.insert(name, m_running.size());
+        m_offsets.push_back(body->addFile(work.upload.imgpath, name));
+        m_running.push_back(work);
+    }
+
+    m_work_queue.clear();
+
+    if (m_running.empty())
+    {
+        delete body;
+
+        for (auto& work : failed)
+            emit error(i18n("Could not open file"), work);
+
+        emit busy(false);
+        return;
+    }
+
+    body->finish();
+    m_offsets.push_back(body->size());
+    m_added.assign(m_running.size(), false);
+    body->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+
+    QUrl url(m_endpoint);
+    QString path = url.path();
+
+    if (path.endsWith(QLatin1Char('/')))
+        path.chop(1);
+
+    url.setPath(path + QLatin1String("/api/v0/add"));
+
+    QUrlQuery query;
+    query.addQueryItem(QLatin1String("wrap-with-directory"), QLatin1String("true"));
+    query.addQueryItem(QLatin1String("pin"),       m_pin       ? QLatin1String("true") : QLatin1String("false"));
+    query.addQueryItem(QLatin1String("only-hash"), m_only_hash ? QLatin1String("true") : QLatin1String("false"));
+    query.addQueryItem(QLatin1String("progress"),  QLatin1String("false"));
+    url.setQuery(query);
+
+    QNetworkRequest request(url);
+    request.setHeader(QNetworkRequest::ContentTypeHeader,   body->contentType());
+    request.setHeader(QNetworkRequest::ContentLengthHeader, body->size());
+
+    qCDebug(KIPIPLUGINS_LOG) << "Adding" << m_running.size() << "files to the IPFS node at" << m_endpoint;
+
+    m_reply = m_net.post(request, body);
+    body->setParent(m_reply);
+
+    connect(m_reply, &QNetworkReply::uploadProgress, this, &IPFSLOCALAPI::uploadProgress);
+    connect(m_reply, &QNetworkReply::readyRead, this, &IPFSLOCALAPI::replyReadyRead);
+    connect(m_reply, &QNetworkReply::finished, this, &IPFSLOCALAPI::replyFinished);
+
+    auto* reply = m_reply;
+
+    for (auto& work : failed)
+    {
+        /* Failed. */
+        emit error(i18n("Could not open file"), work);
+
+        if (m_reply != reply)
+            break; /* Cancelled. */
+    }
+}
@@ -0,0 +1,137 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-26
+ * Description : a kipi plugin to export images to a local IPFS node
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef IPFSLOCALAPI_H
+#define IPFSLOCALAPI_H
+
+// C++ includes
+
+#include <vector>
+
+// Qt includes
+
+#include <QNetworkAccessManager>
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+#include <QUrl>
+
+// Local includes
+
+#include "ipfsglobaluploadapi.h"
+
+/* Client of the HTTP API of a local IPFS daemon (go-ipfs, js-ipfs).
+ *
+ * All the actions queued together are added with one /api/v0/add request:
+ * the files are streamed from disk one after the other in the multipart
+ * body, and wrapped in a directory, so the album gets one root CID
+ * besides the CID of each file. The same signals as IPFSGLOBALUPLOADAPI
+ * are emitted, rootAdded() is emitted in addition for the directory. */
+class IPFSLOCALAPI : public QObject
+{
+Q_OBJECT
+
+public:
+    IPFSLOCALAPI(QObject* parent = nullptr);
+    ~IPFSLOCALAPI();
+
+    /* Address of the API of the daemon. Default is http://127.0.0.1:5001 */
+    void setEndpoint(const QUrl& url);
+    QUrl endpoint() const;
+    /* Pin the added files on the node. Default is true. */
+    void setPin(bool pin);
+    /* Only compute the CIDs, without writing anything on the node. */
+    void setOnlyHash(bool onlyHash);
+    bool onlyHash() const;
+
+    /* Actions queued, running or being reported as failed. */
+    unsigned int workQueueLength();
+    /* Actions queued before the event loop runs are sent together. */
+    void queueWork(const IPFSGLOBALUPLOADAPIAction& action);
+    void cancelAllWork();
+
+    static QUrl urlForHash(const QString& hash);
+
+Q_SIGNALS:
+    /* Emitted on progress changes of the file being sent. */
+    void progress(unsigned int percent, const IPFSGLOBALUPLOADAPIAction& action);
+    void success(const IPFSGLOBALUPLOADAPIResult& result);
+    void error(const QString& msg, const IPFSGLOBALUPLOADAPIAction& action);
+    /* Emitted once all files are added, with the URL of the directory. */
+    void rootAdded(const QString& url);
+    /* Emitted instead of rootAdded() when all files are added, but the
+     * request fails before the directory is. */
+    void rootFailed(const QString& msg);
+
+    /* Emitted when the status changes. */
+    void busy(bool b);
+
+public Q_SLOTS:
+    /* Connected to the running QNetworkReply. */
+    void uploadProgress(qint64 sent, qint64 total);
+    void replyReadyRead();
+    void replyFinished();
+
+protected:
+    void timerEvent(QTimerEvent* event) override;
+
+private:
+    /* Send all queued actions in one request. */
+    void doWork();
+    /* Handle one JSON object of the streamed response. */
+    void readEntry(const QByteArray& line);
+    /* Name of the file in the directory, unique in the request. */
+    QString entryName(const QString& path);
+
+    QUrl m_endpoint;
+    bool m_pin = true;
+    bool m_only_hash = false;
+
+    /* Actions not sent yet. */
+    std::vector<IPFSGLOBALUPLOADAPIAction> m_work_queue;
+    /* Actions of the running request, and the index of each one by its name
+     * in the directory. */
+    std::vector<IPFSGLOBALUPLOADAPIAction> m_running;
+    QHash<QString, int> m_names;
+    /* Offset of each file of m_running in the request body. */
+    std::vector<qint64> m_offsets;
+    /* Actions of m_running added by the node. */
+    std::vector<bool> m_added;
+    /* Actions of the finished request not added, being reported. */
+    std::vector<IPFSGLOBALUPLOADAPIAction> m_failed;
+    /* Response data not parsed yet. */
+    QByteArray m_buffer;
+    QString m_root;
+    QString m_error;
+    int m_progress_index = -1;
+    unsigned int m_progress_percent = 0;
+
+    /* ID of timer triggering on idle (0ms). */
+    int m_work_timer = 0;
+
+    QNetworkReply* m_reply = nullptr;
+
+    /* The QNetworkAccessManager used for connections */
+    QNetworkAccessManager m_net;
+};
+
+#endif // IPFSLOCALAPI_H
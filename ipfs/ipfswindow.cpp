@@ -43,6 +43,7 @@
 #include "kpimageinfo.h"
 #include "kpaboutdata.h"
 #include "kpversion.h"
+#include "kpuploadhistory.h"
 
 namespace KIPIIPFSPlugin
 {
@@ -50,7 +51,11 @@ namespace KIPIIPFSPlugin
 IPFSWindow::IPFSWindow(QWidget* const /*parent*/)
     : KPToolDialog(0)
 {
-    api = new IPFSGLOBALUPLOADAPI(this);
+    api      = new IPFSGLOBALUPLOADAPI(this);
+    localApi = new IPFSLOCALAPI(this);
+    history  = new KPUploadHistory(QString::fromLatin1("IPFS"));
+
+    connect(history, &KPUploadHistory::filesHashed, this, &IPFSWindow::slotFilesHashed);
 
     /* Connect API signals */
 
@@ -59,6 +64,13 @@ IPFSWindow::IPFSWindow(QWidget* const /*parent*/)
     connect(api, &IPFSGLOBALUPLOADAPI::error,      this, &IPFSWindow::apiError);
     connect(api, &IPFSGLOBALUPLOADAPI::busy,       this, &IPFSWindow::apiBusy);
 
+    connect(localApi, &IPFSLOCALAPI::progress,     this, &IPFSWindow::apiProgress);
+    connect(localApi, &IPFSLOCALAPI::success,      this, &IPFSWindow::localSuccess);
+    connect(localApi, &IPFSLOCALAPI::error,        this, &IPFSWindow::apiError);
+    connect(localApi, &IPFSLOCALAPI::rootAdded,    this, &IPFSWindow::localRootAdded);
+    connect(localApi, &IPFSLOCALAPI::rootFailed,   this, &IPFSWindow::localRootFailed);
+    connect(localApi, &IPFSLOCALAPI::busy,         this, &IPFSWindow::apiBusy);
+
     /* | List | Auth | */
     auto* mainLayout = new QHBoxLayout;
     auto* mainWidget = new QWidget(this);
@@ -77,8 +89,42 @@ IPFSWindow::IPFSWindow(QWidget* const /*parent*/)
     auto* authLayout = new QVBoxLayout;
     mainLayout->addLayout(authLayout);
 
+    /* | [x] Add to a local IPFS node |
+     * | http://127.0.0.1:5001        |
+     * | [x] Pin the files            |
+     * | [ ] Only compute the hashes  |
+     * | <album URL>                  | */
+
+    localNodeCheck = new QCheckBox(i18n("Add to a local IPFS node"));
+    localNodeCheck->setToolTip(i18n("Add all the images with one request to the IPFS daemon running "
+                                    "on this computer, in a directory which gets its own address."));
+
+    endpointEdit = new QLineEdit;
+    endpointEdit->setToolTip(i18n("Address of the API of the IPFS daemon"));
+
+    pinCheck = new QCheckBox(i18n("Pin the files on the node"));
+
+    onlyHashCheck = new QCheckBox(i18n("Only compute the addresses (dry run)"));
+    onlyHashCheck->setToolTip(i18n("Nothing is written on the node and the images are not marked as uploaded."));
+
+    rootLabel = new QLabel;
+    rootLabel->setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed);
+    rootLabel->setAlignment(Qt::AlignHCenter | Qt::AlignTop);
+    rootLabel->setWordWrap(true);
+    rootLabel->setOpenExternalLinks(true);
+    rootLabel->setTextInteractionFlags(Qt::TextBrowserInteraction);
+
+    authLayout->addWidget(localNodeCheck);
+    authLayout->addWidget(endpointEdit);
+    authLayout->addWidget(pinCheck);
+    authLayout->addWidget(onlyHashCheck);
+    authLayout->addWidget(rootLabel);
     authLayout->insertStretch(-1, 1);
 
+    connect(localNodeCheck, &QCheckBox::toggled, endpointEdit,  &QLineEdit::setEnabled);
+    connect(localNodeCheck, &QCheckBox::toggled, pinCheck,      &QCheckBox::setEnabled);
+    connect(localNodeCheck, &QCheckBox::toggled, onlyHashCheck, &QCheckBox::setEnabled);
+
     /* Add anonymous upload button */
     /* Connect UI signals */
     connect(startButton(), &QPushButton::clicked,
@@ -117,6 +163,7 @@ IPFSWindow::IPFSWindow(QWidget* const /*parent*/)
 IPFSWindow::~IPFSWindow()
 {
     saveSettings();
+    delete history;
 }
 
 void IPFSWindow::reactivate()
@@ -127,17 +174,58 @@ void IPFSWindow::reactivate()
 
 void IPFSWindow::slotUpload()
 {
+    // The upload starts in slotFilesHashed().
+    if (hashing)
+        return;
+
+    QStringList paths;
+
+    for (auto item : list->getPendingItems())
+        paths << item->url().toLocalFile();
+
+    hashing = true;
+    history->hashFiles(paths);
+}
+
+void IPFSWindow::slotFilesHashed()
+{
+    if (!hashing)
+        return;
+
+    hashing = false;
+
     QList<const IPFSImageListViewItem*> pending = this->list->getPendingItems();
+    bool local = localNodeCheck->isChecked();
+
+    if (local)
+    {
+        localApi->setEndpoint(QUrl::fromUserInput(endpointEdit->text()));
+        localApi->setPin(pinCheck->isChecked());
+        localApi->setOnlyHash(onlyHashCheck->isChecked());
+        rootLabel->clear();
+    }
 
     for (auto item : pending)
     {
+        // Content addressed storage: the same file always gives the same hash.
+        // The album directory of a local node needs all the files though.
+        if (!local && history->isUploaded(item->url().toLocalFile(), api->endpoint().toString()))
+        {
+            qCDebug(KIPIPLUGINS_LOG) << "Skipping" << item->url() << ", already uploaded";
+            list->processed(item->url(), true);
+            continue;
+        }
+
         IPFSGLOBALUPLOADAPIAction action;
         action.type = IPFSGLOBALUPLOADAPIActionType::IMG_UPLOAD;
         action.upload.imgpath = item->url().toLocalFile();
         action.upload.title = item->Title();
         action.upload.description = item->Description();
 
-        api->queueWork(action);
+        if (local)
+            localApi->queueWork(action);
+        else
+            api->queueWork(action);
     }
 }
 
@@ -145,11 +233,14 @@ void IPFSWindow::slotUpload()
 void IPFSWindow::slotFinished()
 {
     saveSettings();
+    history->save();
 }
 
 void IPFSWindow::slotCancel()
 {
+    hashing = false;
     api->cancelAllWork();
+    localApi->cancelAllWork();
 }
 
 /* void IPFSWindow::apiAuthorized(bool success, const QString& username) */
@@ -186,6 +277,7 @@ void IPFSWindow::apiRequestPin(const QUrl& url)
 
 void IPFSWindow::apiSuccess(const IPFSGLOBALUPLOADAPIResult& result)
 {
+    history->addUpload(result.action->upload.imgpath, api->endpoint().toString(), QString(), result.image.url);
     list->slotSuccess(result);
 }
 
@@ -193,8 +285,11 @@ void IPFSWindow::apiError(const QString& msg, const IPFSGLOBALUPLOADAPIAction& a
 {
     list->processed(QUrl::fromLocalFile(action.upload.imgpath), false);
 
+    unsigned int queued = (sender() == localApi) ? localApi->workQueueLength()
+                                                 : api->workQueueLength();
+
     /* 1 here because the current item is still in the queue. */
-    if (api->workQueueLength() <= 1)
+    if (queued <= 1)
     {
         QMessageBox::critical(this,
                               i18n("Uploading Failed"),
@@ -209,7 +304,37 @@ void IPFSWindow::apiError(const QString& msg, const IPFSGLOBALUPLOADAPIAction& a
                                        "Do you want to continue?", msg));
 
     if (cont != QMessageBox::Yes)
-        api->cancelAllWork();
+        slotCancel();
+}
+
+void IPFSWindow::localSuccess(const IPFSGLOBALUPLOADAPIResult& result)
+{
+    if (!localApi->onlyHash())
+    {
+        /* A file on a local node is not on the gateway: keep it under the node address. */
+        history->addUpload(result.action->upload.imgpath, localApi->endpoint().toString(), QString(), result.image.url);
+        list->slotSuccess(result);
+        return;
+    }
+
+    /* Dry run: the file is not on the node, don't remember it. */
+    qCDebug(KIPIPLUGINS_LOG) << result.action->upload.imgpath << "would be added as" << result.image.url;
+    list->processed(QUrl::fromLocalFile(result.action->upload.imgpath), true);
+}
+
+void IPFSWindow::localRootAdded(const QString& url)
+{
+    QString link = QString::fromLatin1("<a href=\"%1\">%1</a>").arg(url);
+
+    if (localApi->onlyHash())
+        rootLabel->setText(i18n("The album would be added as:<br/>%1", link));
+    else
+        rootLabel->setText(i18n("Album added as:<br/>%1", link));
+}
+
+void IPFSWindow::localRootFailed(const QString& msg)
+{
+    rootLabel->setText(i18n("The files were added, but not the album directory: %1", msg));
 }
 
 void IPFSWindow::apiBusy(bool busy)
@@ -238,6 +363,17 @@ void IPFSWindow::readSettings()
     KConfigGroup groupDialog = config.group("IPFS Dialog");
     KWindowConfig::restoreWindowSize(windowHandle(), groupDialog);
     resize(windowHandle()->size());
+
+    api->setMaxConcurrentRequests(groupDialog.readEntry("Parallel Uploads", 3));
+
+    KConfigGroup groupLocal = config.group("IPFS Local Node");
+    localNodeCheck->setChecked(groupLocal.readEntry("Enabled", false));
+    endpointEdit->setText(groupLocal.readEntry("Endpoint", QString::fromLatin1("http://127.0.0.1:5001")));
+    pinCheck->setChecked(groupLocal.readEntry("Pin", true));
+    onlyHashCheck->setChecked(groupLocal.readEntry("Only Hash", false));
+    endpointEdit->setEnabled(localNodeCheck->isChecked());
+    pinCheck->setEnabled(localNodeCheck->isChecked());
+    onlyHashCheck->setEnabled(localNodeCheck->isChecked());
 }
 
 void IPFSWindow::saveSettings()
@@ -248,6 +384,12 @@ void IPFSWindow::saveSettings()
 
     KConfigGroup groupDialog = config.group("IPFS Dialog");
     KWindowConfig::saveWindowSize(windowHandle(), groupDialog);
+
+    KConfigGroup groupLocal = config.group("IPFS Local Node");
+    groupLocal.writeEntry("Enabled",   localNodeCheck->isChecked());
+    groupLocal.writeEntry("Endpoint",  endpointEdit->text());
+    groupLocal.writeEntry("Pin",       pinCheck->isChecked());
+    groupLocal.writeEntry("Only Hash", onlyHashCheck->isChecked());
     config.sync();
 }
 
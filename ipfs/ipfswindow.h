@@ -27,6 +27,8 @@
 
 #include <QObject>
 #include <QLabel>
+#include <QCheckBox>
+#include <QLineEdit>
 
 // Libkipi includes
 
@@ -37,12 +39,18 @@
 #include "ipfsimageslist.h"
 #include "kptooldialog.h"
 #include "ipfsglobaluploadapi.h"
+#include "ipfslocalapi.h"
 
 namespace KIPI
 {
     class Interface;
 }
 
+namespace KIPIPlugins
+{
+    class KPUploadHistory;
+}
+
 using namespace KIPI;
 using namespace KIPIPlugins;
 
@@ -64,6 +72,7 @@ public Q_SLOTS:
     void slotUpload();
     void slotFinished();
     void slotCancel();
+    void slotFilesHashed();
 
     /* IPFSGLOBALUPLOADAPI callbacks */
 /*     void apiAuthorized(bool success, const QString& username); */
@@ -74,6 +83,11 @@ public Q_SLOTS:
     void apiError(const QString &msg, const IPFSGLOBALUPLOADAPIAction& action);
     void apiBusy(bool busy);
 
+    /* IPFSLOCALAPI callbacks */
+    void localSuccess(const IPFSGLOBALUPLOADAPIResult& result);
+    void localRootAdded(const QString& url);
+    void localRootFailed(const QString& msg);
+
 private:
     void closeEvent(QCloseEvent* e) Q_DECL_OVERRIDE;
     void setContinueUpload(bool state);
@@ -83,9 +97,20 @@ private:
 private:
     IPFSImagesList* list = nullptr;
     IPFSGLOBALUPLOADAPI*       api  = nullptr;
+    IPFSLOCALAPI*              localApi = nullptr;
+    KPUploadHistory*           history = nullptr;
+    /* True while the files to upload are hashed, before they are queued. */
+    bool                       hashing = false;
     /* Contains the ipfs username if API authorized.
      * If not, username is null. */
     QString          username;
+
+    /* Local IPFS node settings, and the URL of the last added album. */
+    QCheckBox*       localNodeCheck = nullptr;
+    QLineEdit*       endpointEdit   = nullptr;
+    QCheckBox*       pinCheck       = nullptr;
+    QCheckBox*       onlyHashCheck  = nullptr;
+    QLabel*          rootLabel      = nullptr;
 };
 
 } // namespace KIPIIPFSPlugin
@@ -26,15 +26,22 @@
 
 // C++ includes
 
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 
 // Qt includes
 
-#include <QDomDocument>
+#include <QAtomicInt>
 #include <QFile>
+#include <QFileInfo>
+#include <QFutureInterface>
+#include <QRunnable>
 #include <QString>
 #include <QIODevice>
+#include <QThreadPool>
+#include <QXmlStreamReader>
+#include <QtConcurrentMap>
 
 // Local includes
 
@@ -43,253 +50,559 @@
 namespace KIPIKMLExportPlugin
 {
 
-GPSDataParser::GPSDataParser()
+/// The points of one GPX file, in the order of the file.
+class GPXFilePoints
 {
-    clear();
-}
+public:
 
-void GPSDataParser::clear()
-{
-    m_GPSDataMap.clear();
-}
+    GPXFilePoints()
+        : loaded(false)
+    {
+    }
 
-int GPSDataParser::numPoints() const
+    bool            loaded;
+    QVector<qint64> times;
+    QVector<double> latitudes;
+    QVector<double> longitudes;
+    QVector<double> altitudes;
+};
+
+/** Read the track points of a GPX file in one pass with a stream reader, so the memory
+ *  used does not depend on the size of the file. Run on worker threads.
+ */
+class GPXFileLoader
 {
-    return m_GPSDataMap.count();
-}
+public:
 
-bool GPSDataParser::matchDate(const QDateTime& photoDateTime, int maxGapTime, int secondsOffset,
-                              bool offsetContainsTimeZone,
-                              bool interpolate, int interpolationDstTime,
-                              GPSDataContainer* const gpsData)
-{
-    // GPS device are sync in time by satelite using GMT time.
-    QDateTime cameraGMTDateTime = photoDateTime.addSecs(secondsOffset*(-1));
+    typedef GPXFilePoints result_type;
 
-    if (offsetContainsTimeZone)
+    /** 'loadedKiB' sums the size read by all the loaders. When 'progress' is not null,
+     *  the sum is reported to it as the progress value.
+     */
+    GPXFileLoader(QAtomicInt* const loadedKiB, QFutureInterfaceBase* const progress)
+        : m_loadedKiB(loadedKiB),
+          m_progress(progress)
     {
-        cameraGMTDateTime.setTimeSpec(Qt::UTC);
     }
 
-    qCDebug(KIPIPLUGINS_LOG) << "    photoDateTime: " << photoDateTime << photoDateTime.timeSpec();
-    qCDebug(KIPIPLUGINS_LOG) << "cameraGMTDateTime: " << cameraGMTDateTime << cameraGMTDateTime.timeSpec();
+    GPXFilePoints operator()(const QUrl& url) const
+    {
+        GPXFilePoints points;
+        QFile gpxfile(url.toLocalFile());
 
-    // We are trying to find the right date in the GPS points list.
-    bool findItem = false;
-    int nbSecItem = maxGapTime;
-    int nbSecs;
+        if (!gpxfile.open(QIODevice::ReadOnly))
+            return points;
 
-    for (GPSDataMap::ConstIterator it = m_GPSDataMap.constBegin(); it != m_GPSDataMap.constEnd(); ++it )
-    {
-        // Here we check a possible accuracy in seconds between the
-        // Camera GMT time and the GPS device GMT time.
+        QXmlStreamReader reader(&gpxfile);
+        qint64 reportedKiB = 0;
 
-        nbSecs = qAbs(cameraGMTDateTime.secsTo( it.key() ));
-//         qCDebug(KIPIPLUGINS_LOG) << it.key() << cameraGMTDateTime << nbSecs;
-//         qCDebug(KIPIPLUGINS_LOG) << it.key().timeSpec() << cameraGMTDateTime.timeSpec() << nbSecs;
+        if (!reader.readNextStartElement() || reader.name() != QLatin1String("gpx"))
+            return points;
 
-        // We tring to find the minimal accuracy.
-        if (nbSecs < maxGapTime && nbSecs < nbSecItem)
+        while (reader.readNextStartElement())
         {
-            if (gpsData)
+            if (reader.name() != QLatin1String("trk"))
             {
-                *gpsData = m_GPSDataMap[it.key()];
+                reader.skipCurrentElement();
+                continue;
             }
 
-            findItem  = true;
-            nbSecItem = nbSecs;
+            while (reader.readNextStartElement())
+            {
+                if (reader.name() != QLatin1String("trkseg"))
+                {
+                    reader.skipCurrentElement();
+                    continue;
+                }
+
+                while (reader.readNextStartElement())
+                {
+                    if (reader.name() != QLatin1String("trkpt"))
+                    {
+                        reader.skipCurrentElement();
+                        continue;
+                    }
+
+                    readPoint(reader, &points);
+
+                    if ((points.times.count() % 4096) == 0)
+                    {
+                        reportProgress(gpxfile.pos(), &reportedKiB);
+                    }
+                }
+            }
         }
-    }
 
-    if (findItem) return true;
+        reportProgress(gpxfile.size(), &reportedKiB);
 
-    // If we can't find it, we will trying to interpolate the GPS point.
+        if (reader.hasError())
+        {
+            qCDebug(KIPIPLUGINS_LOG) << "GPX file" << url << "line" << reader.lineNumber() << ":" << reader.errorString();
+            return GPXFilePoints();
+        }
 
-    if (interpolate)
-    {
-        // The interpolate GPS point will be separate by at the maximum of 'interpolationDstTime'
-        // seconds before and after the next and previous real GPS point found.
+        points.loaded = true;
+        return points;
+    }
 
-        QDateTime prevDateTime = findPrevDate(cameraGMTDateTime, interpolationDstTime);
-        QDateTime nextDateTime = findNextDate(cameraGMTDateTime, interpolationDstTime);
+private:
 
-        if (!nextDateTime.isNull() && !prevDateTime.isNull())
+    static void readPoint(QXmlStreamReader& reader, GPXFilePoints* const points)
+    {
+        // Get GPS position. If not available continue to next point.
+        const QXmlStreamAttributes attributes = reader.attributes();
+        const QStringRef lat                  = attributes.value(QLatin1String("lat"));
+        const QStringRef lon                  = attributes.value(QLatin1String("lon"));
+        const bool hasPosition                = !lat.isEmpty() && !lon.isEmpty();
+        const double ptLatitude               = lat.toDouble();
+        const double ptLongitude              = lon.toDouble();
+        double ptAltitude                     = 0.0;
+        qint64 ptTime                         = 0;
+        bool   hasTime                        = false;
+
+        // Get metadata of track point (altitude and time stamp)
+        while (reader.readNextStartElement())
         {
-            GPSDataContainer prevGPSPoint = m_GPSDataMap[prevDateTime];
-            GPSDataContainer nextGPSPoint = m_GPSDataMap[nextDateTime];
-
-            double alt1 = prevGPSPoint.altitude();
-            double lon1 = prevGPSPoint.longitude();
-            double lat1 = prevGPSPoint.latitude();
-            uint   t1   = prevDateTime.toTime_t();
-            double alt2 = nextGPSPoint.altitude();
-            double lon2 = nextGPSPoint.longitude();
-            double lat2 = nextGPSPoint.latitude();
-            uint   t2   = nextDateTime.toTime_t();
-            uint   tCor = cameraGMTDateTime.toTime_t();
+            if (reader.name() == QLatin1String("time"))
+            {
+                // Get GPS point time stamp. If not available continue to next point.
+                const QString time = reader.readElementText(QXmlStreamReader::IncludeChildElements);
 
-            if (tCor-t1 != 0)
+                if (!time.isEmpty())
+                    hasTime = GPSDataParserParseTime(QStringRef(&time), &ptTime);
+            }
+            else if (reader.name() == QLatin1String("ele"))
             {
-                if (gpsData)
-                {
-                    gpsData->setAltitude(alt1  + (alt2-alt1) * (tCor-t1)/(t2-t1));
-                    gpsData->setLatitude(lat1  + (lat2-lat1) * (tCor-t1)/(t2-t1));
-                    gpsData->setLongitude(lon1 + (lon2-lon1) * (tCor-t1)/(t2-t1));
-                    gpsData->setInterpolated(true);
-                }
-                return true;
+                // Get GPS point altitude. If not available continue to next point.
+                const QString ele = reader.readElementText(QXmlStreamReader::IncludeChildElements);
+
+                if (!ele.isEmpty())
+                    ptAltitude = ele.toDouble();
+            }
+            else
+            {
+                reader.skipCurrentElement();
             }
         }
+
+        if (!hasPosition || !hasTime)
+            return;
+
+        points->times.append(ptTime);
+        points->latitudes.append(ptLatitude);
+        points->longitudes.append(ptLongitude);
+        points->altitudes.append(ptAltitude);
     }
 
-    return false;
+    void reportProgress(qint64 bytes, qint64* const reportedKiB) const
+    {
+        const qint64 kib = bytes / 1024;
+
+        if (kib > *reportedKiB)
+        {
+            const int added  = (int)(kib - *reportedKiB);
+            const int loaded = m_loadedKiB->fetchAndAddRelaxed(added) + added;
+            *reportedKiB     = kib;
+
+            if (m_progress)
+                m_progress->setProgressValue(loaded);
+        }
+    }
+
+private:
+
+    QAtomicInt*           m_loadedKiB;
+    QFutureInterfaceBase* m_progress;
+};
+
+/** Run GPSDataParser::loadGPXFiles() on the global thread pool. Unlike QtConcurrent::run(),
+ *  the future reports the progress of the loading, in KiB.
+ */
+class GPXFilesLoadingTask : public QFutureInterface<bool>, public QRunnable
+{
+public:
+
+    GPXFilesLoadingTask(GPSDataParser* const parser, const QList<QUrl>& urls, QList<QUrl>* const failed)
+        : m_parser(parser),
+          m_urls(urls),
+          m_failed(failed)
+    {
+    }
+
+    QFuture<bool> start()
+    {
+        setThreadPool(QThreadPool::globalInstance());
+        setRunnable(this);
+        reportStarted();
+
+        // The task deletes itself once run, the future shares its state.
+        QFuture<bool> future = this->future();
+        QThreadPool::globalInstance()->start(this);
+
+        return future;
+    }
+
+    void run() Q_DECL_OVERRIDE
+    {
+        const bool ok = m_parser->loadGPXFiles(m_urls, m_failed, this);
+
+        reportResult(ok);
+        reportFinished();
+    }
+
+private:
+
+    GPSDataParser* const m_parser;
+    const QList<QUrl>    m_urls;
+    QList<QUrl>* const   m_failed;
+};
+
+/// Order of the indexes of the track points by time.
+class GPSTimeOrder
+{
+public:
+
+    explicit GPSTimeOrder(const QVector<qint64>& times)
+        : m_times(times)
+    {
+    }
+
+    bool operator()(int a, int b) const
+    {
+        return m_times.at(a) < m_times.at(b);
+    }
+
+private:
+
+    const QVector<qint64>& m_times;
+};
+
+GPSDataParser::GPSDataParser()
+{
+    clear();
+}
+
+void GPSDataParser::clear()
+{
+    m_times.clear();
+    m_latitudes.clear();
+    m_longitudes.clear();
+    m_altitudes.clear();
+}
+
+int GPSDataParser::numPoints() const
+{
+    return m_times.count();
 }
 
-QDateTime GPSDataParser::findNextDate(const QDateTime& dateTime, int secs)
+void GPSDataParser::addPoint(qint64 msecs, double latitude, double longitude, double altitude)
 {
-    // We will find the item in GPS data list where the time is
-    // at the maximum bigger than 'secs' mn of the value to match.
-    QDateTime itemFound = dateTime.addSecs(secs);
-    bool found          = false;
+    m_times.append(msecs);
+    m_latitudes.append(latitude);
+    m_longitudes.append(longitude);
+    m_altitudes.append(altitude);
+}
+
+void GPSDataParser::sortPoints()
+{
+    const int count = m_times.count();
+    bool sorted     = true;
+
+    for (int i = 1 ; sorted && i < count ; ++i)
+    {
+        sorted = (m_times.at(i-1) < m_times.at(i));
+    }
+
+    // Tracks are usually recorded in order: nothing to do.
+    if (sorted)
+        return;
+
+    QVector<int> order(count);
+
+    for (int i = 0 ; i < count ; ++i)
+    {
+        order[i] = i;
+    }
+
+    // Stable, so that points with the same time stay in the order they were added.
+    std::stable_sort(order.begin(), order.end(), GPSTimeOrder(m_times));
+
+    QVector<qint64> times;
+    QVector<double> latitudes;
+    QVector<double> longitudes;
+    QVector<double> altitudes;
+    times.reserve(count);
+    latitudes.reserve(count);
+    longitudes.reserve(count);
+    altitudes.reserve(count);
 
-    for (GPSDataMap::ConstIterator it = m_GPSDataMap.constBegin(); it != m_GPSDataMap.constEnd(); ++it )
+    for (int i = 0 ; i < count ; ++i)
     {
-        if (it.key() > dateTime)
+        const int index = order.at(i);
+
+        if (!times.isEmpty() && times.last() == m_times.at(index))
         {
-            if (it.key() < itemFound)
-            {
-                itemFound = it.key();
-                found = true;
-            }
+            // The last point added with this time replaces the previous ones.
+            latitudes.last()  = m_latitudes.at(index);
+            longitudes.last() = m_longitudes.at(index);
+            altitudes.last()  = m_altitudes.at(index);
+            continue;
         }
+
+        times.append(m_times.at(index));
+        latitudes.append(m_latitudes.at(index));
+        longitudes.append(m_longitudes.at(index));
+        altitudes.append(m_altitudes.at(index));
     }
 
-    if (found)
-        return itemFound;
+    m_times      = times;
+    m_latitudes  = latitudes;
+    m_longitudes = longitudes;
+    m_altitudes  = altitudes;
+}
+
+QDateTime GPSDataParser::pointDateTime(int index) const
+{
+    return QDateTime::fromMSecsSinceEpoch(m_times.at(index), Qt::UTC);
+}
 
-    return QDateTime();
+GPSDataContainer GPSDataParser::point(int index) const
+{
+    return GPSDataContainer(m_altitudes.at(index), m_latitudes.at(index), m_longitudes.at(index), false);
 }
 
-QDateTime GPSDataParser::findPrevDate(const QDateTime& dateTime, int secs)
+qint64 GPSDataParser::cameraGMTTime(const QDateTime& photoDateTime, int secondsOffset, bool offsetContainsTimeZone)
 {
-    // We will find the item in GPS data list where the time is
-    // at the maximum smaller than 'secs' mn of the value to match.
-    QDateTime itemFound = dateTime.addSecs((-1)*secs);
-    bool found          = false;
+    // GPS device are sync in time by satelite using GMT time.
+    QDateTime cameraGMTDateTime = photoDateTime.addSecs(secondsOffset*(-1));
 
-    for (GPSDataMap::ConstIterator it = m_GPSDataMap.constBegin(); it != m_GPSDataMap.constEnd(); ++it )
+    if (offsetContainsTimeZone)
     {
-        if (it.key() < dateTime)
+        cameraGMTDateTime.setTimeSpec(Qt::UTC);
+    }
+
+    qCDebug(KIPIPLUGINS_LOG) << "    photoDateTime: " << photoDateTime << photoDateTime.timeSpec();
+    qCDebug(KIPIPLUGINS_LOG) << "cameraGMTDateTime: " << cameraGMTDateTime << cameraGMTDateTime.timeSpec();
+
+    return cameraGMTDateTime.toMSecsSinceEpoch();
+}
+
+bool GPSDataParser::matchDate(const QDateTime& photoDateTime, int maxGapTime, int secondsOffset,
+                              bool offsetContainsTimeZone,
+                              bool interpolate, int interpolationDstTime,
+                              GPSDataContainer* const gpsData) const
+{
+    const qint64 msecs = cameraGMTTime(photoDateTime, secondsOffset, offsetContainsTimeZone);
+    const int pos      = std::lower_bound(m_times.constBegin(), m_times.constEnd(), msecs) - m_times.constBegin();
+
+    return matchTime(msecs, pos, maxGapTime, interpolate, interpolationDstTime, gpsData);
+}
+
+int GPSDataParser::matchDates(const QList<QDateTime>& photoDateTimes, int maxGapTime, int secondsOffset,
+                              bool offsetContainsTimeZone,
+                              bool interpolate, int interpolationDstTime,
+                              QVector<bool>* const matched,
+                              QVector<GPSDataContainer>* const gpsData) const
+{
+    if (matched)
+    {
+        matched->fill(false, photoDateTimes.count());
+    }
+
+    if (gpsData)
+    {
+        gpsData->fill(GPSDataContainer(), photoDateTimes.count());
+    }
+
+    int    found = 0;
+    int    pos   = 0;
+    qint64 last  = 0;
+
+    for (int i = 0 ; i < photoDateTimes.count() ; ++i)
+    {
+        const qint64 msecs = cameraGMTTime(photoDateTimes.at(i), secondsOffset, offsetContainsTimeZone);
+
+        if (i > 0 && msecs < last)
+        {
+            // Not sorted: search this one from scratch.
+            pos = std::lower_bound(m_times.constBegin(), m_times.constEnd(), msecs) - m_times.constBegin();
+        }
+        else
         {
-            if (it.key() > itemFound)
+            while (pos < m_times.count() && m_times.at(pos) < msecs)
             {
-                itemFound = it.key();
-                found = true;
+                ++pos;
             }
         }
-    }
 
-    if (found)
-        return itemFound;
+        last = msecs;
+        GPSDataContainer data;
+
+        if (matchTime(msecs, pos, maxGapTime, interpolate, interpolationDstTime, &data))
+        {
+            ++found;
+
+            if (matched)
+                (*matched)[i] = true;
 
-    return QDateTime();
+            if (gpsData)
+                (*gpsData)[i] = data;
+        }
+    }
+
+    return found;
 }
 
-bool GPSDataParser::loadGPXFile(const QUrl& url)
+bool GPSDataParser::matchTime(qint64 msecs, int pos, int maxGapTime,
+                              bool interpolate, int interpolationDstTime,
+                              GPSDataContainer* const gpsData) const
 {
-    QFile gpxfile(url.toLocalFile());
+    // We are trying to find the right date in the GPS points list: the closest
+    // points are the ones around 'pos'. Here we check a possible accuracy in seconds
+    // between the Camera GMT time and the GPS device GMT time. When several points
+    // have the same accuracy, the earliest one is taken.
 
-    if (!gpxfile.open(QIODevice::ReadOnly))
-        return false;
+    const int count   = m_times.count();
+    int       found   = -1;
+    qint64    nbSecItem = maxGapTime;
 
-    QDomDocument gpxDoc(QLatin1String("gpx"));
+    if (pos > 0)
+    {
+        const qint64 nbSecs = (msecs - m_times.at(pos-1)) / 1000;
 
-    if (!gpxDoc.setContent(&gpxfile))
-        return false;
+        if (nbSecs < maxGapTime && nbSecs < nbSecItem)
+        {
+            // The points after 'limit' are at most nbSecs seconds before.
+            const qint64 limit = msecs - (nbSecs + 1) * 1000;
+            found              = std::upper_bound(m_times.constBegin(), m_times.constBegin() + pos, limit) - m_times.constBegin();
+            nbSecItem          = nbSecs;
+        }
+    }
 
-    QDomElement gpxDocElem = gpxDoc.documentElement();
+    if (pos < count)
+    {
+        const qint64 nbSecs = (m_times.at(pos) - msecs) / 1000;
 
-    if (gpxDocElem.tagName() != QLatin1String("gpx"))
-        return false;
+        if (nbSecs < maxGapTime && nbSecs < nbSecItem)
+        {
+            found     = pos;
+            nbSecItem = nbSecs;
+        }
+    }
 
-    for (QDomNode nTrk = gpxDocElem.firstChild(); !nTrk.isNull(); nTrk = nTrk.nextSibling())
+    if (found >= 0)
     {
-        QDomElement trkElem = nTrk.toElement();
+        if (gpsData)
+        {
+            *gpsData = point(found);
+        }
 
-        if (trkElem.isNull()) continue;
+        return true;
+    }
 
-        if (trkElem.tagName() != QLatin1String("trk")) continue;
+    // If we can't find it, we will trying to interpolate the GPS point.
 
-        for (QDomNode nTrkseg = trkElem.firstChild(); !nTrkseg.isNull(); nTrkseg = nTrkseg.nextSibling())
+    if (interpolate)
+    {
+        // The interpolate GPS point will be separate by at the maximum of 'interpolationDstTime'
+        // seconds before and after the next and previous real GPS point found.
+
+        const qint64 dst = (qint64)interpolationDstTime * 1000;
+        const int prev   = pos - 1;
+        const int next   = (pos < count && m_times.at(pos) == msecs) ? pos + 1 : pos;
+
+        if (prev >= 0 && next < count && m_times.at(prev) > msecs - dst && m_times.at(next) < msecs + dst)
         {
-            QDomElement trksegElem = nTrkseg.toElement();
+            double alt1 = m_altitudes.at(prev);
+            double lon1 = m_longitudes.at(prev);
+            double lat1 = m_latitudes.at(prev);
+            uint   t1   = (uint)(m_times.at(prev) / 1000);
 
-            if (trksegElem.isNull()) continue;
+            double alt2 = m_altitudes.at(next);
+            double lon2 = m_longitudes.at(next);
+            double lat2 = m_latitudes.at(next);
+            uint   t2   = (uint)(m_times.at(next) / 1000);
 
-            if (trksegElem.tagName() != QLatin1String("trkseg")) continue;
+            uint   tCor = (uint)(msecs / 1000);
 
-            for (QDomNode nTrkpt = trksegElem.firstChild(); !nTrkpt.isNull(); nTrkpt = nTrkpt.nextSibling())
+            if (tCor-t1 != 0)
             {
-                QDomElement trkptElem = nTrkpt.toElement();
+                if (gpsData)
+                {
+                    gpsData->setAltitude(alt1  + (alt2-alt1) * (tCor-t1)/(t2-t1));
+                    gpsData->setLatitude(lat1  + (lat2-lat1) * (tCor-t1)/(t2-t1));
+                    gpsData->setLongitude(lon1 + (lon2-lon1) * (tCor-t1)/(t2-t1));
+                    gpsData->setInterpolated(true);
+                }
 
-                if (trkptElem.isNull()) continue;
+                return true;
+            }
+        }
+    }
 
-                if (trkptElem.tagName() != QLatin1String("trkpt")) continue;
+    return false;
+}
 
-                QDateTime ptDateTime;
-                double    ptAltitude  = 0.0;
-                double    ptLatitude  = 0.0;
-                double    ptLongitude = 0.0;
+bool GPSDataParser::loadGPXFile(const QUrl& url)
+{
+    return loadGPXFiles(QList<QUrl>() << url);
+}
 
-                // Get GPS position. If not available continue to next point.
-                QString lat = trkptElem.attribute(QLatin1String("lat"));
-                QString lon = trkptElem.attribute(QLatin1String("lon"));
+bool GPSDataParser::loadGPXFiles(const QList<QUrl>& urls, QList<QUrl>* const failed,
+                                 QFutureInterfaceBase* const progress)
+{
+    qint64 total = 0;
 
-                if (lat.isEmpty() || lon.isEmpty()) continue;
+    foreach (const QUrl& url, urls)
+    {
+        total += QFileInfo(url.toLocalFile()).size();
+    }
 
-                ptLatitude  = lat.toDouble();
-                ptLongitude = lon.toDouble();
+    const int totalKiB = (int)qMax((qint64)1, total / 1024);
+    QAtomicInt loadedKiB(0);
 
-                // Get metadata of track point (altitude and time stamp)
-                for (QDomNode nTrkptMeta = trkptElem.firstChild(); !nTrkptMeta.isNull(); nTrkptMeta = nTrkptMeta.nextSibling())
-                {
-                    QDomElement trkptMetaElem = nTrkptMeta.toElement();
+    if (progress)
+        progress->setProgressRange(0, totalKiB);
 
-                    if (trkptMetaElem.isNull()) continue;
+    // The files are parsed at the same time, then merged in the order of the list.
+    const QList<GPXFilePoints> files = QtConcurrent::blockingMapped<QList<GPXFilePoints> >(urls, GPXFileLoader(&loadedKiB, progress));
+    bool ok                          = true;
 
-                    if (trkptMetaElem.tagName() == QLatin1String("time"))
-                    {
-                        // Get GPS point time stamp. If not available continue to next point.
-                        const QString time = trkptMetaElem.text();
+    for (int i = 0 ; i < files.count() ; ++i)
+    {
+        const GPXFilePoints& points = files.at(i);
 
-                        if (time.isEmpty()) continue;
+        if (!points.loaded)
+        {
+            qCDebug(KIPIPLUGINS_LOG) << "Cannot parse GPX file" << urls.at(i);
 
-                        ptDateTime = GPSDataParserParseTime(time);
-                    }
+            if (failed)
+                failed->append(urls.at(i));
 
-                    if (trkptMetaElem.tagName() == QLatin1String("ele"))
-                    {
-                        // Get GPS point altitude. If not available continue to next point.
-                        QString ele = trkptMetaElem.text();
+            ok = false;
+            continue;
+        }
 
-                        if (!ele.isEmpty())
-                            ptAltitude  = ele.toDouble();
-                    }
-                }
+        m_times      += points.times;
+        m_latitudes  += points.latitudes;
+        m_longitudes += points.longitudes;
+        m_altitudes  += points.altitudes;
+    }
 
-                if (ptDateTime.isNull())
-                    continue;
+    sortPoints();
 
-                GPSDataContainer gpsData(ptAltitude, ptLatitude, ptLongitude, false);
-                m_GPSDataMap.insert( ptDateTime, gpsData );
-            }
-        }
-    }
+    if (progress)
+        progress->setProgressValue(totalKiB);
 
-    //qCDebug(KIPIPLUGINS_LOG) << "GPX File " << url.fileName()
+    //qCDebug(KIPIPLUGINS_LOG) << "GPX Files " << urls
     //                         << " parsed with " << numPoints()
     //                         << " points extracted" ;
-    return true;
+    return ok;
+}
+
+QFuture<bool> GPSDataParser::loadGPXFilesInBackground(const QList<QUrl>& urls, QList<QUrl>* const failed)
+{
+    return (new GPXFilesLoadingTask(this, urls, failed))->start();
 }
 
 } // namespace KIPIKMLExportPlugin
@@ -27,13 +27,17 @@
 // Qt includes
 
 #include <QDateTime>
-#include <QMap>
+#include <QFuture>
+#include <QList>
+#include <QVector>
 #include <QUrl>
 
 // Local includes
 
 #include "gpsdatacontainer.h"
 
+class QFutureInterfaceBase;
+
 namespace KIPIKMLExportPlugin
 {
 
@@ -47,24 +51,70 @@ public:
 
     bool loadGPXFile(const QUrl& url);
 
+    /** Load several GPX files, parsed in parallel, and merge their points with the ones
+     *  already loaded. Return false if a file cannot be parsed: it is added to 'failed',
+     *  and the points of the other files are loaded.
+     *  When 'progress' is not null, the size of the files read is reported to it, in KiB.
+     */
+    bool loadGPXFiles(const QList<QUrl>& urls, QList<QUrl>* const failed = 0,
+                      QFutureInterfaceBase* const progress = 0);
+
+    /** Same as loadGPXFiles(), run on another thread. The progress of the returned future
+     *  goes from 0 to the size of the files in KiB. The parser and 'failed' must not be used
+     *  before the future is finished.
+     */
+    QFuture<bool> loadGPXFilesInBackground(const QList<QUrl>& urls, QList<QUrl>* const failed = 0);
+
     void clear();
     int  numPoints() const;
+
     bool matchDate(const QDateTime& photoDateTime, int maxGapTime, int secondsOffset,
                    bool photoHasSystemTimeZone,
                    bool interpolate, int interpolationDstTime,
-                   GPSDataContainer* const gpsData);
+                   GPSDataContainer* const gpsData) const;
+
+    /** Same as matchDate() for several photos, sorted by date: the track is walked once for
+     *  all of them. 'gpsData' gets one position per photo, valid when 'matched' is true.
+     *  Return the number of photos matched.
+     */
+    int  matchDates(const QList<QDateTime>& photoDateTimes, int maxGapTime, int secondsOffset,
+                    bool photoHasSystemTimeZone,
+                    bool interpolate, int interpolationDstTime,
+                    QVector<bool>* const matched,
+                    QVector<GPSDataContainer>* const gpsData) const;
+
+protected:
+
+    /** Add a track point, in any order. sortPoints() must be called once all points are added.
+     */
+    void addPoint(qint64 msecs, double latitude, double longitude, double altitude);
+
+    /** Sort the points added by time. When several points have the same time, the last one added is kept.
+     */
+    void sortPoints();
+
+    QDateTime        pointDateTime(int index) const;
+    GPSDataContainer point(int index)         const;
 
 private:
 
-    // Methods used to perform interpolation.
-    QDateTime findNextDate(const QDateTime& dateTime, int secs);
-    QDateTime findPrevDate(const QDateTime& dateTime, int secs);
+    /** Camera time of a photo converted to GPS time, in milliseconds since epoch.
+     */
+    static qint64 cameraGMTTime(const QDateTime& photoDateTime, int secondsOffset, bool offsetContainsTimeZone);
 
-protected:
+    /** Match the GPS time 'msecs', with 'pos' the index of the first point not before it.
+     */
+    bool matchTime(qint64 msecs, int pos, int maxGapTime,
+                   bool interpolate, int interpolationDstTime,
+                   GPSDataContainer* const gpsData) const;
 
-    typedef QMap<QDateTime, GPSDataContainer> GPSDataMap;
+protected:
 
-    GPSDataMap                                m_GPSDataMap;
+    /// Track points sorted by time, as parallel arrays. Times are in milliseconds since epoch, in UTC.
+    QVector<qint64> m_times;
+    QVector<double> m_latitudes;
+    QVector<double> m_longitudes;
+    QVector<double> m_altitudes;
 };
 
 } // namespace KIPIKMLExportPlugin
@@ -80,6 +80,132 @@ QDateTime GPSDataParserParseTime(QString timeString)
     return theTime;
 }
 
+/** Parse a GPX time to milliseconds since epoch, in UTC. The usual "yyyy-MM-ddThh:mm:ss[.zzz]Z"
+ *  and "yyyy-MM-ddThh:mm:ss[.zzz]+hh:mm" forms are read directly from the characters, without
+ *  building a QDateTime: this is called for every point of the track. Other forms go through
+ *  the function above. Return false when the time is not valid.
+ */
+bool GPSDataParserParseTime(const QStringRef& timeString, qint64* const msecs)
+{
+    const QChar* const c = timeString.unicode();
+    const int length     = timeString.length();
+    int values[6];
+    int pos              = 0;
+
+    // year, month, day, hours, minutes and seconds, with their separators.
+    static const int  s_digits[6]     = { 4, 2, 2, 2, 2, 2 };
+    static const char s_separators[6] = { '-', '-', 'T', ':', ':', 0 };
+
+    for (int field = 0 ; field < 6 ; ++field)
+    {
+        values[field] = 0;
+
+        for (int i = 0 ; i < s_digits[field] ; ++i, ++pos)
+        {
+            if (pos >= length || c[pos] < QLatin1Char('0') || c[pos] > QLatin1Char('9'))
+            {
+                return false;
+            }
+
+            values[field] = values[field] * 10 + (c[pos].unicode() - '0');
+        }
+
+        if (s_separators[field])
+        {
+            if (pos >= length || c[pos] != QLatin1Char(s_separators[field]))
+            {
+                return false;
+            }
+
+            ++pos;
+        }
+    }
+
+    // fraction of second, rounded to milliseconds.
+    int    milliseconds = 0;
+
+    if (pos < length && c[pos] == QLatin1Char('.'))
+    {
+        double fraction = 0.0;
+        double unit     = 0.1;
+
+        for (++pos ; pos < length && c[pos] >= QLatin1Char('0') && c[pos] <= QLatin1Char('9') ; ++pos, unit /= 10)
+        {
+            fraction += unit * (c[pos].unicode() - '0');
+        }
+
+        milliseconds = qMin(qRound(fraction * 1000), 999);
+    }
+
+    // time zone.
+    int offsetSeconds = 0;
+
+    if (pos == length - 1 && c[pos] == QLatin1Char('Z'))
+    {
+        offsetSeconds = 0;
+    }
+    else if (pos == length - 6 && (c[pos] == QLatin1Char('+') || c[pos] == QLatin1Char('-')) &&
+             c[pos+3] == QLatin1Char(':'))
+    {
+        const QChar* const z = c + pos;
+
+        for (int i = 1 ; i < 6 ; ++i)
+        {
+            if (i != 3 && (z[i] < QLatin1Char('0') || z[i] > QLatin1Char('9')))
+            {
+                return false;
+            }
+        }
+
+        offsetSeconds = ((z[1].unicode() - '0') * 10 + (z[2].unicode() - '0')) * 3600 +
+                        ((z[4].unicode() - '0') * 10 + (z[5].unicode() - '0')) * 60;
+
+        if (z[0] == QLatin1Char('-'))
+        {
+            offsetSeconds = -offsetSeconds;
+        }
+    }
+    else
+    {
+        // Local time or another form of ISO 8601: let QDateTime handle it.
+        const QDateTime theTime = GPSDataParserParseTime(timeString.toString());
+
+        if (theTime.isNull())
+        {
+            return false;
+        }
+
+        *msecs = theTime.toMSecsSinceEpoch();
+        return true;
+    }
+
+    const int year    = values[0];
+    const int month   = values[1];
+    const int day     = values[2];
+
+    static const int s_monthDays[12] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+    if (month < 1 || month > 12 || day < 1 || day > s_monthDays[month-1] ||
+        (month == 2 && day == 29 && !(year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))) ||
+        values[3] > 23 || values[4] > 59 || values[5] > 59)
+    {
+        return false;
+    }
+
+    // Days since 1970-01-01 in the proleptic Gregorian calendar, counting years from March.
+    const int    y    = (month <= 2) ? year - 1 : year;
+    const int    era  = y / 400;
+    const int    yoe  = y - era * 400;
+    const int    doy  = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const int    doe  = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    const qint64 days = (qint64)era * 146097 + doe - 719468;
+
+    *msecs = ((days * 24 + values[3]) * 60 + values[4]) * 60000 + (qint64)values[5] * 1000 + milliseconds -
+             (qint64)offsetSeconds * 1000;
+
+    return true;
+}
+
 } /* KIPIKMLExportPlugin */
 
 #endif /* GPSDATAPARSER_TIME_H */
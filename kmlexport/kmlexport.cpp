@@ -25,15 +25,24 @@
 
 // Qt includes
 
+#include <QHash>
 #include <QImageReader>
+#include <QMap>
 #include <QPainter>
 #include <QRegExp>
-#include <QTextStream>
+#include <QFile>
+#include <QScopedPointer>
+#include <QSet>
 #include <QStandardPaths>
 #include <QApplication>
 #include <QMessageBox>
 #include <QIODevice>
 #include <QDir>
+#include <QEventLoop>
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QTransform>
+#include <QtConcurrentMap>
 
 // KDE includes
 
@@ -41,6 +50,10 @@
 #include <kconfiggroup.h>
 #include <klocalizedstring.h>
 
+#ifdef HAVE_KF5ARCHIVE
+#include <kzip.h>
+#endif
+
 // Libkipi includes
 
 #include <KIPI/PluginLoader>
@@ -54,6 +67,28 @@
 namespace KIPIKMLExportPlugin
 {
 
+/// Run KmlExport::processImage() on the images given to QtConcurrent::mapped().
+class KmlImageProcessor
+{
+public:
+
+    typedef KmlImage result_type;
+
+    explicit KmlImageProcessor(const KmlExport* const exporter)
+        : m_exporter(exporter)
+    {
+    }
+
+    KmlImage operator()(const KmlImage& image) const
+    {
+        return m_exporter->processImage(image);
+    }
+
+private:
+
+    const KmlExport* m_exporter;
+};
+
 KmlExport::KmlExport(bool hostFeatureImagesHasComments, bool hostFeatureImagesHasTime,
                      const QString& hostAlbumName, const ImageCollection& hostSelection)
 {
@@ -68,9 +103,17 @@ KmlExport::KmlExport(bool hostFeatureImagesHasComments, bool hostFeatureImagesHa
     m_LineWidth          = 4;
     m_GPXOpacity         = 64;
     m_GPXAltitudeMode    = 0;
-    m_kmlDocument        = 0;
+    m_GPXSimplify        = 0;
+    m_GPXLevelsOfDetail  = false;
+    m_clusters           = false;
+    m_kmlWriter          = 0;
+    m_kmz                = false;
+    m_kmzArchive         = 0;
     m_iface              = 0;
     m_meta               = 0;
+    m_placemarks         = 0;
+    m_progressPos        = 0;
+    m_progressCount      = 0;
 
     PluginLoader* const pl = PluginLoader::instance();
 
@@ -121,7 +164,8 @@ QImage KmlExport::generateSquareThumbnail(const QImage& fullImage, int size) con
         return image;
     }
 
-    QPixmap croppedPix(size, size);
+    // QImage rather than QPixmap: this is run on worker threads.
+    QImage croppedPix(size, size, QImage::Format_RGB32);
     QPainter painter(&croppedPix);
 
     int sx = 0, sy = 0;
@@ -138,7 +182,7 @@ QImage KmlExport::generateSquareThumbnail(const QImage& fullImage, int size) con
     painter.drawImage(0, 0, image, sx, sy, size, size);
     painter.end();
 
-    return croppedPix.toImage();
+    return croppedPix;
 }
 
 /*!
@@ -151,7 +195,7 @@ QImage KmlExport::generateBorderedThumbnail(const QImage& fullImage, int size) c
     // getting an image minus the border
     QImage image     = fullImage.scaled(size -(2*image_border), size - (2*image_border), Qt::KeepAspectRatioByExpanding);
 
-    QPixmap croppedPix(image.width() + (2*image_border), image.height() + (2*image_border));
+    QImage croppedPix(image.width() + (2*image_border), image.height() + (2*image_border), QImage::Format_RGB32);
     QPainter painter(&croppedPix);
 
     QColor BrushColor(255,255,255);
@@ -161,71 +205,113 @@ QImage KmlExport::generateBorderedThumbnail(const QImage& fullImage, int size) c
     painter.drawImage(image_border, image_border, image);
     painter.end();
 
-    return croppedPix.toImage();
+    return croppedPix;
 }
 
 /*!
-\fn KmlExport::generateImagesthumb(const QUrl& imageURL, QDomElement& kmlAlbum)
+\fn KmlExport::processImage(KmlImage image)
  */
-void KmlExport::generateImagesthumb(const QUrl& imageURL, QDomElement& kmlAlbum)
+KmlImage KmlExport::processImage(KmlImage image) const
 {
-    KPImageInfo info(imageURL);
-
-    // Load image
-    QString path = imageURL.toLocalFile();
-    QFile imageFile(path);
+    // Load image: the file is read once, and decoded at the size needed.
+    QFile imageFile(image.path);
 
     if (!imageFile.open(QIODevice::ReadOnly))
     {
-        logError(i18n("Could not read image '%1'", path));
-        return;
+        image.status = KmlImage::OpenFailed;
+        return image;
     }
 
     QImageReader reader(&imageFile);
-    QString imageFormat = QString::fromUtf8(reader.format());
+    const QByteArray imageFormat = reader.format();
 
     if (imageFormat.isEmpty())
     {
-        logError(i18n("Format of image '%1' is unknown", path));
-        return;
+        image.status = KmlImage::UnknownFormat;
+        return image;
     }
 
-    imageFile.close();
+    image.format = QString::fromLatin1(imageFormat).toLower();
 
-    if (!imageFile.open(QIODevice::ReadOnly))
+    // The image is scaled so that its smaller side is m_size, whatever its orientation.
+    const QSize fullSize = reader.size();
+
+    if (fullSize.isValid() && !fullSize.isEmpty())
     {
-        logError(i18n("Could not read image '%1'", path));
-        return;
+        const double factor = qMax((double)m_size / fullSize.width(), (double)m_size / fullSize.height());
+
+        if (factor < 1.0)
+        {
+            reader.setScaledSize(QSize(qMax(1, qRound(fullSize.width()  * factor)),
+                                       qMax(1, qRound(fullSize.height() * factor))));
+        }
     }
 
-    QByteArray imageData = imageFile.readAll();
+    QImage fullImage = reader.read();
     imageFile.close();
-    QImage image;
 
-    if (!image.loadFromData(imageData))
+    if (fullImage.isNull())
     {
-        logError(i18n("Error loading image '%1'", path));
-        return;
+        image.status = KmlImage::LoadFailed;
+        return image;
     }
 
     // Process images
 
-    if (m_meta && info.orientation() != MetadataProcessor::UNSPECIFIED)
+    if (image.orientation != MetadataProcessor::UNSPECIFIED && image.orientation != MetadataProcessor::NORMAL)
     {
-         m_meta->rotateExifQImage(image, info.orientation());
+        QTransform transform;
+
+        switch (image.orientation)
+        {
+            case MetadataProcessor::HFLIP:
+                transform.scale(-1, 1);
+                break;
+
+            case MetadataProcessor::ROT_180:
+                transform.rotate(180);
+                break;
+
+            case MetadataProcessor::VFLIP:
+                transform.scale(1, -1);
+                break;
+
+            case MetadataProcessor::ROT_90_HFLIP:
+                transform.scale(-1, 1);
+                transform.rotate(90);
+                break;
+
+            case MetadataProcessor::ROT_90:
+                transform.rotate(90);
+                break;
+
+            case MetadataProcessor::ROT_90_VFLIP:
+                transform.scale(1, -1);
+                transform.rotate(90);
+                break;
+
+            case MetadataProcessor::ROT_270:
+                transform.rotate(270);
+                break;
+
+            default:
+                break;
+        }
+
+        fullImage = fullImage.transformed(transform);
     }
 
-    image = image.scaled(m_size, m_size, Qt::KeepAspectRatioByExpanding);
+    fullImage = fullImage.scaled(m_size, m_size, Qt::KeepAspectRatioByExpanding);
     QImage icon;
 
     if (m_optimize_googlemap)
     {
-        icon = generateSquareThumbnail(image,m_googlemapSize);
+        icon = generateSquareThumbnail(fullImage, m_googlemapSize);
     }
     else
     {
     //    icon = image.smoothScale(m_iconSize, m_iconSize, QImage::ScaleMax);
-        icon = generateBorderedThumbnail(image, m_iconSize);
+        icon = generateBorderedThumbnail(fullImage, m_iconSize);
     }
 
     // Save images
@@ -233,157 +319,251 @@ void KmlExport::generateImagesthumb(const QUrl& imageURL, QDomElement& kmlAlbum)
      * it's appear with some kipi host but not with gwenview
      * which already seems to strip the extension
      */
-    QString baseFileName = webifyFileName(info.name());
-    //baseFileName       = mUniqueNameHelper.makeNameUnique(baseFileName);
-    QString fullFileName;
-    fullFileName         = baseFileName + QLatin1Char('.') + imageFormat.toLower();
-    QString destPath     = m_imageDir.filePath(fullFileName);
+    const QString fullFileName = image.baseFileName + QLatin1Char('.') + image.format;
 
-    if (!image.save(destPath, imageFormat.toLatin1().constData(), 85))
+    if (!fullImage.save(m_imageDir.filePath(fullFileName), imageFormat.constData(), 85))
     {
         // if not able to save the image, it's pointless to create a placemark
-        logError(i18n("Could not save image '%1' to '%2'", path, destPath));
+        image.status = KmlImage::SaveFailed;
+        return image;
     }
-    else
+
+    // Save icon
+    const QString iconFileName = QLatin1String("thumb_") + fullFileName;
+    image.iconSaved            = icon.save(m_imageDir.filePath(iconFileName), imageFormat.constData(), 85);
+
+    return image;
+}
+
+// The clusters of a level are replaced by the ones of the next level when their cell
+// is s_clusterMaxLodPixels wide on screen, the cells of the next level being half as wide.
+static const int    s_clusterMinLodPixels = 256;
+static const int    s_clusterMaxLodPixels = 512;
+
+// The cells of the finest level hold no more than s_clusterMaxImages images, unless
+// they are smaller than s_clusterMinCellSize degrees.
+static const int    s_clusterMaxImages    = 64;
+static const int    s_clusterMaxLevel     = 16;
+static const double s_clusterMinCellSize  = 0.00001;
+
+/** Grid of square cells over the images, 2^level cells wide.
+ */
+class KmlClusterGrid
+{
+public:
+
+    KmlClusterGrid(double west, double south, double size, int level)
+        : m_west(west),
+          m_south(south),
+          m_cellSize(size / (1 << level)),
+          m_cells(1 << level)
     {
-        //logInfo(i18n("Creation of picture '%1'").arg(fullFileName));
+    }
 
-        double alt = 0.0, lat = 0.0, lng = 0.0;
+    qint64 cell(double latitude, double longitude) const
+    {
+        const int x = qBound(0, (int)((longitude - m_west)  / m_cellSize), m_cells - 1);
+        const int y = qBound(0, (int)((latitude  - m_south) / m_cellSize), m_cells - 1);
 
-        if (info.hasGeolocationInfo())
-        {
-            lat = info.latitude();
-            lng = info.longitude();
-            alt = info.altitude();
-        }
-        else if (m_meta && m_meta->load(imageURL))
-        {
-            m_meta->getGPSInfo(alt, lat, lng);
-        }
+        return ((qint64)x << 32) | y;
+    }
 
-        QDomElement kmlPlacemark = addKmlElement(kmlAlbum, QLatin1String("Placemark"));
-        addKmlTextElement(kmlPlacemark, QLatin1String("name"), fullFileName);
-        // location and altitude
-        QDomElement kmlGeometry  = addKmlElement(kmlPlacemark, QLatin1String("Point"));
+    QRectF box(qint64 cell) const
+    {
+        return QRectF(m_west  + (cell >> 32)         * m_cellSize,
+                      m_south + (cell & 0xffffffff) * m_cellSize,
+                      m_cellSize, m_cellSize);
+    }
 
-        if (alt)
-        {
-            addKmlTextElement(kmlGeometry, QLatin1String("coordinates"), QString::fromUtf8("%1,%2,%3 ")
-                .arg(lng, 0, 'f', 8)
-                .arg(lat, 0, 'f', 8)
-                .arg(alt, 0, 'f', 8));
-        }
-        else
-        {
-            addKmlTextElement(kmlGeometry, QLatin1String("coordinates"), QString::fromUtf8("%1,%2 ")
-                .arg(lng, 0, 'f', 8)
-                .arg(lat, 0, 'f', 8));
-        }
+private:
 
-        if (m_altitudeMode == 2)
-        {
-            addKmlTextElement(kmlGeometry, QLatin1String("altitudeMode"), QLatin1String("absolute"));
-        }
-        else if (m_altitudeMode == 1)
-        {
-            addKmlTextElement(kmlGeometry, QLatin1String("altitudeMode"), QLatin1String("relativeToGround"));
-        }
-        else
-        {
-            addKmlTextElement(kmlGeometry, QLatin1String("altitudeMode"), QLatin1String("clampToGround"));
-        }
+    double m_west;
+    double m_south;
+    double m_cellSize;
+    int    m_cells;
+};
 
-        addKmlTextElement(kmlGeometry, QLatin1String("extrude"), QLatin1String("1"));
-
-        // we try to load exif value if any otherwise, try the application db
-
-        /** we need to take the DateTimeOriginal
-          * if we refer to http://www.exif.org/Exif2-2.PDF
-          * (standard)DateTime: is The date and time of image creation. In this standard it is the date and time the file was changed
-          * DateTimeOriginal: The date and time when the original image data was generated.
-          *                   For a DSC the date and time the picture was taken are recorded.
-          * DateTimeDigitized: The date and time when the image was stored as digital data.
-          * So for:
-          * - a DSC: the right time is the DateTimeDigitized which is also DateTimeOriginal
-          *          if the picture has been modified the (standard)DateTime should change.
-          * - a scanned picture, the right time is the DateTimeOriginal which should also be the DateTime
-          *          the (standard)DateTime should be the same except if the picture is modified
-          * - a panorama created from several pictures, the right time is the DateTimeOriginal (average of DateTimeOriginal actually)
-          *          The (standard)DateTime is the creation date of the panorama.
-          * it's seems the time to take into acccount is the DateTimeOriginal.
-          * but the MetadataProcessor::getImageDateTime() return the (standard)DateTime first
-          * MetadataProcessor seems to take Original dateTime first so it shoul be alright now.
-          */
-        QDateTime datetime;
-
-        if (m_meta)
-            m_meta->getImageDateTime();
-
-        if (datetime.isValid())
-        {
-            QDomElement kmlTimeStamp = addKmlElement(kmlPlacemark, QLatin1String("TimeStamp"));
-            addKmlTextElement(kmlTimeStamp, QLatin1String("when"), datetime.toString(QLatin1String("yyyy-MM-ddThh:mm:ssZ")));
-        }
-        else if (m_hostFeatureImagesHasTime)
-        {
-            QDomElement kmlTimeStamp = addKmlElement(kmlPlacemark, QLatin1String("TimeStamp"));
-            addKmlTextElement(kmlTimeStamp, QLatin1String("when"), (info.date()).toString(QLatin1String("yyyy-MM-ddThh:mm:ssZ")));
-        }
+/** Images of a cell, with the sum of their positions.
+ */
+class KmlCluster
+{
+public:
 
-        QString my_description;
+    KmlCluster()
+        : count(0),
+          latitude(0.0),
+          longitude(0.0)
+    {
+    }
 
-        if (m_optimize_googlemap)
-        {
-            my_description = QLatin1String("<img src=\"") + m_UrlDestDir + m_imageDirBasename + QLatin1Char('/') + fullFileName + QLatin1String("\">");
-        }
-        else
-        {
-            my_description = QLatin1String("<img src=\"") + m_imageDirBasename + QLatin1Char('/') + fullFileName + QLatin1String("\">");
-        }
+    int    count;
+    double latitude;
+    double longitude;
+};
 
-        if (m_hostFeatureImagesHasComments)
-        {
-            my_description += QLatin1String("<br/>") + info.description() ;
-        }
+/*!
+\fn KmlExport::addPlacemark(const KmlImage& image)
+ */
+void KmlExport::addPlacemark(const KmlImage& image)
+{
+    const QString path = image.path;
+
+    switch (image.status)
+    {
+        case KmlImage::OpenFailed:
+            logError(i18n("Could not read image '%1'", path));
+            return;
+
+        case KmlImage::UnknownFormat:
+            logError(i18n("Format of image '%1' is unknown", path));
+            return;
+
+        case KmlImage::LoadFailed:
+            logError(i18n("Error loading image '%1'", path));
+            return;
+
+        case KmlImage::SaveFailed:
+            logError(i18n("Could not save image '%1' to '%2'", path,
+                          m_imageDir.filePath(image.baseFileName + QLatin1Char('.') + image.format)));
+            return;
+
+        default:
+            break;
+    }
 
-        addKmlTextElement(kmlPlacemark, QLatin1String("description"), my_description);
-        logInfo(i18n("Creation of placemark '%1'", fullFileName));
+    //logInfo(i18n("Creation of picture '%1'").arg(fullFileName));
 
-        // Save icon
-        QString iconFileName = QLatin1String("thumb_") + baseFileName + QLatin1Char('.') + imageFormat.toLower();
-        QString destPath     = m_imageDir.filePath(iconFileName);
+    const QString fullFileName = image.baseFileName + QLatin1Char('.') + image.format;
+    const double  alt          = image.altitude;
+    const double  lat          = image.latitude;
+    const double  lng          = image.longitude;
+
+    m_kmlWriter->writeStartElement(QLatin1String("Placemark"));
+    m_kmlWriter->writeTextElement(QLatin1String("name"), fullFileName);
+
+    if (image.cellLevel > 0)
+    {
+        // Loaded when the clusters of the finest level are replaced.
+        addKmlRegion(image.cell, s_clusterMinLodPixels, -1);
+    }
+
+    // location and altitude
+    m_kmlWriter->writeStartElement(QLatin1String("Point"));
+
+    if (alt)
+    {
+        m_kmlWriter->writeTextElement(QLatin1String("coordinates"), QString::fromUtf8("%1,%2,%3 ")
+            .arg(lng, 0, 'f', 8)
+            .arg(lat, 0, 'f', 8)
+            .arg(alt, 0, 'f', 8));
+    }
+    else
+    {
+        m_kmlWriter->writeTextElement(QLatin1String("coordinates"), QString::fromUtf8("%1,%2 ")
+            .arg(lng, 0, 'f', 8)
+            .arg(lat, 0, 'f', 8));
+    }
+
+    if (m_altitudeMode == 2)
+    {
+        m_kmlWriter->writeTextElement(QLatin1String("altitudeMode"), QLatin1String("absolute"));
+    }
+    else if (m_altitudeMode == 1)
+    {
+        m_kmlWriter->writeTextElement(QLatin1String("altitudeMode"), QLatin1String("relativeToGround"));
+    }
+    else
+    {
+        m_kmlWriter->writeTextElement(QLatin1String("altitudeMode"), QLatin1String("clampToGround"));
+    }
+
+    m_kmlWriter->writeTextElement(QLatin1String("extrude"), QLatin1String("1"));
+    m_kmlWriter->writeEndElement();
+
+    // we try to load exif value if any otherwise, try the application db
+
+    /** we need to take the DateTimeOriginal
+      * if we refer to http://www.exif.org/Exif2-2.PDF
+      * (standard)DateTime: is The date and time of image creation. In this standard it is the date and time the file was changed
+      * DateTimeOriginal: The date and time when the original image data was generated.
+      *                   For a DSC the date and time the picture was taken are recorded.
+      * DateTimeDigitized: The date and time when the image was stored as digital data.
+      * So for:
+      * - a DSC: the right time is the DateTimeDigitized which is also DateTimeOriginal
+      *          if the picture has been modified the (standard)DateTime should change.
+      * - a scanned picture, the right time is the DateTimeOriginal which should also be the DateTime
+      *          the (standard)DateTime should be the same except if the picture is modified
+      * - a panorama created from several pictures, the right time is the DateTimeOriginal (average of DateTimeOriginal actually)
+      *          The (standard)DateTime is the creation date of the panorama.
+      * it's seems the time to take into acccount is the DateTimeOriginal.
+      * but the MetadataProcessor::getImageDateTime() return the (standard)DateTime first
+      * MetadataProcessor seems to take Original dateTime first so it shoul be alright now.
+      */
+    if (m_hostFeatureImagesHasTime)
+    {
+        m_kmlWriter->writeStartElement(QLatin1String("TimeStamp"));
+        m_kmlWriter->writeTextElement(QLatin1String("when"), image.date.toString(QLatin1String("yyyy-MM-ddThh:mm:ssZ")));
+        m_kmlWriter->writeEndElement();
+    }
+
+    QString my_description;
+
+    if (m_optimize_googlemap)
+    {
+        my_description = QLatin1String("<img src=\"") + m_UrlDestDir + m_imageDirBasename + QLatin1Char('/') + fullFileName + QLatin1String("\">");
+    }
+    else
+    {
+        my_description = QLatin1String("<img src=\"") + m_imageDirBasename + QLatin1Char('/') + fullFileName + QLatin1String("\">");
+    }
+
+    if (m_hostFeatureImagesHasComments)
+    {
+        my_description += QLatin1String("<br/>") + image.description;
+    }
+
+    m_kmlWriter->writeTextElement(QLatin1String("description"), my_description);
+    logInfo(i18n("Creation of placemark '%1'", fullFileName));
+
+    // Icon saved by processImage()
+    const QString iconFileName = QLatin1String("thumb_") + fullFileName;
+
+    if (!image.iconSaved)
+    {
+        logWarning(i18n("Could not save icon for image '%1' to '%2'", path, m_imageDir.filePath(iconFileName)));
+    }
+    else
+    {
+        //logInfo(i18n("Creation of icon '%1'").arg(iconFileName));
+        // style et icon
+        m_kmlWriter->writeStartElement(QLatin1String("Style"));
+        m_kmlWriter->writeStartElement(QLatin1String("IconStyle"));
+        m_kmlWriter->writeStartElement(QLatin1String("Icon"));
 
-        if (!icon.save(destPath, imageFormat.toLatin1().constData(), 85))
+        if (m_optimize_googlemap)
         {
-            logWarning(i18n("Could not save icon for image '%1' to '%2'",path,destPath));
+            m_kmlWriter->writeTextElement(QLatin1String("href"), m_UrlDestDir + m_imageDirBasename + QLatin1Char('/') + iconFileName);
         }
         else
         {
-            //logInfo(i18n("Creation of icon '%1'").arg(iconFileName));
-            // style et icon
-            QDomElement kmlStyle     = addKmlElement(kmlPlacemark, QLatin1String("Style"));
-            QDomElement kmlIconStyle = addKmlElement(kmlStyle,     QLatin1String("IconStyle"));
-            QDomElement kmlIcon      = addKmlElement(kmlIconStyle, QLatin1String("Icon"));
-
-            if (m_optimize_googlemap)
-            {
-                addKmlTextElement(kmlIcon, QLatin1String("href"), m_UrlDestDir + m_imageDirBasename + QLatin1Char('/') + iconFileName);
-            }
-            else
-            {
-                addKmlTextElement(kmlIcon, QLatin1String("href"), m_imageDirBasename + QLatin1Char('/') + iconFileName);
-            }
-
-            QDomElement kmlBallonStyle = addKmlElement(kmlStyle, QLatin1String("BalloonStyle"));
-            addKmlTextElement(kmlBallonStyle, QLatin1String("text"), QLatin1String("$[description]"));
+            m_kmlWriter->writeTextElement(QLatin1String("href"), m_imageDirBasename + QLatin1Char('/') + iconFileName);
         }
+
+        m_kmlWriter->writeEndElement();
+        m_kmlWriter->writeEndElement();
+        m_kmlWriter->writeStartElement(QLatin1String("BalloonStyle"));
+        m_kmlWriter->writeTextElement(QLatin1String("text"), QLatin1String("$[description]"));
+        m_kmlWriter->writeEndElement();
+        m_kmlWriter->writeEndElement();
     }
+
+    m_kmlWriter->writeEndElement();
 }
 
 /*!
-\fn KmlExport::addTrack(QDomElement& kmlAlbum)
+\fn KmlExport::addTrack()
  */
-void KmlExport::addTrack(QDomElement& kmlAlbum)
+void KmlExport::addTrack()
 {
     if (m_GPXFile.isEmpty())
     {
@@ -391,12 +571,42 @@ void KmlExport::addTrack(QDomElement& kmlAlbum)
         return;
     }
 
+    // Several files can be chosen, separated by ';'.
+    QList<QUrl> urls;
+
+    foreach (const QString& file, m_GPXFile.split(QLatin1Char(';'), QString::SkipEmptyParts))
+    {
+        urls << QUrl::fromLocalFile(file.trimmed());
+    }
+
+    logInfo(i18n("Loading GPX files..."));
+
     m_gpxParser.clear();
-    bool ret = m_gpxParser.loadGPXFile(QUrl::fromLocalFile(m_GPXFile));
+    QList<QUrl> failed;
+
+    // The files are loaded on other threads, to keep the progress dialog updated
+    // by slotTrackLoadingProgress() until they are all loaded.
+    QEventLoop loop;
+    QFutureWatcher<bool> watcher;
+
+    connect(&watcher, SIGNAL(progressValueChanged(int)),
+            this, SLOT(slotTrackLoadingProgress(int)));
+
+    connect(&watcher, SIGNAL(finished()),
+            &loop, SLOT(quit()));
 
-    if (!ret)
+    watcher.setFuture(m_gpxParser.loadGPXFilesInBackground(urls, &failed));
+    loop.exec();
+
+    m_progressDialog->progressWidget()->setProgress(100, 100);
+
+    foreach (const QUrl& url, failed)
+    {
+        logError(i18n("Cannot parse %1 GPX file.", url.toLocalFile()));
+    }
+
+    if (!watcher.result() && m_gpxParser.numPoints() <= 0)
     {
-        logError(i18n("Cannot parse %1 GPX file.",m_GPXFile));
         return;
     }
 
@@ -407,27 +617,37 @@ void KmlExport::addTrack(QDomElement& kmlAlbum)
         return;
     }
 
+    m_gpxParser.setSimplification(m_GPXSimplify, m_GPXLevelsOfDetail);
+
     // create a folder that will contain tracks and points
-    QDomElement kmlFolder = addKmlElement(kmlAlbum, QLatin1String("Folder"));
-    addKmlTextElement(kmlFolder, QLatin1String("name"), i18n("Tracks"));
+    m_kmlWriter->writeStartElement(QLatin1String("Folder"));
+    m_kmlWriter->writeTextElement(QLatin1String("name"), i18n("Tracks"));
+
+    if (!m_optimize_googlemap)
+    {
+        m_gpxParser.CreateTrackPoints(*m_kmlWriter, m_TimeZone - 12, m_GPXAltitudeMode);
+    }
+
+    m_kmlWriter->writeEndElement();
 
     if (!m_optimize_googlemap)
     {
         // style of points and track
-        QDomElement kmlTrackStyle = addKmlElement(kmlAlbum, QLatin1String("Style"));
-        kmlTrackStyle.setAttribute(QLatin1String("id"), QLatin1String("track"));
-        QDomElement kmlIconStyle  = addKmlElement(kmlTrackStyle, QLatin1String("IconStyle"));
-        QDomElement kmlIcon       = addKmlElement(kmlIconStyle, QLatin1String("Icon"));
+        m_kmlWriter->writeStartElement(QLatin1String("Style"));
+        m_kmlWriter->writeAttribute(QLatin1String("id"), QLatin1String("track"));
+        m_kmlWriter->writeStartElement(QLatin1String("IconStyle"));
+        m_kmlWriter->writeStartElement(QLatin1String("Icon"));
         //! FIXME is there a way to be sure of the location of the icon?
-        addKmlTextElement(kmlIcon, QLatin1String("href"), QLatin1String("http://maps.google.com/mapfiles/kml/pal4/icon60.png"));
-
-        m_gpxParser.CreateTrackPoints(kmlFolder, *m_kmlDocument, m_TimeZone - 12, m_GPXAltitudeMode);
+        m_kmlWriter->writeTextElement(QLatin1String("href"), QLatin1String("http://maps.google.com/mapfiles/kml/pal4/icon60.png"));
+        m_kmlWriter->writeEndElement();
+        m_kmlWriter->writeEndElement();
+        m_kmlWriter->writeEndElement();
     }
 
     // linetrack style
-    QDomElement kmlLineTrackStyle = addKmlElement(kmlAlbum, QLatin1String("Style"));
-    kmlLineTrackStyle.setAttribute(QLatin1String("id"), QLatin1String("linetrack"));
-    QDomElement kmlLineStyle      = addKmlElement(kmlLineTrackStyle, QLatin1String("LineStyle"));
+    m_kmlWriter->writeStartElement(QLatin1String("Style"));
+    m_kmlWriter->writeAttribute(QLatin1String("id"), QLatin1String("linetrack"));
+    m_kmlWriter->writeStartElement(QLatin1String("LineStyle"));
 
     // the KML color is not #RRGGBB but AABBGGRR
     QString KMLColorValue = QString::fromUtf8("%1%2%3%4")
@@ -435,10 +655,12 @@ void KmlExport::addTrack(QDomElement& kmlAlbum)
         .arg((&m_GPXColor)->blue(), 2, 16)
         .arg((&m_GPXColor)->green(), 2, 16)
         .arg((&m_GPXColor)->red(), 2, 16);
-    addKmlTextElement(kmlLineStyle, QLatin1String("color"), KMLColorValue);
-    addKmlTextElement(kmlLineStyle, QLatin1String("width"), QString::fromUtf8("%1").arg(m_LineWidth));
+    m_kmlWriter->writeTextElement(QLatin1String("color"), KMLColorValue);
+    m_kmlWriter->writeTextElement(QLatin1String("width"), QString::fromUtf8("%1").arg(m_LineWidth));
+    m_kmlWriter->writeEndElement();
+    m_kmlWriter->writeEndElement();
 
-    m_gpxParser.CreateTrackLine(kmlAlbum, *m_kmlDocument, m_GPXAltitudeMode);
+    m_gpxParser.CreateTrackLine(*m_kmlWriter, m_GPXAltitudeMode);
 }
 
 /*!
@@ -447,36 +669,76 @@ void KmlExport::addTrack(QDomElement& kmlAlbum)
 void KmlExport::generate()
 {
     //! @todo perform a test here before continuing.
-    QDir().mkpath(m_tempDestDir.absolutePath());
     QDir().mkpath(m_imageDir.absolutePath());
 
     m_progressDialog->show();
 
+    // Without KMZ, the document and the images are written in the destination directory.
+    // With KMZ, the images are moved to the archive as their placemarks are written, and
+    // the document is added at the end.
+    QString kmlPath = QDir(m_baseDestDir).filePath(m_KMLFileName + QLatin1String(".kml"));
+    m_kmzArchive    = 0;
+
+#ifdef HAVE_KF5ARCHIVE
+    QScopedPointer<KZip> archive;
+
+    if (m_kmz)
+    {
+        kmlPath = m_tempDestDir.filePath(QLatin1String("doc.kml"));
+        archive.reset(new KZip(QDir(m_baseDestDir).filePath(m_KMLFileName + QLatin1String(".kmz"))));
+
+        if (!QDir().mkpath(m_baseDestDir) || !archive->open(QIODevice::WriteOnly))
+        {
+            logError(i18n("Cannot open file for writing"));
+            QDir(m_tempDestDir.absolutePath()).removeRecursively();
+            return;
+        }
+
+        // The images are compressed already.
+        archive->setCompression(KZip::NoCompression);
+        m_kmzArchive = archive.data();
+    }
+#endif
+
+    QFile file(kmlPath);
+
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        logError(i18n("Cannot open file for writing"));
+        QDir(m_tempDestDir.absolutePath()).removeRecursively();
+        return;
+    }
+
     // create the document, and it's root
-    m_kmlDocument                   = new QDomDocument(QLatin1String(""));
-    QDomImplementation impl;
-    QDomProcessingInstruction instr = m_kmlDocument->createProcessingInstruction(QLatin1String("xml"), QLatin1String("version=\"1.0\" encoding=\"UTF-8\""));
-    m_kmlDocument->appendChild(instr);
-    QDomElement kmlRoot             = m_kmlDocument->createElementNS(QLatin1String("http://www.opengis.net/kml/2.2"), QLatin1String("kml"));
-    m_kmlDocument->appendChild(kmlRoot);
-
-    QDomElement kmlAlbum            = addKmlElement(kmlRoot, QLatin1String("Document"));
-    QDomElement kmlName             = addKmlTextElement(kmlAlbum, QLatin1String("name"), m_hostAlbumName);
-    QDomElement kmlDescription      = addKmlHtmlElement(kmlAlbum, QLatin1String("description"),
-                                                        QLatin1String("Created with kmlexport kipi-plugin"));
+    QXmlStreamWriter writer(&file);
+    writer.setAutoFormatting(true);
+    writer.setAutoFormattingIndent(1);
+    m_kmlWriter = &writer;
+
+    m_kmlWriter->writeStartDocument();
+    m_kmlWriter->writeStartElement(QLatin1String("kml"));
+    m_kmlWriter->writeDefaultNamespace(QLatin1String("http://www.opengis.net/kml/2.2"));
+
+    m_kmlWriter->writeStartElement(QLatin1String("Document"));
+    m_kmlWriter->writeTextElement(QLatin1String("name"), m_hostAlbumName);
+    addKmlHtmlElement(QLatin1String("description"), QLatin1String("Created with kmlexport kipi-plugin"));
 
     if (m_GPXtracks)
     {
-        addTrack(kmlAlbum);
+        addTrack();
     }
 
+    // The host and the KML document are used from this thread only: the information
+    // about the images is taken first, then the images are processed on worker threads.
     QList<QUrl> images = m_hostSelection.images();
-    int defectImage   = 0;
-    int pos           = 1;
-    int count         = images.count();
+    int defectImage    = 0;
+    int pos            = 1;
+    int count          = images.count();
+    QList<KmlImage> toProcess;
+    QSet<QString> baseFileNames;
     QList<QUrl>::ConstIterator imagesEnd (images.constEnd());
 
-    for (QList<QUrl>::ConstIterator selIt = images.constBegin(); selIt != imagesEnd; ++selIt, ++pos)
+    for (QList<QUrl>::ConstIterator selIt = images.constBegin(); selIt != imagesEnd; ++selIt)
     {
         double alt, lat, lng;
         QUrl url        = *selIt;
@@ -496,17 +758,66 @@ void KmlExport::generate()
 
         if (hasGPSInfo)
         {
-            // generation de l'image et de l'icone
-            generateImagesthumb(url, kmlAlbum);
+            KmlImage image;
+            image.path         = url.toLocalFile();
+            image.baseFileName = webifyFileName(info.name());
+
+            // Images of several folders can have the same name. They are written at the
+            // same time by the worker threads, so their names are made unique here.
+            const QString webName = image.baseFileName;
+
+            for (int i = 2 ; baseFileNames.contains(image.baseFileName) ; ++i)
+            {
+                image.baseFileName = webName + QLatin1Char('-') + QString::number(i);
+            }
+
+            baseFileNames.insert(image.baseFileName);
+
+            image.orientation  = m_meta ? info.orientation() : (int)MetadataProcessor::UNSPECIFIED;
+            image.altitude     = alt;
+            image.latitude     = lat;
+            image.longitude    = lng;
+
+            if (m_hostFeatureImagesHasTime)
+                image.date = info.date();
+
+            if (m_hostFeatureImagesHasComments)
+                image.description = info.description();
+
+            toProcess << image;
         }
         else
         {
             logWarning(i18n("No position data for '%1'", info.name()));
             defectImage++;
+            m_progressDialog->progressWidget()->setProgress(pos++, count);
         }
+    }
+
+    if (m_clusters)
+    {
+        addClusters(toProcess);
+    }
+
+    // generation de l'image et de l'icone, in parallel. The placemarks are added by
+    // slotImageProcessed() as the results come in, until the last image is done.
+    if (!toProcess.isEmpty())
+    {
+        m_placemarks    = 0;
+        m_progressPos   = pos - 1;
+        m_progressCount = count;
+
+        QEventLoop loop;
+        QFutureWatcher<KmlImage> watcher;
+
+        connect(&watcher, SIGNAL(resultReadyAt(int)),
+                this, SLOT(slotImageProcessed()));
+
+        connect(&watcher, SIGNAL(finished()),
+                &loop, SLOT(quit()));
 
-        m_progressDialog->progressWidget()->setProgress(pos, count);
-        QApplication::processEvents();
+        watcher.setFuture(QtConcurrent::mapped(toProcess, KmlImageProcessor(this)));
+        loop.exec();
     }
 
     if (defectImage)
@@ -518,69 +829,196 @@ void KmlExport::generate()
                                        "No position data for %1 pictures", defectImage));
     }
 
-    /** @todo change to kml or kmz if compressed */
-    QFile file(m_tempDestDir.filePath(m_KMLFileName + QLatin1String(".kml")));
+    m_kmlWriter->writeEndElement();
+    m_kmlWriter->writeEndElement();
+    m_kmlWriter->writeEndDocument();
+    m_kmlWriter = 0;
+    file.close();
 
-    if (!file.open(QIODevice::WriteOnly))
+    if (writer.hasError())
     {
-        logError(i18n("Cannot open file for writing"));
-        delete m_kmlDocument;
-        m_kmlDocument = 0;
-        return;
+        logError(i18n("Cannot write file '%1'", kmlPath));
     }
 
-    QTextStream stream(&file); // we will serialize the data into the file
-    stream << m_kmlDocument->toString();
-    file.close();
+#ifdef HAVE_KF5ARCHIVE
+    if (m_kmzArchive)
+    {
+        // The document, first .kml file of the archive, is the one opened by the viewers.
+        archive->setCompression(KZip::DeflateCompression);
 
-    delete m_kmlDocument;
-    m_kmlDocument = 0;
+        if (!archive->addLocalFile(kmlPath, QLatin1String("doc.kml")) || !archive->close())
+        {
+            logError(i18n("Cannot write file '%1'", archive->fileName()));
+        }
 
-    logInfo(i18n("Move to final directory"));
+        m_kmzArchive = 0;
+    }
+#endif
 
-    if (!copyDir(m_tempDestDir.absolutePath(), m_baseDestDir))
+    if (m_kmz)
     {
-        logWarning(i18n("Cannot move data to destination directory"));
+        QDir(m_tempDestDir.absolutePath()).removeRecursively();
     }
 
-    QDir(m_tempDestDir.absolutePath()).removeRecursively();
     m_progressDialog->close();
 }
 
-bool KmlExport::copyDir(const QString& srcFilePath, const QString& dstFilePath)
+void KmlExport::slotTrackLoadingProgress(int value)
 {
-    if (QFileInfo(srcFilePath).isDir())
+    QFutureWatcher<bool>* const watcher = static_cast<QFutureWatcher<bool>*>(sender());
+
+    m_progressDialog->progressWidget()->setProgress(value, watcher->progressMaximum());
+}
+
+void KmlExport::slotImageProcessed()
+{
+    QFutureWatcher<KmlImage>* const watcher = static_cast<QFutureWatcher<KmlImage>*>(sender());
+
+    // The results are ready in any order, a placemark waits for the ones of the images before it.
+    while (watcher->future().isResultReadyAt(m_placemarks))
     {
-        QDir srcDir(srcFilePath);
-        QDir dstDir(dstFilePath);
+        const KmlImage image = watcher->resultAt(m_placemarks++);
+        addPlacemark(image);
 
-        if (!QDir().mkpath(dstDir.absolutePath()))
-            return false;
+        if (m_kmzArchive)
+        {
+            archiveImage(image);
+        }
 
-        QStringList files = srcDir.entryList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+        m_progressDialog->progressWidget()->setProgress(++m_progressPos, m_progressCount);
+    }
+}
+
+void KmlExport::archiveImage(const KmlImage& image)
+{
+#ifdef HAVE_KF5ARCHIVE
+    if (image.status != KmlImage::Processed)
+        return;
+
+    QStringList fileNames;
+    fileNames << image.baseFileName + QLatin1Char('.') + image.format;
+
+    if (image.iconSaved)
+        fileNames << QLatin1String("thumb_") + fileNames.first();
+
+    foreach (const QString& fileName, fileNames)
+    {
+        const QString path = m_imageDir.filePath(fileName);
 
-        foreach(const QString& file, files)
+        if (!m_kmzArchive->addLocalFile(path, m_imageDirBasename + QLatin1Char('/') + fileName))
         {
-            const QString newSrcFilePath = srcDir.absolutePath() + QLatin1Char('/') + file;
-            const QString newDstFilePath = dstDir.absolutePath() + QLatin1Char('/') + file;
+            logWarning(i18n("Cannot add '%1' to the archive", fileName));
+        }
+
+        QFile::remove(path);
+    }
+#else
+    Q_UNUSED(image);
+#endif
+}
+
+void KmlExport::addClusters(QList<KmlImage>& images)
+{
+    if (images.isEmpty())
+        return;
+
+    double north = images.first().latitude;
+    double south = north;
+    double east  = images.first().longitude;
+    double west  = east;
 
-            if (!copyDir(newSrcFilePath, newDstFilePath))
-                return false;
+    foreach (const KmlImage& image, images)
+    {
+        north = qMax(north, image.latitude);
+        south = qMin(south, image.latitude);
+        east  = qMax(east,  image.longitude);
+        west  = qMin(west,  image.longitude);
+    }
+
+    const double size = qMax(east - west, north - south);
+
+    // The finest level is the first one without crowded cells. The images are
+    // shown at once when they are few.
+    int finestLevel = 0;
+
+    for ( ; finestLevel < s_clusterMaxLevel && size / (1 << finestLevel) > s_clusterMinCellSize ; ++finestLevel)
+    {
+        const KmlClusterGrid grid(west, south, size, finestLevel);
+        QHash<qint64, int> counts;
+        int maxCount = 0;
+
+        foreach (const KmlImage& image, images)
+        {
+            maxCount = qMax(maxCount, ++counts[grid.cell(image.latitude, image.longitude)]);
         }
+
+        if (maxCount <= s_clusterMaxImages)
+            break;
     }
-    else
+
+    if (finestLevel == 0)
+        return;
+
+    m_kmlWriter->writeStartElement(QLatin1String("Folder"));
+    m_kmlWriter->writeTextElement(QLatin1String("name"), i18n("Clusters"));
+
+    for (int level = 0 ; level < finestLevel ; ++level)
     {
-        if (srcFilePath != dstFilePath && QFile::exists(srcFilePath) && QFile::exists(dstFilePath))
+        const KmlClusterGrid grid(west, south, size, level);
+
+        // Sorted by cell, for the document not to change from one export to the other.
+        QMap<qint64, KmlCluster> clusters;
+
+        foreach (const KmlImage& image, images)
         {
-            if (!QFile::remove(dstFilePath))
-                return false;
+            KmlCluster& cluster = clusters[grid.cell(image.latitude, image.longitude)];
+            cluster.count++;
+            cluster.latitude  += image.latitude;
+            cluster.longitude += image.longitude;
         }
 
-        if (!QFile::copy(srcFilePath, dstFilePath))
-            return false;
+        for (QMap<qint64, KmlCluster>::ConstIterator it = clusters.constBegin() ; it != clusters.constEnd() ; ++it)
+        {
+            const KmlCluster& cluster = it.value();
+
+            m_kmlWriter->writeStartElement(QLatin1String("Placemark"));
+            m_kmlWriter->writeTextElement(QLatin1String("name"), i18np("1 picture", "%1 pictures", cluster.count));
+            addKmlRegion(grid.box(it.key()), level == 0 ? 0 : s_clusterMinLodPixels, s_clusterMaxLodPixels);
+            m_kmlWriter->writeStartElement(QLatin1String("Point"));
+            m_kmlWriter->writeTextElement(QLatin1String("coordinates"), QString::fromUtf8("%1,%2 ")
+                .arg(cluster.longitude / cluster.count, 0, 'f', 8)
+                .arg(cluster.latitude  / cluster.count, 0, 'f', 8));
+            m_kmlWriter->writeEndElement();
+            m_kmlWriter->writeEndElement();
+        }
+    }
+
+    m_kmlWriter->writeEndElement();
+
+    const KmlClusterGrid grid(west, south, size, finestLevel);
+
+    for (int i = 0 ; i < images.count() ; ++i)
+    {
+        KmlImage& image = images[i];
+        image.cell      = grid.box(grid.cell(image.latitude, image.longitude));
+        image.cellLevel = finestLevel;
     }
+}
 
-    return true;
+void KmlExport::addKmlRegion(const QRectF& box, int minLodPixels, int maxLodPixels) const
+{
+    m_kmlWriter->writeStartElement(QLatin1String("Region"));
+    m_kmlWriter->writeStartElement(QLatin1String("LatLonAltBox"));
+    m_kmlWriter->writeTextElement(QLatin1String("north"), QString::number(qMin(box.bottom(),  90.0), 'f', 8));
+    m_kmlWriter->writeTextElement(QLatin1String("south"), QString::number(qMax(box.top(),   -90.0), 'f', 8));
+    m_kmlWriter->writeTextElement(QLatin1String("east"),  QString::number(qMin(box.right(), 180.0), 'f', 8));
+    m_kmlWriter->writeTextElement(QLatin1String("west"),  QString::number(qMax(box.left(), -180.0), 'f', 8));
+    m_kmlWriter->writeEndElement();
+    m_kmlWriter->writeStartElement(QLatin1String("Lod"));
+    m_kmlWriter->writeTextElement(QLatin1String("minLodPixels"), QString::number(minLodPixels));
+    m_kmlWriter->writeTextElement(QLatin1String("maxLodPixels"), QString::number(maxLodPixels));
+    m_kmlWriter->writeEndElement();
+    m_kmlWriter->writeEndElement();
 }
 
 /*!
@@ -610,11 +1048,30 @@ int KmlExport::getConfig()
     m_GPXColor           = group.readEntry(QLatin1String("Track Color"),       QColor("#17eeee"));
     m_GPXOpacity         = group.readEntry(QLatin1String("Track Opacity"),     64);
     m_GPXAltitudeMode    = group.readEntry(QLatin1String("GPX Altitude Mode"), 0);
+    m_GPXSimplify        = group.readEntry(QLatin1String("Track Simplification"),   0);
+    m_GPXLevelsOfDetail  = group.readEntry(QLatin1String("Track Levels Of Detail"), false);
+    m_clusters           = group.readEntry(QLatin1String("Cluster Pictures"),       false);
+
+#ifdef HAVE_KF5ARCHIVE
+    m_kmz                = group.readEntry(QLatin1String("KMZ"),                    false);
+#else
+    m_kmz                = false;
+#endif
 
     m_tempDestDir        = QDir(QDir::temp().filePath(QString::fromLatin1("kipi-kmlrexportplugin-%1").arg(qApp->applicationPid())));
 
     m_imageDirBasename   = QLatin1String("images");
-    m_imageDir           = QDir(m_tempDestDir.filePath(m_imageDirBasename));
+
+    // The images are moved to the KMZ archive one by one, otherwise they are written
+    // in their final place.
+    if (m_kmz)
+    {
+        m_imageDir       = QDir(m_tempDestDir.filePath(m_imageDirBasename));
+    }
+    else
+    {
+        m_imageDir       = QDir(QDir(m_baseDestDir).filePath(m_imageDirBasename));
+    }
 
     m_googlemapSize      = 32;
     return 1;
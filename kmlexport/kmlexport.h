@@ -27,9 +27,12 @@
 // Qt includes
 
 #include <QColor>
+#include <QDateTime>
 #include <QDir>
-#include <QDomDocument>
+#include <QObject>
 #include <QPointer>
+#include <QRectF>
+#include <QXmlStreamWriter>
 
 // Libkipi includes
 
@@ -42,6 +45,8 @@
 
 class QImage;
 
+class KZip;
+
 namespace KIPIPlugins
 {
     class KPBatchProgressDialog;
@@ -53,12 +58,61 @@ using namespace KIPIPlugins;
 namespace KIPIKMLExportPlugin
 {
 
+/*! An image to export: what the host knows about it, taken on the GUI thread,
+ *  and the result of KmlExport::processImage().
+ */
+class KmlImage
+{
+public:
+
+    enum Status
+    {
+        Processed = 0,
+        OpenFailed,
+        UnknownFormat,
+        LoadFailed,
+        SaveFailed
+    };
+
+public:
+
+    KmlImage()
+    {
+        orientation = 0;
+        altitude    = 0.0;
+        latitude    = 0.0;
+        longitude   = 0.0;
+        status      = Processed;
+        iconSaved   = false;
+        cellLevel   = -1;
+    }
+
+    QString   path;
+    QString   baseFileName;
+    int       orientation;
+    double    altitude;
+    double    latitude;
+    double    longitude;
+    QDateTime date;
+    QString   description;
+
+    /// With clustering, the cell of the finest level containing the image, and this level.
+    QRectF    cell;
+    int       cellLevel;
+
+    Status    status;
+    bool      iconSaved;
+    /// Lower case name of the image format, also used as file extension.
+    QString   format;
+};
+
 /**
  * @brief Exporte to KML
  * @author KIPI dev. team
  */
-class KmlExport
+class KmlExport : public QObject
 {
+    Q_OBJECT
 
 public:
 
@@ -67,12 +121,17 @@ public:
 
     ~KmlExport();
 
-    /*! generate the kml element for pictures with tumbnails
-     *  @param interface the kipi interface
-     *  @param QUrl the URL of the picture
-     *  @param kmlAlbum the album used
+    /*! Generate the picture and its thumbnail in the images directory.
+     *  It does not use the host or the KML document, and is run on worker threads.
+     *  @param image the picture, with the information from the host
+     *  @return the picture with the status of the processing
+     */
+    KmlImage processImage(KmlImage image) const;
+
+    /*! write the kml element for a picture processed by processImage()
+     *  @param image the picture
      */
-    void generateImagesthumb(const QUrl&, QDomElement& kmlAlbum);
+    void addPlacemark(const KmlImage& image);
 
     /*! Produce a web-friendly file name
      *  otherwise, while google earth works fine, maps.google.com may not find pictures and thumbnail
@@ -97,63 +156,50 @@ public:
      */
     QImage generateBorderedThumbnail(const QImage& fullImage, int size) const;
 
-    void   addTrack(QDomElement& kmlAlbum);
+    void   addTrack();
     void   generate();
     int    getConfig();
 
+private Q_SLOTS:
+
+    /*! Show the progress of the GPX files loaded by the QFutureWatcher sending the signal
+     */
+    void slotTrackLoadingProgress(int value);
+
+    /*! Write the placemarks of the images processed so far by the QFutureWatcher
+     *  sending the signal, in the order of the selection
+     */
+    void slotImageProcessed();
+
 private:
 
     void logInfo(const QString& msg) const;
     void logError(const QString& msg) const;
     void logWarning(const QString& msg) const;
-    bool copyDir(const QString& srcFilePath, const QString& dstFilePath);
 
-    /*!
-     *  \fn KIPIKMLExport::KmlExport::addKmlElement(QDomElement target, QString tag)
-     *  Add a new element
-     *  @param target the parent element to which add the element
-     *  @param tag the new element name
-     *  @return the New element
+    /*! Move the picture and the icon generated for @p image to the KMZ archive
      */
-    QDomElement addKmlElement(QDomElement& target, const QString& tag) const
-    {
-        QDomElement kmlElement = m_kmlDocument->createElement( tag );
-        target.appendChild( kmlElement );
-        return kmlElement;
-    }
+    void archiveImage(const KmlImage& image);
 
-    /*!
-     *  \fn KIPIKMLExport::KmlExport::addKmlTextElement(QDomElement target, QString tag, QString text)
-     *  Add a new element with a text
-     *  @param target the parent element to which add the element
-     *  @param tag the new element name
-     *  @param text the text content of the new element
-     *  @return the New element
+    /*! Write the placemarks grouping nearby images, and set the cell of each image
      */
-    QDomElement addKmlTextElement(QDomElement& target, const QString& tag, const QString& text) const
-    {
-        QDomElement kmlElement  = m_kmlDocument->createElement( tag );
-        target.appendChild( kmlElement );
-        QDomText kmlTextElement = m_kmlDocument->createTextNode( text );
-        kmlElement.appendChild( kmlTextElement );
-        return kmlElement;
-    }
+    void addClusters(QList<KmlImage>& images);
+
+    /*! Write a Region over @p box, shown between @p minLodPixels and @p maxLodPixels
+     */
+    void addKmlRegion(const QRectF& box, int minLodPixels, int maxLodPixels) const;
 
     /*!
-     *  \fn KIPIKMLExport::KmlExport::addKmlHtmlElement(QDomElement target, QString tag, QString text)
-     *  Add a new element with html content (html entities are escaped and text is wrapped in a CDATA section)
-     *  @param target the parent element to which add the element
+     *  \fn KIPIKMLExport::KmlExport::addKmlHtmlElement(QString tag, QString text)
+     *  Write a new element with html content (html entities are escaped and text is wrapped in a CDATA section)
      *  @param tag the new element name
      *  @param text the HTML content of the new element
-     *  @return the New element
      */
-    QDomElement addKmlHtmlElement(QDomElement& target, const QString& tag, const QString& text) const
+    void addKmlHtmlElement(const QString& tag, const QString& text) const
     {
-        QDomElement kmlElement  = m_kmlDocument->createElement( tag );
-        target.appendChild( kmlElement );
-        QDomText kmlTextElement = m_kmlDocument->createCDATASection( text );
-        kmlElement.appendChild( kmlTextElement );
-        return kmlElement;
+        m_kmlWriter->writeStartElement(tag);
+        m_kmlWriter->writeCDATA(text);
+        m_kmlWriter->writeEndElement();
     }
 
 private:
@@ -161,6 +207,8 @@ private:
     bool                        m_localTarget;
     bool                        m_optimize_googlemap;
     bool                        m_GPXtracks;
+    bool                        m_GPXLevelsOfDetail;
+    bool                        m_clusters;
 
     int                         m_iconSize;
     int                         m_googlemapSize;
@@ -170,6 +218,8 @@ private:
     int                         m_LineWidth;
     int                         m_GPXOpacity;
     int                         m_GPXAltitudeMode;
+    /** maximal distance in meters between the track and its simplification, 0 for none */
+    int                         m_GPXSimplify;
 
     /** directory used in kmldocument structure */
     QString                     m_imageDirBasename;
@@ -199,13 +249,22 @@ private:
     Interface*                  m_iface;
     QPointer<MetadataProcessor> m_meta;
 
-    /*! the root document, used to create all QDomElements */
-    QDomDocument*               m_kmlDocument;
+    /*! the writer of the document, used to write all elements as they are generated */
+    QXmlStreamWriter*           m_kmlWriter;
+
+    /*! write a single KMZ archive, with the images stored without compression */
+    bool                        m_kmz;
+    KZip*                       m_kmzArchive;
 
     /*! the GPS parsed data */
     KMLGPSDataParser            m_gpxParser;
 
     KPBatchProgressDialog*      m_progressDialog;
+
+    /*! the number of placemarks written for the processed images, and the progress of the export */
+    int                         m_placemarks;
+    int                         m_progressPos;
+    int                         m_progressCount;
 };
 
 } // namespace KIPIKMLExportPlugin
@@ -23,6 +23,10 @@
 
 #include "kmlgpsdataparser.h"
 
+// Qt includes
+
+#include <QtMath>
+
 // KDE includes
 
 #include <klocalizedstring.h>
@@ -30,109 +34,359 @@
 namespace KIPIKMLExportPlugin
 {
 
+/// A sub-range of the track still to simplify, between two points kept.
+class KMLTrackRange
+{
+public:
+
+    KMLTrackRange(int f = 0, int l = 0)
+        : first(f),
+          last(l)
+    {
+    }
+
+    int first;
+    int last;
+};
+
+/// The bounding box of the track, in degrees.
+class KMLTrackBox
+{
+public:
+
+    KMLTrackBox()
+        : north(0.0),
+          south(0.0),
+          east(0.0),
+          west(0.0)
+    {
+    }
+
+    double north;
+    double south;
+    double east;
+    double west;
+};
+
 KMLGPSDataParser::KMLGPSDataParser()
     : GPSDataParser()
 {
-    kmlDocument = 0;
+    m_tolerance      = 0.0;
+    m_levelsOfDetail = false;
 }
 
 KMLGPSDataParser::~KMLGPSDataParser()
 {
 }
 
+void KMLGPSDataParser::setSimplification(double tolerance, bool levelsOfDetail)
+{
+    m_tolerance      = qMax(0.0, tolerance);
+    m_levelsOfDetail = levelsOfDetail;
+}
+
+QVector<int> KMLGPSDataParser::simplify(double tolerance) const
+{
+    const int count = numPoints();
+    QVector<int> indexes;
+
+    if (tolerance <= 0.0 || count < 3)
+    {
+        indexes.reserve(count);
+
+        for (int i = 0 ; i < count ; ++i)
+        {
+            indexes.append(i);
+        }
+
+        return indexes;
+    }
+
+    // Project the points on a plane in meters, around the mean latitude of the track.
+    const double earthRadius = 6371000.0;
+    const double toRadians   = qDegreesToRadians(1.0);
+    double meanLatitude      = 0.0;
+
+    for (int i = 0 ; i < count ; ++i)
+    {
+        meanLatitude += m_latitudes.at(i);
+    }
+
+    const double xScale = earthRadius * toRadians * qCos(meanLatitude / count * toRadians);
+    const double yScale = earthRadius * toRadians;
+    QVector<double> xs(count);
+    QVector<double> ys(count);
+
+    for (int i = 0 ; i < count ; ++i)
+    {
+        xs[i] = m_longitudes.at(i) * xScale;
+        ys[i] = m_latitudes.at(i)  * yScale;
+    }
+
+    // Keep the point the farthest from the segment between the points kept around it,
+    // as long as it is farther than the tolerance. A stack is used rather than recursion,
+    // as tracks can have millions of points.
+    const double tolerance2 = tolerance * tolerance;
+    QVector<bool> keep(count, false);
+    keep[0]                 = true;
+    keep[count-1]           = true;
+
+    QVector<KMLTrackRange> ranges;
+    ranges.append(KMLTrackRange(0, count - 1));
+
+    while (!ranges.isEmpty())
+    {
+        const KMLTrackRange range = ranges.last();
+        ranges.removeLast();
+
+        const double ax = xs.at(range.first);
+        const double ay = ys.at(range.first);
+        const double dx = xs.at(range.last) - ax;
+        const double dy = ys.at(range.last) - ay;
+        const double d2 = dx * dx + dy * dy;
+        double farthest = 0.0;
+        int    index    = -1;
+
+        for (int i = range.first + 1 ; i < range.last ; ++i)
+        {
+            // Squared distance between the point and the segment.
+            double px = xs.at(i) - ax;
+            double py = ys.at(i) - ay;
+
+            if (d2 > 0.0)
+            {
+                const double t = qBound(0.0, (px * dx + py * dy) / d2, 1.0);
+                px            -= t * dx;
+                py            -= t * dy;
+            }
+
+            const double distance = px * px + py * py;
+
+            if (distance > farthest)
+            {
+                farthest = distance;
+                index    = i;
+            }
+        }
+
+        if (index >= 0 && farthest > tolerance2)
+        {
+            keep[index] = true;
+            ranges.append(KMLTrackRange(range.first, index));
+            ranges.append(KMLTrackRange(index, range.last));
+        }
+    }
+
+    for (int i = 0 ; i < count ; ++i)
+    {
+        if (keep.at(i))
+            indexes.append(i);
+    }
+
+    return indexes;
+}
+
 QString KMLGPSDataParser::lineString()
 {
-    QString line = QLatin1String("");
-    // cache the end to not recalculate it with large number of points
-    GPSDataMap::ConstIterator end (m_GPSDataMap.constEnd());
+    const QVector<int> indexes = simplify(m_tolerance);
 
-    for (GPSDataMap::ConstIterator it = m_GPSDataMap.constBegin(); it != end; ++it )
+    return lineString(indexes, 0, indexes.count());
+}
+
+QString KMLGPSDataParser::lineString(const QVector<int>& indexes, int first, int count) const
+{
+    // About 32 characters per point: build the string in place rather than with arg().
+    QString line;
+    line.reserve(count * 32);
+
+    for (int n = first ; n < first + count ; ++n)
     {
-        line += QString::fromUtf8("%1,%2,%3 ").arg(it.value().longitude()).arg(it.value().latitude()).arg(it.value().altitude());
+        const int i = indexes.at(n);
+
+        line += QString::number(m_longitudes.at(i));
+        line += QLatin1Char(',');
+        line += QString::number(m_latitudes.at(i));
+        line += QLatin1Char(',');
+        line += QString::number(m_altitudes.at(i));
+        line += QLatin1Char(' ');
     }
 
     return line;
 }
 
-void KMLGPSDataParser::CreateTrackLine(QDomElement& parent, QDomDocument& root, int altitudeMode)
+void KMLGPSDataParser::writeCoordinates(QXmlStreamWriter& writer, const QVector<int>& indexes) const
 {
-    kmlDocument = &root;
+    // The string of a whole track can take hundreds of megabytes.
+    const int pieceSize = 4096;
 
-    // add the linetrack
-    QDomElement kmlPlacemark = addKmlElement(parent, QLatin1String("Placemark"));
-    addKmlTextElement(kmlPlacemark, QLatin1String("name"), i18n("Track"));
-    QDomElement kmlLineString = addKmlElement(kmlPlacemark, QLatin1String("LineString"));
-    addKmlTextElement(kmlLineString, QLatin1String("coordinates"), lineString());
-    addKmlTextElement(kmlPlacemark, QLatin1String("styleUrl"), QLatin1String("#linetrack"));
+    writer.writeStartElement(QLatin1String("coordinates"));
 
-    if (altitudeMode == 2 )
+    for (int first = 0 ; first < indexes.count() ; first += pieceSize)
     {
-        addKmlTextElement(kmlLineString, QLatin1String("altitudeMode"), QLatin1String("absolute"));
+        writer.writeCharacters(lineString(indexes, first, qMin(pieceSize, indexes.count() - first)));
     }
-    else if (altitudeMode == 1 )
+
+    writer.writeEndElement();
+}
+
+KMLTrackBox KMLGPSDataParser::boundingBox() const
+{
+    KMLTrackBox box;
+
+    if (numPoints() <= 0)
+        return box;
+
+    box.north = m_latitudes.first();
+    box.south = box.north;
+    box.east  = m_longitudes.first();
+    box.west  = box.east;
+
+    for (int i = 1 ; i < numPoints() ; ++i)
     {
-        addKmlTextElement(kmlLineString, QLatin1String("altitudeMode"), QLatin1String("relativeToGround"));
+        box.north = qMax(box.north, m_latitudes.at(i));
+        box.south = qMin(box.south, m_latitudes.at(i));
+        box.east  = qMax(box.east,  m_longitudes.at(i));
+        box.west  = qMin(box.west,  m_longitudes.at(i));
+    }
+
+    return box;
+}
+
+void KMLGPSDataParser::writeRegion(QXmlStreamWriter& writer, const KMLTrackBox& box,
+                                   int minLodPixels, int maxLodPixels) const
+{
+    // The size of a region on screen is computed from its area: keep some width
+    // to a track going straight north or east.
+    const double margin = 0.0005;
+
+    writer.writeStartElement(QLatin1String("Region"));
+    writer.writeStartElement(QLatin1String("LatLonAltBox"));
+    writer.writeTextElement(QLatin1String("north"), QString::number(qMin(box.north + margin,  90.0), 'f', 8));
+    writer.writeTextElement(QLatin1String("south"), QString::number(qMax(box.south - margin, -90.0), 'f', 8));
+    writer.writeTextElement(QLatin1String("east"),  QString::number(qMin(box.east  + margin,  180.0), 'f', 8));
+    writer.writeTextElement(QLatin1String("west"),  QString::number(qMax(box.west  - margin, -180.0), 'f', 8));
+    writer.writeEndElement();
+    writer.writeStartElement(QLatin1String("Lod"));
+    writer.writeTextElement(QLatin1String("minLodPixels"), QString::number(minLodPixels));
+    writer.writeTextElement(QLatin1String("maxLodPixels"), QString::number(maxLodPixels));
+    writer.writeEndElement();
+    writer.writeEndElement();
+}
+
+void KMLGPSDataParser::CreateTrackLine(QXmlStreamWriter& writer, int altitudeMode)
+{
+    // With levels of detail, coarser tracks are shown while the track is small on screen.
+    // Each level has a tolerance 4 times larger than the next one.
+    QList<double> tolerances;
+    QList<int>    minLodPixels;
+    QList<int>    maxLodPixels;
+    KMLTrackBox   box;
+
+    if (m_levelsOfDetail && numPoints() > 0)
+    {
+        const double base = qMax(m_tolerance, 1.0);
+        tolerances   << base * 16 << base * 4 << m_tolerance;
+        minLodPixels << 0         << 512      << 2048;
+        maxLodPixels << 512       << 2048     << -1;
+
+        // All the levels are shown over the region of the whole track.
+        box = boundingBox();
     }
     else
     {
-        addKmlTextElement(kmlLineString, QLatin1String("altitudeMode"), QLatin1String("clampToGround"));
+        tolerances   << m_tolerance;
+    }
+
+    for (int level = 0 ; level < tolerances.count() ; ++level)
+    {
+        // add the linetrack
+        writer.writeStartElement(QLatin1String("Placemark"));
+        writer.writeTextElement(QLatin1String("name"), i18n("Track"));
+
+        if (!minLodPixels.isEmpty())
+        {
+            writeRegion(writer, box, minLodPixels.at(level), maxLodPixels.at(level));
+        }
+
+        writer.writeStartElement(QLatin1String("LineString"));
+        writeCoordinates(writer, simplify(tolerances.at(level)));
+
+        if (altitudeMode == 2 )
+        {
+            writer.writeTextElement(QLatin1String("altitudeMode"), QLatin1String("absolute"));
+        }
+        else if (altitudeMode == 1 )
+        {
+            writer.writeTextElement(QLatin1String("altitudeMode"), QLatin1String("relativeToGround"));
+        }
+        else
+        {
+            writer.writeTextElement(QLatin1String("altitudeMode"), QLatin1String("clampToGround"));
+        }
+
+        writer.writeEndElement();
+        writer.writeTextElement(QLatin1String("styleUrl"), QLatin1String("#linetrack"));
+        writer.writeEndElement();
     }
 }
 
-void KMLGPSDataParser::CreateTrackPoints(QDomElement& parent, QDomDocument& root, int timeZone, int altitudeMode)
+void KMLGPSDataParser::CreateTrackPoints(QXmlStreamWriter& writer, int timeZone, int altitudeMode)
 {
-    kmlDocument = &root;
     //kDebug(AREA_CODE_LOADING) << "creation d'un trackpoint" ;
 
     // create the points
-    QDomElement kmlPointsFolder = addKmlElement(parent, QLatin1String("Folder"));
-    addKmlTextElement(kmlPointsFolder, QLatin1String("name"),       i18n("Points"));
-    addKmlTextElement(kmlPointsFolder, QLatin1String("visibility"), QLatin1String("0"));
-    addKmlTextElement(kmlPointsFolder, QLatin1String("open"),       QLatin1String("0"));
-    int i = 0;
+    writer.writeStartElement(QLatin1String("Folder"));
+    writer.writeTextElement(QLatin1String("name"),       i18n("Points"));
+    writer.writeTextElement(QLatin1String("visibility"), QLatin1String("0"));
+    writer.writeTextElement(QLatin1String("open"),       QLatin1String("0"));
+    // Only the points kept by the simplification of the track.
+    const QVector<int> indexes = simplify(m_tolerance);
 
-    // cache the end to not recalculate it with large number of points
-    GPSDataMap::ConstIterator end (m_GPSDataMap.constEnd());
-
-    for (GPSDataMap::ConstIterator it = m_GPSDataMap.constBegin(); it != end; ++it, ++i)
+    foreach (int i, indexes)
     {
-        QDomElement kmlPointPlacemark = addKmlElement(kmlPointsFolder, QLatin1String("Placemark"));
-        addKmlTextElement(kmlPointPlacemark, QLatin1String("name"), QString::fromUtf8("%1 %2 ").arg(i18n("Point")).arg(i));
-        addKmlTextElement(kmlPointPlacemark, QLatin1String("styleUrl"), QLatin1String("#track"));
-        QDomElement kmlTimeStamp      = addKmlElement(kmlPointPlacemark, QLatin1String("TimeStamp"));
+        writer.writeStartElement(QLatin1String("Placemark"));
+        writer.writeTextElement(QLatin1String("name"), QString::fromUtf8("%1 %2 ").arg(i18n("Point")).arg(i));
+        writer.writeTextElement(QLatin1String("styleUrl"), QLatin1String("#track"));
+        writer.writeStartElement(QLatin1String("TimeStamp"));
         // GPS device are sync in time by satellite using GMT time.
         // If the camera time is different than GMT time, we want to
         // convert the GPS time to localtime of the picture to be display
         // in the same timeframe
-        QDateTime GPSLocalizedTime = it.key().addSecs(timeZone*3600);
+        QDateTime GPSLocalizedTime = pointDateTime(i).addSecs(timeZone*3600);
 
-        addKmlTextElement(kmlTimeStamp, QLatin1String("when"), GPSLocalizedTime.toString(QLatin1String("yyyy-MM-ddThh:mm:ssZ")));
-        QDomElement kmlGeometry = addKmlElement(kmlPointPlacemark, QLatin1String("Point"));
-        addKmlTextElement(kmlPointPlacemark, QLatin1String("visibility"), QLatin1String("0"));
+        writer.writeTextElement(QLatin1String("when"), GPSLocalizedTime.toString(QLatin1String("yyyy-MM-ddThh:mm:ssZ")));
+        writer.writeEndElement();
+        writer.writeStartElement(QLatin1String("Point"));
 
-        if (it.value().latitude())
+        if (m_latitudes.at(i))
         {
-            addKmlTextElement(kmlGeometry, QLatin1String("coordinates"),
-                              QString::fromUtf8("%1,%2,%3 ")
-                              .arg(it.value().longitude()).arg(it.value().latitude()).arg(it.value().altitude()));
+            writer.writeTextElement(QLatin1String("coordinates"),
+                                    QString::fromUtf8("%1,%2,%3 ")
+                                    .arg(m_longitudes.at(i)).arg(m_latitudes.at(i)).arg(m_altitudes.at(i)));
         }
         else
         {
-            addKmlTextElement(kmlGeometry, QLatin1String("coordinates"), QString::fromUtf8("%1,%2 ").arg(it.value().longitude()).arg(it.value().latitude()));
+            writer.writeTextElement(QLatin1String("coordinates"), QString::fromUtf8("%1,%2 ").arg(m_longitudes.at(i)).arg(m_latitudes.at(i)));
         }
         if (altitudeMode == 2 )
         {
-            addKmlTextElement(kmlGeometry, QLatin1String("altitudeMode"), QLatin1String("absolute"));
+            writer.writeTextElement(QLatin1String("altitudeMode"), QLatin1String("absolute"));
         }
         else if (altitudeMode == 1 )
         {
-            addKmlTextElement(kmlGeometry, QLatin1String("altitudeMode"), QLatin1String("relativeToGround"));
+            writer.writeTextElement(QLatin1String("altitudeMode"), QLatin1String("relativeToGround"));
         }
         else
         {
-            addKmlTextElement(kmlGeometry, QLatin1String("altitudeMode"), QLatin1String("clampToGround"));
+            writer.writeTextElement(QLatin1String("altitudeMode"), QLatin1String("clampToGround"));
         }
+
+        writer.writeEndElement();
+        writer.writeTextElement(QLatin1String("visibility"), QLatin1String("0"));
+        writer.writeEndElement();
     }
+
+    writer.writeEndElement();
 }
 
 } // namespace KIPIKMLExportPlugin
@@ -30,11 +30,13 @@
 
 // Qt includes
 
-#include <QDomDocument>
+#include <QXmlStreamWriter>
 
 namespace KIPIKMLExportPlugin
 {
 
+class KMLTrackBox;
+
 /*! a classe derivated from GPSDataParser mainly to transform GPS data to KML
  *  @author Stéphane Pontier shadow.walker@free.fr
  */
@@ -46,62 +48,61 @@ public:
     KMLGPSDataParser();
     ~KMLGPSDataParser();
 
+    /*! Set how the track is simplified before being written
+     *  @param tolerance the maximal distance in meters between the track and its simplification,
+     *         0 to write all points
+     *  @param levelsOfDetail write coarser tracks too, shown by the viewer depending on the zoom
+     */
+    void setSimplification(double tolerance, bool levelsOfDetail);
+
     /*! KMLGPSDataParser::KMLGPSDataParser::lineString()
      *  @return the string containing the time ordered point (lon,lat,alt)
      */
     QString lineString();
 
-    /*! Create a KML Element that will contain the linetrace of the GPS
-     *  @param parent the QDomElement to which the track will be added
-     *  @param root the QDomDocument used to create all elements
+    /*! Write a KML Element that will contain the linetrace of the GPS
+     *  @param writer the writer of the KML document, in the parent element of the track
      *  @param altitudeMode altitude mode of the line and points
      */
-    void CreateTrackLine(QDomElement& parent, QDomDocument& root, int altitudeMode);
+    void CreateTrackLine(QXmlStreamWriter& writer, int altitudeMode);
 
-    /*! Create a KML Element that will contain the points and of the GPS
-     *  @param parent the QDomElement to which the track will be added
-     *  @param root the QDomDocument used to create all elements
+    /*! Write a KML Element that will contain the points and of the GPS
+     *  @param writer the writer of the KML document, in the parent element of the points
      *  @param timeZone the Timezone of the pictures
      *  @param altitudeMode altitude mode of the line and points
      */
-    void CreateTrackPoints(QDomElement& parent, QDomDocument& root, int timeZone, int altitudeMode);
+    void CreateTrackPoints(QXmlStreamWriter& writer, int timeZone, int altitudeMode);
 
 private:
 
-    /*!
-     *  @brief Add a new element
-     *  @param target the parent element to which add the element
-     *  @param tag the new element name
-     *  @return the New element
+    /*! Douglas-Peucker simplification of the track
+     *  @param tolerance the maximal distance in meters between the track and the points kept
+     *  @return the indexes of the points kept, in time order
+     */
+    QVector<int> simplify(double tolerance) const;
+
+    /*! @return the string containing the points (lon,lat,alt) of @p count @p indexes from @p first
      */
-    QDomElement addKmlElement(QDomElement& target, const QString& tag)
-    {
-        QDomElement kmlElement = kmlDocument->createElement( tag );
-        target.appendChild( kmlElement );
-        return kmlElement;
-    }
-
-    /**
-     *  @brief Add a new element with a text
-     *  @param target the parent element to which add the element
-     *  @param tag the new element name
-     *  @param text the text content of the new element
-     *  @return the New element
+    QString lineString(const QVector<int>& indexes, int first, int count) const;
+
+    /*! Write the points of @p indexes as the coordinates of a line, by pieces
+     */
+    void writeCoordinates(QXmlStreamWriter& writer, const QVector<int>& indexes) const;
+
+    /*! @return the bounding box of the track, walked once for all the levels of detail
+     */
+    KMLTrackBox boundingBox() const;
+
+    /*! Write a Region showing its parent between @p minLodPixels and @p maxLodPixels,
+     *  over the bounding box @p box of the track
      */
-    QDomElement addKmlTextElement(QDomElement& target, const QString& tag, const QString& text)
-    {
-        QDomElement kmlElement  = kmlDocument->createElement( tag );
-        target.appendChild( kmlElement );
-        QDomText kmlTextElement = kmlDocument->createTextNode( text );
-        kmlElement.appendChild( kmlTextElement );
-        return kmlElement;
-    }
+    void writeRegion(QXmlStreamWriter& writer, const KMLTrackBox& box,
+                     int minLodPixels, int maxLodPixels) const;
 
 private:
 
-    /*! @todo maybe initialize it in the constructor */
-    /*! the root document, used to create all QDomElements */
-    QDomDocument* kmlDocument;
+    double        m_tolerance;
+    bool          m_levelsOfDetail;
 };
 
 } // namespace KIPIKMLExportPlugin
@@ -127,6 +127,17 @@ KmlWindow::KmlWindow(QWidget* const parent,
     FileNameLabel_       = new QLabel(i18n("Filename:"), TargetPreferenceGroupBox);
     FileName_            = new QLineEdit(TargetPreferenceGroupBox);
 
+    KMZCheckBox_         = new QCheckBox(i18n("Write a single KMZ archive"), TargetPreferenceGroupBox);
+    KMZCheckBox_->setWhatsThis(i18n("Writes the document and the pictures in one compressed file, "
+                                    "instead of a KML file and a directory of pictures."));
+#ifndef HAVE_KF5ARCHIVE
+    KMZCheckBox_->setVisible(false);
+#endif
+
+    ClustersCheckBox_    = new QCheckBox(i18n("Group nearby pictures"), TargetPreferenceGroupBox);
+    ClustersCheckBox_->setWhatsThis(i18n("Shows the number of pictures of an area instead of the pictures, "
+                                         "which are loaded when zooming in. Use it for large albums."));
+
     TargetPreferenceGroupBoxLayout->addWidget(TargetTypeGroupBox,         0, 0, 2, 5);
     TargetPreferenceGroupBoxLayout->addWidget(AltitudeLabel_,             2, 0, 1, 1);
     TargetPreferenceGroupBoxLayout->addWidget(AltitudeCB_,                2, 1, 1, 4);
@@ -136,6 +147,8 @@ KmlWindow::KmlWindow(QWidget* const parent,
     TargetPreferenceGroupBoxLayout->addWidget(DestinationUrl_,            4, 1, 1, 4);
     TargetPreferenceGroupBoxLayout->addWidget(FileNameLabel_,             5, 0, 1, 1);
     TargetPreferenceGroupBoxLayout->addWidget(FileName_,                  5, 1, 1, 4);
+    TargetPreferenceGroupBoxLayout->addWidget(KMZCheckBox_,               6, 0, 1, 5);
+    TargetPreferenceGroupBoxLayout->addWidget(ClustersCheckBox_,          7, 0, 1, 5);
     TargetPreferenceGroupBoxLayout->setContentsMargins(spacing, spacing, spacing, spacing);
     TargetPreferenceGroupBoxLayout->setAlignment(Qt::AlignTop);
 
@@ -171,12 +184,12 @@ KmlWindow::KmlWindow(QWidget* const parent,
     GPXTracksCheckBox_ = new QCheckBox(i18n("Draw GPX Track"), GPXTracksGroupBox);
 
     // file selector
-    GPXFileLabel_ = new QLabel(i18n("GPX file:"), GPXTracksGroupBox);
+    GPXFileLabel_ = new QLabel(i18n("GPX files:"), GPXTracksGroupBox);
 
     GPXFileUrlRequester_ = new KPFileSelector(GPXTracksGroupBox);
     GPXFileUrlRequester_->setFileDlgFilter(i18n("%1|GPS Exchange Format", QLatin1String("*.gpx")));
-    GPXFileUrlRequester_->setFileDlgTitle(i18n("Select GPX File to Load"));
-    GPXFileUrlRequester_->setFileDlgMode(QFileDialog::ExistingFile);
+    GPXFileUrlRequester_->setFileDlgTitle(i18n("Select GPX Files to Load"));
+    GPXFileUrlRequester_->setFileDlgMode(QFileDialog::ExistingFiles);
 
     timeZoneLabel_ = new QLabel(i18n("Time Zone:"), GPXTracksGroupBox);
     timeZoneCB     = new QComboBox(GPXTracksGroupBox);
@@ -241,6 +254,21 @@ KmlWindow::KmlWindow(QWidget* const parent,
                                       "regardless of the actual elevation of the terrain beneath "
                                       "the element.</dd></dl>"));
 
+    GPXSimplifyLabel_ = new QLabel(i18n("Simplify Track:"), GPXTracksGroupBox);
+    GPXSimplifyInput_ = new QSpinBox(GPXTracksGroupBox);
+    GPXSimplifyInput_->setRange(0, 1000);
+    GPXSimplifyInput_->setSingleStep(1);
+    GPXSimplifyInput_->setValue(0);
+    GPXSimplifyInput_->setSuffix(i18n(" m"));
+    GPXSimplifyInput_->setSpecialValueText(i18n("No simplification"));
+    GPXSimplifyInput_->setWhatsThis(i18n("Sets the maximal distance between the track and the points "
+                                         "written in the file. Removing the points which do not change "
+                                         "the shape of the track makes files smaller and faster to display."));
+
+    GPXLevelsOfDetailCheckBox_ = new QCheckBox(i18n("Write levels of detail"), GPXTracksGroupBox);
+    GPXLevelsOfDetailCheckBox_->setWhatsThis(i18n("Also writes coarser tracks, displayed instead of the "
+                                                  "full track while it is small on the screen."));
+
     GPXTracksGroupBoxLayout->addWidget(GPXTracksCheckBox_,     0, 0, 1, 4);
     GPXTracksGroupBoxLayout->addWidget(GPXFileLabel_,          1, 0, 1, 1);
     GPXTracksGroupBoxLayout->addWidget(GPXFileUrlRequester_,   1, 1, 1, 3);
@@ -254,6 +282,9 @@ KmlWindow::KmlWindow(QWidget* const parent,
     GPXTracksGroupBoxLayout->addWidget(GPXTracksOpacityInput_, 4, 3, 1, 1);
     GPXTracksGroupBoxLayout->addWidget(GPXAltitudeLabel_,      5, 0, 1, 1);
     GPXTracksGroupBoxLayout->addWidget(GPXAltitudeCB_,         5, 1, 1, 3);
+    GPXTracksGroupBoxLayout->addWidget(GPXSimplifyLabel_,      6, 0, 1, 1);
+    GPXTracksGroupBoxLayout->addWidget(GPXSimplifyInput_,      6, 1, 1, 3);
+    GPXTracksGroupBoxLayout->addWidget(GPXLevelsOfDetailCheckBox_, 7, 0, 1, 4);
     GPXTracksGroupBoxLayout->setContentsMargins(spacing, spacing, spacing, spacing);
     GPXTracksGroupBoxLayout->setAlignment(Qt::AlignTop);
 
@@ -380,6 +411,9 @@ void KmlWindow::slotKMLTracksCheckButtonToggled(bool)
         GPXLineWidthLabel_->setEnabled(true);
         GPXLineWidthInput_->setEnabled(true);
         GPXTracksOpacityInput_->setEnabled(true);
+        GPXSimplifyLabel_->setEnabled(true);
+        GPXSimplifyInput_->setEnabled(true);
+        GPXLevelsOfDetailCheckBox_->setEnabled(true);
     }
     else
     {
@@ -394,6 +428,9 @@ void KmlWindow::slotKMLTracksCheckButtonToggled(bool)
         GPXLineWidthLabel_->setEnabled(false);
         GPXLineWidthInput_->setEnabled(false);
         GPXTracksOpacityInput_->setEnabled(false);
+        GPXSimplifyLabel_->setEnabled(false);
+        GPXSimplifyInput_->setEnabled(false);
+        GPXLevelsOfDetailCheckBox_->setEnabled(false);
     }
 }
 
@@ -409,6 +446,8 @@ void KmlWindow::readSettings()
     QString baseDestDir;
     QString KMLFileName;
     int     AltitudeMode;
+    bool    KMZ;
+    bool    Clusters;
 
     bool    GPXtracks;
     QString GPXFile;
@@ -417,6 +456,8 @@ void KmlWindow::readSettings()
     QString GPXColor;
     int     GPXOpacity;
     int     GPXAltitudeMode;
+    int     GPXSimplify;
+    bool    GPXLevelsOfDetail;
 
     KConfig config(QLatin1String("kipirc"));
     KConfigGroup group  = config.group(QLatin1String("KMLExport Settings"));
@@ -432,6 +473,8 @@ void KmlWindow::readSettings()
     UrlDestDir	        = group.readEntry(QLatin1String("UrlDestDir"),  QString::fromUtf8("http://www.example.com/"));
     KMLFileName         = group.readEntry(QLatin1String("KMLFileName"), QString::fromUtf8("kmldocument"));
     AltitudeMode        = group.readEntry(QLatin1String("Altitude Mode"), 0);
+    KMZ                 = group.readEntry(QLatin1String("KMZ"), false);
+    Clusters            = group.readEntry(QLatin1String("Cluster Pictures"), false);
 
     GPXtracks           = group.readEntry(QLatin1String("UseGPXTracks"), false);
     GPXFile             = group.readEntry(QLatin1String("GPXFile"), QString());
@@ -440,6 +483,8 @@ void KmlWindow::readSettings()
     GPXColor            = group.readEntry(QLatin1String("Track Color"), QString::fromUtf8("#17eeee"));
     GPXOpacity          = group.readEntry(QLatin1String("Track Opacity"), 64);
     GPXAltitudeMode     = group.readEntry(QLatin1String("GPX Altitude Mode"), 0);
+    GPXSimplify         = group.readEntry(QLatin1String("Track Simplification"), 0);
+    GPXLevelsOfDetail   = group.readEntry(QLatin1String("Track Levels Of Detail"), false);
 
     winId();
     KConfigGroup group2 = config.group(QLatin1String("KMLExport Dialog"));
@@ -458,6 +503,8 @@ void KmlWindow::readSettings()
     DestinationDirectory_->lineEdit()->setText(baseDestDir);
     DestinationUrl_->setText(UrlDestDir);
     FileName_->setText(KMLFileName);
+    KMZCheckBox_->setChecked(KMZ);
+    ClustersCheckBox_->setChecked(Clusters);
 
     GPXTracksCheckBox_->setChecked(GPXtracks);
     timeZoneCB->setCurrentIndex(TimeZone);
@@ -465,6 +512,8 @@ void KmlWindow::readSettings()
     GPXTrackColor_->setColor(GPXColor);
     GPXTracksOpacityInput_->setValue(GPXOpacity);
     GPXAltitudeCB_->setCurrentIndex(GPXAltitudeMode);
+    GPXSimplifyInput_->setValue(GPXSimplify);
+    GPXLevelsOfDetailCheckBox_->setChecked(GPXLevelsOfDetail);
 }
 
 void KmlWindow::saveSettings()
@@ -495,6 +544,8 @@ void KmlWindow::saveSettings()
     group.writeEntry(QLatin1String("UrlDestDir"),        url);
     group.writeEntry(QLatin1String("KMLFileName"),       FileName_->text());
     group.writeEntry(QLatin1String("Altitude Mode"),     AltitudeCB_->currentIndex());
+    group.writeEntry(QLatin1String("KMZ"),               KMZCheckBox_->isChecked());
+    group.writeEntry(QLatin1String("Cluster Pictures"),  ClustersCheckBox_->isChecked());
     group.writeEntry(QLatin1String("UseGPXTracks"),      GPXTracksCheckBox_->isChecked());
     group.writeEntry(QLatin1String("GPXFile"),           GPXFileUrlRequester_->lineEdit()->text());
     group.writeEntry(QLatin1String("Time Zone"),         timeZoneCB->currentIndex());
@@ -502,6 +553,8 @@ void KmlWindow::saveSettings()
     group.writeEntry(QLatin1String("Track Color"),       GPXTrackColor_->color().name());
     group.writeEntry(QLatin1String("Track Opacity"),     GPXTracksOpacityInput_->value());
     group.writeEntry(QLatin1String("GPX Altitude Mode"), GPXAltitudeCB_->currentIndex());
+    group.writeEntry(QLatin1String("Track Simplification"),   GPXSimplifyInput_->value());
+    group.writeEntry(QLatin1String("Track Levels Of Detail"), GPXLevelsOfDetailCheckBox_->isChecked());
 
     KConfigGroup group2 = config.group(QLatin1String("KMLExport Dialog"));
     KWindowConfig::saveWindowSize(windowHandle(), group2);
@@ -80,6 +80,7 @@ public:
     QLabel*         GPXColorLabel_;
     QLabel*         GPXAltitudeLabel_;
     QLabel*         GPXTracksOpacityLabel_;
+    QLabel*         GPXSimplifyLabel_;
 
     QGroupBox*      TargetPreferenceGroupBox;
     QGroupBox*      TargetTypeGroupBox;
@@ -93,6 +94,9 @@ public:
     QLineEdit*      FileName_;
 
     QCheckBox*      GPXTracksCheckBox_;
+    QCheckBox*      KMZCheckBox_;
+    QCheckBox*      ClustersCheckBox_;
+    QCheckBox*      GPXLevelsOfDetailCheckBox_;
 
     QComboBox*      AltitudeCB_;
     QComboBox*      timeZoneCB;
@@ -107,6 +111,7 @@ public:
     QSpinBox*       IconSizeInput_;
     QSpinBox*       GPXTracksOpacityInput_;
     QSpinBox*       GPXLineWidthInput_;
+    QSpinBox*       GPXSimplifyInput_;
 
 public Q_SLOTS:
 
@@ -0,0 +1,215 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-04-02
+ * Description : unit tests of the correlation of photos with a GPS track.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "gpsdataparsertest.h"
+
+// Qt includes
+
+#include <QDateTime>
+#include <QTest>
+
+// Local includes
+
+#include "gpsdataparser.h"
+
+using namespace KIPIKMLExportPlugin;
+
+QTEST_GUILESS_MAIN(GPSDataParserTest)
+
+/// Give access to the points of the track, to build it without a GPX file.
+class GPSTestTrack : public GPSDataParser
+{
+public:
+
+    using GPSDataParser::addPoint;
+    using GPSDataParser::sortPoints;
+};
+
+static const QDateTime s_start = QDateTime(QDate(2018, 3, 1), QTime(12, 0, 0), Qt::UTC);
+
+/// Three points, one minute apart, with latitudes 1, 2 and 3.
+static void createTrack(GPSTestTrack* const track)
+{
+    for (int i = 0 ; i < 3 ; ++i)
+    {
+        track->addPoint(s_start.addSecs(i * 60).toMSecsSinceEpoch(), i + 1.0, (i + 1) * 10.0, (i + 1) * 100.0);
+    }
+
+    track->sortPoints();
+}
+
+void GPSDataParserTest::testMatchDate_data()
+{
+    QTest::addColumn<qint64>("photoMSecs");
+    QTest::addColumn<int>("maxGapTime");
+    QTest::addColumn<bool>("matched");
+    QTest::addColumn<double>("latitude");
+
+    QTest::newRow("on a point")            << Q_INT64_C(60000)  << 30 << true  << 2.0;
+    QTest::newRow("closer to previous")    << Q_INT64_C(70000)  << 30 << true  << 2.0;
+    QTest::newRow("closer to next")        << Q_INT64_C(100000) << 30 << true  << 3.0;
+    QTest::newRow("below the gap")         << Q_INT64_C(89500)  << 30 << true  << 2.0;
+
+    // The gap must be strictly lower than the maximum, whole seconds are compared.
+    QTest::newRow("both at the max gap")   << Q_INT64_C(90000)  << 30 << false << 0.0;
+    QTest::newRow("tie below the gap")     << Q_INT64_C(30000)  << 31 << true  << 1.0;
+
+    // Before the first point and after the last one.
+    QTest::newRow("before, in the gap")    << Q_INT64_C(-29000) << 30 << true  << 1.0;
+    QTest::newRow("before, at the gap")    << Q_INT64_C(-30000) << 30 << false << 0.0;
+    QTest::newRow("before the track")      << Q_INT64_C(-86400000) << 30 << false << 0.0;
+    QTest::newRow("after, in the gap")     << Q_INT64_C(149999) << 30 << true  << 3.0;
+    QTest::newRow("after, at the gap")     << Q_INT64_C(150000) << 30 << false << 0.0;
+    QTest::newRow("after the track")       << Q_INT64_C(86400000) << 30 << false << 0.0;
+}
+
+void GPSDataParserTest::testMatchDate()
+{
+    QFETCH(qint64, photoMSecs);
+    QFETCH(int,    maxGapTime);
+    QFETCH(bool,   matched);
+    QFETCH(double, latitude);
+
+    GPSTestTrack track;
+    createTrack(&track);
+
+    GPSDataContainer data;
+    QCOMPARE(track.matchDate(s_start.addMSecs(photoMSecs), maxGapTime, 0, true, false, 0, &data), matched);
+
+    if (matched)
+    {
+        QCOMPARE(data.latitude(), latitude);
+        QCOMPARE(data.longitude(), latitude * 10);
+        QCOMPARE(data.altitude(), latitude * 100);
+        QVERIFY(!data.isInterpolated());
+    }
+}
+
+void GPSDataParserTest::testInterpolation()
+{
+    GPSTestTrack track;
+    createTrack(&track);
+
+    // Halfway between the second and the third point, out of the gap of both.
+    const QDateTime photo = s_start.addSecs(90);
+    GPSDataContainer data;
+
+    QVERIFY(track.matchDate(photo, 30, 0, true, true, 61, &data));
+    QVERIFY(data.isInterpolated());
+    QCOMPARE(data.latitude(), 2.5);
+    QCOMPARE(data.longitude(), 25.0);
+    QCOMPARE(data.altitude(), 250.0);
+
+    // The points around must be closer than the interpolation distance.
+    QVERIFY(!track.matchDate(photo, 30, 0, true, true, 30, &data));
+
+    // No point after the last one.
+    QVERIFY(!track.matchDate(s_start.addSecs(200), 30, 0, true, true, 3600, &data));
+}
+
+void GPSDataParserTest::testTieInSameSecond()
+{
+    GPSTestTrack track;
+    track.addPoint(s_start.toMSecsSinceEpoch(),       1.0, 10.0, 100.0);
+    track.addPoint(s_start.toMSecsSinceEpoch() + 400, 2.0, 20.0, 200.0);
+    track.sortPoints();
+
+    // Both points are 10 whole seconds before the photo: the earliest is taken.
+    GPSDataContainer data;
+    QVERIFY(track.matchDate(s_start.addMSecs(10500), 30, 0, true, false, 0, &data));
+    QCOMPARE(data.latitude(), 1.0);
+}
+
+void GPSDataParserTest::testUnsortedPoints()
+{
+    GPSTestTrack track;
+    track.addPoint(s_start.addSecs(120).toMSecsSinceEpoch(), 3.0, 30.0, 300.0);
+    track.addPoint(s_start.toMSecsSinceEpoch(),              1.0, 10.0, 100.0);
+    track.addPoint(s_start.addSecs(60).toMSecsSinceEpoch(),  9.0, 90.0, 900.0);
+
+    // The last point added with the same time replaces the previous one.
+    track.addPoint(s_start.addSecs(60).toMSecsSinceEpoch(),  2.0, 20.0, 200.0);
+    track.sortPoints();
+
+    QCOMPARE(track.numPoints(), 3);
+
+    GPSDataContainer data;
+    QVERIFY(track.matchDate(s_start.addSecs(55), 30, 0, true, false, 0, &data));
+    QCOMPARE(data.latitude(), 2.0);
+    QCOMPARE(data.altitude(), 200.0);
+}
+
+void GPSDataParserTest::testMatchDates()
+{
+    GPSTestTrack track;
+    createTrack(&track);
+
+    // Not sorted, with the same photo time twice.
+    QList<QDateTime> photos;
+    photos << s_start.addSecs(70)
+           << s_start.addSecs(90)
+           << s_start.addDays(-1)
+           << s_start.addSecs(149)
+           << s_start.addSecs(149)
+           << s_start.addSecs(-10);
+
+    QVector<bool>             matched;
+    QVector<GPSDataContainer> data;
+
+    QCOMPARE(track.matchDates(photos, 30, 0, true, false, 0, &matched, &data), 4);
+    QCOMPARE(matched.count(), photos.count());
+    QCOMPARE(data.count(), photos.count());
+
+    // The same as one photo at a time.
+    for (int i = 0 ; i < photos.count() ; ++i)
+    {
+        GPSDataContainer one;
+        QCOMPARE(matched.at(i), track.matchDate(photos.at(i), 30, 0, true, false, 0, &one));
+
+        if (matched.at(i))
+        {
+            QVERIFY(data.at(i).sameCoordinatesAs(one));
+        }
+    }
+
+    QCOMPARE(data.at(0).latitude(), 2.0);
+    QCOMPARE(data.at(3).latitude(), 3.0);
+    QCOMPARE(data.at(5).latitude(), 1.0);
+}
+
+void GPSDataParserTest::testEmptyTrack()
+{
+    GPSTestTrack track;
+    GPSDataContainer data;
+
+    QVERIFY(!track.matchDate(s_start, 30, 0, true, true, 3600, &data));
+
+    QList<QDateTime> photos;
+    photos << s_start << s_start.addSecs(60);
+
+    QVector<bool>             matched;
+    QVector<GPSDataContainer> gpsData;
+
+    QCOMPARE(track.matchDates(photos, 30, 0, true, true, 3600, &matched, &gpsData), 0);
+    QCOMPARE(matched, QVector<bool>(2, false));
+    QCOMPARE(gpsData.count(), 2);
+}
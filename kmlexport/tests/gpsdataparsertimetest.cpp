@@ -0,0 +1,130 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-04-03
+ * Description : unit tests of the parser of GPX times.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "gpsdataparsertimetest.h"
+
+// Qt includes
+
+#include <QDateTime>
+#include <QTest>
+
+// Local includes
+
+#include "gpsdataparser_time.h"
+
+using namespace KIPIKMLExportPlugin;
+
+QTEST_GUILESS_MAIN(GPSDataParserTimeTest)
+
+static qint64 utcMSecs(int year, int month, int day, int hour, int minute, int second, int msecs = 0)
+{
+    return QDateTime(QDate(year, month, day), QTime(hour, minute, second, msecs), Qt::UTC).toMSecsSinceEpoch();
+}
+
+void GPSDataParserTimeTest::testParseTime_data()
+{
+    QTest::addColumn<QString>("time");
+    QTest::addColumn<qint64>("msecs");
+
+    QTest::newRow("utc")                << QString::fromLatin1("2009-03-11T13:39:55Z")
+                                        << utcMSecs(2009, 3, 11, 13, 39, 55);
+    QTest::newRow("utc, milliseconds")  << QString::fromLatin1("2009-03-11T13:39:55.622Z")
+                                        << utcMSecs(2009, 3, 11, 13, 39, 55, 622);
+
+    // Fractions of any length are rounded to milliseconds.
+    QTest::newRow("tenths")             << QString::fromLatin1("2009-03-11T13:39:55.5Z")
+                                        << utcMSecs(2009, 3, 11, 13, 39, 55, 500);
+    QTest::newRow("microseconds")       << QString::fromLatin1("2009-03-11T13:39:55.123456Z")
+                                        << utcMSecs(2009, 3, 11, 13, 39, 55, 123);
+    QTest::newRow("rounded up")         << QString::fromLatin1("2009-03-11T13:39:55.1239Z")
+                                        << utcMSecs(2009, 3, 11, 13, 39, 55, 124);
+    QTest::newRow("empty fraction")     << QString::fromLatin1("2009-03-11T13:39:55.Z")
+                                        << utcMSecs(2009, 3, 11, 13, 39, 55);
+
+    // Time zones, the time is converted to UTC.
+    QTest::newRow("negative offset")    << QString::fromLatin1("2010-01-14T09:26:02.287-02:00")
+                                        << utcMSecs(2010, 1, 14, 11, 26, 2, 287);
+    QTest::newRow("positive offset")    << QString::fromLatin1("2010-01-14T09:26:02.287+02:00")
+                                        << utcMSecs(2010, 1, 14, 7, 26, 2, 287);
+    QTest::newRow("half hour offset")   << QString::fromLatin1("2010-01-14T09:26:02+05:30")
+                                        << utcMSecs(2010, 1, 14, 3, 56, 2);
+    QTest::newRow("zero offset")        << QString::fromLatin1("2010-01-14T09:26:02-00:00")
+                                        << utcMSecs(2010, 1, 14, 9, 26, 2);
+    QTest::newRow("previous year")      << QString::fromLatin1("2018-01-01T00:30:00+01:00")
+                                        << utcMSecs(2017, 12, 31, 23, 30, 0);
+    QTest::newRow("next day")           << QString::fromLatin1("2018-02-28T23:59:59.999-00:01")
+                                        << utcMSecs(2018, 3, 1, 0, 0, 59, 999);
+
+    // Calendar.
+    QTest::newRow("leap day")           << QString::fromLatin1("2016-02-29T12:00:00Z")
+                                        << utcMSecs(2016, 2, 29, 12, 0, 0);
+    QTest::newRow("leap day of 2000")   << QString::fromLatin1("2000-02-29T12:00:00Z")
+                                        << utcMSecs(2000, 2, 29, 12, 0, 0);
+    QTest::newRow("epoch")              << QString::fromLatin1("1970-01-01T00:00:00Z")
+                                        << Q_INT64_C(0);
+}
+
+void GPSDataParserTimeTest::testParseTime()
+{
+    QFETCH(QString, time);
+    QFETCH(qint64,  msecs);
+
+    qint64 parsed = -1;
+    QVERIFY(GPSDataParserParseTime(QStringRef(&time), &parsed));
+    QCOMPARE(parsed, msecs);
+}
+
+void GPSDataParserTimeTest::testInvalidTime_data()
+{
+    QTest::addColumn<QString>("time");
+
+    QTest::newRow("empty")              << QString();
+    QTest::newRow("text")               << QString::fromLatin1("yesterday");
+    QTest::newRow("date only")          << QString::fromLatin1("2018-03-01");
+    QTest::newRow("missing seconds")    << QString::fromLatin1("2018-03-01T12:00Z");
+    QTest::newRow("month 13")           << QString::fromLatin1("2018-13-01T12:00:00Z");
+    QTest::newRow("day 0")              << QString::fromLatin1("2018-03-00T12:00:00Z");
+    QTest::newRow("april 31")           << QString::fromLatin1("2018-04-31T12:00:00Z");
+    QTest::newRow("not a leap year")    << QString::fromLatin1("2018-02-29T12:00:00Z");
+    QTest::newRow("not a leap century") << QString::fromLatin1("1900-02-29T12:00:00Z");
+    QTest::newRow("hour 24")            << QString::fromLatin1("2018-03-01T24:00:00Z");
+    QTest::newRow("minute 60")          << QString::fromLatin1("2018-03-01T12:60:00Z");
+    QTest::newRow("bad offset")         << QString::fromLatin1("2018-03-01T12:00:00+0a:00");
+}
+
+void GPSDataParserTimeTest::testInvalidTime()
+{
+    QFETCH(QString, time);
+
+    qint64 parsed = -1;
+    QVERIFY(!GPSDataParserParseTime(QStringRef(&time), &parsed));
+}
+
+void GPSDataParserTimeTest::testLocalTime()
+{
+    // Without a time zone, the time is local, as read by QDateTime.
+    const QString time = QString::fromLatin1("2018-03-01T12:34:56");
+    qint64 parsed      = -1;
+
+    QVERIFY(GPSDataParserParseTime(QStringRef(&time), &parsed));
+    QCOMPARE(parsed, QDateTime::fromString(time, Qt::ISODate).toMSecsSinceEpoch());
+}
@@ -0,0 +1,43 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-04-03
+ * Description : unit tests of the parser of GPX times.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef GPSDATAPARSER_TIME_TEST_H
+#define GPSDATAPARSER_TIME_TEST_H
+
+// Qt includes
+
+#include <QObject>
+
+class GPSDataParserTimeTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+
+    void testParseTime_data();
+    void testParseTime();
+    void testInvalidTime_data();
+    void testInvalidTime();
+    void testLocalTime();
+};
+
+#endif // GPSDATAPARSER_TIME_TEST_H
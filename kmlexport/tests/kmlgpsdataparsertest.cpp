@@ -0,0 +1,148 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-04-04
+ * Description : unit tests of the simplification of KML tracks.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "kmlgpsdataparsertest.h"
+
+// Qt includes
+
+#include <QXmlStreamWriter>
+#include <QTest>
+
+// Local includes
+
+#include "kmlgpsdataparser.h"
+
+using namespace KIPIKMLExportPlugin;
+
+QTEST_GUILESS_MAIN(KMLGPSDataParserTest)
+
+/// Give access to the points of the track, to build it without a GPX file.
+class KMLTestTrack : public KMLGPSDataParser
+{
+public:
+
+    /// Add a point, one second after the previous one.
+    void addPoint(double latitude, double longitude, double altitude = 0.0)
+    {
+        GPSDataParser::addPoint((qint64)numPoints() * 1000, latitude, longitude, altitude);
+    }
+
+    /// Write the track line with the levels of detail.
+    QString trackLine()
+    {
+        QString kml;
+        QXmlStreamWriter writer(&kml);
+        CreateTrackLine(writer, 0);
+
+        return kml;
+    }
+};
+
+void KMLGPSDataParserTest::testEmptyTrack()
+{
+    KMLTestTrack track;
+    track.setSimplification(10.0, true);
+
+    QVERIFY(track.lineString().isEmpty());
+
+    // A single line, without region.
+    const QString kml = track.trackLine();
+    QCOMPARE(kml.count(QLatin1String("<Placemark>")), 1);
+    QCOMPARE(kml.count(QLatin1String("<Region>")), 0);
+}
+
+void KMLGPSDataParserTest::testOnePoint()
+{
+    KMLTestTrack track;
+    track.addPoint(1.0, 10.0, 100.0);
+
+    track.setSimplification(10.0, false);
+    QCOMPARE(track.lineString(), QString::fromLatin1("10,1,100 "));
+
+    track.setSimplification(0.0, false);
+    QCOMPARE(track.lineString(), QString::fromLatin1("10,1,100 "));
+}
+
+void KMLGPSDataParserTest::testTwoPoints()
+{
+    KMLTestTrack track;
+    track.addPoint(1.0, 10.0, 100.0);
+    track.addPoint(2.0, 20.0, 200.0);
+
+    // The ends of the track are always kept.
+    track.setSimplification(1000000.0, false);
+    QCOMPARE(track.lineString(), QString::fromLatin1("10,1,100 20,2,200 "));
+
+    // Also when they are at the same place.
+    KMLTestTrack still;
+    still.addPoint(1.0, 10.0);
+    still.addPoint(1.0, 10.0);
+    still.setSimplification(10.0, false);
+    QCOMPARE(still.lineString(), QString::fromLatin1("10,1,0 10,1,0 "));
+}
+
+void KMLGPSDataParserTest::testStraightLine()
+{
+    KMLTestTrack track;
+    track.addPoint(0.0, 0.0);
+    track.addPoint(0.0, 0.001);
+    track.addPoint(0.0, 0.002);
+
+    track.setSimplification(1.0, false);
+    QCOMPARE(track.lineString(), QString::fromLatin1("0,0,0 0.002,0,0 "));
+
+    // No simplification.
+    track.setSimplification(0.0, false);
+    QCOMPARE(track.lineString(), QString::fromLatin1("0,0,0 0.001,0,0 0.002,0,0 "));
+}
+
+void KMLGPSDataParserTest::testLoop()
+{
+    // Back to the start, about 111 meters north.
+    KMLTestTrack track;
+    track.addPoint(0.0,   0.0);
+    track.addPoint(0.001, 0.0);
+    track.addPoint(0.0,   0.0);
+
+    track.setSimplification(10.0, false);
+    QCOMPARE(track.lineString(), QString::fromLatin1("0,0,0 0,0.001,0 0,0,0 "));
+
+    track.setSimplification(1000.0, false);
+    QCOMPARE(track.lineString(), QString::fromLatin1("0,0,0 0,0,0 "));
+}
+
+void KMLGPSDataParserTest::testLevelsOfDetail()
+{
+    KMLTestTrack track;
+    track.addPoint(1.0, 10.0, 100.0);
+    track.setSimplification(10.0, true);
+
+    // Three levels over the region of the point, with a margin.
+    const QString kml = track.trackLine();
+    QCOMPARE(kml.count(QLatin1String("<Placemark>")), 3);
+    QCOMPARE(kml.count(QLatin1String("<Region>")), 3);
+    QCOMPARE(kml.count(QLatin1String("<north>1.00050000</north>")), 3);
+    QCOMPARE(kml.count(QLatin1String("<south>0.99950000</south>")), 3);
+    QCOMPARE(kml.count(QLatin1String("<east>10.00050000</east>")), 3);
+    QCOMPARE(kml.count(QLatin1String("<west>9.99950000</west>")), 3);
+    QCOMPARE(kml.count(QLatin1String("10,1,100 ")), 3);
+}
@@ -0,0 +1,44 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-04-04
+ * Description : unit tests of the simplification of KML tracks.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef KMLGPSDATAPARSER_TEST_H
+#define KMLGPSDATAPARSER_TEST_H
+
+// Qt includes
+
+#include <QObject>
+
+class KMLGPSDataParserTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+
+    void testEmptyTrack();
+    void testOnePoint();
+    void testTwoPoints();
+    void testStraightLine();
+    void testLoop();
+    void testLevelsOfDetail();
+};
+
+#endif // KMLGPSDATAPARSER_TEST_H
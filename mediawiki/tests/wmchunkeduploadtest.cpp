@@ -0,0 +1,238 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-27
+ * Description : unit tests of the chunked upload to a MediaWiki wiki.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "wmchunkeduploadtest.h"
+
+// Qt includes
+
+#include <QDir>
+#include <QFile>
+#include <QTest>
+#include <QUrlQuery>
+
+// MediaWiki includes
+
+#include <MediaWiki/MediaWiki>
+
+// Local includes
+
+#include "wmchunkedupload.h"
+#include "kpmockserver.h"
+
+using namespace KIPIPlugins;
+using namespace KIPIWikiMediaPlugin;
+
+QTEST_GUILESS_MAIN(WMChunkedUploadTest)
+
+/// Size of the uploaded file: two full chunks of 64 KiB and a last one of 22 KiB.
+static const int s_fileSize  = 150 * 1024;
+static const int s_chunkSize = 64 * 1024;
+
+/** Return the value of the field 'name' of a request received by the mock wiki,
+ *  sent in the URL, in a form or in a multipart form.
+ */
+static QByteArray field(const QByteArray& request, const char* const name)
+{
+    const QByteArray body = KPMockServer::requestBody(request);
+
+    const QByteArray part = QByteArray("name=\"") + name + '"';
+    const int partPos     = body.indexOf(part);
+
+    if (partPos >= 0)
+    {
+        const int start = body.indexOf("\r\n\r\n", partPos) + 4;
+        return body.mid(start, body.indexOf("\r\n", start) - start);
+    }
+
+    QByteArray query = body;
+
+    if (!request.startsWith("POST"))
+    {
+        const QString path = KPMockServer::requestPath(request);
+        query              = path.mid(path.indexOf(QLatin1Char('?')) + 1).toLatin1();
+    }
+
+    return QUrlQuery(QString::fromLatin1(query)).queryItemValue(QLatin1String(name), QUrl::FullyDecoded).toLatin1();
+}
+
+static QByteArray tokenAnswer(const char* const token)
+{
+    return QByteArray("{\"query\":{\"tokens\":{\"csrftoken\":\"") + token + "\"}}}";
+}
+
+static QByteArray continueAnswer(qint64 offset)
+{
+    return QByteArray("{\"upload\":{\"result\":\"Continue\",\"filekey\":\"stash.key\",\"offset\":") +
+           QByteArray::number(offset) + "}}";
+}
+
+static QByteArray successAnswer()
+{
+    return QByteArray("{\"upload\":{\"result\":\"Success\",\"filekey\":\"stash.key\"}}");
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void WMChunkedUploadTest::initTestCase()
+{
+    m_path = QDir::temp().filePath(QLatin1String("wmchunkeduploadtest.jpg"));
+
+    QFile file(m_path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+
+    QByteArray data(s_fileSize, 0);
+
+    for (int i = 0 ; i < s_fileSize ; ++i)
+        data[i] = char(i % 251);
+
+    QCOMPARE(file.write(data), qint64(s_fileSize));
+}
+
+void WMChunkedUploadTest::cleanupTestCase()
+{
+    QFile::remove(m_path);
+}
+
+void WMChunkedUploadTest::testUploadByChunks()
+{
+    KPMockServer server;
+    server.addAnswer(200, tokenAnswer("token1"));
+    server.addAnswer(200, continueAnswer(s_chunkSize));
+    server.addAnswer(200, continueAnswer(2 * s_chunkSize));
+    server.addAnswer(200, successAnswer());
+    server.addAnswer(200, "{\"upload\":{\"result\":\"Success\"}}");
+
+    mediawiki::MediaWiki wiki(server.url(QLatin1String("/w/api.php")));
+    QFile file(m_path);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+
+    WMChunkedUpload job(wiki);
+    job.setAutoDelete(false);
+    job.setFile(&file);
+    job.setFilename(QLatin1String("Test.jpg"));
+    job.setChunkSize(s_chunkSize);
+
+    QVERIFY2(job.exec(), qPrintable(job.errorText()));
+    QCOMPARE(server.requests().size(), 5);
+
+    QCOMPARE(field(server.requests()[0], "meta"),    QByteArray("tokens"));
+    QCOMPARE(field(server.requests()[1], "offset"),  QByteArray("0"));
+    QCOMPARE(field(server.requests()[1], "token"),   QByteArray("token1"));
+    QCOMPARE(field(server.requests()[2], "offset"),  QByteArray::number(s_chunkSize));
+    QCOMPARE(field(server.requests()[2], "filekey"), QByteArray("stash.key"));
+    QCOMPARE(field(server.requests()[3], "offset"),  QByteArray::number(2 * s_chunkSize));
+    QCOMPARE(field(server.requests()[4], "filekey"), QByteArray("stash.key"));
+    QCOMPARE(field(server.requests()[4], "filename"), QByteArray("Test.jpg"));
+    QCOMPARE(job.percent(), 100UL);
+}
+
+void WMChunkedUploadTest::testResumeAfterNetworkError()
+{
+    // The second chunk fails, but the server has received it:
+    // the upload goes on from the offset given by the status, not from the start.
+
+    KPMockServer server;
+    server.addAnswer(200, tokenAnswer("token1"));
+    server.addAnswer(200, continueAnswer(s_chunkSize));
+    server.addAnswer(500, QByteArray());
+    server.addAnswer(200, continueAnswer(2 * s_chunkSize));
+    server.addAnswer(200, successAnswer());
+    server.addAnswer(200, "{\"upload\":{\"result\":\"Success\"}}");
+
+    mediawiki::MediaWiki wiki(server.url(QLatin1String("/w/api.php")));
+    QFile file(m_path);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+
+    WMChunkedUpload job(wiki);
+    job.setAutoDelete(false);
+    job.setFile(&file);
+    job.setFilename(QLatin1String("Test.jpg"));
+    job.setChunkSize(s_chunkSize);
+
+    QVERIFY2(job.exec(), qPrintable(job.errorText()));
+    QCOMPARE(server.requests().size(), 6);
+
+    QCOMPARE(field(server.requests()[2], "offset"),      QByteArray::number(s_chunkSize));
+    QCOMPARE(field(server.requests()[3], "checkstatus"), QByteArray("1"));
+    QCOMPARE(field(server.requests()[3], "filekey"),     QByteArray("stash.key"));
+    QCOMPARE(field(server.requests()[3], "token"),       QByteArray("token1"));
+    QCOMPARE(field(server.requests()[4], "offset"),      QByteArray::number(2 * s_chunkSize));
+}
+
+void WMChunkedUploadTest::testTokenRefetch()
+{
+    // The session expires before the first chunk: a new token is asked and the chunk sent again.
+
+    KPMockServer server;
+    server.addAnswer(200, tokenAnswer("token1"));
+    server.addAnswer(200, "{\"error\":{\"code\":\"badtoken\",\"info\":\"Invalid CSRF token.\"}}");
+    server.addAnswer(200, tokenAnswer("token2"));
+    server.addAnswer(200, continueAnswer(s_chunkSize));
+    server.addAnswer(200, continueAnswer(2 * s_chunkSize));
+    server.addAnswer(200, successAnswer());
+    server.addAnswer(200, "{\"upload\":{\"result\":\"Success\"}}");
+
+    mediawiki::MediaWiki wiki(server.url(QLatin1String("/w/api.php")));
+    QFile file(m_path);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+
+    WMChunkedUpload job(wiki);
+    job.setAutoDelete(false);
+    job.setFile(&file);
+    job.setFilename(QLatin1String("Test.jpg"));
+    job.setChunkSize(s_chunkSize);
+
+    QVERIFY2(job.exec(), qPrintable(job.errorText()));
+    QCOMPARE(server.requests().size(), 7);
+
+    QCOMPARE(field(server.requests()[1], "token"),  QByteArray("token1"));
+    QCOMPARE(field(server.requests()[2], "meta"),   QByteArray("tokens"));
+    QCOMPARE(field(server.requests()[3], "offset"), QByteArray("0"));
+    QCOMPARE(field(server.requests()[3], "token"),  QByteArray("token2"));
+    QCOMPARE(field(server.requests()[6], "token"),  QByteArray("token2"));
+}
+
+void WMChunkedUploadTest::testCommitError()
+{
+    // An error when the stashed file is published is not retried.
+
+    KPMockServer server;
+    server.addAnswer(200, tokenAnswer("token1"));
+    server.addAnswer(200, continueAnswer(s_chunkSize));
+    server.addAnswer(200, continueAnswer(2 * s_chunkSize));
+    server.addAnswer(200, successAnswer());
+    server.addAnswer(200, "{\"error\":{\"code\":\"fileexists-no-change\",\"info\":\"The upload is a duplicate.\"}}");
+
+    mediawiki::MediaWiki wiki(server.url(QLatin1String("/w/api.php")));
+    QFile file(m_path);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+
+    WMChunkedUpload job(wiki);
+    job.setAutoDelete(false);
+    job.setFile(&file);
+    job.setFilename(QLatin1String("Test.jpg"));
+    job.setChunkSize(s_chunkSize);
+
+    QVERIFY(!job.exec());
+    QCOMPARE(server.requests().size(), 5);
+    QCOMPARE(job.errorText(), QString::fromLatin1("The upload is a duplicate."));
+}
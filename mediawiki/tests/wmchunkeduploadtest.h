@@ -0,0 +1,50 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-27
+ * Description : unit tests of the chunked upload to a MediaWiki wiki.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef WM_CHUNKEDUPLOAD_TEST_H
+#define WM_CHUNKEDUPLOAD_TEST_H
+
+// Qt includes
+
+#include <QObject>
+#include <QString>
+
+class WMChunkedUploadTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testUploadByChunks();
+    void testResumeAfterNetworkError();
+    void testTokenRefetch();
+    void testCommitError();
+
+private:
+
+    QString m_path;
+};
+
+#endif // WM_CHUNKEDUPLOAD_TEST_H
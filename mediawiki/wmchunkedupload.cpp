@@ -0,0 +1,482 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-27
+ * Description : upload of large files to a MediaWiki wiki,
+ *               by chunks stashed on the server.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "wmchunkedupload.h"
+
+// Qt includes
+
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QHttpMultiPart>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+#include <QIODevice>
+#include <QUrlQuery>
+#include <QTimer>
+
+// KDE includes
+
+#include <klocalizedstring.h>
+
+// MediaWiki includes
+
+#include <MediaWiki/MediaWiki>
+
+// Local includes
+
+#include "kipiplugins_debug.h"
+
+namespace KIPIWikiMediaPlugin
+{
+
+/// Number of times a failing request is sent again, after 2, 4 then 8 seconds.
+static const int s_maxRetries = 3;
+
+class WMChunkedUpload::Private
+{
+public:
+
+    enum Step
+    {
+        Chunk = 0,
+        Status,
+        Commit
+    };
+
+public:
+
+    explicit Private(MediaWiki& mw)
+        : mediawiki(mw)
+    {
+        file      = 0;
+        reply     = 0;
+        chunkSize = 5 * 1024 * 1024;
+        size      = 0;
+        offset    = 0;
+        sent      = 0;
+        retries   = 0;
+        step      = Chunk;
+        killed    = false;
+    }
+
+    QNetworkRequest request(const QUrl& url) const
+    {
+        QNetworkRequest request(url);
+        request.setRawHeader("User-Agent", mediawiki.userAgent().toUtf8());
+        return request;
+    }
+
+    static void addField(QByteArray& data, const char* const name, const QString& value)
+    {
+        if (!data.isEmpty())
+            data.append('&');
+
+        data.append(name).append('=').append(QUrl::toPercentEncoding(value));
+    }
+
+    static void addPart(QHttpMultiPart* const multiPart, const char* const name, const QString& value)
+    {
+        QHttpPart part;
+        part.setHeader(QNetworkRequest::ContentDispositionHeader,
+                       QByteArray("form-data; name=\"") + name + '"');
+        part.setBody(value.toUtf8());
+        multiPart->append(part);
+    }
+
+public:
+
+    MediaWiki&     mediawiki;
+    QIODevice*     file;
+    QNetworkReply* reply;
+
+    QString        filename;
+    QString        comment;
+    QString        text;
+    QString        token;
+
+    /// Name of the file in the upload stash, given by the server with the first chunk.
+    QString        fileKey;
+
+    qint64         chunkSize;
+    qint64         size;
+    /// Data of the file received by the server.
+    qint64         offset;
+    /// Data of the running chunk sent so far.
+    qint64         sent;
+
+    int            retries;
+    Step           step;
+    bool           killed;
+};
+
+WMChunkedUpload::WMChunkedUpload(MediaWiki& mediawiki, QObject* const parent)
+    : KJob(parent),
+      d(new Private(mediawiki))
+{
+}
+
+WMChunkedUpload::~WMChunkedUpload()
+{
+    if (d->reply)
+    {
+        disconnect(d->reply, 0, this, 0);
+        d->reply->abort();
+        d->reply->deleteLater();
+    }
+
+    delete d;
+}
+
+void WMChunkedUpload::setFile(QIODevice* const file)
+{
+    d->file = file;
+}
+
+void WMChunkedUpload::setFilename(const QString& filename)
+{
+    d->filename = filename;
+}
+
+void WMChunkedUpload::setComment(const QString& comment)
+{
+    d->comment = comment;
+}
+
+void WMChunkedUpload::setText(const QString& text)
+{
+    d->text = text;
+}
+
+void WMChunkedUpload::setChunkSize(qint64 size)
+{
+    d->chunkSize = qMax(qint64(64 * 1024), size);
+}
+
+void WMChunkedUpload::start()
+{
+    if (!d->file || !d->file->isOpen())
+    {
+        fail(i18n("Cannot open file"));
+        return;
+    }
+
+    d->size = d->file->size();
+    QTimer::singleShot(0, this, SLOT(resume()));
+}
+
+bool WMChunkedUpload::doKill()
+{
+    d->killed = true;
+
+    if (d->reply)
+    {
+        disconnect(d->reply, 0, this, 0);
+        d->reply->abort();
+        d->reply->deleteLater();
+        d->reply = 0;
+    }
+
+    return true;
+}
+
+void WMChunkedUpload::resume()
+{
+    if (d->killed)
+        return;
+
+    if (d->token.isEmpty())
+    {
+        requestToken();
+    }
+    else if (d->step == Private::Commit)
+    {
+        commit();
+    }
+    else if (!d->fileKey.isEmpty())
+    {
+        // Ask where the server is before sending anything again.
+        checkStatus();
+    }
+    else
+    {
+        d->offset = 0;
+        sendChunk();
+    }
+}
+
+void WMChunkedUpload::requestToken()
+{
+    QUrl url = d->mediawiki.url();
+    QUrlQuery query;
+    query.addQueryItem(QLatin1String("format"), QLatin1String("json"));
+    query.addQueryItem(QLatin1String("action"), QLatin1String("query"));
+    query.addQueryItem(QLatin1String("meta"),   QLatin1String("tokens"));
+    query.addQueryItem(QLatin1String("type"),   QLatin1String("csrf"));
+    url.setQuery(query);
+
+    d->reply = d->mediawiki.manager()->get(d->request(url));
+
+    connect(d->reply, SIGNAL(finished()),
+            this, SLOT(slotFinished()));
+}
+
+void WMChunkedUpload::sendChunk()
+{
+    d->step = Private::Chunk;
+    d->sent = 0;
+
+    if (!d->file->seek(d->offset))
+    {
+        fail(d->file->errorString());
+        return;
+    }
+
+    const QByteArray chunk = d->file->read(qMin(d->chunkSize, d->size - d->offset));
+
+    if (chunk.isEmpty() && d->offset < d->size)
+    {
+        fail(d->file->errorString());
+        return;
+    }
+
+    QHttpMultiPart* const multiPart = new QHttpMultiPart(QHttpMultiPart::FormDataType);
+    Private::addPart(multiPart, "format",         QLatin1String("json"));
+    Private::addPart(multiPart, "action",         QLatin1String("upload"));
+    Private::addPart(multiPart, "stash",          QLatin1String("1"));
+    // Warnings, such as an existing file, are reported when the file is published.
+    Private::addPart(multiPart, "ignorewarnings", QLatin1String("1"));
+    Private::addPart(multiPart, "filename",       d->filename);
+    Private::addPart(multiPart, "filesize",       QString::number(d->size));
+    Private::addPart(multiPart, "offset",         QString::number(d->offset));
+
+    if (!d->fileKey.isEmpty())
+        Private::addPart(multiPart, "filekey",    d->fileKey);
+
+    QHttpPart part;
+    part.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/octet-stream"));
+    part.setHeader(QNetworkRequest::ContentDispositionHeader,
+                   QByteArray("form-data; name=\"chunk\"; filename=\"") + d->filename.toUtf8() + '"');
+    part.setBody(chunk);
+    multiPart->append(part);
+
+    // The token goes last, so that a truncated request is rejected.
+    Private::addPart(multiPart, "token", d->token);
+
+    qCDebug(KIPIPLUGINS_LOG) << "Sending chunk of" << d->filename << "at" << d->offset << "of" << d->size;
+
+    d->reply = d->mediawiki.manager()->post(d->request(d->mediawiki.url()), multiPart);
+    multiPart->setParent(d->reply);
+
+    connect(d->reply, SIGNAL(uploadProgress(qint64, qint64)),
+            this, SLOT(slotUploadProgress(qint64, qint64)));
+
+    connect(d->reply, SIGNAL(finished()),
+            this, SLOT(slotFinished()));
+}
+
+void WMChunkedUpload::checkStatus()
+{
+    d->step = Private::Status;
+
+    QByteArray data;
+    Private::addField(data, "format",      QLatin1String("json"));
+    Private::addField(data, "action",      QLatin1String("upload"));
+    Private::addField(data, "checkstatus", QLatin1String("1"));
+    Private::addField(data, "filekey",     d->fileKey);
+    Private::addField(data, "token",       d->token);
+
+    QNetworkRequest request = d->request(d->mediawiki.url());
+    request.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/x-www-form-urlencoded"));
+
+    d->reply = d->mediawiki.manager()->post(request, data);
+
+    connect(d->reply, SIGNAL(finished()),
+            this, SLOT(slotFinished()));
+}
+
+void WMChunkedUpload::commit()
+{
+    d->step = Private::Commit;
+
+    QByteArray data;
+    Private::addField(data, "format",   QLatin1String("json"));
+    Private::addField(data, "action",   QLatin1String("upload"));
+    Private::addField(data, "filename", d->filename);
+    Private::addField(data, "filekey",  d->fileKey);
+    Private::addField(data, "comment",  d->comment);
+    Private::addField(data, "text",     d->text);
+    Private::addField(data, "token",    d->token);
+
+    QNetworkRequest request = d->request(d->mediawiki.url());
+    request.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/x-www-form-urlencoded"));
+
+    d->reply = d->mediawiki.manager()->post(request, data);
+
+    connect(d->reply, SIGNAL(finished()),
+            this, SLOT(slotFinished()));
+}
+
+void WMChunkedUpload::slotUploadProgress(qint64 sent, qint64 total)
+{
+    if (d->step != Private::Chunk || total <= 0 || d->size <= 0)
+        return;
+
+    // The request is a little larger than the chunk, because of the other fields.
+    d->sent = qMin(sent, qMin(d->chunkSize, d->size - d->offset));
+    setPercent((unsigned long)((d->offset + d->sent) * 100 / d->size));
+}
+
+void WMChunkedUpload::slotFinished()
+{
+    QNetworkReply* const reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (!reply || reply != d->reply)
+        return;
+
+    d->reply = 0;
+    reply->deleteLater();
+
+    if (reply->error() != QNetworkReply::NoError)
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "Upload of" << d->filename << "failed:" << reply->errorString();
+        retry(reply->errorString());
+        return;
+    }
+
+    const QJsonObject json = QJsonDocument::fromJson(reply->readAll()).object();
+
+    if (json.contains(QLatin1String("error")))
+    {
+        const QJsonObject error = json[QLatin1String("error")].toObject();
+        const QString code      = error[QLatin1String("code")].toString();
+        const QString info      = error[QLatin1String("info")].toString();
+
+        qCDebug(KIPIPLUGINS_LOG) << "Upload of" << d->filename << "failed:" << code << info;
+
+        if (code == QLatin1String("badtoken"))
+        {
+            // The session was renewed: get a new token and go on.
+            d->token.clear();
+            retry(info);
+        }
+        else if (d->step == Private::Chunk || d->step == Private::Status)
+        {
+            // Stash errors are often transient on busy servers.
+            retry(info);
+        }
+        else
+        {
+            fail(info);
+        }
+
+        return;
+    }
+
+    if (d->token.isEmpty())
+    {
+        // Answer of requestToken()
+        d->token = json[QLatin1String("query")].toObject()[QLatin1String("tokens")].toObject()
+                       [QLatin1String("csrftoken")].toString();
+
+        if (d->token.isEmpty())
+        {
+            fail(i18n("The wiki does not support uploads by chunks"));
+            return;
+        }
+
+        resume();
+        return;
+    }
+
+    const QJsonObject upload = json[QLatin1String("upload")].toObject();
+    const QString result     = upload[QLatin1String("result")].toString();
+
+    if (d->step == Private::Commit)
+    {
+        if (result == QLatin1String("Success"))
+        {
+            setPercent(100);
+            emitResult();
+        }
+        else if (result == QLatin1String("Warning"))
+        {
+            fail(i18n("Warnings: %1", upload[QLatin1String("warnings")].toObject().keys().join(QLatin1String(", "))));
+        }
+        else
+        {
+            fail(i18n("Unexpected answer from the wiki"));
+        }
+
+        return;
+    }
+
+    // Chunk or status
+    if (!upload[QLatin1String("filekey")].toString().isEmpty())
+    {
+        d->fileKey = upload[QLatin1String("filekey")].toString();
+    }
+
+    if (result == QLatin1String("Continue"))
+    {
+        d->offset = (qint64)upload[QLatin1String("offset")].toDouble();
+
+        if (d->step == Private::Chunk)
+            d->retries = 0;
+
+        setPercent((unsigned long)(d->offset * 100 / qMax(qint64(1), d->size)));
+        sendChunk();
+    }
+    else if (result == QLatin1String("Success") && !d->fileKey.isEmpty())
+    {
+        // All chunks are in the stash.
+        d->retries = 0;
+        commit();
+    }
+    else
+    {
+        fail(i18n("Unexpected answer from the wiki"));
+    }
+}
+
+void WMChunkedUpload::retry(const QString& errorText)
+{
+    if (d->retries >= s_maxRetries)
+    {
+        fail(errorText);
+        return;
+    }
+
+    d->retries++;
+    QTimer::singleShot(1000 << d->retries, this, SLOT(resume()));
+}
+
+void WMChunkedUpload::fail(const QString& errorText)
+{
+    setError(KJob::UserDefinedError);
+    setErrorText(errorText);
+    emitResult();
+}
+
+} // namespace KIPIWikiMediaPlugin
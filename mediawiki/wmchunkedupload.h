@@ -0,0 +1,105 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-27
+ * Description : upload of large files to a MediaWiki wiki,
+ *               by chunks stashed on the server.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef WM_CHUNKEDUPLOAD_H
+#define WM_CHUNKEDUPLOAD_H
+
+// Qt includes
+
+#include <QString>
+
+// KDE includes
+
+#include <kjob.h>
+
+class QIODevice;
+
+namespace mediawiki
+{
+    class MediaWiki;
+}
+
+using namespace mediawiki;
+
+namespace KIPIWikiMediaPlugin
+{
+
+/** Upload a file with the chunked upload protocol of the MediaWiki API, for files larger
+ *  than what the server accepts in one request: the chunks are sent to the upload stash
+ *  of the user, then the stashed file is published with its description.
+ *
+ *  When a chunk fails, the offset reached by the server is asked again and the upload
+ *  resumes from there, so an error does not restart the whole file.
+ *
+ *  The setters and the signals are the ones of mediawiki::Upload.
+ */
+class WMChunkedUpload : public KJob
+{
+    Q_OBJECT
+
+public:
+
+    explicit WMChunkedUpload(MediaWiki& mediawiki, QObject* const parent = 0);
+    ~WMChunkedUpload();
+
+    /** The file must be open, it is not deleted by the job.
+     */
+    void setFile(QIODevice* const file);
+    void setFilename(const QString& filename);
+    void setComment(const QString& comment);
+    void setText(const QString& text);
+
+    /** Set the size of the chunks. Default is 5 MiB.
+     */
+    void setChunkSize(qint64 size);
+
+    void start() Q_DECL_OVERRIDE;
+
+protected:
+
+    bool doKill() Q_DECL_OVERRIDE;
+
+private Q_SLOTS:
+
+    void resume();
+    void slotUploadProgress(qint64 sent, qint64 total);
+    void slotFinished();
+
+private:
+
+    void requestToken();
+    void sendChunk();
+    void checkStatus();
+    void commit();
+    void retry(const QString& errorText);
+    void fail(const QString& errorText);
+
+private:
+
+    class Private;
+    Private* const d;
+};
+
+} // namespace KIPIWikiMediaPlugin
+
+#endif // WM_CHUNKEDUPLOAD_H
@@ -31,8 +31,16 @@
 #include <QApplication>
 #include <QMessageBox>
 #include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QHash>
+#include <QImage>
+#include <QImageReader>
+#include <QPointer>
 #include <QTimer>
 #include <QStringList>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
 
 // KDE includes
 
@@ -50,26 +58,111 @@
 // Local includes
 
 #include "kipiplugins_debug.h"
+#include "kputil.h"
+#include "wmchunkedupload.h"
 
 namespace KIPIWikiMediaPlugin
 {
 
+struct WMPreparation
+{
+    QString tmpDir;
+    bool    resize;
+    int     dimension;
+    int     quality;
+    bool    removeMeta;
+    bool    removeGeo;
+};
+
+/** Write the image to upload in 'tmpPath', as requested by 'preparation'. Run on a worker thread,
+ *  so the host interface is not used here: see WMTalker::completePreparation().
+ *  Return 'tmpPath', or an empty string if the image cannot be read or written.
+ */
+static QString prepareImageForUpload(const WMPreparation& preparation, const QString& imgPath, const QString& tmpPath)
+{
+    if (preparation.resize)
+    {
+        // Rescale image if requested: metadata is lost
+
+        const QImage image = KIPIPlugins::loadScaledImage(imgPath, preparation.dimension);
+
+        if (image.isNull())
+        {
+            return QString();
+        }
+
+        qCDebug(KIPIPLUGINS_LOG) << "Saving to temp file:" << tmpPath;
+
+        if (!image.save(tmpPath, "JPEG", preparation.quality))
+        {
+            QFile::remove(tmpPath);
+            return QString();
+        }
+    }
+    else
+    {
+        // file is copied with its embedded metadata
+        QFile::remove(tmpPath);
+
+        if (!QFile::copy(imgPath, tmpPath))
+        {
+            qCDebug(KIPIPLUGINS_LOG) << "File copy error from:" << imgPath << "to" << tmpPath;
+            return QString();
+        }
+    }
+
+    return tmpPath;
+}
+
 class WMTalker::Private
 {
+public:
+
+    struct Item
+    {
+        /// The file selected by the user.
+        QString                path;
+        /// The file sent: a temporary file when the image is prepared, else 'path'.
+        QString                uploadPath;
+        /// The temporary file written when the image is prepared.
+        QString                tmpPath;
+        QMap<QString, QString> info;
+    };
+
 public:
 
     Private()
     {
-        interface = 0;
-        mediawiki = 0;
+        interface   = 0;
+        mediawiki   = 0;
+        prepare     = false;
+        tmpCount    = 0;
+        maxParallel = 3;
+        chunkSize   = 5 * 1024 * 1024;
+        total       = 0;
+        done        = 0;
     }
 
-    QList<QUrl>                              urls;
     Interface*                               interface;
     MediaWiki*                               mediawiki;
     QString                                  error;
-    QString                                  currentFile;
+
+    /// Files not prepared nor uploaded yet.
     QMap <QString, QMap <QString, QString> > imageDesc;
+
+    bool                                     prepare;
+    WMPreparation                            preparation;
+    int                                      tmpCount;
+
+    QHash<QFutureWatcher<QString>*, Item>    preparing;
+    QList<Item>                              ready;
+    QHash<KJob*, Item>                       running;
+    QHash<KJob*, unsigned long>              percents;
+
+    int                                      maxParallel;
+    qint64                                   chunkSize;
+    int                                      total;
+    int                                      done;
 };
 
 WMTalker::WMTalker(Interface* const interface, MediaWiki* const mediawiki, QObject* const parent)
@@ -82,6 +175,12 @@ WMTalker::WMTalker(Interface* const interface, MediaWiki* const mediawiki, QObje
 
 WMTalker::~WMTalker()
 {
+    // Preparations cannot be interrupted, wait for them before their watchers are deleted.
+    foreach (QFutureWatcher<QString>* const watcher, d->preparing.keys())
+    {
+        watcher->waitForFinished();
+    }
+
     delete d;
 }
 
@@ -101,12 +200,45 @@ void WMTalker::setImageMap(const QMap <QString,QMap <QString,QString> >& imageDe
     qCDebug(KIPIPLUGINS_LOG) << "Map length:" << imageDesc.size();
 }
 
+void WMTalker::setPreparation(const QString& tmpDir, bool resize, int dimension, int quality,
+                              bool removeMeta, bool removeGeo)
+{
+    // Create temporary directory if it does not exist
+
+    if (!QDir(tmpDir).exists())
+    {
+        QDir().mkpath(tmpDir);
+    }
+
+    d->prepare                = true;
+    d->preparation.tmpDir     = tmpDir;
+    d->preparation.resize     = resize;
+    d->preparation.dimension  = dimension;
+    d->preparation.quality    = quality;
+    d->preparation.removeMeta = removeMeta;
+    d->preparation.removeGeo  = removeGeo;
+}
+
+void WMTalker::clearPreparation()
+{
+    d->prepare = false;
+}
+
+void WMTalker::setMaxParallel(int count)
+{
+    d->maxParallel = qMax(1, count);
+}
+
+void WMTalker::setChunkSize(qint64 size)
+{
+    d->chunkSize = size;
+}
+
 void WMTalker::uploadHandle(KJob* j)
 {
     if (j != 0)
     {
         qCDebug(KIPIPLUGINS_LOG) << "Upload error" << j->error() << j->errorString() << j->errorText();
-        emit uploadProgress(100);
 
         disconnect(j, SIGNAL(result(KJob*)),
                    this, SLOT(uploadHandle(KJob*)));
@@ -114,6 +246,10 @@ void WMTalker::uploadHandle(KJob* j)
         disconnect(j, SIGNAL(percent(KJob*, ulong)),
                    this, SLOT(slotUploadProgress(KJob*, ulong)));
 
+        const Private::Item item = d->running.take(j);
+        d->percents.remove(j);
+        d->done++;
+
         // Error from previous upload
 
         if ((int)j->error() != 0)
@@ -122,78 +258,279 @@ void WMTalker::uploadHandle(KJob* j)
 
             if (errorText.isEmpty())
             {
-                d->error.append(i18n("Error on file '%1'\n", d->currentFile));
+                d->error.append(i18n("Error on file '%1'\n", item.path));
             }
             else
             {
-                d->error.append(i18n("Error on file '%1': %2\n", d->currentFile, errorText));
+                d->error.append(i18n("Error on file '%1': %2\n", item.path, errorText));
             }
         }
-    }
 
-    // Upload next image
+        if (item.uploadPath != item.path)
+        {
+            QFile::remove(item.uploadPath);
+        }
 
-    if (!d->imageDesc.isEmpty())
+        emitProgress();
+    }
+    else if (d->running.isEmpty() && d->preparing.isEmpty() && d->ready.isEmpty())
     {
-        QList<QString> keys        = d->imageDesc.keys();
-        QMap<QString,QString> info = d->imageDesc.take(keys.first());
-        Upload* const e1           = new Upload(*d->mediawiki, this);
+        // New upload
+        d->total = d->imageDesc.count();
+        d->done  = 0;
+        emit uploadProgress(0);
+    }
+
+    startNext();
+}
 
-        qCDebug(KIPIPLUGINS_LOG) << "Path:" << keys.first();
+void WMTalker::startNext()
+{
+    // Prepare the next images while the previous ones are sent.
 
-        QFile* const file = new QFile(keys.first(),this);
+    while (!d->imageDesc.isEmpty() && (d->preparing.count() + d->ready.count()) < d->maxParallel)
+    {
+        Private::Item item;
+        item.path = d->imageDesc.firstKey();
+        item.info = d->imageDesc.take(item.path);
 
-        if (!file->open(QIODevice::ReadOnly))
+        if (!d->prepare)
         {
-            qCDebug(KIPIPLUGINS_LOG) << "File open error:" << keys.first();
-            delete file;
-            return;
+            item.uploadPath = item.path;
+            d->ready.append(item);
+            continue;
         }
 
-        //emit fileUploadProgress(done = 0, total file.size());
+        // Each file gets its own name, images with the same name are prepared at the same time.
+        item.tmpPath = d->preparation.tmpDir + QString::number(d->tmpCount++) + QLatin1Char('_') +
+                                QFileInfo(item.path).baseName().trimmed() + QLatin1String(".jpg");
+
+        QFutureWatcher<QString>* const watcher = new QFutureWatcher<QString>(this);
+
+        connect(watcher, SIGNAL(finished()),
+                this, SLOT(slotPrepared()));
 
-        e1->setFile(file);
-        d->currentFile = file->fileName();
-        qCDebug(KIPIPLUGINS_LOG) << "Name:" << file->fileName();
-        e1->setFilename(info[QLatin1String("title")].replace(QLatin1String(" "), QLatin1String("_")));
-        qCDebug(KIPIPLUGINS_LOG) << "Title:" << info[QLatin1String("title")];
+        d->preparing.insert(watcher, item);
+        watcher->setFuture(QtConcurrent::run(prepareImageForUpload, d->preparation, item.path, item.tmpPath));
+    }
+
+    // Upload next images
+
+    while (d->running.count() < d->maxParallel && !d->ready.isEmpty())
+    {
+        startUpload();
+    }
 
-        if (!info[QLatin1String("comments")].isEmpty())
+    if (d->imageDesc.isEmpty() && d->preparing.isEmpty() && d->ready.isEmpty() && d->running.isEmpty())
+    {
+        // Finish upload
+
+        if (d->error.size() > 0)
         {
-            e1->setComment(info[QLatin1String("comments")]);
+            QMessageBox::critical(QApplication::activeWindow(), i18n("Error"), d->error);
         }
         else
         {
-            e1->setComment(i18n("Uploaded via KIPI uploader"));
+            emit endUpload();
         }
 
-        e1->setText(buildWikiText(info));
-        keys.removeFirst();
+        d->error.clear();
+    }
+}
 
-        connect(e1, SIGNAL(result(KJob*)),
-                this, SLOT(uploadHandle(KJob*)));
+void WMTalker::slotPrepared()
+{
+    QFutureWatcher<QString>* const watcher = static_cast<QFutureWatcher<QString>*>(sender());
 
-        connect(e1, SIGNAL(percent(KJob*, ulong)),
-                this, SLOT(slotUploadProgress(KJob*, ulong)));
+    if (!d->preparing.contains(watcher))
+        return;
 
-        emit uploadProgress(0);
-        e1->start();
+    Private::Item item = d->preparing.take(watcher);
+    item.uploadPath    = completePreparation(item.path, item.tmpPath, watcher->result());
+    watcher->deleteLater();
+
+    if (item.uploadPath.isEmpty())
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "Cannot prepare" << item.path;
+        d->error.append(i18n("Error on file '%1'\n", item.path));
+        d->done++;
+        emitProgress();
     }
     else
     {
-        // Finish upload
+        d->ready.append(item);
+    }
 
-        if (d->error.size() > 0)
+    startNext();
+}
+
+QString WMTalker::completePreparation(const QString& imgPath, const QString& tmpPath, const QString& prepared)
+{
+    QString path = prepared;
+    QSize   size;
+
+    if (path.isEmpty())
+    {
+        if (!d->preparation.resize || !d->interface)
         {
-            QMessageBox::critical(QApplication::activeWindow(), i18n("Error"), d->error);
+            return QString();
+        }
+
+        // Format not read by QImageReader, for ex. RAW files: use the preview of the host.
+
+        QImage image = d->interface->preview(QUrl::fromLocalFile(imgPath));
+
+        if (image.isNull())
+        {
+            return QString();
+        }
+
+        const int maxDim = d->preparation.dimension;
+
+        if (image.width() > maxDim || image.height() > maxDim)
+        {
+            qCDebug(KIPIPLUGINS_LOG) << "Resizing to" << maxDim;
+            image = image.scaled(maxDim, maxDim, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+
+        if (!image.save(tmpPath, "JPEG", d->preparation.quality))
+        {
+            QFile::remove(tmpPath);
+            return QString();
+        }
+
+        path = tmpPath;
+        size = image.size();
+    }
+    else if (d->preparation.resize)
+    {
+        size = QImageReader(path).size();
+    }
+
+    if (d->interface)
+    {
+        // NOTE : In case of metadata are saved to tmp file, we will override MetadataProcessor settings from KIPI host
+        // to write metadata to image file rather than sidecar file, to be effective with remote web service.
+
+        QPointer<MetadataProcessor> meta = d->interface->createMetadataProcessor();
+
+        if (!meta)
+        {
+            return path;
+        }
+
+        if (d->preparation.removeMeta)
+        {
+            // save empty metadata to erase them
+            meta->save(QUrl::fromLocalFile(path), true);
         }
         else
         {
-            emit endUpload();
+            // copy meta data from initial to temporary image
+
+            if (meta->load(QUrl::fromLocalFile(imgPath)))
+            {
+                if (d->preparation.resize)
+                {
+                    meta->setImageDimensions(size);
+                }
+
+                if (d->preparation.removeGeo)
+                {
+                    meta->removeGPSInfo();
+                }
+
+                meta->setImageOrientation(MetadataProcessor::NORMAL);
+                meta->save(QUrl::fromLocalFile(path), true);
+            }
         }
 
-        d->error.clear();
+        delete meta;
+    }
+
+    return path;
+}
+
+void WMTalker::startUpload()
+{
+    const Private::Item item = d->ready.takeFirst();
+    qCDebug(KIPIPLUGINS_LOG) << "Path:" << item.path;
+
+    QFile* const file = new QFile(item.uploadPath);
+
+    if (!file->open(QIODevice::ReadOnly))
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "File open error:" << item.uploadPath;
+        d->error.append(i18n("Error on file '%1'\n", item.path));
+        delete file;
+
+        if (item.uploadPath != item.path)
+        {
+            QFile::remove(item.uploadPath);
+        }
+
+        d->done++;
+        emitProgress();
+        return;
+    }
+
+    QMap<QString, QString> info = item.info;
+    const QString filename      = info[QLatin1String("title")].replace(QLatin1String(" "), QLatin1String("_"));
+    const QString comment       = info[QLatin1String("comments")].isEmpty() ? i18n("Uploaded via KIPI uploader")
+                                                                              : info[QLatin1String("comments")];
+    KJob* job                   = 0;
+
+    qCDebug(KIPIPLUGINS_LOG) << "Name:" << file->fileName();
+    qCDebug(KIPIPLUGINS_LOG) << "Title:" << filename;
+
+    if (file->size() > d->chunkSize)
+    {
+        // Too large for one request on most wikis.
+        WMChunkedUpload* const upload = new WMChunkedUpload(*d->mediawiki, this);
+        upload->setFile(file);
+        upload->setFilename(filename);
+        upload->setComment(comment);
+        upload->setText(buildWikiText(info));
+        upload->setChunkSize(d->chunkSize);
+        job = upload;
+    }
+    else
+    {
+        Upload* const upload = new Upload(*d->mediawiki, this);
+        upload->setFile(file);
+        upload->setFilename(filename);
+        upload->setComment(comment);
+        upload->setText(buildWikiText(info));
+        job = upload;
     }
+
+    // Deleted with the job.
+    file->setParent(job);
+
+    connect(job, SIGNAL(result(KJob*)),
+            this, SLOT(uploadHandle(KJob*)));
+
+    connect(job, SIGNAL(percent(KJob*, ulong)),
+            this, SLOT(slotUploadProgress(KJob*, ulong)));
+
+    d->running.insert(job, item);
+    d->percents.insert(job, 0);
+    job->start();
+}
+
+void WMTalker::emitProgress()
+{
+    if (d->total <= 0)
+        return;
+
+    unsigned long percent = (unsigned long)d->done * 100;
+
+    foreach (unsigned long p, d->percents)
+    {
+        percent += p;
+    }
+
+    emit uploadProgress((int)(percent / d->total));
 }
 
 QString WMTalker::buildWikiText(const QMap<QString, QString>& info) const
@@ -267,8 +604,11 @@ QString WMTalker::buildWikiText(const QMap<QString, QString>& info) const
 
 void WMTalker::slotUploadProgress(KJob* job, unsigned long percent)
 {
-    Q_UNUSED(job)
-    emit uploadProgress((int)percent);
+    if (!d->percents.contains(job))
+        return;
+
+    d->percents[job] = percent;
+    emitProgress();
 }
 
 } // namespace KIPIWikiMediaPlugin
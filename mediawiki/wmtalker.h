@@ -63,6 +63,22 @@ public:
     QString buildWikiText(const QMap<QString, QString>& info) const;
 
     void setImageMap(const QMap <QString,QMap <QString,QString> >& imageDesc);
+
+    /** Resize the images and remove their metadata in temporary files of 'tmpDir' before upload.
+     *  The images are prepared on worker threads, a few ahead of the uploads.
+     */
+    void setPreparation(const QString& tmpDir, bool resize, int dimension, int quality,
+                        bool removeMeta, bool removeGeo);
+    void clearPreparation();
+
+    /** Set the number of files uploaded at the same time. Default is 3.
+     */
+    void setMaxParallel(int count);
+
+    /** Files larger than 'size' are uploaded by chunks of this size. Default is 5 MiB.
+     */
+    void setChunkSize(qint64 size);
+
     void start() Q_DECL_OVERRIDE;
 
 Q_SIGNALS:
@@ -76,6 +92,22 @@ public Q_SLOTS:
     void uploadHandle(KJob* j = 0);
     void slotUploadProgress(KJob* job, unsigned long percent);
 
+private Q_SLOTS:
+
+    void slotPrepared();
+
+private:
+
+    void startNext();
+    void startUpload();
+
+    /** Finish on the GUI thread the preparation of 'imgPath' done by a worker in 'prepared':
+     *  the host interface is used for the images the worker cannot read and for the metadata.
+     *  Return the file to upload, or an empty string on error.
+     */
+    QString completePreparation(const QString& imgPath, const QString& tmpPath, const QString& prepared);
+    void emitProgress();
+
 private:
 
     class Private;
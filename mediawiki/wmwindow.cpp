@@ -79,13 +79,14 @@ public:
 
     Private()
     {
-        widget       = 0;
-        mediawiki    = 0;
-        uploadTalker = 0;
+        widget          = 0;
+        mediawiki       = 0;
+        uploadTalker    = 0;
+        parallelUploads = 3;
+        chunkSize       = 5 * 1024 * 1024;
     }
 
     QString    tmpDir;
-    QString    tmpPath;
     QString    login;
     QString    pass;
     QString    wikiName;
@@ -95,13 +96,15 @@ public:
     MediaWiki* mediawiki;
 
     WMTalker*  uploadTalker;
+
+    int        parallelUploads;
+    qint64     chunkSize;
 };
 
 WMWindow::WMWindow(const QString& tmpFolder, QWidget* const /*parent*/)
     : KPToolDialog(0),
       d(new Private)
 {
-    d->tmpPath.clear();
     d->tmpDir       = tmpFolder;
     d->widget       = new WmWidget(this);
     d->uploadTalker = 0;
@@ -200,6 +203,9 @@ void WMWindow::readSettings()
 
     d->widget->readSettings(group);
 
+    d->parallelUploads = group.readEntry("Parallel Uploads", 3);
+    d->chunkSize       = (qint64)group.readEntry("Chunk Size MiB", 5) * 1024 * 1024;
+
     winId();
     KConfigGroup group2 = config.group(QLatin1String("MediaWiki export dialog"));
     KWindowConfig::restoreWindowSize(windowHandle(), group2);
@@ -230,115 +236,25 @@ void WMWindow::slotProgressCanceled()
     reject();
 }
 
-bool WMWindow::prepareImageForUpload(const QString& imgPath)
+void WMWindow::slotStartTransfer()
 {
-    // Create temporary directory if it does not exist
-
-    if (!QDir(d->tmpDir).exists())
-    {
-        QDir().mkdir(d->tmpDir);
-    }
-
-    // Get temporary file name
-
-    d->tmpPath = d->tmpDir + QFileInfo(imgPath).baseName().trimmed() + QLatin1String(".jpg");
-
-    QImage image;
+    saveSettings();
+    QMap <QString, QMap <QString, QString> > imagesDesc = d->widget->allImagesDesc();
 
-    // Rescale image if requested: metadata is lost
+    // Images are prepared by the talker on worker threads, while the previous ones are sent.
 
-    if (d->widget->resize())
+    if (d->widget->resize() || d->widget->removeMeta() || d->widget->removeGeo())
     {
-        if (iface())
-        {
-            image = iface()->preview(QUrl::fromLocalFile(imgPath));
-        }
-
-        if (image.isNull())
-        {
-            image.load(imgPath);
-        }
-
-        if (image.isNull())
-        {
-            return false;
-        }
-
-        int maxDim = d->widget->dimension();
-
-        if (d->widget->resize() && (image.width() > maxDim || image.height() > maxDim))
-        {
-            qCDebug(KIPIPLUGINS_LOG) << "Resizing to" << maxDim;
-            image = image.scaled(maxDim, maxDim, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-        }
-
-        qCDebug(KIPIPLUGINS_LOG) << "Saving to temp file:" << d->tmpPath;
-        image.save(d->tmpPath, "JPEG", d->widget->quality());
+        d->uploadTalker->setPreparation(d->tmpDir, d->widget->resize(), d->widget->dimension(),
+                                        d->widget->quality(), d->widget->removeMeta(), d->widget->removeGeo());
     }
     else
     {
-        // file is copied with its embedded metadata
-        if (!QFile::copy(imgPath, d->tmpPath))
-        {
-            qCDebug(KIPIPLUGINS_LOG) << "File copy error from:" << imgPath << "to" << d->tmpPath;
-            return false;
-        }
-    }
-
-    if (iface())
-    {
-        // NOTE : In case of metadata are saved to tmp file, we will override MetadataProcessor settings from KIPI host
-        // to write metadata to image file rather than sidecar file, to be effective with remote web service.
-
-        QPointer<MetadataProcessor> meta = iface()->createMetadataProcessor();
-
-        if (d->widget->removeMeta())
-        {
-            // save empty metadata to erase them
-            meta->save(QUrl::fromLocalFile(d->tmpPath), true);
-        }
-        else
-        {
-            // copy meta data from initial to temporary image
-
-            if (meta->load(QUrl::fromLocalFile(imgPath)))
-            {
-                if (d->widget->resize())
-                {
-                    meta->setImageDimensions(image.size());
-                }
-
-                if (d->widget->removeGeo())
-                {
-                    meta->removeGPSInfo();
-                }
-
-                meta->setImageOrientation(MetadataProcessor::NORMAL);
-                meta->save(QUrl::fromLocalFile(d->tmpPath), true);
-            }
-        }
-    }
-
-    return true;
-}
-
-void WMWindow::slotStartTransfer()
-{
-    saveSettings();
-    QList<QUrl> urls                                    = d->widget->imagesList()->imageUrls(false);
-    QMap <QString, QMap <QString, QString> > imagesDesc = d->widget->allImagesDesc();
-
-    for (int i = 0; i < urls.size(); ++i)
-    {
-        QString url;
-
-        if (d->widget->resize() || d->widget->removeMeta() || d->widget->removeGeo())
-        {
-            prepareImageForUpload(urls.at(i).toLocalFile());
-            imagesDesc.insert(d->tmpPath, imagesDesc.take(urls.at(i).toLocalFile()));
-        }
+        d->uploadTalker->clearPreparation();
     }
 
+    d->uploadTalker->setMaxParallel(d->parallelUploads);
+    d->uploadTalker->setChunkSize(d->chunkSize);
     d->uploadTalker->setImageMap(imagesDesc);
 
     d->widget->progressBar()->setRange(0, 100);
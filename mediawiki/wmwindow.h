@@ -49,7 +49,6 @@ public:
     ~WMWindow();
 
     void reactivate();
-    bool prepareImageForUpload(const QString& imgPath);
 
 private Q_SLOTS:
 
@@ -37,6 +37,8 @@
 #include <QApplication>
 #include <QCryptographicHash>
 #include <QUuid>
+#include <QUrlQuery>
+#include <QHttpMultiPart>
 
 // KDE includes
 
@@ -53,6 +55,7 @@
 #include "kpversion.h"
 #include "kpimageinfo.h"
 #include "kputil.h"
+#include "kplistingcache.h"
 
 using namespace KIPIPlugins;
 
@@ -70,9 +73,16 @@ PiwigoTalker::PiwigoTalker(QWidget* const parent)
       m_chunkId(0),
       m_nbOfChunks(0),
       m_version(-1),
+      m_fileSize(0),
+      m_chunkOffset(0),
+      m_chunkSize(CHUNK_DEFAULT_SIZE),
+      m_maxParallelChunks(3),
+      m_binaryUpload(false),
       m_albumId(0),
       m_photoId(0),
-      m_iface(0)
+      m_iface(0),
+      m_listingCache(0),
+      m_albumsCached(false)
 {
     m_netMngr = new QNetworkAccessManager(this);
 
@@ -85,16 +95,25 @@ PiwigoTalker::PiwigoTalker(QWidget* const parent)
     {
         m_iface = pl->interface();
     }
+
+    m_listingCache = new KPListingCache(QString::fromLatin1("Piwigo"));
 }
 
 PiwigoTalker::~PiwigoTalker()
 {
     cancel();
+    delete m_listingCache;
+}
+
+void PiwigoTalker::setMaxParallelChunks(int count)
+{
+    m_maxParallelChunks = qMax(1, count);
 }
 
 void PiwigoTalker::cancel()
 {
     deleteTemporaryFile();
+    abortChunks();
 
     if (m_reply)
     {
@@ -126,8 +145,9 @@ bool PiwigoTalker::loggedIn() const
 
 void PiwigoTalker::login(const QUrl& url, const QString& name, const QString& passwd)
 {
-    m_url   = url;
-    m_state = GE_LOGIN;
+    m_url     = url;
+    m_state   = GE_LOGIN;
+    m_account = name + QLatin1Char('@') + url.toString();
     m_talker_buffer.resize(0);
 
     // Add the page to the URL
@@ -157,6 +177,15 @@ void PiwigoTalker::login(const QUrl& url, const QString& name, const QString& pa
 
 void PiwigoTalker::listAlbums()
 {
+    m_albumsCached    = false;
+    QByteArray cached = m_listingCache->data(m_account, QLatin1String("albums"));
+
+    if (!cached.isEmpty())
+    {
+        parseResponseListAlbums(cached);
+        m_albumsCached = true;
+    }
+
     m_state = GE_LISTALBUMS;
     m_talker_buffer.resize(0);
 
@@ -311,6 +340,12 @@ bool PiwigoTalker::addPhoto(int   albumId,
 
 void PiwigoTalker::slotFinished(QNetworkReply* reply)
 {
+    if (m_chunks.contains(reply))
+    {
+        chunkFinished(reply);
+        return;
+    }
+
     if (reply != m_reply)
     {
         return;
@@ -333,6 +368,13 @@ void PiwigoTalker::slotFinished(QNetworkReply* reply)
             // As login succeeded, albums can be listed
             listAlbums();
         }
+        else if (state == GE_GETTOKEN)
+        {
+            qCDebug(KIPIPLUGINS_LOG) << reply->errorString();
+            // The token is only needed by pwg.images.upload
+            m_binaryUpload = false;
+            startChunks();
+        }
         else if (state == GE_CHECKPHOTOEXIST || state == GE_GETINFO           ||
                  state == GE_SETINFO         || state == GE_ADDPHOTOCHUNK     ||
                  state == GE_ADDPHOTOSUMMARY)
@@ -373,9 +415,8 @@ void PiwigoTalker::slotFinished(QNetworkReply* reply)
         case (GE_SETINFO):
             parseResponseSetInfo(m_talker_buffer);
             break;
-        case (GE_ADDPHOTOCHUNK):
-            // Support for Web API >= 2.4
-            parseResponseAddPhotoChunk(m_talker_buffer);
+        case (GE_GETTOKEN):
+            parseResponseGetToken(m_talker_buffer);
             break;
         case (GE_ADDPHOTOSUMMARY):
             parseResponseAddPhotoSummary(m_talker_buffer);
@@ -451,7 +492,7 @@ void PiwigoTalker::parseResponseGetVersion(const QByteArray& data)
 {
     QXmlStreamReader ts(data);
     QString line;
-    QRegExp verrx(QString::fromLatin1(".?(\\d)\\.(\\d).*"));
+    QRegExp verrx(QString::fromLatin1("\\D?(\\d+)\\.(\\d+).*"));
 
     bool foundResponse = false;
 
@@ -489,6 +530,10 @@ void PiwigoTalker::parseResponseGetVersion(const QByteArray& data)
         emit signalLoginFailed(i18n("Upload to Piwigo version < 2.4 is no longer supported"));
         return;
     }
+
+    // Chunks can be sent as binary data since 2.7
+    m_binaryUpload = (m_version >= PIWIGO_VER_2_7);
+    m_pwgToken.clear();
 }
 
 void PiwigoTalker::parseResponseListAlbums(const QByteArray& data)
@@ -568,6 +613,9 @@ void PiwigoTalker::parseResponseListAlbums(const QByteArray& data)
         return;
     }
 
+    if (!m_listingCache->update(m_account, QLatin1String("albums"), data, m_albumsCached))
+        return;
+
     // We need parent albums to come first for rest of the code to work
     std::sort(albumList.begin(), albumList.end());
 
@@ -648,15 +696,14 @@ void PiwigoTalker::parseResponseDoesPhotoExist(const QByteArray& data)
 
     if (m_version >= PIWIGO_VER_2_4)
     {
-        QFileInfo fi(m_path);
-
-        m_state      = GE_ADDPHOTOCHUNK;
-        m_talker_buffer.resize(0);
-        // Compute the number of chunks for the image
-        m_nbOfChunks = (fi.size() / CHUNK_MAX_SIZE) + 1;
-        m_chunkId    = 0;
-
-        addNextChunk();
+        if (m_binaryUpload && m_pwgToken.isEmpty())
+        {
+            getToken();
+        }
+        else
+        {
+            startChunks();
+        }
     }
     else
     {
@@ -791,7 +838,61 @@ void PiwigoTalker::parseResponseSetInfo(const QByteArray& data)
     emit signalAddPhotoSucceeded();
 }
 
-void PiwigoTalker::addNextChunk()
+void PiwigoTalker::getToken()
+{
+    m_state = GE_GETTOKEN;
+    m_talker_buffer.resize(0);
+
+    QByteArray buffer = "method=pwg.session.getStatus";
+
+    QNetworkRequest netRequest(m_url);
+    netRequest.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/x-www-form-urlencoded"));
+    netRequest.setRawHeader("Authorization", s_authToken.toLatin1());
+
+    m_reply = m_netMngr->post(netRequest, buffer);
+}
+
+void PiwigoTalker::parseResponseGetToken(const QByteArray& data)
+{
+    QXmlStreamReader ts(data);
+
+    qCDebug(KIPIPLUGINS_LOG) << "parseResponseGetToken: " << QString::fromUtf8(data);
+
+    while (!ts.atEnd())
+    {
+        ts.readNext();
+
+        if (ts.isStartElement() && ts.name() == QString::fromLatin1("pwg_token"))
+        {
+            m_pwgToken = ts.readElementText().trimmed();
+            break;
+        }
+    }
+
+    if (m_pwgToken.isEmpty())
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "No pwg_token, use pwg.images.addChunk";
+        m_binaryUpload = false;
+    }
+
+    startChunks();
+}
+
+void PiwigoTalker::startChunks()
+{
+    m_state       = GE_ADDPHOTOCHUNK;
+    m_talker_buffer.resize(0);
+
+    m_fileSize    = QFileInfo(m_path).size();
+    m_chunkOffset = 0;
+    m_chunkId     = 0;
+    m_nbOfChunks  = 0;
+    m_photoId     = 0;
+
+    addNextChunks();
+}
+
+void PiwigoTalker::addNextChunks()
 {
     QFile imagefile(m_path);
 
@@ -801,33 +902,204 @@ void PiwigoTalker::addNextChunk()
         return;
     }
 
-    m_chunkId++; // We start with chunk 1
+    // pwg.images.upload appends the chunks to the file in the order they are received,
+    // they are sent one after the other. The chunks of pwg.images.addChunk are stored by
+    // position and merged by pwg.images.add, so several can be sent at the same time.
+    const int maxParallel = m_binaryUpload ? 1 : m_maxParallelChunks;
 
-    imagefile.seek((m_chunkId - 1) * CHUNK_MAX_SIZE);
+    // A file has at least one chunk, even if empty.
+    while (m_chunks.size() < maxParallel && (m_chunkOffset < m_fileSize || m_chunkId == 0))
+    {
+        imagefile.seek(m_chunkOffset);
+        const QByteArray data = imagefile.read(m_chunkSize);
 
-    m_talker_buffer.resize(0);
+        if (data.isEmpty() && m_chunkOffset < m_fileSize)
+        {
+            abortChunks();
+            deleteTemporaryFile();
+            emit signalAddPhotoFailed(i18n("Error : Cannot open photo: %1", QUrl(m_path).fileName()));
+            return;
+        }
+
+        m_chunkId++; // We start with chunk 1
+        m_chunkOffset += data.size();
+
+        // The number of chunks changes with their size, the last one is known when it is sent.
+        m_nbOfChunks   = m_chunkId + (m_fileSize - m_chunkOffset + m_chunkSize - 1) / m_chunkSize;
+
+        Chunk chunk;
+        chunk.position = m_chunkId;
+        chunk.size     = data.size();
+        chunk.timer.start();
+
+        QNetworkReply* const reply = m_binaryUpload ? postBinaryChunk(data) : postChunk(data);
+        m_chunks.insert(reply, chunk);
+
+        emit signalProgressInfo(i18n("Upload the chunk %1/%2 of %3", m_chunkId, m_nbOfChunks, QUrl(m_path).fileName()));
+    }
+
+    imagefile.close();
+}
+
+QNetworkReply* PiwigoTalker::postChunk(const QByteArray& data)
+{
     QStringList qsl;
     qsl.append(QLatin1String("method=pwg.images.addChunk"));
     qsl.append(QLatin1String("original_sum=") + QString::fromLatin1(m_md5sum.toHex()));
     qsl.append(QLatin1String("position=") + QString::number(m_chunkId));
     qsl.append(QLatin1String("type=file"));
-    qsl.append(QLatin1String("data=") + QString::fromUtf8(imagefile.read(CHUNK_MAX_SIZE).toBase64().toPercentEncoding()));
+    qsl.append(QLatin1String("data=") + QString::fromUtf8(data.toBase64().toPercentEncoding()));
     QString dataParameters = qsl.join(QLatin1String("&"));
     QByteArray buffer;
     buffer.append(dataParameters.toUtf8());
 
-    imagefile.close();
-
     QNetworkRequest netRequest(m_url);
     netRequest.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/x-www-form-urlencoded"));
     netRequest.setRawHeader("Authorization", s_authToken.toLatin1());
 
-    m_reply = m_netMngr->post(netRequest, buffer);
+    return m_netMngr->post(netRequest, buffer);
+}
+
+static void appendFormPart(QHttpMultiPart* const multiPart, const QString& name, const QString& value)
+{
+    QHttpPart part;
+    part.setHeader(QNetworkRequest::ContentDispositionHeader,
+                   QString::fromLatin1("form-data; name=\"%1\"").arg(name));
+    part.setBody(value.toUtf8());
+    multiPart->append(part);
+}
+
+QNetworkReply* PiwigoTalker::postBinaryChunk(const QByteArray& data)
+{
+    const QString fileName = QUrl(m_path).fileName();
+
+    QHttpMultiPart* const multiPart = new QHttpMultiPart(QHttpMultiPart::FormDataType);
+
+    appendFormPart(multiPart, QLatin1String("method"),    QLatin1String("pwg.images.upload"));
+    appendFormPart(multiPart, QLatin1String("pwg_token"), m_pwgToken);
+    appendFormPart(multiPart, QLatin1String("category"),  QString::number(m_albumId));
+    appendFormPart(multiPart, QLatin1String("name"),      fileName);
+    appendFormPart(multiPart, QLatin1String("chunk"),     QString::number(m_chunkId - 1));
+    appendFormPart(multiPart, QLatin1String("chunks"),    QString::number(m_nbOfChunks));
+
+    QHttpPart filePart;
+    filePart.setHeader(QNetworkRequest::ContentDispositionHeader,
+                       QString::fromLatin1("form-data; name=\"file\"; filename=\"%1\"").arg(fileName));
+    filePart.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/octet-stream"));
+    filePart.setBody(data);
+    multiPart->append(filePart);
+
+    // The method is also given in the URL, as some servers only read it there.
+    QUrl url(m_url);
+    QUrlQuery query(url);
+    query.addQueryItem(QLatin1String("method"), QLatin1String("pwg.images.upload"));
+    url.setQuery(query);
+
+    QNetworkRequest netRequest(url);
+    netRequest.setRawHeader("Authorization", s_authToken.toLatin1());
+
+    QNetworkReply* const reply = m_netMngr->post(netRequest, multiPart);
+    multiPart->setParent(reply);
 
-    emit signalProgressInfo(i18n("Upload the chunk %1/%2 of %3", m_chunkId, m_nbOfChunks, QUrl(m_path).fileName()));
+    return reply;
 }
 
-void PiwigoTalker::parseResponseAddPhotoChunk(const QByteArray& data)
+void PiwigoTalker::chunkFinished(QNetworkReply* reply)
+{
+    const Chunk chunk = m_chunks.take(reply);
+    const qint64 time = chunk.timer.elapsed();
+
+    emit signalBusy(false);
+    reply->deleteLater();
+
+    bool success = false;
+
+    if (reply->error() == QNetworkReply::NoError)
+    {
+        const QByteArray data = reply->readAll();
+        success               = m_binaryUpload ? parseResponseUploadChunk(data)
+                                               : parseResponseAddPhotoChunk(data);
+    }
+    else
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "Chunk" << chunk.position << ":" << reply->errorString();
+    }
+
+    if (!success)
+    {
+        if (m_binaryUpload && chunk.position == 1)
+        {
+            // pwg.images.upload is not available, or not allowed: use the legacy method.
+            qCDebug(KIPIPLUGINS_LOG) << "Binary upload failed, use pwg.images.addChunk";
+            m_binaryUpload = false;
+            startChunks();
+            return;
+        }
+
+        if (reply->error() != QNetworkReply::NoError || m_binaryUpload)
+        {
+            abortChunks();
+            deleteTemporaryFile();
+            emit signalAddPhotoFailed(reply->error() != QNetworkReply::NoError ? reply->errorString()
+                                                                                : i18n("Failed to upload photo"));
+            return;
+        }
+
+        emit signalProgressInfo(i18n("Warning : The full size photo cannot be uploaded."));
+    }
+
+    adaptChunkSize(chunk.size, time);
+
+    if (m_chunkOffset < m_fileSize)
+    {
+        addNextChunks();
+    }
+    else if (m_chunks.isEmpty())
+    {
+        if (m_binaryUpload)
+        {
+            if (m_photoId <= 0)
+            {
+                deleteTemporaryFile();
+                emit signalAddPhotoFailed(i18n("Failed to upload photo"));
+                return;
+            }
+
+            setPhotoInfo();
+        }
+        else
+        {
+            addPhotoSummary();
+        }
+    }
+}
+
+void PiwigoTalker::abortChunks()
+{
+    QList<QNetworkReply*> replies = m_chunks.keys();
+    m_chunks.clear();
+
+    foreach (QNetworkReply* const reply, replies)
+    {
+        reply->abort();
+        reply->deleteLater();
+    }
+}
+
+void PiwigoTalker::adaptChunkSize(qint64 size, qint64 elapsed)
+{
+    if (size <= 0 || elapsed <= 0)
+    {
+        return;
+    }
+
+    // Large chunks lower the cost of each request on fast connections, small ones keep
+    // the progress moving and lower the cost of a failure on slow connections.
+    qint64 wanted = size * CHUNK_TARGET_TIME / elapsed;
+    m_chunkSize   = qBound((qint64)CHUNK_MIN_SIZE, (m_chunkSize + wanted) / 2, (qint64)CHUNK_MAX_SIZE);
+}
+
+bool PiwigoTalker::parseResponseAddPhotoChunk(const QByteArray& data)
 {
     QString str        = QString::fromUtf8(data);
     QXmlStreamReader ts(data);
@@ -855,19 +1127,72 @@ void PiwigoTalker::parseResponseAddPhotoChunk(const QByteArray& data)
         }
     }
 
-    if (!foundResponse || !success)
-    {
-        emit signalProgressInfo(i18n("Warning : The full size photo cannot be uploaded."));
-    }
+    return (foundResponse && success);
+}
 
-    if (m_chunkId < m_nbOfChunks)
-    {
-        addNextChunk();
-    }
-    else
+bool PiwigoTalker::parseResponseUploadChunk(const QByteArray& data)
+{
+    QXmlStreamReader ts(data);
+    bool success = false;
+
+    qCDebug(KIPIPLUGINS_LOG) << "parseResponseUploadChunk: " << QString::fromUtf8(data);
+
+    while (!ts.atEnd())
     {
-        addPhotoSummary();
+        ts.readNext();
+
+        if (ts.isStartElement())
+        {
+            if (ts.name() == QString::fromLatin1("rsp"))
+            {
+                success = (ts.attributes().value(QString::fromLatin1("stat")) == QString::fromLatin1("ok"));
+
+                if (!success)
+                    break;
+            }
+            else if (ts.name() == QString::fromLatin1("image_id"))
+            {
+                // Sent with the response to the last chunk
+                m_photoId = ts.readElementText().toInt();
+                qCDebug(KIPIPLUGINS_LOG) << "m_photoId: " << m_photoId;
+            }
+        }
     }
+
+    return success;
+}
+
+void PiwigoTalker::setPhotoInfo()
+{
+    m_state = GE_SETINFO;
+    m_talker_buffer.resize(0);
+
+    QStringList qsl;
+    qsl.append(QLatin1String("method=pwg.images.setInfo"));
+    qsl.append(QLatin1String("image_id=") + QString::number(m_photoId));
+    qsl.append(QLatin1String("single_value_mode=replace"));
+    qsl.append(QLatin1String("name=") + QString::fromUtf8(m_title.toUtf8().toPercentEncoding()));
+
+    if (!m_author.isEmpty())
+        qsl.append(QLatin1String("author=") + QString::fromUtf8(m_author.toUtf8().toPercentEncoding()));
+
+    if (!m_comment.isEmpty())
+        qsl.append(QLatin1String("comment=") + QString::fromUtf8(m_comment.toUtf8().toPercentEncoding()));
+
+    qsl.append(QLatin1String("date_creation=") +
+               QString::fromUtf8(m_date.toString(QLatin1String("yyyy-MM-dd hh:mm:ss")).toUtf8().toPercentEncoding()));
+
+    QString dataParameters = qsl.join(QLatin1String("&"));
+    QByteArray buffer;
+    buffer.append(dataParameters.toUtf8());
+
+    QNetworkRequest netRequest(m_url);
+    netRequest.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/x-www-form-urlencoded"));
+    netRequest.setRawHeader("Authorization", s_authToken.toLatin1());
+
+    m_reply = m_netMngr->post(netRequest, buffer);
+
+    emit signalProgressInfo(i18n("Upload the metadata of %1", QUrl(m_path).fileName()));
 }
 
 void PiwigoTalker::addPhotoSummary()
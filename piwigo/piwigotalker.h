@@ -35,6 +35,8 @@
 #include <QTextStream>
 #include <QFile>
 #include <QUrl>
+#include <QHash>
+#include <QElapsedTimer>
 #include <QNetworkReply>
 #include <QNetworkAccessManager>
 
@@ -44,6 +46,11 @@
 
 using namespace KIPI;
 
+namespace KIPIPlugins
+{
+    class KPListingCache;
+}
+
 template <class T> class QList;
 
 namespace KIPIPiwigoExportPlugin
@@ -67,14 +74,19 @@ public:
         GE_CHECKPHOTOEXIST,
         GE_GETINFO,
         GE_SETINFO,
+        GE_GETTOKEN,
         GE_ADDPHOTOCHUNK,
         GE_ADDPHOTOSUMMARY
     };
 
     enum
     {
-        CHUNK_MAX_SIZE = 512*1024,
-        PIWIGO_VER_2_4 = 24
+        CHUNK_MIN_SIZE     = 128*1024,
+        CHUNK_DEFAULT_SIZE = 512*1024,
+        CHUNK_MAX_SIZE     = 1536*1024, // Below the 2 MB upload limit of PHP default settings
+        CHUNK_TARGET_TIME  = 2000,      // Chunk size is adapted to be sent in about this time (ms)
+        PIWIGO_VER_2_4     = 24,
+        PIWIGO_VER_2_7     = 27
     };
 
 public:
@@ -103,6 +115,11 @@ public:
                   const QString& photoPath,
                   bool  rescale = false, int maxWidth = 1600, int maxHeight = 1600, int quality = 95);
 
+    /** Set the number of chunks of a photo sent at the same time, when the server
+     *  stores them separately. Default is 3.
+     */
+    void setMaxParallelChunks(int count);
+
     void cancel();
 
 Q_SIGNALS:
@@ -124,8 +141,19 @@ private:
     void parseResponseGetInfo(const QByteArray& data);
     void parseResponseSetInfo(const QByteArray& data);
 
-    void addNextChunk();
-    void parseResponseAddPhotoChunk(const QByteArray& data);
+    void getToken();
+    void parseResponseGetToken(const QByteArray& data);
+
+    void startChunks();
+    void addNextChunks();
+    QNetworkReply* postChunk(const QByteArray& data);
+    QNetworkReply* postBinaryChunk(const QByteArray& data);
+    void chunkFinished(QNetworkReply* reply);
+    void abortChunks();
+    void adaptChunkSize(qint64 size, qint64 elapsed);
+    bool parseResponseAddPhotoChunk(const QByteArray& data);
+    bool parseResponseUploadChunk(const QByteArray& data);
+    void setPhotoInfo();
     void addPhotoSummary();
     void parseResponseAddPhotoSummary(const QByteArray& data);
 
@@ -136,6 +164,15 @@ private Q_SLOTS:
 
     void slotFinished(QNetworkReply* reply);
 
+private:
+
+    struct Chunk
+    {
+        uint          position;
+        qint64        size;
+        QElapsedTimer timer;
+    };
+
 private:
 
     QWidget*               m_parent;
@@ -150,6 +187,15 @@ private:
     uint                   m_nbOfChunks;
     int                    m_version;
 
+    // Chunks of the photo file being sent
+    QHash<QNetworkReply*, Chunk> m_chunks;
+    qint64                 m_fileSize;
+    qint64                 m_chunkOffset;  // Position of the next chunk in the file
+    qint64                 m_chunkSize;    // Adapted to the measured throughput
+    int                    m_maxParallelChunks;
+    bool                   m_binaryUpload; // Use pwg.images.upload, else pwg.images.addChunk
+    QString                m_pwgToken;
+
     QByteArray             m_md5sum;
     QString                m_path;
     QString                m_tmpPath;    // If set, contains a temporary file which must be deleted
@@ -161,6 +207,10 @@ private:
     QDateTime              m_date;       // Synchronized with Piwigo date
     Interface*             m_iface;
 
+    QString                m_account;
+    KIPIPlugins::KPListingCache* m_listingCache;
+    bool                   m_albumsCached; // Albums are shown from the cache while they are listed again
+
     static QString         s_authToken;
 };
 
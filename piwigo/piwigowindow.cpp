@@ -368,6 +368,8 @@ void PiwigoWindow::readSettings()
     d->heightSpinBox->setValue(group.readEntry("Maximum Height", 1600));
 
     d->qualitySpinBox->setValue(group.readEntry("Quality", 95));
+
+    d->talker->setMaxParallelChunks(group.readEntry("Parallel Chunks", 3));
 }
 
 void PiwigoWindow::slotDoLogin()
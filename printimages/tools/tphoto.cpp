@@ -27,6 +27,8 @@
 
 #include <QPainter>
 #include <QFileInfo>
+#include <QImageReader>
+#include <QtConcurrentRun>
 
 // Libkipi includes
 
@@ -57,6 +59,7 @@ TPhoto::TPhoto(int thumbnailSize)
     m_iface                = 0;
 
     m_thumbnail            = 0;
+    m_loadingStarted       = false;
 
     this->m_thumbnailSize  = thumbnailSize;
 
@@ -90,10 +93,14 @@ TPhoto::TPhoto (const TPhoto& photo)
         pCaptionInfo = new CaptionInfo(*photo.pCaptionInfo);
     }
 
-    m_size      = 0;
-    m_meta      = 0;
-    m_iface     = 0;
-    m_thumbnail = 0;
+    m_size           = 0;
+    m_meta           = 0;
+    m_iface          = 0;
+    m_thumbnail      = 0;
+
+    // The copies of a photo share the reading of its size and thumbnail.
+    m_loading        = photo.m_loading;
+    m_loadingStarted = photo.m_loadingStarted;
 
     PluginLoader* const pl = PluginLoader::instance();
 
@@ -111,20 +118,79 @@ TPhoto::~TPhoto()
     delete pCaptionInfo;
 }
 
+/** Read the size from the image header, and decode the thumbnail at its size,
+ *  without decoding the full image. It runs on a worker thread: only QImageReader
+ *  is used here. The size is invalid if the format cannot be read this way.
+ */
+TPhotoCache TPhoto::readCache(const QUrl& url, int thumbnailSize, bool autoTransform)
+{
+    TPhotoCache cache;
+    QImageReader reader(url.toLocalFile());
+    QSize fullSize = reader.size();
+
+    if (!fullSize.isValid() || fullSize.isEmpty())
+    {
+        return cache;
+    }
+
+    // The image given by the host is rotated following its EXIF orientation.
+    reader.setAutoTransform(autoTransform);
+
+    const double factor = qMin((double)thumbnailSize / fullSize.width(), (double)thumbnailSize / fullSize.height());
+
+    reader.setScaledSize(QSize(qMax(1, qRound(fullSize.width()  * factor)),
+                               qMax(1, qRound(fullSize.height() * factor))));
+
+    if (autoTransform && (reader.transformation() & QImageIOHandler::TransformationRotate90))
+    {
+        fullSize.transpose();
+    }
+
+    cache.thumbnail = reader.read();
+
+    if (!cache.thumbnail.isNull())
+    {
+        cache.size = fullSize;
+    }
+
+    return cache;
+}
+
+void TPhoto::loadInBackground()
+{
+    if (m_loadingStarted || filename.isEmpty())
+    {
+        return;
+    }
+
+    m_loading        = QtConcurrent::run(&TPhoto::readCache, filename, m_thumbnailSize, (m_iface != 0));
+    m_loadingStarted = true;
+}
+
 void TPhoto::loadCache()
 {
     // load the thumbnail and size only once.
     delete m_thumbnail;
+    delete m_size;
 
-    QImage photo = loadPhoto();
-    QImage image = photo.scaled(m_thumbnailSize, m_thumbnailSize, Qt::KeepAspectRatio);
+    TPhotoCache cache = m_loadingStarted ? m_loading.result()
+                                         : readCache(filename, m_thumbnailSize, (m_iface != 0));
+
+    if (!cache.size.isValid())
+    {
+        // Format not handled by QImageReader, for ex. RAW files: decode the full image.
+        QImage photo    = loadPhoto();
+        cache.thumbnail = photo.scaled(m_thumbnailSize, m_thumbnailSize, Qt::KeepAspectRatio);
+        cache.size      = photo.size();
+    }
+
+    QImage image = cache.thumbnail;
     m_thumbnail  = new QPixmap(image.width(), image.height());
     QPainter painter(m_thumbnail);
     painter.drawImage(0, 0, image );
     painter.end();
 
-    delete m_size;
-    m_size = new QSize(photo.width(), photo.height());
+    m_size = new QSize(cache.size);
 }
 
 QPixmap& TPhoto::thumbnail()
@@ -31,6 +31,8 @@
 #include <QColor>
 #include <QUrl>
 #include <QPointer>
+#include <QImage>
+#include <QFuture>
 
 // Libkipi includes
 
@@ -130,6 +132,18 @@ public:
 
 // -----------------------------------------------------------
 
+/** Size and thumbnail of a photo, read on a worker thread.
+ */
+class TPhotoCache
+{
+public:
+
+    QSize  size;
+    QImage thumbnail;
+};
+
+// -----------------------------------------------------------
+
 class TPhoto
 {
 
@@ -151,6 +165,12 @@ public:
 
     MetadataProcessor* metaIface();
 
+    /**
+     * Start reading the size and the thumbnail on a worker thread. Call it once
+     * filename is set: size() and thumbnail() then only wait for the result.
+     */
+    void loadInBackground();
+
 public:
 
     // full path
@@ -170,12 +190,17 @@ private:
 
     void loadCache();
 
+    static TPhotoCache readCache(const QUrl& url, int thumbnailSize, bool autoTransform);
+
 private:
 
     QPixmap*                    m_thumbnail;
     QSize*                      m_size;
     Interface*                  m_iface;
     QPointer<MetadataProcessor> m_meta;
+
+    QFuture<TPhotoCache>        m_loading;
+    bool                        m_loadingStarted;
 };
 
 }  // NameSpace KIPIPrintImagesPlugin
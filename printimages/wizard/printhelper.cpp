@@ -218,6 +218,7 @@ void PrintHelper::print(const QList<QUrl>& fileList)
         TPhoto *photo   = new TPhoto(150);
         photo->filename = fileList[i];
         photo->pAddInfo = new AdditionalInfo();
+        photo->loadInBackground();
         d->m_photos.append(photo);
         QApplication::processEvents();
     }
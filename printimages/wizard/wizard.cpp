@@ -394,6 +394,7 @@ void Wizard::print(const QList<QUrl>& fileList, const QString& tempPath)
         TPhoto* const photo = new TPhoto(150);
         photo->filename     = fileList[i];
         photo->first        = true;
+        photo->loadInBackground();
         d->m_photos.append(photo);
     }
 
@@ -1668,6 +1669,7 @@ void Wizard::slotAddItems(const QList<QUrl>& list)
             TPhoto* const pPhoto = new TPhoto(150);
             pPhoto->filename     = *it;
             pPhoto->first        = true;
+            pPhoto->loadInBackground();
             d->m_photos.append(pPhoto);
             qCDebug(KIPIPLUGINS_LOG) << "Added new fileName: " << pPhoto->filename.fileName();
         }
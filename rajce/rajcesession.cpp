@@ -26,10 +26,14 @@
 
 #include <QWidget>
 #include <QCryptographicHash>
-#include <QXmlResultItems>
-#include <QXmlQuery>
+#include <QXmlStreamReader>
 #include <QFileInfo>
+#include <QDir>
 #include <QUrl>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
 
 // Libkipi includes
 
@@ -52,14 +56,20 @@ namespace KIPIRajcePlugin
 const QUrl     RAJCE_URL(QString::fromLatin1("http://www.rajce.idnes.cz/liveAPI/index.php"));
 const unsigned THUMB_SIZE = 100;
 
+/// Number of photos uploaded at the same time to the open album.
+const int      MAX_PARALLEL_UPLOADS = 2;
+
 struct PreparedImage
 {
     QString scaledImagePath;
     QString thumbPath;
+    QSize   originalSize;
+    QSize   scaledSize;
 };
 
 PreparedImage _prepareImageForUpload(const QString& saveDir, const QImage& img, const QString& imagePath,
-                                     unsigned maxDimension, unsigned thumbDimension, int jpgQuality)
+                                     unsigned maxDimension, unsigned thumbDimension, int jpgQuality,
+                                     const QSize& originalSize = QSize())
 {
     PreparedImage ret;
 
@@ -67,6 +77,7 @@ PreparedImage _prepareImageForUpload(const QString& saveDir, const QImage& img,
         return ret;
 
     QImage image(img);
+    ret.originalSize    = originalSize.isValid() ? originalSize : image.size();
 
     // get temporary file name
     QString baseName    = saveDir  + QFileInfo(imagePath).baseName().trimmed();
@@ -81,35 +92,200 @@ PreparedImage _prepareImageForUpload(const QString& saveDir, const QImage& img,
 
     qCDebug(KIPIPLUGINS_LOG) << "Saving to temp file: " << ret.scaledImagePath;
     image.save(ret.scaledImagePath, "JPEG", jpgQuality);
+    ret.scaledSize      = image.size();
 
     QImage thumb = image.scaled(thumbDimension, thumbDimension, Qt::KeepAspectRatio, Qt::SmoothTransformation);
     qCDebug(KIPIPLUGINS_LOG) << "Saving thumb to temp file: " << ret.thumbPath;
     thumb.save(ret.thumbPath, "JPEG", jpgQuality);
 
+    return ret;
+}
+
+/** Copy the metadata of the image to its prepared file. The host interface is only
+ *  used from the GUI thread.
+ */
+void _copyMetadata(const QString& imagePath, const PreparedImage& prepared)
+{
     PluginLoader* const pl = PluginLoader::instance();
+    Interface* const iface = pl ? pl->interface() : 0;
 
-    if (pl)
+    if (!iface)
     {
-        Interface* const iface = pl->interface();
+        return;
+    }
+
+    QPointer<MetadataProcessor> meta = iface->createMetadataProcessor();
+
+    if (meta && meta->load(QUrl::fromLocalFile(imagePath)))
+    {
+        meta->setImageDimensions(prepared.scaledSize);
+        meta->setImageOrientation(MetadataProcessor::NORMAL);
+        meta->setImageProgramId(QString::fromLatin1("Kipi-plugins"), kipipluginsVersion());
+        meta->save(QUrl::fromLocalFile(prepared.scaledImagePath), true);
+    }
+
+    delete meta;
+}
+
+/** Prepare the image of a photo upload on a worker thread, while the commands queued
+ *  before it are sent.
+ */
+class PrepareImageJob : public QRunnable
+{
+public:
+
+    PrepareImageJob(const QString& saveDir, const QString& imagePath, unsigned maxDimension, int jpgQuality);
+
+    void run() Q_DECL_OVERRIDE;
+
+    /// Wait until the image is prepared and return it. To be called from the GUI thread:
+    /// the metadata are copied, and the images the worker cannot read are prepared, here.
+    PreparedImage result();
+
+    /// The image is not needed anymore: the job is deleted with its files, when it is done.
+    void release();
+
+private:
+
+    void removeFiles();
+
+private:
+
+    QString        m_saveDir;
+    QString        m_imagePath;
+    unsigned       m_maxDimension;
+    int            m_jpgQuality;
+
+    QMutex         m_mutex;
+    QWaitCondition m_done;
+    bool           m_finished;
+    bool           m_released;
+    bool           m_completed;
+    PreparedImage  m_result;
+};
+
+PrepareImageJob::PrepareImageJob(const QString& saveDir, const QString& imagePath,
+                                 unsigned maxDimension, int jpgQuality)
+    : m_saveDir(saveDir),
+      m_imagePath(imagePath),
+      m_maxDimension(maxDimension),
+      m_jpgQuality(jpgQuality),
+      m_finished(false),
+      m_released(false),
+      m_completed(false)
+{
+    // deleted by release() or by run(), see there.
+    setAutoDelete(false);
+}
+
+void PrepareImageJob::run()
+{
+    m_mutex.lock();
+    bool released = m_released;
+    m_mutex.unlock();
+
+    PreparedImage prepared;
 
-        if (iface)
+    if (!released)
+    {
+        QSize originalSize;
+        QImage image = loadScaledImage(m_imagePath, m_maxDimension, &originalSize);
+
+        // Else result() uses the host preview.
+        if (!image.isNull())
         {
-            // copy meta data to temporary image
-            QPointer<MetadataProcessor> meta = iface->createMetadataProcessor();
+            QDir().mkpath(m_saveDir);
+            prepared = _prepareImageForUpload(m_saveDir, image, m_imagePath, m_maxDimension, THUMB_SIZE,
+                                              m_jpgQuality, originalSize);
+        }
+    }
+
+    m_mutex.lock();
+    m_result   = prepared;
+    m_finished = true;
+    released   = m_released;
+    m_done.wakeAll();
+    m_mutex.unlock();
+
+    if (released)
+    {
+        removeFiles();
+        delete this;
+    }
+}
 
-            if (meta->load(QUrl::fromLocalFile(imagePath)))
+PreparedImage PrepareImageJob::result()
+{
+    QMutexLocker lock(&m_mutex);
+
+    while (!m_finished)
+    {
+        m_done.wait(&m_mutex);
+    }
+
+    if (!m_completed)
+    {
+        m_completed = true;
+
+        if (m_result.scaledImagePath.isEmpty())
+        {
+            // Format not read by QImageReader, for ex. RAW files.
+            QImage image;
+            PluginLoader* const pl = PluginLoader::instance();
+            Interface* const iface = pl ? pl->interface() : 0;
+
+            if (iface)
+            {
+                image = iface->preview(QUrl::fromLocalFile(m_imagePath));
+            }
+
+            if (image.isNull())
             {
-                meta->setImageDimensions(image.size());
-                meta->setImageOrientation(MetadataProcessor::NORMAL);
-                meta->setImageProgramId(QString::fromLatin1("Kipi-plugins"), kipipluginsVersion());
-                meta->save(QUrl::fromLocalFile(ret.scaledImagePath), true);
+                qCDebug(KIPIPLUGINS_LOG) << "Could not read in an image from " << m_imagePath << ". Adding the photo will not work.";
             }
+            else
+            {
+                QDir().mkpath(m_saveDir);
+                m_result = _prepareImageForUpload(m_saveDir, image, m_imagePath, m_maxDimension, THUMB_SIZE, m_jpgQuality);
+            }
+        }
+
+        if (!m_result.scaledImagePath.isEmpty())
+        {
+            _copyMetadata(m_imagePath, m_result);
         }
     }
 
-    return ret;
+    return m_result;
+}
+
+void PrepareImageJob::release()
+{
+    m_mutex.lock();
+    m_released    = true;
+    bool finished = m_finished;
+    m_mutex.unlock();
+
+    if (finished)
+    {
+        removeFiles();
+        delete this;
+    }
 }
 
+void PrepareImageJob::removeFiles()
+{
+    if (!m_result.scaledImagePath.isEmpty())
+    {
+        QFile::remove(m_result.thumbPath);
+        QFile::remove(m_result.scaledImagePath);
+    }
+
+    QDir().rmdir(m_saveDir);
+}
+
+// -----------------------------------------------------------------------
+
 /// Commands definitions
 
 class RajceCommand
@@ -121,7 +297,7 @@ public:
 
     QString getXml() const;
 
-    void processResponse(const QString& response, SessionState& state);
+    void processResponse(const QByteArray& response, SessionState& state);
 
     RajceCommandType commandType() const;
     virtual QByteArray encode()    const;
@@ -129,7 +305,16 @@ public:
 
 protected:
 
-    virtual void parseResponse(QXmlQuery& query, SessionState& state) = 0;
+    /** The simple values of the response, as text by element name: <response><name>text</name></response>.
+     */
+    typedef QMap<QString, QString> ResponseValues;
+
+    /** Read the child element of <response> the reader is on, if it is not a simple value, and
+     *  return true. The element must be read until its end. Return false to read it as a value.
+     */
+    virtual bool readElement(QXmlStreamReader& xml);
+
+    virtual void parseResponse(const ResponseValues& values, SessionState& state) = 0;
     virtual void cleanUpOnError(SessionState& state) = 0;
 
     QMap<QString, QString>& parameters() const; // allow modification in const methods for lazy init to be possible
@@ -139,7 +324,7 @@ protected:
 
 private:
 
-    bool _parseError(QXmlQuery& query, SessionState& state);
+    bool _parseError(const ResponseValues& values, SessionState& state);
 
 private:
 
@@ -158,7 +343,7 @@ public:
 
 protected:
 
-    void parseResponse(QXmlQuery& response, SessionState& state) Q_DECL_OVERRIDE;
+    void parseResponse(const ResponseValues& values, SessionState& state) Q_DECL_OVERRIDE;
     void cleanUpOnError(SessionState& state) Q_DECL_OVERRIDE;
 };
 
@@ -172,7 +357,7 @@ public:
 
 protected:
 
-    void parseResponse(QXmlQuery& response, SessionState& state) Q_DECL_OVERRIDE;
+    void parseResponse(const ResponseValues& values, SessionState& state) Q_DECL_OVERRIDE;
     void cleanUpOnError(SessionState& state) Q_DECL_OVERRIDE;
 };
 
@@ -186,7 +371,7 @@ public:
 
 protected:
 
-    void parseResponse(QXmlQuery& response, SessionState& state) Q_DECL_OVERRIDE;
+    void parseResponse(const ResponseValues& values, SessionState& state) Q_DECL_OVERRIDE;
     void cleanUpOnError(SessionState& state) Q_DECL_OVERRIDE;
 };
 
@@ -200,7 +385,7 @@ public:
 
 protected:
 
-    void parseResponse(QXmlQuery& response, SessionState& state) Q_DECL_OVERRIDE;
+    void parseResponse(const ResponseValues& values, SessionState& state) Q_DECL_OVERRIDE;
     void cleanUpOnError(SessionState& state) Q_DECL_OVERRIDE;
 };
 
@@ -214,8 +399,17 @@ public:
 
 protected:
 
-    void parseResponse(QXmlQuery& response, SessionState& state) Q_DECL_OVERRIDE;
+    bool readElement(QXmlStreamReader& xml) Q_DECL_OVERRIDE;
+    void parseResponse(const ResponseValues& values, SessionState& state) Q_DECL_OVERRIDE;
     void cleanUpOnError(SessionState& state) Q_DECL_OVERRIDE;
+
+private:
+
+    Album readAlbum(QXmlStreamReader& xml) const;
+
+private:
+
+    QVector<Album> m_albums;
 };
 
 // -----------------------------------------------------------------------
@@ -227,28 +421,35 @@ public:
     AddPhotoCommand(const QString& tmpDir, const QString& path, unsigned dimension, int jpgQuality, const SessionState& state);
     virtual ~AddPhotoCommand();
 
+    /// Start to prepare the image on a worker thread, if not done yet.
+    void prepare();
+
     QByteArray encode() const Q_DECL_OVERRIDE;
     QString    contentType() const Q_DECL_OVERRIDE;
 
 protected:
 
     void    cleanUpOnError(KIPIRajcePlugin::SessionState& state) Q_DECL_OVERRIDE;
-    void    parseResponse(QXmlQuery& query, KIPIRajcePlugin::SessionState& state) Q_DECL_OVERRIDE;
+    void    parseResponse(const ResponseValues& values, KIPIRajcePlugin::SessionState& state) Q_DECL_OVERRIDE;
     QString additionalXml() const Q_DECL_OVERRIDE;
 
 private:
 
-    int        m_jpgQuality;
+    PreparedImage prepared() const;
 
-    unsigned   m_desiredDimension;
-    unsigned   m_maxDimension;
+private:
+
+    int              m_jpgQuality;
 
-    QString    m_tmpDir;
-    QString    m_imagePath;
+    unsigned         m_desiredDimension;
+    unsigned         m_maxDimension;
 
-    QImage     m_image;
+    QString          m_tmpDir;
+    QString          m_imagePath;
 
-    MPForm*    m_form;
+    PrepareImageJob* m_job;
+
+    MPForm*          m_form;
 };
 
 /// Commands impls
@@ -290,19 +491,14 @@ QString RajceCommand::getXml() const
     return ret;
 }
 
-bool RajceCommand::_parseError(QXmlQuery& query, SessionState& state)
+bool RajceCommand::_parseError(const ResponseValues& values, SessionState& state)
 {
-    QString results;
-
-    query.setQuery(QString::fromLatin1("/response/string(errorCode)"));
-    query.evaluateTo(&results);
+    const QString errorCode = values.value(QString::fromLatin1("errorCode"));
 
-    if (results.trimmed().length() > 0)
+    if (errorCode.trimmed().length() > 0)
     {
-        state.lastErrorCode()    = results.toUInt();
-        query.setQuery(QString::fromLatin1("/response/string(result)"));
-        query.evaluateTo(&results);
-        state.lastErrorMessage() = results.trimmed();
+        state.lastErrorCode()    = errorCode.trimmed().toUInt();
+        state.lastErrorMessage() = values.value(QString::fromLatin1("result")).trimmed();
 
         return true;
     }
@@ -310,20 +506,45 @@ bool RajceCommand::_parseError(QXmlQuery& query, SessionState& state)
     return false;
 }
 
-void RajceCommand::processResponse(const QString& response, SessionState& state)
+bool RajceCommand::readElement(QXmlStreamReader&)
+{
+    return false;
+}
+
+void RajceCommand::processResponse(const QByteArray& response, SessionState& state)
 {
-    QXmlQuery q;
-    q.setFocus(response);
+    QXmlStreamReader xml(response);
+    ResponseValues   values;
+
+    if (xml.readNextStartElement() && xml.name() == QLatin1String("response"))
+    {
+        while (xml.readNextStartElement())
+        {
+            if (readElement(xml))
+                continue;
+
+            const QString name = xml.name().toString();
+            const QString text = xml.readElementText(QXmlStreamReader::IncludeChildElements);
+
+            if (!values.contains(name))
+                values.insert(name, text);
+        }
+    }
+
+    if (xml.hasError())
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "Invalid response at line" << xml.lineNumber() << ":" << xml.errorString();
+    }
 
     state.lastCommand() = m_commandType;
 
-    if (_parseError(q, state))
+    if (_parseError(values, state))
     {
         cleanUpOnError(state);
     }
     else
     {
-        parseResponse(q, state);
+        parseResponse(values, state);
     }
 }
 
@@ -359,16 +580,9 @@ OpenAlbumCommand::OpenAlbumCommand(unsigned albumId, const SessionState& state)
     parameters()[QString::fromLatin1("albumID")] = QString::number(albumId);
 }
 
-void OpenAlbumCommand::parseResponse(QXmlQuery& q, SessionState& state)
+void OpenAlbumCommand::parseResponse(const ResponseValues& values, SessionState& state)
 {
-    state.openAlbumToken() = QString();
-
-    QString result;
-
-    q.setQuery(QString::fromLatin1("/response/data(albumToken)"));
-    q.evaluateTo(&result);
-
-    state.openAlbumToken() = result.trimmed();
+    state.openAlbumToken() = values.value(QString::fromLatin1("albumToken")).trimmed();
 }
 
 void OpenAlbumCommand::cleanUpOnError(SessionState& state)
@@ -386,30 +600,13 @@ LoginCommand::LoginCommand(const QString& username, const QString& password)
         QCryptographicHash::hash(password.toUtf8(), QCryptographicHash::Md5).toHex());
 }
 
-void LoginCommand::parseResponse(QXmlQuery& q, SessionState& state)
+void LoginCommand::parseResponse(const ResponseValues& values, SessionState& state)
 {
-    QString results;
-
-    q.setQuery(QString::fromLatin1("/response/string(maxWidth)"));
-    q.evaluateTo(&results);
-    state.maxWidth()     = results.toUInt();
-
-    q.setQuery(QString::fromLatin1("/response/string(maxHeight)"));
-    q.evaluateTo(&results);
-    state.maxHeight()    = results.toUInt();
-
-    q.setQuery(QString::fromLatin1("/response/string(quality)"));
-    q.evaluateTo(&results);
-    state.imageQuality() = results.toUInt();
-
-    q.setQuery(QString::fromLatin1("/response/string(nick)"));
-    q.evaluateTo(&results);
-    state.nickname()     = results.trimmed();
-
-    q.setQuery(QString::fromLatin1("data(/response/sessionToken)"));
-    q.evaluateTo(&results);
-    state.sessionToken() = results.trimmed();
-
+    state.maxWidth()     = values.value(QString::fromLatin1("maxWidth")).trimmed().toUInt();
+    state.maxHeight()    = values.value(QString::fromLatin1("maxHeight")).trimmed().toUInt();
+    state.imageQuality() = values.value(QString::fromLatin1("quality")).trimmed().toUInt();
+    state.nickname()     = values.value(QString::fromLatin1("nick")).trimmed();
+    state.sessionToken() = values.value(QString::fromLatin1("sessionToken")).trimmed();
     state.username()     = parameters()[QString::fromLatin1("login")];
 }
 
@@ -437,7 +634,7 @@ CreateAlbumCommand::CreateAlbumCommand(const QString& name, const QString& descr
     parameters()[QString::fromLatin1("albumVisible")]     = visible ? QString::fromLatin1("1") : QString::fromLatin1("0");
 }
 
-void CreateAlbumCommand::parseResponse(QXmlQuery&, SessionState&)
+void CreateAlbumCommand::parseResponse(const ResponseValues&, SessionState&)
 {
 }
 
@@ -445,7 +642,7 @@ void CreateAlbumCommand::cleanUpOnError(SessionState&)
 {
 }
 
-void CloseAlbumCommand::parseResponse(QXmlQuery&, SessionState&)
+void CloseAlbumCommand::parseResponse(const ResponseValues&, SessionState&)
 {
 }
 
@@ -470,83 +667,77 @@ AlbumListCommand::AlbumListCommand(const SessionState& state)
     parameters()[QString::fromLatin1("token")] = state.sessionToken();
 }
 
-void AlbumListCommand::parseResponse(QXmlQuery& q, SessionState& state)
+bool AlbumListCommand::readElement(QXmlStreamReader& xml)
 {
-    state.albums().clear();
+    if (xml.name() != QLatin1String("albums"))
+        return false;
 
-    QXmlResultItems results;
-
-    q.setQuery(QString::fromLatin1("/response/albums/album"));
-    q.evaluateTo(&results);
-
-    QXmlItem item(results.next());
-
-    while(!item.isNull())
+    while (xml.readNextStartElement())
     {
-        q.setFocus(item);
-        Album album;
-        QString detail;
+        if (xml.name() == QLatin1String("album"))
+            m_albums.append(readAlbum(xml));
+        else
+            xml.skipCurrentElement();
+    }
 
-        q.setQuery(QString::fromLatin1("data(./@id)"));
-        q.evaluateTo(&detail);
-        album.id          = detail.toUInt();
+    return true;
+}
 
-        q.setQuery(QString::fromLatin1("data(./albumName)"));
-        q.evaluateTo(&detail);
-        album.name        = detail.trimmed();
+Album AlbumListCommand::readAlbum(QXmlStreamReader& xml) const
+{
+    Album album;
+    album.id = xml.attributes().value(QLatin1String("id")).toString().toUInt();
 
-        q.setQuery(QString::fromLatin1("data(./description)"));
-        q.evaluateTo(&detail);
-        album.description = detail.trimmed();
+    ResponseValues details;
 
-        q.setQuery(QString::fromLatin1("data(./url)"));
-        q.evaluateTo(&detail);
-        album.url         = detail.trimmed();
+    while (xml.readNextStartElement())
+    {
+        const QString name = xml.name().toString();
+        const QString text = xml.readElementText(QXmlStreamReader::IncludeChildElements);
 
-        q.setQuery(QString::fromLatin1("data(./thumbUrl)"));
-        q.evaluateTo(&detail);
-        album.thumbUrl    = detail.trimmed();
+        if (!details.contains(name))
+            details.insert(name, text);
+    }
 
-        q.setQuery(QString::fromLatin1("data(./createDate)"));
-        q.evaluateTo(&detail);
-        album.createDate  = QDateTime::fromString(detail.trimmed(), QString::fromLatin1("yyyy-MM-dd hh:mm:ss"));
+    const QString dateFormat = QString::fromLatin1("yyyy-MM-dd hh:mm:ss");
+    QString detail;
 
-        qCDebug(KIPIPLUGINS_LOG) << "Create date: " << detail.trimmed() << " = " << QDateTime::fromString(detail.trimmed(), QString::fromLatin1("yyyy-MM-dd hh:mm:ss"));
+    album.name        = details.value(QString::fromLatin1("albumName")).trimmed();
+    album.description = details.value(QString::fromLatin1("description")).trimmed();
+    album.url         = details.value(QString::fromLatin1("url")).trimmed();
+    album.thumbUrl    = details.value(QString::fromLatin1("thumbUrl")).trimmed();
 
-        q.setQuery(QString::fromLatin1("data(./updateDate)"));
-        q.evaluateTo(&detail);
-        album.updateDate  = QDateTime::fromString(detail.trimmed(), QString::fromLatin1("yyyy-MM-dd hh:mm:ss"));
+    detail            = details.value(QString::fromLatin1("createDate")).trimmed();
+    album.createDate  = QDateTime::fromString(detail, dateFormat);
 
-        q.evaluateTo(&detail);
-        album.isHidden    = detail.toUInt() != 0;
+    qCDebug(KIPIPLUGINS_LOG) << "Create date: " << detail << " = " << album.createDate;
 
-        q.setQuery(QString::fromLatin1("data(./secure)"));
-        q.evaluateTo(&detail);
-        album.isSecure    = detail.toUInt() != 0;
+    album.updateDate  = QDateTime::fromString(details.value(QString::fromLatin1("updateDate")).trimmed(), dateFormat);
+    album.isHidden    = details.value(QString::fromLatin1("hidden")).trimmed().toUInt() != 0;
+    album.isSecure    = details.value(QString::fromLatin1("secure")).trimmed().toUInt() != 0;
 
-        q.setQuery(QString::fromLatin1("data(./startDateInterval)"));
-        q.evaluateTo(&detail);
+    detail = details.value(QString::fromLatin1("startDateInterval"));
 
-        if (detail.trimmed().length() > 0)
-        {
-            album.validFrom = QDateTime::fromString(detail, QString::fromLatin1("yyyy-MM-dd hh:mm:ss"));
-        }
+    if (detail.trimmed().length() > 0)
+    {
+        album.validFrom = QDateTime::fromString(detail, dateFormat);
+    }
 
-        q.setQuery(QString::fromLatin1("data(./endDateInterval)"));
-        q.evaluateTo(&detail);
+    detail = details.value(QString::fromLatin1("endDateInterval"));
 
-        if (detail.trimmed().length() > 0)
-        {
-            album.validTo = QDateTime::fromString(detail, QString::fromLatin1("yyyy-MM-dd hh:mm:ss"));
-        }
+    if (detail.trimmed().length() > 0)
+    {
+        album.validTo = QDateTime::fromString(detail, dateFormat);
+    }
 
-        q.setQuery(QString::fromLatin1("data(./thumbUrlBest)"));
-        q.evaluateTo(&detail);
-        album.bestQualityThumbUrl = detail.trimmed();
+    album.bestQualityThumbUrl = details.value(QString::fromLatin1("thumbUrlBest")).trimmed();
 
-        state.albums().append(album);
-        item = results.next();
-    }
+    return album;
+}
+
+void AlbumListCommand::parseResponse(const ResponseValues&, SessionState& state)
+{
+    state.albums() = m_albums;
 }
 
 void AlbumListCommand::cleanUpOnError(SessionState& state)
@@ -564,31 +755,9 @@ AddPhotoCommand::AddPhotoCommand(const QString& tmpDir, const QString& path, uns
       m_maxDimension(0),
       m_tmpDir(tmpDir),
       m_imagePath(path),
+      m_job(0),
       m_form(0)
 {
-    PluginLoader* const pl = PluginLoader::instance();
-
-    if (pl)
-    {
-        Interface* const iface = pl->interface();
-
-        if (iface)
-        {
-            m_image = iface->preview(QUrl::fromLocalFile(path));
-        }
-    }
-
-    if (m_image.isNull())
-    {
-        m_image.load(path);
-    }
-
-    if (m_image.isNull())
-    {
-        qCDebug(KIPIPLUGINS_LOG) << "Could not read in an image from " << path << ". Adding the photo will not work.";
-        return;
-    }
-
     m_maxDimension                                  = (state.maxHeight() > state.maxWidth()) ? state.maxWidth()
                                                                                              : state.maxHeight();
     parameters()[QString::fromLatin1("token")]      = state.sessionToken();
@@ -598,20 +767,44 @@ AddPhotoCommand::AddPhotoCommand(const QString& tmpDir, const QString& path, uns
 
 AddPhotoCommand::~AddPhotoCommand()
 {
+    if (m_job)
+    {
+        m_job->release();
+    }
+
     delete m_form;
 }
 
+void AddPhotoCommand::prepare()
+{
+    if (!m_job)
+    {
+        m_job = new PrepareImageJob(m_tmpDir, m_imagePath, m_desiredDimension, m_jpgQuality);
+        QThreadPool::globalInstance()->start(m_job);
+    }
+}
+
+PreparedImage AddPhotoCommand::prepared() const
+{
+    // Normally started when the command is queued, see RajceSession::_prepareAhead().
+    const_cast<AddPhotoCommand*>(this)->prepare();
+
+    return m_job->result();
+}
+
 void AddPhotoCommand::cleanUpOnError(KIPIRajcePlugin::SessionState&)
 {
 }
 
-void AddPhotoCommand::parseResponse(QXmlQuery&, KIPIRajcePlugin::SessionState&)
+void AddPhotoCommand::parseResponse(const ResponseValues&, KIPIRajcePlugin::SessionState&)
 {
 }
 
 QString AddPhotoCommand::additionalXml() const
 {
-    if (m_image.isNull())
+    const PreparedImage image = prepared();
+
+    if (image.scaledImagePath.isEmpty())
     {
         return QString();
     }
@@ -623,8 +816,8 @@ QString AddPhotoCommand::additionalXml() const
     metadata[QString::fromLatin1("OriginalFileName")]      = f.fileName();
     metadata[QString::fromLatin1("OriginalFileExtension")] = QString::fromLatin1(".") + f.suffix();
     metadata[QString::fromLatin1("PerceivedType")]         = QString::fromLatin1("image"); //what are the other values here? video?
-    metadata[QString::fromLatin1("OriginalWidth")]         = QString::number(m_image.width());
-    metadata[QString::fromLatin1("OriginalHeight")]        = QString::number(m_image.height());
+    metadata[QString::fromLatin1("OriginalWidth")]         = QString::number(image.originalSize.width());
+    metadata[QString::fromLatin1("OriginalHeight")]        = QString::number(image.originalSize.height());
     metadata[QString::fromLatin1("LengthMS")]              = QLatin1Char('0');
     metadata[QString::fromLatin1("FileSize")]              = QString::number(f.size());
 
@@ -669,23 +862,17 @@ QString AddPhotoCommand::contentType() const
 
 QByteArray AddPhotoCommand::encode() const
 {
-    if (m_image.isNull())
+    const PreparedImage image = prepared();
+
+    if (image.scaledImagePath.isEmpty())
     {
         qCDebug(KIPIPLUGINS_LOG) << m_imagePath << " could not be read, no data will be sent.";
         return QByteArray();
     }
 
-    PreparedImage prepared                      = _prepareImageForUpload(m_tmpDir,
-                                                                         m_image,
-                                                                         m_imagePath,
-                                                                         m_desiredDimension,
-                                                                         THUMB_SIZE,
-                                                                         m_jpgQuality);
-
     //add the rest of the parameters to be encoded as xml
-    QImage scaled(prepared.scaledImagePath);
-    parameters()[QString::fromLatin1("width")]  = QString::number(scaled.width());
-    parameters()[QString::fromLatin1("height")] = QString::number(scaled.height());
+    parameters()[QString::fromLatin1("width")]  = QString::number(image.scaledSize.width());
+    parameters()[QString::fromLatin1("height")] = QString::number(image.scaledSize.height());
     QString xml                                 = getXml();
 
     qCDebug(KIPIPLUGINS_LOG) << "Really sending:\n" << xml;
@@ -695,11 +882,11 @@ QByteArray AddPhotoCommand::encode() const
 
     m_form->addPair(QString::fromLatin1("data"), xml);
 
-    m_form->addFile(QString::fromLatin1("thumb"), prepared.thumbPath);
-    m_form->addFile(QString::fromLatin1("photo"), prepared.scaledImagePath);
+    m_form->addFile(QString::fromLatin1("thumb"), image.thumbPath);
+    m_form->addFile(QString::fromLatin1("photo"), image.scaledImagePath);
 
-    QFile::remove(prepared.thumbPath);
-    QFile::remove(prepared.scaledImagePath);
+    QFile::remove(image.thumbPath);
+    QFile::remove(image.scaledImagePath);
 
     m_form->finish();
 
@@ -714,8 +901,8 @@ RajceSession::RajceSession(QWidget* const parent, const QString& tmpDir)
     : QObject(parent),
       m_queueAccess(QMutex::Recursive),
       m_tmpDir(tmpDir),
-      m_netMngr(0),
-      m_reply(0)
+      m_uploadCount(0),
+      m_netMngr(0)
 {
     m_netMngr = new QNetworkAccessManager(this);
 
@@ -737,14 +924,101 @@ void RajceSession::_startJob(RajceCommand* command)
     QNetworkRequest netRequest(RAJCE_URL);
     netRequest.setHeader(QNetworkRequest::ContentTypeHeader, command->contentType());
 
-    m_reply = m_netMngr->post(netRequest, data);
+    QNetworkReply* const reply = m_netMngr->post(netRequest, data);
+    m_running.insert(command, reply);
 
-    connect(m_reply, SIGNAL(uploadProgress(qint64,qint64)),
+    connect(reply, SIGNAL(uploadProgress(qint64,qint64)),
             SLOT(slotUploadProgress(qint64,qint64)));
 
     emit busyStarted(command->commandType());
 }
 
+void RajceSession::_startJobs()
+{
+    if (m_commandQueue.isEmpty())
+    {
+        return;
+    }
+
+    // Start to prepare the next photos before waiting for the ones sent now.
+    _prepareAhead();
+
+    RajceCommand* const head = m_commandQueue.head();
+
+    if (!m_running.contains(head))
+    {
+        _startJob(head);
+    }
+
+    // The photos queued after the current one are sent to the open album with it,
+    // the other commands are sent one at a time.
+    if (head->commandType() == AddPhoto)
+    {
+        for (int i = 1 ; i < m_commandQueue.size() && i < MAX_PARALLEL_UPLOADS ; ++i)
+        {
+            RajceCommand* const command = m_commandQueue.at(i);
+
+            if (command->commandType() != AddPhoto)
+            {
+                break;
+            }
+
+            if (!m_running.contains(command))
+            {
+                _startJob(command);
+            }
+        }
+    }
+}
+
+void RajceSession::_prepareAhead()
+{
+    const int ahead = MAX_PARALLEL_UPLOADS + QThread::idealThreadCount();
+    int count       = 0;
+
+    foreach(RajceCommand* const command, m_commandQueue)
+    {
+        if (command->commandType() != AddPhoto)
+        {
+            continue;
+        }
+
+        static_cast<AddPhotoCommand*>(command)->prepare();
+
+        if (++count >= ahead)
+        {
+            break;
+        }
+    }
+}
+
+void RajceSession::_finishCurrentJob()
+{
+    RajceCommand* const c      = m_commandQueue.dequeue();
+    QNetworkReply* const reply = m_running.take(c);
+    QByteArray response        = reply->readAll();
+
+    qCDebug(KIPIPLUGINS_LOG) << response;
+
+    c->processResponse(response, m_state);
+
+    RajceCommandType type = c->commandType();
+
+    delete c;
+    reply->deleteLater();
+
+    qCDebug(KIPIPLUGINS_LOG) << "State after command: " << m_state;
+
+    // Let the users react on the command before the
+    // following responses are processed.
+    // This enables the connected slots to read in
+    // reliable values from the state and/or
+    // clear the error state once it's handled.
+    // Commands queued from there are started
+    // once the current one is handled.
+    emit busyFinished(type);
+}
+
 void RajceSession::login(const QString& username, const QString& password)
 {
     LoginCommand* const command = new LoginCommand(username, password);
@@ -765,50 +1039,29 @@ void RajceSession::createAlbum(const QString& name, const QString& description,
 
 void RajceSession::slotFinished(QNetworkReply* reply)
 {
-    if (reply != m_reply)
+    if (!m_running.key(reply))
     {
         return;
     }
 
-    QString response      = QString::fromUtf8(reply->readAll());
-
-    qCDebug(KIPIPLUGINS_LOG) << response;
-
     m_queueAccess.lock();
 
-    RajceCommand* const c = m_commandQueue.head();
-    m_reply               = 0;
-
-    c->processResponse(response, m_state);
-
-    RajceCommandType type = c->commandType();
-
-    delete c;
-
-    qCDebug(KIPIPLUGINS_LOG) << "State after command: " << m_state;
-
-    // Let the users react on the command before we
-    // let the next queued command in.
-    // This enables the connected slots to read in
-    // reliable values from the state and/or
-    // clear the error state once it's handled.
-    emit busyFinished(type);
+    // Responses are processed in the order the commands were queued:
+    // a photo sent faster than the ones before waits for them.
+    while (!m_commandQueue.isEmpty())
+    {
+        QNetworkReply* const current = m_running.value(m_commandQueue.head());
 
-    reply->deleteLater();
+        if (!current || !current->isFinished())
+        {
+            break;
+        }
 
-    // Only dequeue the command after the above signal has been
-    // emitted so that the users can queue other commands
-    // without them being started straight away in the enqueue
-    // method which would happen if the command was dequed
-    // before the signal and the signal was emitted in the same
-    // thread (which is the case (always?)).
-    m_commandQueue.dequeue();
+        _finishCurrentJob();
+    }
 
     // see if there's something to continue with
-    if (m_commandQueue.size() > 0)
-    {
-        _startJob(m_commandQueue.head());
-    }
+    _startJobs();
 
     m_queueAccess.unlock();
 }
@@ -839,7 +1092,9 @@ void RajceSession::closeAlbum()
 
 void RajceSession::uploadPhoto(const QString& path, unsigned dimension, int jpgQuality)
 {
-    AddPhotoCommand* const command = new AddPhotoCommand(m_tmpDir, path, dimension, jpgQuality, m_state);
+    // Each photo is prepared in its own folder, as several ones are prepared at the same time.
+    QString tmpDir                 = m_tmpDir + QString::number(++m_uploadCount) + QLatin1Char('/');
+    AddPhotoCommand* const command = new AddPhotoCommand(tmpDir, path, dimension, jpgQuality, m_state);
     _enqueue(command);
 }
 
@@ -856,6 +1111,12 @@ void RajceSession::slotUploadProgress(qint64 bytesSent, qint64 bytesTotal)
         return;
     }
 
+    // Only the progress of the first photo sent is reported.
+    if (m_commandQueue.isEmpty() || sender() != m_running.value(m_commandQueue.head()))
+    {
+        return;
+    }
+
     unsigned percent = (unsigned)((float)bytesSent / bytesTotal * 100);
 
     qCDebug(KIPIPLUGINS_LOG) << "Percent signalled: " << percent;
@@ -872,23 +1133,46 @@ void RajceSession::_enqueue(RajceCommand* command)
 
     m_queueAccess.lock();
     m_commandQueue.enqueue(command);
-
-    if (m_commandQueue.size() == 1)
-    {
-        _startJob(command);
-    }
-
+    _startJobs();
     m_queueAccess.unlock();
 }
 
 void RajceSession::cancelCurrentCommand()
 {
-    if (m_reply != 0)
+    m_queueAccess.lock();
+
+    if (m_commandQueue.isEmpty() || !m_running.contains(m_commandQueue.head()))
+    {
+        m_queueAccess.unlock();
+        return;
+    }
+
+    // The photos queued with the current one are cancelled with it.
+    if (m_commandQueue.head()->commandType() == AddPhoto)
     {
-        slotFinished(m_reply);
-        m_reply->abort();
-        m_reply = 0;
+        while (m_commandQueue.size() > 1 && m_commandQueue.at(1)->commandType() == AddPhoto)
+        {
+            RajceCommand* const command = m_commandQueue.takeAt(1);
+            QNetworkReply* const reply  = m_running.take(command);
+
+            if (reply)
+            {
+                reply->abort();
+                reply->deleteLater();
+            }
+
+            delete command;
+        }
     }
+
+    QNetworkReply* const reply = m_running.value(m_commandQueue.head());
+
+    _finishCurrentJob();
+    reply->abort();
+
+    _startJobs();
+
+    m_queueAccess.unlock();
 }
 
 void RajceSession::init(const KIPIRajcePlugin::SessionState& initialState)
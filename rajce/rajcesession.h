@@ -28,6 +28,7 @@
 #include <QObject>
 #include <QMutex>
 #include <QQueue>
+#include <QHash>
 #include <QNetworkReply>
 #include <QNetworkAccessManager>
 
@@ -79,6 +80,9 @@ private Q_SLOTS:
 private:
 
     void _startJob(RajceCommand*);
+    void _startJobs();
+    void _prepareAhead();
+    void _finishCurrentJob();
     void _enqueue(RajceCommand*);
 
 private:
@@ -86,9 +90,12 @@ private:
     QQueue<RajceCommand*>  m_commandQueue;
     QMutex                 m_queueAccess;
     QString                m_tmpDir;
+    unsigned               m_uploadCount;
 
     QNetworkAccessManager* m_netMngr;
-    QNetworkReply*         m_reply;
+
+    /// The commands sent, with their reply, until the response is processed.
+    QHash<RajceCommand*, QNetworkReply*> m_running;
 
     SessionState           m_state;
 };
@@ -221,7 +221,7 @@ void RajceWidget::progressChange(unsigned /*commandType*/, unsigned int percent)
 {
     if (m_uploadingPhotos)
     {
-        unsigned idx  = m_currentUploadImage - m_uploadQueue.begin() - 1;
+        unsigned idx  = m_currentUploadImage - m_uploadQueue.begin();
         float perc    = (float)idx / m_uploadQueue.size();
         perc         += (float)percent / 100 / m_uploadQueue.size();
         percent       = perc * 100;
@@ -234,7 +234,7 @@ void RajceWidget::progressFinished(unsigned)
 {
     if (m_uploadingPhotos)
     {
-        unsigned idx = m_currentUploadImage - m_uploadQueue.begin();
+        unsigned idx = m_currentUploadImage - m_uploadQueue.begin() + 1;
         float perc   = (float)idx / m_uploadQueue.size();
 
         m_progressBar->setValue(perc * 100);
@@ -379,7 +379,17 @@ void RajceWidget::startUploadAfterAlbumOpened()
     m_progressBar->setValue(0);
     progressStarted(AddPhoto);
     m_currentUploadImage = m_uploadQueue.begin();
-    uploadNext();
+    m_imgList->processing(QUrl::fromLocalFile(*m_currentUploadImage));
+
+    unsigned dimension   = m_dimensionSpB->value();
+    int jpgQuality       = m_imageQualitySpB->value();
+
+    // All photos are queued at once, so that the session prepares the next ones
+    // and sends several of them while the first ones are uploaded.
+    foreach(const QString& photo, m_uploadQueue)
+    {
+        m_session->uploadPhoto(photo, dimension, jpgQuality);
+    }
 }
 
 void RajceWidget::closeAlbum()
@@ -397,35 +407,23 @@ void RajceWidget::closeAlbum()
 
 void RajceWidget::uploadNext()
 {
-    QList<QString>::Iterator tmp = m_currentUploadImage;
+    bool success = (m_session->state().lastErrorCode() == 0);
+
+    m_imgList->processed(QUrl::fromLocalFile(*m_currentUploadImage), success);
+    ++m_currentUploadImage;
 
-    if (m_currentUploadImage == m_uploadQueue.end())
+    if (m_currentUploadImage == m_uploadQueue.end() || !success)
     {
-        m_imgList->processed(QUrl::fromLocalFile(*(--tmp)), (m_session->state().lastErrorCode() == 0));
         cancelUpload();
         return;
     }
 
-    if (m_currentUploadImage != m_uploadQueue.begin())
-    {
-        m_imgList->processed(QUrl::fromLocalFile(*(--tmp)), (m_session->state().lastErrorCode() == 0));
-    }
-
     m_imgList->processing(QUrl::fromLocalFile(*m_currentUploadImage));
-
-    QString currentPhoto = *m_currentUploadImage;
-    ++m_currentUploadImage;
-
-    unsigned dimension   = m_dimensionSpB->value();
-    int jpgQuality       = m_imageQualitySpB->value();
-
-    m_session->uploadPhoto(currentPhoto, dimension, jpgQuality);
 }
 
 void RajceWidget::cancelUpload()
 {
-    if (m_uploadingPhotos && m_currentUploadImage != m_uploadQueue.begin() &&
-        m_currentUploadImage != m_uploadQueue.end())
+    if (m_uploadingPhotos && m_currentUploadImage != m_uploadQueue.end())
     {
         m_imgList->processed(QUrl::fromLocalFile(*m_currentUploadImage), false);
     }
@@ -28,6 +28,8 @@
 #include <QVBoxLayout>
 #include <QLabel>
 #include <QApplication>
+#include <QCheckBox>
+#include <QComboBox>
 
 // KDE includes
 
@@ -72,11 +74,29 @@ KioExportWidget::KioExportWidget(QWidget* const parent)
     m_imageList->listView()->setWhatsThis(i18n("This is the list of images to upload "
                                                "to the specified target."));
 
+    // setup transfer options
+    KPHBox* const syncBox    = new KPHBox(this);
+    QLabel* const syncLabel  = new QLabel(i18n("Existing files: "), syncBox);
+    m_syncModeCombo          = new QComboBox(syncBox);
+    m_syncModeCombo->addItem(i18n("Copy all images"),                         KioTransfer::CopyAll);
+    m_syncModeCombo->addItem(i18n("Skip images of same size and date"),       KioTransfer::SizeAndDate);
+    m_syncModeCombo->addItem(i18n("Skip images of same size and checksum"),   KioTransfer::Checksum);
+    m_syncModeCombo->setWhatsThis(i18n("Sets how images already in the target are handled. "
+                                       "Unchanged images can be skipped, and the other ones are "
+                                       "copied several at a time, replacing the target files."));
+    syncLabel->setBuddy(m_syncModeCombo);
+
+    m_verifyCheckBox = new QCheckBox(i18n("Verify copied images"), this);
+    m_verifyCheckBox->setWhatsThis(i18n("Reads back each copied image and compares its checksum "
+                                        "with the one of the original."));
+
     // layout dialog
     QVBoxLayout* const layout = new QVBoxLayout(this);
 
     layout->addWidget(hbox);
     layout->addWidget(m_targetSearchButton);
+    layout->addWidget(syncBox);
+    layout->addWidget(m_verifyCheckBox);
     layout->addWidget(m_imageList);
     layout->setSpacing(QApplication::style()->pixelMetric(QStyle::PM_DefaultLayoutSpacing));
     layout->setContentsMargins(QMargins());
@@ -89,9 +109,13 @@ KioExportWidget::KioExportWidget(QWidget* const parent)
     connect(m_targetLabel, SIGNAL(textChanged(QString)),
             this, SLOT(slotLabelUrlChanged()));
 
+    connect(m_syncModeCombo, SIGNAL(currentIndexChanged(int)),
+            this, SLOT(slotSyncModeChanged()));
+
     // ------------------------------------------------------------------------
 
     updateTargetLabel();
+    slotSyncModeChanged();
 }
 
 KioExportWidget::~KioExportWidget()
@@ -161,6 +185,32 @@ void KioExportWidget::updateTargetLabel()
     }
 }
 
+KioTransfer::SyncMode KioExportWidget::syncMode() const
+{
+    return (KioTransfer::SyncMode)m_syncModeCombo->currentData().toInt();
+}
+
+void KioExportWidget::setSyncMode(KioTransfer::SyncMode mode)
+{
+    m_syncModeCombo->setCurrentIndex(qMax(0, m_syncModeCombo->findData(mode)));
+}
+
+bool KioExportWidget::verifyCopies() const
+{
+    return m_verifyCheckBox->isChecked();
+}
+
+void KioExportWidget::setVerifyCopies(bool verify)
+{
+    m_verifyCheckBox->setChecked(verify);
+}
+
+void KioExportWidget::slotSyncModeChanged()
+{
+    // Copying all images is left to a single KIO copy job, which asks about the existing files.
+    m_verifyCheckBox->setEnabled(syncMode() != KioTransfer::CopyAll);
+}
+
 KPImagesList* KioExportWidget::imagesList() const
 {
     return m_imageList;
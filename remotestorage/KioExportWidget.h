@@ -34,6 +34,13 @@
 
 #include <kurlrequester.h>
 
+// Local includes
+
+#include "KioTransfer.h"
+
+class QCheckBox;
+class QComboBox;
+
 namespace KIPIPlugins
 {
     class KPImagesList;
@@ -80,10 +87,23 @@ public:
     QList<QUrl> history() const;
     void setHistory(const QList<QUrl>& urls);
 
+    /**
+     * Returns how the files already in the target are handled.
+     */
+    KioTransfer::SyncMode syncMode() const;
+    void setSyncMode(KioTransfer::SyncMode mode);
+
+    /**
+     * Returns true if the copies have to be compared with their source.
+     */
+    bool verifyCopies() const;
+    void setVerifyCopies(bool verify);
+
 private Q_SLOTS:
 
     void slotLabelUrlChanged();
     void slotShowTargetDialogClicked(bool checked);
+    void slotSyncModeChanged();
 
 Q_SIGNALS:
 
@@ -100,6 +120,8 @@ private:
     QPushButton*        m_targetSearchButton;
     QUrl                m_targetUrl;
     KPImagesList*       m_imageList;
+    QComboBox*          m_syncModeCombo;
+    QCheckBox*          m_verifyCheckBox;
 };
 
 } // namespace KIPIRemoteStoragePlugin
@@ -45,6 +45,7 @@
 #include "kpversion.h"
 #include "kpimageslist.h"
 #include "KioExportWidget.h"
+#include "KioTransfer.h"
 
 namespace KIPIRemoteStoragePlugin
 {
@@ -52,11 +53,14 @@ namespace KIPIRemoteStoragePlugin
 const QString KioExportWindow::TARGET_URL_PROPERTY  = QString::fromLatin1("targetUrl");
 const QString KioExportWindow::HISTORY_URL_PROPERTY = QString::fromLatin1("historyUrls");
 const QString KioExportWindow::CONFIG_GROUP         = QString::fromLatin1("KioExport");
+const QString KioExportWindow::SYNC_MODE_PROPERTY   = QString::fromLatin1("syncMode");
+const QString KioExportWindow::VERIFY_PROPERTY      = QString::fromLatin1("verifyCopies");
 
 KioExportWindow::KioExportWindow(QWidget* const /*parent*/)
     : KPToolDialog(0)
 {
     m_exportWidget = new KioExportWidget(this);
+    m_transfer     = new KioTransfer(this);
     setMainWidget(m_exportWidget);
 
     // -- Window setup ------------------------------------------------------
@@ -79,6 +83,12 @@ KioExportWindow::KioExportWindow(QWidget* const /*parent*/)
     connect(m_exportWidget, SIGNAL(signalTargetUrlChanged(QUrl)),
             this, SLOT(slotTargetUrlChanged(QUrl)));
 
+    connect(m_transfer, SIGNAL(signalFileDone(QUrl, bool, QString)),
+            this, SLOT(slotTransferFileDone(QUrl, bool, QString)));
+
+    connect(m_transfer, SIGNAL(signalFinished()),
+            this, SLOT(slotTransferFinished()));
+
     // -- About data and help button ----------------------------------------
 
     KPAboutData* const about = new KPAboutData(ki18n("Export to remote storage"),
@@ -132,6 +142,8 @@ void KioExportWindow::restoreSettings()
     KConfigGroup group  = config.group(CONFIG_GROUP);
     m_exportWidget->setHistory(group.readEntry(HISTORY_URL_PROPERTY, QList<QUrl>()));
     m_exportWidget->setTargetUrl(group.readEntry(TARGET_URL_PROPERTY, QUrl()));
+    m_exportWidget->setSyncMode((KioTransfer::SyncMode)group.readEntry(SYNC_MODE_PROPERTY, (int)KioTransfer::CopyAll));
+    m_exportWidget->setVerifyCopies(group.readEntry(VERIFY_PROPERTY, false));
 
     winId();
     KConfigGroup group2 = config.group(QString::fromLatin1("Kio Export Dialog"));
@@ -146,6 +158,8 @@ void KioExportWindow::saveSettings()
     KConfigGroup group = config.group(CONFIG_GROUP);
     group.writeEntry(HISTORY_URL_PROPERTY, m_exportWidget->history());
     group.writeEntry(TARGET_URL_PROPERTY,  m_exportWidget->targetUrl().url());
+    group.writeEntry(SYNC_MODE_PROPERTY,   (int)m_exportWidget->syncMode());
+    group.writeEntry(VERIFY_PROPERTY,      m_exportWidget->verifyCopies());
 
     KConfigGroup group2 = config.group(QString::fromLatin1("Kio Export Dialog"));
     KWindowConfig::saveWindowSize(windowHandle(), group2);
@@ -202,12 +216,41 @@ void KioExportWindow::slotCopyingFinished(KJob* job)
     }
 }
 
+void KioExportWindow::slotTransferFileDone(const QUrl& source, bool copied, const QString& errMsg)
+{
+    if (!errMsg.isEmpty())
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "cannot copy " << source.toDisplayString() << ": " << errMsg;
+        m_exportWidget->imagesList()->processed(source, false);
+        return;
+    }
+
+    qCDebug(KIPIPLUGINS_LOG) << (copied ? "copied " : "unchanged ") << source.toDisplayString();
+
+    m_exportWidget->imagesList()->removeItemByUrl(source);
+}
+
+void KioExportWindow::slotTransferFinished()
+{
+    slotCopyingFinished(0);
+}
+
 void KioExportWindow::slotUpload()
 {
     saveSettings();
 
     // start copying and react on signals
     setEnabled(false);
+
+    if (m_exportWidget->syncMode() != KioTransfer::CopyAll)
+    {
+        m_transfer->setSyncMode(m_exportWidget->syncMode());
+        m_transfer->setVerify(m_exportWidget->verifyCopies());
+        m_transfer->start(m_exportWidget->imagesList()->imageUrls(),
+                          m_exportWidget->targetUrl());
+        return;
+    }
+
     KIO::CopyJob* const copyJob = KIO::copy(m_exportWidget->imagesList()->imageUrls(),
                                             m_exportWidget->targetUrl());
 
@@ -37,6 +37,7 @@
 
 #include "kptooldialog.h"
 #include "KioExportWidget.h"
+#include "KioTransfer.h"
 
 namespace KIPI
 {
@@ -106,6 +107,16 @@ private Q_SLOTS:
      */
     void slotCopyingFinished(KJob* job);
 
+    /**
+     * Removes the image transferred, or skipped, by the sync mode from the image list.
+     */
+    void slotTransferFileDone(const QUrl& source, bool copied, const QString& errMsg);
+
+    /**
+     * Re-enables the dialog after the sync mode transfer, as slotCopyingFinished().
+     */
+    void slotTransferFinished();
+
     void slotFinished();
 
 protected:
@@ -136,10 +147,13 @@ private:
     const static QString TARGET_URL_PROPERTY;
     const static QString HISTORY_URL_PROPERTY;
     const static QString CONFIG_GROUP;
+    const static QString SYNC_MODE_PROPERTY;
+    const static QString VERIFY_PROPERTY;
 
 private:
 
     KioExportWidget* m_exportWidget;
+    KioTransfer*     m_transfer;
 };
 
 } // namespace KIPIRemoteStoragePlugin
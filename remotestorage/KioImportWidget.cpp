@@ -26,6 +26,9 @@
 
 #include <QBoxLayout>
 #include <QApplication>
+#include <QCheckBox>
+#include <QComboBox>
+#include <QLabel>
 
 // KDE includes
 
@@ -39,6 +42,7 @@
 // Local includes
 
 #include "kpimageslist.h"
+#include "kputil.h"
 
 namespace KIPIRemoteStoragePlugin
 {
@@ -55,13 +59,36 @@ KioImportWidget::KioImportWidget(QWidget* const parent, Interface* const interfa
     // setup upload widget
     m_uploadWidget            = interface->uploadWidget(this);
 
+    // setup transfer options
+    KPHBox* const syncBox     = new KPHBox(this);
+    QLabel* const syncLabel   = new QLabel(i18n("Existing files: "), syncBox);
+    m_syncModeCombo           = new QComboBox(syncBox);
+    m_syncModeCombo->addItem(i18n("Copy all images"),                         KioTransfer::CopyAll);
+    m_syncModeCombo->addItem(i18n("Skip images of same size and date"),       KioTransfer::SizeAndDate);
+    m_syncModeCombo->addItem(i18n("Skip images of same size and checksum"),   KioTransfer::Checksum);
+    m_syncModeCombo->setWhatsThis(i18n("Sets how images already in the album are handled. "
+                                       "Unchanged images can be skipped, and the other ones are "
+                                       "copied several at a time, replacing the album files."));
+    syncLabel->setBuddy(m_syncModeCombo);
+
+    m_verifyCheckBox = new QCheckBox(i18n("Verify copied images"), this);
+    m_verifyCheckBox->setWhatsThis(i18n("Reads back each copied image and compares its checksum "
+                                        "with the one of the original."));
+
     // layout dialog
     QVBoxLayout* const layout = new QVBoxLayout(this);
 
     layout->addWidget(m_imageList);
     layout->addWidget(m_uploadWidget);
+    layout->addWidget(syncBox);
+    layout->addWidget(m_verifyCheckBox);
     layout->setContentsMargins(QMargins());
     layout->setSpacing(QApplication::style()->pixelMetric(QStyle::PM_DefaultLayoutSpacing));
+
+    connect(m_syncModeCombo, SIGNAL(currentIndexChanged(int)),
+            this, SLOT(slotSyncModeChanged()));
+
+    slotSyncModeChanged();
 }
 
 KioImportWidget::~KioImportWidget()
@@ -78,6 +105,32 @@ UploadWidget* KioImportWidget::uploadWidget() const
     return m_uploadWidget;
 }
 
+KioTransfer::SyncMode KioImportWidget::syncMode() const
+{
+    return (KioTransfer::SyncMode)m_syncModeCombo->currentData().toInt();
+}
+
+void KioImportWidget::setSyncMode(KioTransfer::SyncMode mode)
+{
+    m_syncModeCombo->setCurrentIndex(qMax(0, m_syncModeCombo->findData(mode)));
+}
+
+bool KioImportWidget::verifyCopies() const
+{
+    return m_verifyCheckBox->isChecked();
+}
+
+void KioImportWidget::setVerifyCopies(bool verify)
+{
+    m_verifyCheckBox->setChecked(verify);
+}
+
+void KioImportWidget::slotSyncModeChanged()
+{
+    // Copying all images is left to a single KIO copy job, which asks about the existing files.
+    m_verifyCheckBox->setEnabled(syncMode() != KioTransfer::CopyAll);
+}
+
 QList<QUrl> KioImportWidget::sourceUrls() const
 {
     return m_imageList->imageUrls();
@@ -28,6 +28,13 @@
 #include <QUrl>
 #include <QWidget>
 
+// Local includes
+
+#include "KioTransfer.h"
+
+class QCheckBox;
+class QComboBox;
+
 namespace KIPI
 {
     class Interface;
@@ -89,10 +96,28 @@ public:
      */
     UploadWidget* uploadWidget() const;
 
+    /**
+     * Returns how the files already in the album are handled.
+     */
+    KioTransfer::SyncMode syncMode() const;
+    void setSyncMode(KioTransfer::SyncMode mode);
+
+    /**
+     * Returns true if the copies have to be compared with their source.
+     */
+    bool verifyCopies() const;
+    void setVerifyCopies(bool verify);
+
+private Q_SLOTS:
+
+    void slotSyncModeChanged();
+
 private:
 
     KPImagesList* m_imageList;
     UploadWidget* m_uploadWidget;
+    QComboBox*    m_syncModeCombo;
+    QCheckBox*    m_verifyCheckBox;
 };
 
 } // namespace KIPIRemoteStoragePlugin
@@ -32,6 +32,8 @@
 // KDE includes
 
 #include <kio/copyjob.h>
+#include <kconfig.h>
+#include <kconfiggroup.h>
 #include <klocalizedstring.h>
 
 // Libkipi includes
@@ -44,6 +46,7 @@
 
 #include "kipiplugins_debug.h"
 #include "KioImportWidget.h"
+#include "KioTransfer.h"
 #include "kpaboutdata.h"
 #include "kpimageslist.h"
 
@@ -54,6 +57,7 @@ KioImportWindow::KioImportWindow(QWidget* const /*parent*/)
     : KPToolDialog(0)
 {
     m_importWidget = new KioImportWidget(this, iface());
+    m_transfer     = new KioTransfer(this);
     setMainWidget(m_importWidget);
 
     // window setup
@@ -76,6 +80,19 @@ KioImportWindow::KioImportWindow(QWidget* const /*parent*/)
     connect(m_importWidget->uploadWidget(), SIGNAL(selectionChanged()),
             this, SLOT(slotSourceAndTargetUpdated()));
 
+    connect(m_transfer, SIGNAL(signalFileDone(QUrl, bool, QString)),
+            this, SLOT(slotTransferFileDone(QUrl, bool, QString)));
+
+    connect(m_transfer, SIGNAL(signalFinished()),
+            this, SLOT(slotTransferFinished()));
+
+    // settings
+
+    KConfig config(QString::fromLatin1("kipirc"));
+    KConfigGroup group = config.group(QString::fromLatin1("KioImport"));
+    m_importWidget->setSyncMode((KioTransfer::SyncMode)group.readEntry("syncMode", (int)KioTransfer::CopyAll));
+    m_importWidget->setVerifyCopies(group.readEntry("verifyCopies", false));
+
     // about data and help button
 
     KPAboutData* const about = new KPAboutData(ki18n("Import from remote storage"),
@@ -100,8 +117,24 @@ void KioImportWindow::slotImport()
 {
     qCDebug(KIPIPLUGINS_LOG) << "starting to import urls: " << m_importWidget->sourceUrls();
 
+    KConfig config(QString::fromLatin1("kipirc"));
+    KConfigGroup group = config.group(QString::fromLatin1("KioImport"));
+    group.writeEntry("syncMode",     (int)m_importWidget->syncMode());
+    group.writeEntry("verifyCopies", m_importWidget->verifyCopies());
+    config.sync();
+
     // start copying and react on signals
     setEnabled(false);
+
+    if (m_importWidget->syncMode() != KioTransfer::CopyAll)
+    {
+        m_transfer->setSyncMode(m_importWidget->syncMode());
+        m_transfer->setVerify(m_importWidget->verifyCopies());
+        m_transfer->start(m_importWidget->imagesList()->imageUrls(),
+                          m_importWidget->uploadWidget()->selectedImageCollection().uploadUrl());
+        return;
+    }
+
     KIO::CopyJob* const copyJob = KIO::copy(m_importWidget->imagesList()->imageUrls(),
                                   m_importWidget->uploadWidget()->selectedImageCollection().uploadUrl());
 
@@ -141,6 +174,25 @@ void KioImportWindow::slotCopyingFinished(KJob* job)
     }
 }
 
+void KioImportWindow::slotTransferFileDone(const QUrl& source, bool copied, const QString& errMsg)
+{
+    if (!errMsg.isEmpty())
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "cannot copy " << source.toDisplayString() << ": " << errMsg;
+        m_importWidget->imagesList()->processed(source, false);
+        return;
+    }
+
+    qCDebug(KIPIPLUGINS_LOG) << (copied ? "copied " : "unchanged ") << source.toDisplayString();
+
+    m_importWidget->imagesList()->removeItemByUrl(source);
+}
+
+void KioImportWindow::slotTransferFinished()
+{
+    slotCopyingFinished(0);
+}
+
 void KioImportWindow::slotSourceAndTargetUpdated()
 {
     bool hasUrlToImport = !m_importWidget->sourceUrls().empty();
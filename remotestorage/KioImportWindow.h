@@ -36,6 +36,7 @@
 
 #include "kptooldialog.h"
 #include "KioImportWidget.h"
+#include "KioTransfer.h"
 
 namespace KIPI
 {
@@ -94,9 +95,20 @@ private Q_SLOTS:
      */
     void slotCopyingFinished(KJob* job);
 
+    /**
+     * Removes the image transferred, or skipped, by the sync mode from the image list.
+     */
+    void slotTransferFileDone(const QUrl& source, bool copied, const QString& errMsg);
+
+    /**
+     * Re-enables the dialog after the sync mode transfer, as slotCopyingFinished().
+     */
+    void slotTransferFinished();
+
 private:
 
     KioImportWidget* m_importWidget;
+    KioTransfer*     m_transfer;
 };
 
 } // namespace KIPIRemoteStoragePlugin
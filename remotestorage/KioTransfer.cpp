@@ -0,0 +1,585 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-24
+ * Description : synchronize images with a KIO accessible location
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "KioTransfer.h"
+
+// Qt includes
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QHash>
+#include <QSet>
+
+// KDE includes
+
+#include <kio/filecopyjob.h>
+#include <kio/listjob.h>
+#include <kio/mkdirjob.h>
+#include <kio/simplejob.h>
+#include <kio/transferjob.h>
+#include <kio/udsentry.h>
+#include <klocalizedstring.h>
+
+// Local includes
+
+#include "kipiplugins_debug.h"
+#include "kpuploadhistory.h"
+
+using namespace KIPIPlugins;
+
+namespace KIPIRemoteStoragePlugin
+{
+
+class Q_DECL_HIDDEN KioTransfer::Private
+{
+public:
+
+    /// Size and modification time of a file, from a listing.
+    struct Entry
+    {
+        Entry()
+        {
+            size = -1;
+        }
+
+        qint64    size;
+        QDateTime mtime;
+    };
+
+    /// A file to copy, and the checksums of both files while it is verified.
+    struct Item
+    {
+        Item()
+            : sourceHash(QCryptographicHash::Md5),
+              destHash(QCryptographicHash::Md5)
+        {
+            reads = 0;
+        }
+
+        QUrl               source;
+        QUrl               dest;
+        QCryptographicHash sourceHash;
+        QCryptographicHash destHash;
+        int                reads;
+        QString            errMsg;
+    };
+
+    /// A file read back to verify a copy.
+    struct Read
+    {
+        Read()
+        {
+            item = 0;
+            hash = 0;
+        }
+
+        Item*               item;
+        QCryptographicHash* hash;
+    };
+
+public:
+
+    Private()
+    {
+        mode         = SizeAndDate;
+        verify       = false;
+        maxParallel  = 4;
+        targetExists = true;
+        mkdirJob     = 0;
+        verifying    = 0;
+        remaining    = 0;
+        history      = 0;
+        hashing      = false;
+    }
+
+    ~Private()
+    {
+        delete history;
+    }
+
+    static Entry entry(const KIO::UDSEntry& udsEntry)
+    {
+        Entry entry;
+        entry.size  = udsEntry.numberValue(KIO::UDSEntry::UDS_SIZE, -1);
+        entry.mtime = QDateTime::fromMSecsSinceEpoch(udsEntry.numberValue(KIO::UDSEntry::UDS_MODIFICATION_TIME, 0) * 1000);
+
+        return entry;
+    }
+
+    static QUrl directory(const QUrl& url)
+    {
+        return url.adjusted(QUrl::RemoveFilename | QUrl::StripTrailingSlash);
+    }
+
+    static QUrl child(const QUrl& dir, const QString& name)
+    {
+        QUrl url = dir;
+        url.setPath(dir.path() + QLatin1Char('/') + name);
+
+        return url;
+    }
+
+    /// Return true if the copy of 'source' in the target is up to date.
+    bool isUnchanged(const QUrl& source)
+    {
+        const Entry dest = targetEntries.value(source.fileName());
+
+        if (dest.size < 0 || dest.size != sourceEntries.value(source).size)
+            return false;
+
+        if (mode == Checksum && source.isLocalFile())
+            return history->isUploaded(source.toLocalFile(), target.toString(), source.fileName());
+
+        const QDateTime mtime = sourceEntries.value(source).mtime;
+
+        if (!mtime.isValid() || !dest.mtime.isValid())
+            return true;
+
+        // Listings give times in seconds.
+        return dest.mtime.toMSecsSinceEpoch() / 1000 >= mtime.toMSecsSinceEpoch() / 1000;
+    }
+
+public:
+
+    SyncMode                mode;
+    bool                    verify;
+    int                     maxParallel;
+
+    QList<QUrl>             sources;
+    QUrl                    target;
+
+    /// Listings running, with the directory listed.
+    QHash<KJob*, QUrl>      listings;
+    QHash<QUrl, Entry>      sourceEntries;
+    QHash<QString, Entry>   targetEntries;
+    bool                    targetExists;
+    KJob*                   mkdirJob;
+
+    QList<Item*>            queue;
+    QHash<KJob*, Item*>     copies;
+    QHash<KJob*, Read>      reads;
+    int                     verifying;
+
+    /// Files not handled yet.
+    int                     remaining;
+
+    /// Content of the local files copied, used by the Checksum mode.
+    KPUploadHistory*        history;
+    /// True while the sums of the local sources are computed by the history.
+    bool                    hashing;
+};
+
+KioTransfer::KioTransfer(QObject* const parent)
+    : QObject(parent),
+      d(new Private)
+{
+}
+
+KioTransfer::~KioTransfer()
+{
+    cancel();
+    delete d;
+}
+
+void KioTransfer::setSyncMode(SyncMode mode)
+{
+    d->mode = mode;
+}
+
+void KioTransfer::setVerify(bool verify)
+{
+    d->verify = verify;
+}
+
+void KioTransfer::setMaxParallel(int count)
+{
+    d->maxParallel = qMax(1, count);
+}
+
+void KioTransfer::start(const QList<QUrl>& sources, const QUrl& target)
+{
+    cancel();
+
+    d->sources      = sources;
+    d->target       = target.adjusted(QUrl::StripTrailingSlash);
+    d->remaining    = sources.count();
+    d->targetExists = true;
+    d->sourceEntries.clear();
+    d->targetEntries.clear();
+
+    if (d->mode == Checksum && !d->history)
+    {
+        d->history = new KPUploadHistory(QString::fromLatin1("RemoteStorage"));
+
+        connect(d->history, SIGNAL(filesHashed(QStringList)),
+                this, SLOT(slotFilesHashed()));
+    }
+
+    if (sources.isEmpty())
+    {
+        emit signalFinished();
+        return;
+    }
+
+    // Local sources are read directly, the directories of the other ones are listed.
+    QSet<QUrl> dirs;
+    dirs << d->target;
+
+    foreach (const QUrl& source, sources)
+    {
+        if (source.isLocalFile())
+        {
+            const QFileInfo info(source.toLocalFile());
+
+            if (info.isFile())
+            {
+                Private::Entry entry;
+                entry.size  = info.size();
+                entry.mtime = info.lastModified();
+                d->sourceEntries.insert(source, entry);
+            }
+        }
+        else
+        {
+            dirs << Private::directory(source);
+        }
+    }
+
+    foreach (const QUrl& dir, dirs)
+    {
+        KIO::ListJob* const job = KIO::listDir(dir, KIO::HideProgressInfo, false);
+
+        connect(job, SIGNAL(entries(KIO::Job*, KIO::UDSEntryList)),
+                this, SLOT(slotEntries(KIO::Job*, KIO::UDSEntryList)));
+
+        connect(job, SIGNAL(result(KJob*)),
+                this, SLOT(slotListingResult(KJob*)));
+
+        d->listings.insert(job, dir);
+    }
+}
+
+void KioTransfer::cancel()
+{
+    QList<KJob*> jobs = d->listings.keys() + d->copies.keys() + d->reads.keys();
+
+    if (d->mkdirJob)
+        jobs << d->mkdirJob;
+
+    foreach (KJob* const job, jobs)
+    {
+        job->kill();
+    }
+
+    // An item being verified has two reads.
+    QSet<Private::Item*> items = d->copies.values().toSet();
+
+    foreach (const Private::Read& read, d->reads)
+    {
+        items << read.item;
+    }
+
+    qDeleteAll(items);
+    qDeleteAll(d->queue);
+
+    d->listings.clear();
+    d->copies.clear();
+    d->reads.clear();
+    d->queue.clear();
+    d->mkdirJob  = 0;
+    d->verifying = 0;
+    d->remaining = 0;
+    d->hashing   = false;
+}
+
+void KioTransfer::slotEntries(KIO::Job* job, const KIO::UDSEntryList& entries)
+{
+    const QUrl dir = d->listings.value(job);
+
+    foreach (const KIO::UDSEntry& udsEntry, entries)
+    {
+        if (udsEntry.isDir())
+            continue;
+
+        const QString name         = udsEntry.stringValue(KIO::UDSEntry::UDS_NAME);
+        const Private::Entry entry = Private::entry(udsEntry);
+
+        if (dir == d->target)
+        {
+            d->targetEntries.insert(name, entry);
+        }
+
+        d->sourceEntries.insert(Private::child(dir, name), entry);
+    }
+}
+
+void KioTransfer::slotListingResult(KJob* job)
+{
+    const QUrl dir = d->listings.take(job);
+
+    if (job->error())
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "Cannot list" << dir.toDisplayString() << ":" << job->errorString();
+
+        // The files of a directory which cannot be listed are copied.
+        if (dir == d->target && job->error() == KIO::ERR_DOES_NOT_EXIST)
+        {
+            d->targetExists = false;
+        }
+    }
+
+    if (!d->listings.isEmpty())
+        return;
+
+    if (!d->targetExists)
+    {
+        d->mkdirJob = KIO::mkdir(d->target);
+
+        connect(d->mkdirJob, SIGNAL(result(KJob*)),
+                this, SLOT(slotMkdirResult(KJob*)));
+
+        return;
+    }
+
+    hashSources();
+}
+
+void KioTransfer::slotMkdirResult(KJob* job)
+{
+    d->mkdirJob = 0;
+
+    if (job->error())
+    {
+        const QList<QUrl> sources = d->sources;
+
+        foreach (const QUrl& source, sources)
+        {
+            fileDone(source, false, job->errorString());
+        }
+
+        return;
+    }
+
+    hashSources();
+}
+
+void KioTransfer::hashSources()
+{
+    if (d->mode != Checksum)
+    {
+        compare();
+        return;
+    }
+
+    // Only the local sources with a copy of the same size are compared by their content.
+    QStringList paths;
+
+    foreach (const QUrl& source, d->sources)
+    {
+        const Private::Entry dest = d->targetEntries.value(source.fileName());
+
+        if (source.isLocalFile() && dest.size >= 0 && dest.size == d->sourceEntries.value(source).size)
+        {
+            paths << source.toLocalFile();
+        }
+    }
+
+    d->hashing = true;
+    d->history->hashFiles(paths);
+}
+
+void KioTransfer::slotFilesHashed()
+{
+    if (!d->hashing)
+        return;
+
+    d->hashing = false;
+    compare();
+}
+
+void KioTransfer::compare()
+{
+    const QList<QUrl> sources = d->sources;
+    int skipped               = 0;
+
+    // The source copied to each name of the target.
+    QHash<QString, QUrl> names;
+
+    foreach (const QUrl& source, sources)
+    {
+        const QString name = source.fileName();
+
+        if (names.contains(name))
+        {
+            fileDone(source, false, i18n("%1 is not copied, it has the same name as %2",
+                                         source.toDisplayString(), names.value(name).toDisplayString()));
+            continue;
+        }
+
+        names.insert(name, source);
+
+        if (d->mode != CopyAll && d->isUnchanged(source))
+        {
+            skipped++;
+            fileDone(source, false, QString());
+            continue;
+        }
+
+        Private::Item* const item = new Private::Item;
+        item->source              = source;
+        item->dest                = Private::child(d->target, source.fileName());
+        d->queue << item;
+    }
+
+    qCDebug(KIPIPLUGINS_LOG) << skipped << "unchanged files," << d->queue.count() << "files to copy to"
+                             << d->target.toDisplayString();
+
+    startNext();
+}
+
+void KioTransfer::startNext()
+{
+    while (d->copies.count() + d->verifying < d->maxParallel && !d->queue.isEmpty())
+    {
+        Private::Item* const item   = d->queue.takeFirst();
+        KIO::FileCopyJob* const job = KIO::file_copy(item->source, item->dest, -1,
+                                                     KIO::Overwrite | KIO::HideProgressInfo);
+
+        connect(job, SIGNAL(result(KJob*)),
+                this, SLOT(slotCopyResult(KJob*)));
+
+        d->copies.insert(job, item);
+    }
+}
+
+void KioTransfer::slotCopyResult(KJob* job)
+{
+    Private::Item* const item = d->copies.take(job);
+
+    if (!item)
+        return;
+
+    if (job->error())
+    {
+        fileDone(item->source, false, job->errorString());
+        delete item;
+    }
+    else if (d->verify)
+    {
+        // Both files are read back, so the copy is compared with the source as stored.
+        d->verifying++;
+        item->reads = 2;
+
+        const QUrl urls[]                  = { item->source,      item->dest      };
+        QCryptographicHash* const hashes[] = { &item->sourceHash, &item->destHash };
+
+        for (int i = 0 ; i < 2 ; ++i)
+        {
+            Private::Read read;
+            read.item = item;
+            read.hash = hashes[i];
+
+            KIO::TransferJob* const readJob = KIO::get(urls[i], KIO::Reload, KIO::HideProgressInfo);
+
+            connect(readJob, SIGNAL(data(KIO::Job*, QByteArray)),
+                    this, SLOT(slotVerifyData(KIO::Job*, QByteArray)));
+
+            connect(readJob, SIGNAL(result(KJob*)),
+                    this, SLOT(slotVerifyResult(KJob*)));
+
+            d->reads.insert(readJob, read);
+        }
+    }
+    else
+    {
+        copyDone(item->source, item->dest, QString());
+        delete item;
+    }
+
+    startNext();
+}
+
+void KioTransfer::slotVerifyData(KIO::Job* job, const QByteArray& data)
+{
+    const Private::Read read = d->reads.value(job);
+
+    if (read.hash)
+        read.hash->addData(data);
+}
+
+void KioTransfer::slotVerifyResult(KJob* job)
+{
+    const Private::Read read  = d->reads.take(job);
+    Private::Item* const item = read.item;
+
+    if (!item)
+        return;
+
+    if (job->error() && item->errMsg.isEmpty())
+    {
+        item->errMsg = job->errorString();
+    }
+
+    if (--item->reads > 0)
+        return;
+
+    d->verifying--;
+
+    if (item->errMsg.isEmpty() && item->sourceHash.result() != item->destHash.result())
+    {
+        item->errMsg = i18n("The copy of %1 differs from the original", item->source.fileName());
+
+        // Removed, for the file to be copied again by the next transfer.
+        KIO::file_delete(item->dest, KIO::HideProgressInfo);
+    }
+
+    copyDone(item->source, item->dest, item->errMsg);
+    delete item;
+
+    startNext();
+}
+
+void KioTransfer::copyDone(const QUrl& source, const QUrl& dest, const QString& errMsg)
+{
+    if (errMsg.isEmpty() && d->history && source.isLocalFile())
+    {
+        d->history->addUpload(source.toLocalFile(), d->target.toString(), source.fileName(), dest.toString());
+    }
+
+    fileDone(source, true, errMsg);
+}
+
+void KioTransfer::fileDone(const QUrl& source, bool copied, const QString& errMsg)
+{
+    emit signalFileDone(source, copied, errMsg);
+
+    if (--d->remaining == 0)
+    {
+        if (d->history)
+            d->history->save();
+
+        emit signalFinished();
+    }
+}
+
+} // namespace KIPIRemoteStoragePlugin
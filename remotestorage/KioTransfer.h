@@ -0,0 +1,143 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-24
+ * Description : synchronize images with a KIO accessible location
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef KIOTRANSFER_H
+#define KIOTRANSFER_H
+
+// Qt includes
+
+#include <QObject>
+#include <QList>
+#include <QUrl>
+
+// KDE includes
+
+#include <kio/job.h>
+
+namespace KIPIRemoteStoragePlugin
+{
+
+/**
+ * Copies files into a directory, skipping the ones which are already there.
+ *
+ * The target directory, and the directories of the remote sources, are listed once.
+ * A file is copied if the target has no file of the same name, of the same size and at
+ * least as recent as the source. With the Checksum mode, the MD5 sum of a local source
+ * is compared to the ones recorded by the previous transfers instead of its date. The
+ * sums are cached with the size and date of the files, and computed on a worker thread.
+ *
+ * Several files are copied at the same time, overwriting the changed ones. Each copy
+ * can be verified by reading back both files and comparing their checksums. A source
+ * with the same name as a previous one is not copied, as it would overwrite it.
+ */
+class KioTransfer : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    enum SyncMode
+    {
+        CopyAll = 0,  ///< Copy all files, overwriting the existing ones.
+        SizeAndDate,  ///< Skip files of the same size and not older.
+        Checksum      ///< Skip local files of the same size and content, remote ones as SizeAndDate.
+    };
+
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param parent the parent object
+     */
+    explicit KioTransfer(QObject* const parent = 0);
+
+    /**
+     * Destructor. The running jobs are killed.
+     */
+    ~KioTransfer();
+
+    /**
+     * Sets how unchanged files are detected. Default is SizeAndDate.
+     */
+    void setSyncMode(SyncMode mode);
+
+    /**
+     * Sets if the copies are read back and compared with their source.
+     */
+    void setVerify(bool verify);
+
+    /**
+     * Sets the number of files copied or verified at the same time. Default is 4.
+     */
+    void setMaxParallel(int count);
+
+    /**
+     * Starts the transfer of @p sources into the directory @p target.
+     */
+    void start(const QList<QUrl>& sources, const QUrl& target);
+
+    /**
+     * Kills the running jobs and drops the files not transferred yet.
+     */
+    void cancel();
+
+Q_SIGNALS:
+
+    /**
+     * Emitted once @p source is handled. @p errMsg is empty if the file has been
+     * copied, or skipped if @p copied is false.
+     */
+    void signalFileDone(const QUrl& source, bool copied, const QString& errMsg);
+
+    /**
+     * Emitted when all files are handled.
+     */
+    void signalFinished();
+
+private Q_SLOTS:
+
+    void slotEntries(KIO::Job* job, const KIO::UDSEntryList& entries);
+    void slotListingResult(KJob* job);
+    void slotMkdirResult(KJob* job);
+    void slotFilesHashed();
+    void slotCopyResult(KJob* job);
+    void slotVerifyData(KIO::Job* job, const QByteArray& data);
+    void slotVerifyResult(KJob* job);
+
+private:
+
+    void hashSources();
+    void compare();
+    void startNext();
+    void copyDone(const QUrl& source, const QUrl& dest, const QString& errMsg);
+    void fileDone(const QUrl& source, bool copied, const QString& errMsg);
+
+private:
+
+    class Private;
+    Private* const d;
+};
+
+} // namespace KIPIRemoteStoragePlugin
+
+#endif /* KIOTRANSFER_H */
@@ -120,6 +120,7 @@ public:
     QString key;
     QString caption;
     QString keywords;
+    QString md5;
 
     QString thumbURL;
     QString originalURL;
@@ -26,8 +26,6 @@
 // Qt includes
 
 #include <QByteArray>
-#include <QDomDocument>
-#include <QDomElement>
 #include <QTextDocument>
 #include <QFile>
 #include <QFileInfo>
@@ -40,6 +38,8 @@
 
 #include "kipiplugins_debug.h"
 #include "kpversion.h"
+#include "kpdownloader.h"
+#include "kplistingcache.h"
 #include "mpform.h"
 #include "smugitem.h"
 
@@ -48,18 +48,32 @@ namespace KIPISmugPlugin
 
 SmugTalker::SmugTalker(QWidget* const parent)
 {
-    m_parent     = parent;
-    m_reply      = 0;
-    m_state      = SMUG_LOGOUT;
-    m_userAgent  = QString::fromLatin1("KIPI-Plugin-Smug/%1 (lure@kubuntu.org)").arg(kipipluginsVersion());
-    m_apiVersion = QString::fromLatin1("1.2.2");
-    m_apiURL     = QString::fromLatin1("https://api.smugmug.com/services/api/rest/%1/").arg(m_apiVersion);
-    m_apiKey     = QString::fromLatin1("R83lTcD4TvMsIiXqpdrA9OdIJ22uA4Wi");
-
-    m_netMngr    = new QNetworkAccessManager(this);
+    m_parent      = parent;
+    m_reply       = 0;
+    m_state       = SMUG_LOGOUT;
+    m_parsing     = SMUG_LOGOUT;
+    m_xmlDepth    = 0;
+    m_errCode     = -1;
+    m_newAlbumID  = -1;
+    m_lastImageID = -1;
+    m_userAgent   = QString::fromLatin1("KIPI-Plugin-Smug/%1 (lure@kubuntu.org)").arg(kipipluginsVersion());
+    m_apiVersion  = QString::fromLatin1("1.2.2");
+    m_apiURL      = QString::fromLatin1("https://api.smugmug.com/services/api/rest/%1/").arg(m_apiVersion);
+    m_apiKey      = QString::fromLatin1("R83lTcD4TvMsIiXqpdrA9OdIJ22uA4Wi");
+
+    // Albums, templates and categories are shown from the last session at once.
+    m_listingCache = new KPListingCache(QString::fromLatin1("SmugMug"));
+
+    m_netMngr     = new QNetworkAccessManager(this);
 
     connect(m_netMngr, SIGNAL(finished(QNetworkReply*)),
             this, SLOT(slotFinished(QNetworkReply*)));
+
+    // Photos are written to disk while they are received, several at once.
+    m_downloader  = new KPDownloader(this);
+
+    connect(m_downloader, SIGNAL(signalDownloadDone(QString,int,QString)),
+            this, SLOT(slotDownloadDone(QString,int,QString)));
 }
 
 SmugTalker::~SmugTalker()
@@ -76,6 +90,8 @@ SmugTalker::~SmugTalker()
 
     if (m_reply)
         m_reply->abort();
+
+    delete m_listingCache;
 }
 
 bool SmugTalker::loggedIn() const
@@ -88,6 +104,11 @@ SmugUser SmugTalker::getUser() const
     return m_user;
 }
 
+qint64 SmugTalker::getLastImageID() const
+{
+    return m_lastImageID;
+}
+
 void SmugTalker::cancel()
 {
     if (m_reply)
@@ -96,6 +117,13 @@ void SmugTalker::cancel()
         m_reply = 0;
     }
 
+    m_downloader->cancel();
+
+    foreach (QNetworkReply* const reply, m_revalidations.keys())
+    {
+        reply->abort();
+    }
+
     emit signalBusy(false);
 }
 
@@ -135,7 +163,7 @@ void SmugTalker::login(const QString& email, const QString& password)
     m_reply = m_netMngr->get(netRequest);
 
     m_state = SMUG_LOGIN;
-    m_buffer.resize(0);
+    startResponse(m_state, m_reply);
 
     m_user.email = email;
 }
@@ -163,7 +191,7 @@ void SmugTalker::logout()
     m_reply = m_netMngr->get(netRequest);
 
     m_state = SMUG_LOGOUT;
-    m_buffer.resize(0);
+    startResponse(m_state, m_reply);
 }
 
 void SmugTalker::listAlbums(const QString& nickName)
@@ -176,6 +204,8 @@ void SmugTalker::listAlbums(const QString& nickName)
 
     emit signalBusy(true);
 
+    QString listing = QString::fromLatin1("albums/") + nickName;
+
     QUrl url(m_apiURL);
     QUrlQuery q;
     q.addQueryItem(QString::fromLatin1("method"),    QString::fromLatin1("smugmug.albums.get"));
@@ -191,10 +221,14 @@ void SmugTalker::listAlbums(const QString& nickName)
     netRequest.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/x-www-form-urlencoded"));
     netRequest.setHeader(QNetworkRequest::UserAgentHeader, m_userAgent);
 
+    if (listFromCache(SMUG_LISTALBUMS, listing, netRequest))
+        return;
+
     m_reply = m_netMngr->get(netRequest);
 
-    m_state = SMUG_LISTALBUMS;
-    m_buffer.resize(0);
+    m_state   = SMUG_LISTALBUMS;
+    m_listing = listing;
+    startResponse(m_state, m_reply);
 }
 
 void SmugTalker::listPhotos(const qint64 albumID,
@@ -233,7 +267,7 @@ void SmugTalker::listPhotos(const qint64 albumID,
     m_reply = m_netMngr->get(netRequest);
 
     m_state = SMUG_LISTPHOTOS;
-    m_buffer.resize(0);
+    startResponse(m_state, m_reply);
 }
 
 void SmugTalker::listAlbumTmpl()
@@ -256,10 +290,14 @@ void SmugTalker::listAlbumTmpl()
     netRequest.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/x-www-form-urlencoded"));
     netRequest.setHeader(QNetworkRequest::UserAgentHeader, m_userAgent);
 
+    if (listFromCache(SMUG_LISTALBUMTEMPLATES, QString::fromLatin1("templates"), netRequest))
+        return;
+
     m_reply = m_netMngr->get(netRequest);
 
-    m_state = SMUG_LISTALBUMTEMPLATES;
-    m_buffer.resize(0);
+    m_state   = SMUG_LISTALBUMTEMPLATES;
+    m_listing = QString::fromLatin1("templates");
+    startResponse(m_state, m_reply);
 }
 
 void SmugTalker::listCategories()
@@ -282,10 +320,14 @@ void SmugTalker::listCategories()
     netRequest.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("application/x-www-form-urlencoded"));
     netRequest.setHeader(QNetworkRequest::UserAgentHeader, m_userAgent);
 
+    if (listFromCache(SMUG_LISTCATEGORIES, QString::fromLatin1("categories"), netRequest))
+        return;
+
     m_reply = m_netMngr->get(netRequest);
 
-    m_state = SMUG_LISTCATEGORIES;
-    m_buffer.resize(0);
+    m_state   = SMUG_LISTCATEGORIES;
+    m_listing = QString::fromLatin1("categories");
+    startResponse(m_state, m_reply);
 }
 
 void SmugTalker::listSubCategories(qint64 categoryID)
@@ -312,7 +354,7 @@ void SmugTalker::listSubCategories(qint64 categoryID)
     m_reply = m_netMngr->get(netRequest);
 
     m_state = SMUG_LISTSUBCATEGORIES;
-    m_buffer.resize(0);
+    startResponse(m_state, m_reply);
 }
 
 void SmugTalker::createAlbum(const SmugAlbum& album)
@@ -366,7 +408,7 @@ void SmugTalker::createAlbum(const SmugAlbum& album)
     m_reply = m_netMngr->get(netRequest);
 
     m_state = SMUG_CREATEALBUM;
-    m_buffer.resize(0);
+    startResponse(m_state, m_reply);
 }
 
 bool SmugTalker::addPhoto(const QString& imgPath,
@@ -425,29 +467,30 @@ bool SmugTalker::addPhoto(const QString& imgPath,
     m_reply = m_netMngr->post(netRequest, form.formData());
 
     m_state = SMUG_ADDPHOTO;
-    m_buffer.resize(0);
+    startResponse(m_state, m_reply);
     return true;
 }
 
-void SmugTalker::getPhoto(const QString& imgPath)
+void SmugTalker::getPhoto(const QUrl& url, const QString& localPath)
 {
-    if (m_reply)
-    {
-        m_reply->abort();
-        m_reply = 0;
-    }
-
     emit signalBusy(true);
 
-    QNetworkRequest netRequest(QUrl::fromLocalFile(imgPath));
+    QNetworkRequest netRequest(url);
     netRequest.setHeader(QNetworkRequest::UserAgentHeader, m_userAgent);
     netRequest.setRawHeader("X-Smug-SessionID", m_sessionID.toLatin1());
     netRequest.setRawHeader("X-Smug-Version", m_apiVersion.toLatin1());
 
-    m_reply = m_netMngr->get(netRequest);
+    m_downloader->download(netRequest, localPath);
+}
 
-    m_state = SMUG_GETPHOTO;
-    m_buffer.resize(0);
+void SmugTalker::slotDownloadDone(const QString& path, int errCode, const QString& errMsg)
+{
+    if (m_downloader->pending() == 0)
+    {
+        emit signalBusy(false);
+    }
+
+    emit signalGetPhotoDone(errCode, errMsg, path);
 }
 
 QString SmugTalker::errorToText(int errCode, const QString &errMsg)
@@ -476,8 +519,67 @@ QString SmugTalker::errorToText(int errCode, const QString &errMsg)
     return transError;
 }
 
+/** If 'listing' is in the cache, show it at once and ask it again with 'request' in background.
+ *  The listing is only reported again if it changed. Return false if the listing is not cached.
+ */
+bool SmugTalker::listFromCache(State state, const QString& listing, const QNetworkRequest& request)
+{
+    const QByteArray cached = m_listingCache->data(m_user.email, listing);
+
+    if (cached.isEmpty())
+        return false;
+
+    QNetworkRequest netRequest(request);
+    m_listingCache->prepareRequest(netRequest, m_user.email, listing);
+
+    m_revalidations.insert(m_netMngr->get(netRequest), qMakePair(state, listing));
+    parseListing(state, cached);
+
+    return true;
+}
+
+int SmugTalker::parseListing(State state, const QByteArray& data)
+{
+    startResponse(state);
+    readResponse(data);
+    endResponse();
+
+    // The window can start another request from the signal.
+    const int errCode = m_errCode;
+    emitResponse();
+
+    return errCode;
+}
+
+void SmugTalker::revalidated(QNetworkReply* const reply)
+{
+    const QPair<State, QString> listing = m_revalidations.take(reply);
+    reply->deleteLater();
+
+    // On error, the cached listing stays shown.
+    if (reply->error() != QNetworkReply::NoError || KPListingCache::isNotModified(reply))
+        return;
+
+    const QByteArray data = reply->readAll();
+
+    // Do not disturb the window if nothing changed, or while it waits for another request.
+    if (m_reply || data == m_listingCache->data(m_user.email, listing.second))
+        return;
+
+    qCDebug(KIPIPLUGINS_LOG) << "Listing" << listing.second << "changed since it was cached";
+
+    if (parseListing(listing.first, data) == 0)
+        m_listingCache->store(m_user.email, listing.second, data, reply);
+}
+
 void SmugTalker::slotFinished(QNetworkReply* reply)
 {
+    if (m_revalidations.contains(reply))
+    {
+        revalidated(reply);
+        return;
+    }
+
     if (reply != m_reply)
     {
         return;
@@ -500,11 +602,6 @@ void SmugTalker::slotFinished(QNetworkReply* reply)
             emit signalBusy(false);
             emit signalAddPhotoDone(reply->error(), reply->errorString());
         }
-        else if (m_state == SMUG_GETPHOTO)
-        {
-            emit signalBusy(false);
-            emit signalGetPhotoDone(reply->error(), reply->errorString(), QByteArray());
-        }
         else
         {
             emit signalBusy(false);
@@ -516,608 +613,461 @@ void SmugTalker::slotFinished(QNetworkReply* reply)
         return;
     }
 
-    m_buffer.append(reply->readAll());
+    readResponse(reply->readAll());
+    endResponse();
 
-    switch(m_state)
-    {
-        case (SMUG_LOGIN):
-            parseResponseLogin(m_buffer);
-            break;
-        case (SMUG_LOGOUT):
-            parseResponseLogout(m_buffer);
-            break;
-        case (SMUG_LISTALBUMS):
-            parseResponseListAlbums(m_buffer);
-            break;
-        case (SMUG_LISTPHOTOS):
-            parseResponseListPhotos(m_buffer);
-            break;
-        case (SMUG_LISTALBUMTEMPLATES):
-            parseResponseListAlbumTmpl(m_buffer);
-            break;
-        case (SMUG_LISTCATEGORIES):
-            parseResponseListCategories(m_buffer);
-            break;
-        case (SMUG_LISTSUBCATEGORIES):
-            parseResponseListSubCategories(m_buffer);
-            break;
-        case (SMUG_CREATEALBUM):
-            parseResponseCreateAlbum(m_buffer);
-            break;
-        case (SMUG_ADDPHOTO):
-            parseResponseAddPhoto(m_buffer);
-            break;
-        case (SMUG_GETPHOTO):
-            // all we get is data of the image
-            emit signalBusy(false);
-            emit signalGetPhotoDone(0, QString(), m_buffer);
-            break;
-    }
+    // Keep the listings to show them at once next time, before the window starts another request.
+    if (m_errCode == 0 && isCachedListing(m_parsing))
+        m_listingCache->store(m_user.email, m_listing, m_buffer, reply);
+
+    emitResponse();
 
     reply->deleteLater();
 }
 
-void SmugTalker::parseResponseLogin(const QByteArray& data)
+void SmugTalker::slotReadyRead()
 {
-    int errCode = -1;
-    QString errMsg;
-
-    emit signalLoginProgress(3);
+    QNetworkReply* const reply = qobject_cast<QNetworkReply*>(sender());
 
-    QDomDocument doc(QString::fromLatin1("login"));
-
-    if (!doc.setContent(data))
+    if (!reply || reply != m_reply || reply->error() != QNetworkReply::NoError)
         return;
 
-    qCDebug(KIPIPLUGINS_LOG) << "Parse Login response:" << endl << data;
-
-    QDomElement e = doc.documentElement();
-
-    for (QDomNode node = e.firstChild();
-         !node.isNull();
-         node = node.nextSibling())
-    {
-        if (!node.isElement())
-            continue;
-
-        e = node.toElement();
-
-        if (e.tagName() == QString::fromLatin1("Login"))
-        {
-            m_user.accountType   = e.attribute(QString::fromLatin1("AccountType"));
-            m_user.fileSizeLimit = e.attribute(QString::fromLatin1("FileSizeLimit")).toInt();
-
-            for (QDomNode nodeL = e.firstChild(); !nodeL.isNull(); nodeL = nodeL.nextSibling())
-            {
-                if (!nodeL.isElement())
-                    continue;
-
-                e = nodeL.toElement();
-
-                if (e.tagName() == QString::fromLatin1("Session"))
-                {
-                    m_sessionID = e.attribute(QString::fromLatin1("id"));
-                }
-                else if (e.tagName() == QString::fromLatin1("User"))
-                {
-                    m_user.nickName    = e.attribute(QString::fromLatin1("NickName"));
-                    m_user.displayName = e.attribute(QString::fromLatin1("DisplayName"));
-                }
-            }
-            errCode = 0;
-        }
-        else if (e.tagName() == QString::fromLatin1("err"))
-        {
-            errCode = e.attribute(QString::fromLatin1("code")).toInt();
-            errMsg  = e.attribute(QString::fromLatin1("msg"));
-            qCDebug(KIPIPLUGINS_LOG) << "Error:" << errCode << errMsg;
-        }
-    }
+    // Parse the response while it is received.
+    readResponse(reply->readAll());
+}
 
-    emit signalLoginProgress(4);
+bool SmugTalker::isCachedListing(State state)
+{
+    return (state == SMUG_LISTALBUMS         ||
+            state == SMUG_LISTALBUMTEMPLATES ||
+            state == SMUG_LISTCATEGORIES);
+}
 
-    if (errCode != 0) // if login failed, reset user properties
+/** Start parsing the response of a 'state' request. If 'reply' is set, the response
+ *  is parsed as data are received.
+ */
+void SmugTalker::startResponse(State state, QNetworkReply* const reply)
+{
+    m_parsing = state;
+    m_buffer.resize(0);
+    m_xml.clear();
+    m_xmlText.clear();
+    m_xmlDepth = 0;
+
+    m_errCode = -1;
+    m_errMsg.clear();
+    m_albumsList.clear();
+    m_photosList.clear();
+    m_albumTList.clear();
+    m_categoriesList.clear();
+    m_newAlbumID  = -1;
+    m_newAlbumKey.clear();
+
+    if (state == SMUG_ADDPHOTO)
+        m_lastImageID = -1;
+
+    if (reply)
     {
-        m_sessionID.clear();
-        m_user.clear();
+        connect(reply, SIGNAL(readyRead()),
+                this, SLOT(slotReadyRead()));
     }
-
-    emit signalBusy(false);
-    emit signalLoginDone(errCode, errorToText(errCode, errMsg));
 }
 
-void SmugTalker::parseResponseLogout(const QByteArray& data)
+void SmugTalker::readResponse(const QByteArray& data)
 {
-    int errCode = -1;
-    QString errMsg;
-
-    QDomDocument doc(QString::fromLatin1("logout"));
-
-    if (!doc.setContent(data))
-        return;
+    // Raw listings are only kept to be cached.
+    if (isCachedListing(m_parsing))
+        m_buffer.append(data);
 
-    qCDebug(KIPIPLUGINS_LOG) << "Parse Logout response:" << endl << data;
+    m_xml.addData(data);
 
-    QDomElement e = doc.documentElement();
-
-    for (QDomNode node = e.firstChild(); !node.isNull(); node = node.nextSibling())
+    // When the data received so far are consumed, the reader stops with a premature
+    // end of document error, and continues from there with the next data.
+    while (!m_xml.atEnd())
     {
-        if (!node.isElement())
-            continue;
-
-        e = node.toElement();
+        m_xml.readNext();
 
-        if (e.tagName() == QString::fromLatin1("Logout"))
+        if (m_xml.isStartElement())
+        {
+            m_xmlDepth++;
+            m_xmlText.clear();
+            parseStartElement();
+        }
+        else if (m_xml.isCharacters())
         {
-            errCode = 0;
+            m_xmlText += m_xml.text();
         }
-        else if (e.tagName() == QString::fromLatin1("err"))
+        else if (m_xml.isEndElement())
         {
-            errCode = e.attribute(QString::fromLatin1("code")).toInt();
-            errMsg  = e.attribute(QString::fromLatin1("msg"));
-            qCDebug(KIPIPLUGINS_LOG) << "Error:" << errCode << errMsg;
+            parseEndElement();
+            m_xmlDepth--;
         }
     }
-
-    // consider we are logged out in any case
-    m_sessionID.clear();
-    m_user.clear();
-
-    emit signalBusy(false);
 }
 
-void SmugTalker::parseResponseAddPhoto(const QByteArray& data)
+/** Check the response once all data are parsed.
+ */
+void SmugTalker::endResponse()
 {
-    // A multi-part put response (which we get now) looks like:
-    // <?xml version="1.0" encoding="utf-8"?>
-    // <rsp stat="ok">
-    //   <method>smugmug.images.upload</method>
-    //   <ImageID>884775096</ImageID>
-    //   <ImageKey>L7aq5</ImageKey>
-    //   <ImageURL>http://froody.smugmug.com/Other/Test/12372176_y7yNq#884775096_L7aq5</ImageURL>
-    // </rsp>
-
-    // A simple put response (which we used to get) looks like:
-    // <?xml version="1.0" encoding="utf-8"?>
-    // <rsp stat="ok">
-    //   <method>smugmug.images.upload</method>
-    //   <Image id="884790545" Key="seeQa" URL="http://froody.smugmug.com/Other/Test/12372176_y7yNq#884790545_seeQa"/>
-    // </rsp>
-
-    // Since all we care about is success or not, we can just check the rsp
-    // stat.
-
-    int errCode = -1;
-    QString errMsg;
-    QDomDocument doc(QString::fromLatin1("addphoto"));
-
-    if (!doc.setContent(data))
-        return;
-
-    qCDebug(KIPIPLUGINS_LOG) << "Parse Add Photo response:" << endl << data;
-
-    QDomElement document = doc.documentElement();
-
-    if (document.tagName() == QString::fromLatin1("rsp"))
+    if (m_xml.hasError())
     {
-        qCDebug(KIPIPLUGINS_LOG) << "rsp stat: " << document.attribute(QString::fromLatin1("stat"));
+        qCDebug(KIPIPLUGINS_LOG) << "Malformed response:" << m_xml.errorString()
+                                 << "at line" << m_xml.lineNumber();
 
-        if (document.attribute(QString::fromLatin1("stat")) == QString::fromLatin1("ok"))
-        {
-            errCode = 0;
-        }
-        else if (document.attribute(QString::fromLatin1("stat")) == QString::fromLatin1("fail"))
-        {
-            QDomElement error = document.firstChildElement(QString::fromLatin1("err"));
-            errCode           = error.attribute(QString::fromLatin1("code")).toInt();
-            errMsg            = error.attribute(QString::fromLatin1("msg"));
-            qCDebug(KIPIPLUGINS_LOG) << "error" << errCode << ":" << errMsg << endl;
-        }
-    }
-    else
-    {
-        errCode = -2;
-        errMsg  = QString::fromLatin1("Malformed response from smugmug: ") + document.tagName();
-        qCDebug(KIPIPLUGINS_LOG) << "Error:" << errCode << errMsg;
+        m_errCode = -2;
+        m_errMsg  = QString::fromLatin1("Malformed response from smugmug: ") + m_xml.errorString();
     }
 
-    emit signalBusy(false);
-    emit signalAddPhotoDone(errCode, errorToText(errCode, errMsg));
+    if (m_errCode == 15)  // 15: empty list
+        m_errCode = 0;
 }
 
-void SmugTalker::parseResponseCreateAlbum(const QByteArray& data)
+void SmugTalker::emitResponse()
 {
-    int errCode = -1;
-    QString errMsg;
-    QDomDocument doc(QString::fromLatin1("createalbum"));
-
-    if (!doc.setContent(data))
-        return;
-
-    qCDebug(KIPIPLUGINS_LOG) << "Parse Create Album response:" << endl << data;
-
-    int newAlbumID = -1;
-    QString newAlbumKey;
-    QDomElement e  = doc.documentElement();
-
-    for (QDomNode node = e.firstChild(); !node.isNull(); node = node.nextSibling())
+    switch (m_parsing)
     {
-        if (!node.isElement())
-            continue;
-
-        e = node.toElement();
-
-        if (e.tagName() == QString::fromLatin1("Album"))
-        {
-            newAlbumID  = e.attribute(QString::fromLatin1("id")).toLongLong();
-            newAlbumKey = e.attribute(QString::fromLatin1("Key"));
-            qCDebug(KIPIPLUGINS_LOG) << "AlbumID: " << newAlbumID;
-            qCDebug(KIPIPLUGINS_LOG) << "Key: " << newAlbumKey;
-            errCode = 0;
-        }
-        else if (e.tagName() == QString::fromLatin1("err"))
-        {
-            errCode = e.attribute(QString::fromLatin1("code")).toInt();
-            errMsg  = e.attribute(QString::fromLatin1("msg"));
-            qCDebug(KIPIPLUGINS_LOG) << "Error:" << errCode << errMsg;
-        }
+        case (SMUG_LOGIN):
+            parseResponseLogin();
+            break;
+        case (SMUG_LOGOUT):
+            parseResponseLogout();
+            break;
+        case (SMUG_LISTALBUMS):
+            parseResponseListAlbums();
+            break;
+        case (SMUG_LISTPHOTOS):
+            parseResponseListPhotos();
+            break;
+        case (SMUG_LISTALBUMTEMPLATES):
+            parseResponseListAlbumTmpl();
+            break;
+        case (SMUG_LISTCATEGORIES):
+            parseResponseListCategories();
+            break;
+        case (SMUG_LISTSUBCATEGORIES):
+            parseResponseListSubCategories();
+            break;
+        case (SMUG_CREATEALBUM):
+            parseResponseCreateAlbum();
+            break;
+        case (SMUG_ADDPHOTO):
+            parseResponseAddPhoto();
+            break;
     }
-
-    emit signalBusy(false);
-    emit signalCreateAlbumDone(errCode, errorToText(errCode, errMsg),
-                               newAlbumID, newAlbumKey);
 }
 
-void SmugTalker::parseResponseListAlbums(const QByteArray& data)
+void SmugTalker::parseStartElement()
 {
-    int errCode = -1;
-    QString errMsg;
-    QDomDocument doc(QString::fromLatin1("albums.get"));
+    const QStringRef name            = m_xml.name();
+    const QXmlStreamAttributes attrs = m_xml.attributes();
 
-    if (!doc.setContent(data))
+    if (name == QLatin1String("err"))
+    {
+        m_errCode = attrs.value(QLatin1String("code")).toString().toInt();
+        m_errMsg  = attrs.value(QLatin1String("msg")).toString();
+        qCDebug(KIPIPLUGINS_LOG) << "Error:" << m_errCode << m_errMsg;
         return;
+    }
 
-    qCDebug(KIPIPLUGINS_LOG) << "Parse Albums response:" << endl << data;
-
-    QList <SmugAlbum> albumsList;
-    QDomElement e = doc.documentElement();
-
-    for (QDomNode node = e.firstChild(); !node.isNull(); node = node.nextSibling())
+    switch (m_parsing)
     {
-        if (!node.isElement())
-            continue;
-
-        e = node.toElement();
+        case (SMUG_LOGIN):
 
-        if (e.tagName() == QString::fromLatin1("Albums"))
-        {
-            for (QDomNode nodeA = e.firstChild(); !nodeA.isNull(); nodeA = nodeA.nextSibling())
+            if (name == QLatin1String("Login"))
             {
-                if (!nodeA.isElement())
-                    continue;
+                m_user.accountType   = attrs.value(QLatin1String("AccountType")).toString();
+                m_user.fileSizeLimit = attrs.value(QLatin1String("FileSizeLimit")).toString().toInt();
+                m_errCode            = 0;
+            }
+            else if (name == QLatin1String("Session"))
+            {
+                m_sessionID = attrs.value(QLatin1String("id")).toString();
+            }
+            else if (name == QLatin1String("User"))
+            {
+                m_user.nickName    = attrs.value(QLatin1String("NickName")).toString();
+                m_user.displayName = attrs.value(QLatin1String("DisplayName")).toString();
+            }
 
-                e = nodeA.toElement();
+            break;
 
-                if (e.tagName() == QString::fromLatin1("Album"))
-                {
-                    SmugAlbum album;
-                    album.id           = e.attribute(QString::fromLatin1("id")).toLongLong();
-                    album.key          = e.attribute(QString::fromLatin1("Key"));
-                    album.title        = htmlToText(e.attribute(QString::fromLatin1("Title")));
-                    album.description  = htmlToText(e.attribute(QString::fromLatin1("Description")));
-                    album.keywords     = htmlToText(e.attribute(QString::fromLatin1("Keywords")));
-                    album.isPublic     = e.attribute(QString::fromLatin1("Public")) == QString::fromLatin1("1");
-                    album.password     = htmlToText(e.attribute(QString::fromLatin1("Password")));
-                    album.passwordHint = htmlToText(e.attribute(QString::fromLatin1("PasswordHint")));
-                    album.imageCount   = e.attribute(QString::fromLatin1("ImageCount")).toInt();
-
-                    for (QDomNode nodeC = e.firstChild(); !nodeC.isNull(); nodeC = node.nextSibling())
-                    {
-                        if (!nodeC.isElement())
-                            continue;
-
-                        e = nodeC.toElement();
-
-                        if (e.tagName() == QString::fromLatin1("Category"))
-                        {
-                            album.categoryID = e.attribute(QString::fromLatin1("id")).toLongLong();
-                            album.category   = htmlToText(e.attribute(QString::fromLatin1("Name")));
-                        }
-                        else if (e.tagName() == QString::fromLatin1("SubCategory"))
-                        {
-                            album.subCategoryID = e.attribute(QString::fromLatin1("id")).toLongLong();
-                            album.subCategory   = htmlToText(e.attribute(QString::fromLatin1("Name")));
-                        }
-                    }
-                    albumsList.append(album);
-                }
-            }
+        case (SMUG_LOGOUT):
 
-            errCode = 0;
-        }
-        else if (e.tagName() == QString::fromLatin1("err"))
-        {
-            errCode = e.attribute(QString::fromLatin1("code")).toInt();
-            errMsg  = e.attribute(QString::fromLatin1("msg"));
-            qCDebug(KIPIPLUGINS_LOG) << "Error:" << errCode << errMsg;
-        }
-    }
+            if (name == QLatin1String("Logout"))
+                m_errCode = 0;
 
-    if (errCode == 15)  // 15: empty list
-        errCode = 0;
+            break;
 
-    std::sort(albumsList.begin(), albumsList.end(), SmugAlbum::lessThan);
+        case (SMUG_ADDPHOTO):
 
-    emit signalBusy(false);
-    emit signalListAlbumsDone(errCode, errorToText(errCode, errMsg), albumsList);
-}
+            // A multi-part put response (which we get now) looks like:
+            // <?xml version="1.0" encoding="utf-8"?>
+            // <rsp stat="ok">
+            //   <method>smugmug.images.upload</method>
+            //   <ImageID>884775096</ImageID>
+            //   <ImageKey>L7aq5</ImageKey>
+            //   <ImageURL>http://froody.smugmug.com/Other/Test/12372176_y7yNq#884775096_L7aq5</ImageURL>
+            // </rsp>
+
+            // A simple put response (which we used to get) looks like:
+            // <?xml version="1.0" encoding="utf-8"?>
+            // <rsp stat="ok">
+            //   <method>smugmug.images.upload</method>
+            //   <Image id="884790545" Key="seeQa" URL="http://froody.smugmug.com/Other/Test/12372176_y7yNq#884790545_seeQa"/>
+            // </rsp>
+
+            // We check the rsp stat, and keep the image ID to record it in the upload history.
+
+            if (m_xmlDepth == 1)
+            {
+                if (name == QLatin1String("rsp"))
+                {
+                    qCDebug(KIPIPLUGINS_LOG) << "rsp stat: " << attrs.value(QLatin1String("stat"));
 
-void SmugTalker::parseResponseListPhotos(const QByteArray& data)
-{
-    int errCode = -1;
-    QString errMsg;
-    QDomDocument doc(QString::fromLatin1("images.get"));
+                    if (attrs.value(QLatin1String("stat")) == QLatin1String("ok"))
+                        m_errCode = 0;
+                }
+                else
+                {
+                    m_errCode = -2;
+                    m_errMsg  = QString::fromLatin1("Malformed response from smugmug: ") + name.toString();
+                    qCDebug(KIPIPLUGINS_LOG) << "Error:" << m_errCode << m_errMsg;
+                }
+            }
+            else if (name == QLatin1String("Image"))
+            {
+                m_lastImageID = attrs.value(QLatin1String("id")).toString().toLongLong();
+            }
 
-    if (!doc.setContent(data))
-        return;
+            break;
 
-    qCDebug(KIPIPLUGINS_LOG) << "Parse Photos response:" << endl << data;
+        case (SMUG_CREATEALBUM):
 
-    QList <SmugPhoto> photosList;
-    QDomElement e = doc.documentElement();
+            if (name == QLatin1String("Album"))
+            {
+                m_newAlbumID  = attrs.value(QLatin1String("id")).toString().toLongLong();
+                m_newAlbumKey = attrs.value(QLatin1String("Key")).toString();
+                qCDebug(KIPIPLUGINS_LOG) << "AlbumID: " << m_newAlbumID;
+                qCDebug(KIPIPLUGINS_LOG) << "Key: " << m_newAlbumKey;
+                m_errCode     = 0;
+            }
 
-    for (QDomNode node = e.firstChild(); !node.isNull(); node = node.nextSibling())
-    {
-        if (!node.isElement())
-            continue;
+            break;
 
-        e = node.toElement();
+        case (SMUG_LISTALBUMS):
 
-        if (e.tagName() == QString::fromLatin1("Album"))
-        {
-            node = e.firstChild();
+            if (name == QLatin1String("Albums"))
+            {
+                m_errCode = 0;
+            }
+            else if (name == QLatin1String("Album"))
+            {
+                SmugAlbum album;
+                album.id           = attrs.value(QLatin1String("id")).toString().toLongLong();
+                album.key          = attrs.value(QLatin1String("Key")).toString();
+                album.title        = htmlToText(attrs.value(QLatin1String("Title")).toString());
+                album.description  = htmlToText(attrs.value(QLatin1String("Description")).toString());
+                album.keywords     = htmlToText(attrs.value(QLatin1String("Keywords")).toString());
+                album.isPublic     = attrs.value(QLatin1String("Public")) == QLatin1String("1");
+                album.password     = htmlToText(attrs.value(QLatin1String("Password")).toString());
+                album.passwordHint = htmlToText(attrs.value(QLatin1String("PasswordHint")).toString());
+                album.imageCount   = attrs.value(QLatin1String("ImageCount")).toString().toInt();
+                m_albumsList.append(album);
+            }
+            else if (name == QLatin1String("Category") && !m_albumsList.isEmpty())
+            {
+                m_albumsList.last().categoryID = attrs.value(QLatin1String("id")).toString().toLongLong();
+                m_albumsList.last().category   = htmlToText(attrs.value(QLatin1String("Name")).toString());
+            }
+            else if (name == QLatin1String("SubCategory") && !m_albumsList.isEmpty())
+            {
+                m_albumsList.last().subCategoryID = attrs.value(QLatin1String("id")).toString().toLongLong();
+                m_albumsList.last().subCategory   = htmlToText(attrs.value(QLatin1String("Name")).toString());
+            }
 
-            if (!node.isElement())
-                continue;
+            break;
 
-            e = node.toElement();
-        }
+        case (SMUG_LISTPHOTOS):
 
-        if (e.tagName() == QString::fromLatin1("Images"))
-        {
-            for (QDomNode nodeP = e.firstChild(); !nodeP.isNull(); nodeP = nodeP.nextSibling())
+            if (name == QLatin1String("Images"))
             {
-                if (!nodeP.isElement())
-                    continue;
-
-                e = nodeP.toElement();
+                m_errCode = 0;
+            }
+            else if (name == QLatin1String("Image"))
+            {
+                SmugPhoto photo;
+                photo.id       = attrs.value(QLatin1String("id")).toString().toLongLong();
+                photo.key      = attrs.value(QLatin1String("Key")).toString();
+                photo.caption  = htmlToText(attrs.value(QLatin1String("Caption")).toString());
+                photo.keywords = htmlToText(attrs.value(QLatin1String("Keywords")).toString());
+                photo.md5      = attrs.value(QLatin1String("MD5Sum")).toString();
+                photo.thumbURL = attrs.value(QLatin1String("ThumbURL")).toString();
+
+                // try to get largest size available
+                static const char* const sizes[] =
+                {
+                    "Video1280URL", "Video960URL", "Video640URL", "Video320URL", "OriginalURL",
+                    "X3LargeURL",   "X2LargeURL",  "XLargeURL",   "LargeURL",    "MediumURL",
+                    "SmallURL"
+                };
 
-                if (e.tagName() == QString::fromLatin1("Image"))
+                for (size_t i = 0 ; i < sizeof(sizes) / sizeof(sizes[0]) ; ++i)
                 {
-                    SmugPhoto photo;
-                    photo.id       = e.attribute(QString::fromLatin1("id")).toLongLong();
-                    photo.key      = e.attribute(QString::fromLatin1("Key"));
-                    photo.caption  = htmlToText(e.attribute(QString::fromLatin1("Caption")));
-                    photo.keywords = htmlToText(e.attribute(QString::fromLatin1("Keywords")));
-                    photo.thumbURL = e.attribute(QString::fromLatin1("ThumbURL"));
-
-                    // try to get largest size available
-                    if (e.hasAttribute(QString::fromLatin1("Video1280URL")))
-                        photo.originalURL = e.attribute(QString::fromLatin1("Video1280URL"));
-                    else if (e.hasAttribute(QString::fromLatin1("Video960URL")))
-                        photo.originalURL = e.attribute(QString::fromLatin1("Video960URL"));
-                    else if (e.hasAttribute(QString::fromLatin1("Video640URL")))
-                        photo.originalURL = e.attribute(QString::fromLatin1("Video640URL"));
-                    else if (e.hasAttribute(QString::fromLatin1("Video320URL")))
-                        photo.originalURL = e.attribute(QString::fromLatin1("Video320URL"));
-                    else if (e.hasAttribute(QString::fromLatin1("OriginalURL")))
-                        photo.originalURL = e.attribute(QString::fromLatin1("OriginalURL"));
-                    else if (e.hasAttribute(QString::fromLatin1("X3LargeURL")))
-                        photo.originalURL = e.attribute(QString::fromLatin1("X3LargeURL"));
-                    else if (e.hasAttribute(QString::fromLatin1("X2LargeURL")))
-                        photo.originalURL = e.attribute(QString::fromLatin1("X2LargeURL"));
-                    else if (e.hasAttribute(QString::fromLatin1("XLargeURL")))
-                        photo.originalURL = e.attribute(QString::fromLatin1("XLargeURL"));
-                    else if (e.hasAttribute(QString::fromLatin1("LargeURL")))
-                        photo.originalURL = e.attribute(QString::fromLatin1("LargeURL"));
-                    else if (e.hasAttribute(QString::fromLatin1("MediumURL")))
-                        photo.originalURL = e.attribute(QString::fromLatin1("MediumURL"));
-                    else if (e.hasAttribute(QString::fromLatin1("SmallURL")))
-                        photo.originalURL = e.attribute(QString::fromLatin1("SmallURL"));
-
-                    photosList.append(photo);
+                    if (attrs.hasAttribute(QLatin1String(sizes[i])))
+                    {
+                        photo.originalURL = attrs.value(QLatin1String(sizes[i])).toString();
+                        break;
+                    }
                 }
-            }
 
-            errCode = 0;
-        }
-        else if (e.tagName() == QString::fromLatin1("err"))
-        {
-            errCode = e.attribute(QString::fromLatin1("code")).toInt();
-            errMsg  = e.attribute(QString::fromLatin1("msg"));
-            qCDebug(KIPIPLUGINS_LOG) << "Error:" << errCode << errMsg;
-        }
-    }
+                m_photosList.append(photo);
+            }
 
-    if (errCode == 15)  // 15: empty list
-        errCode = 0;
+            break;
 
-    emit signalBusy(false);
-    emit signalListPhotosDone(errCode, errorToText(errCode, errMsg), photosList);
-}
+        case (SMUG_LISTALBUMTEMPLATES):
 
-void SmugTalker::parseResponseListAlbumTmpl(const QByteArray& data)
-{
-    int errCode = -1;
-    QString errMsg;
-    QDomDocument doc(QString::fromLatin1("albumtemplates.get"));
+            if (name == QLatin1String("AlbumTemplates"))
+            {
+                m_errCode = 0;
+            }
+            else if (name == QLatin1String("AlbumTemplate"))
+            {
+                SmugAlbumTmpl tmpl;
+                tmpl.id           = attrs.value(QLatin1String("id")).toString().toLongLong();
+                tmpl.name         = htmlToText(attrs.value(QLatin1String("AlbumTemplateName")).toString());
+                tmpl.isPublic     = attrs.value(QLatin1String("Public")) == QLatin1String("1");
+                tmpl.password     = htmlToText(attrs.value(QLatin1String("Password")).toString());
+                tmpl.passwordHint = htmlToText(attrs.value(QLatin1String("PasswordHint")).toString());
+                m_albumTList.append(tmpl);
+            }
 
-    if (!doc.setContent(data))
-        return;
+            break;
 
-    qCDebug(KIPIPLUGINS_LOG) << "Parse AlbumTemplates response:" << endl << data;
+        case (SMUG_LISTCATEGORIES):
 
-    QList<SmugAlbumTmpl> albumTList;
-    QDomElement e = doc.documentElement();
+            if (name == QLatin1String("Categories"))
+            {
+                m_errCode = 0;
+            }
+            else if (name == QLatin1String("Category"))
+            {
+                SmugCategory category;
+                category.id   = attrs.value(QLatin1String("id")).toString().toLongLong();
+                category.name = htmlToText(attrs.value(QLatin1String("Name")).toString());
+                m_categoriesList.append(category);
+            }
 
-    for (QDomNode node = e.firstChild(); !node.isNull(); node = node.nextSibling())
-    {
-        if (!node.isElement())
-            continue;
+            break;
 
-        e = node.toElement();
+        case (SMUG_LISTSUBCATEGORIES):
 
-        if (e.tagName() == QString::fromLatin1("AlbumTemplates"))
-        {
-            for (QDomNode nodeT = e.firstChild(); !nodeT.isNull(); nodeT = nodeT.nextSibling())
+            if (name == QLatin1String("SubCategories"))
             {
-                if (!nodeT.isElement())
-                    continue;
-
-                QDomElement e = nodeT.toElement();
-
-                if (e.tagName() == QString::fromLatin1("AlbumTemplate"))
-                {
-                    SmugAlbumTmpl tmpl;
-                    tmpl.id           = e.attribute(QString::fromLatin1("id")).toLongLong();
-                    tmpl.name         = htmlToText(e.attribute(QString::fromLatin1("AlbumTemplateName")));
-                    tmpl.isPublic     = e.attribute(QString::fromLatin1("Public")) == QString::fromLatin1("1");
-                    tmpl.password     = htmlToText(e.attribute(QString::fromLatin1("Password")));
-                    tmpl.passwordHint = htmlToText(e.attribute(QString::fromLatin1("PasswordHint")));
-                    albumTList.append(tmpl);
-                }
+                m_errCode = 0;
+            }
+            else if (name == QLatin1String("SubCategory"))
+            {
+                SmugCategory category;
+                category.id   = attrs.value(QLatin1String("id")).toString().toLongLong();
+                category.name = htmlToText(attrs.value(QLatin1String("Name")).toString());
+                m_categoriesList.append(category);
             }
 
-            errCode = 0;
-        }
-        else if (e.tagName() == QString::fromLatin1("err"))
-        {
-            errCode = e.attribute(QString::fromLatin1("code")).toInt();
-            errMsg  = e.attribute(QString::fromLatin1("msg"));
-            qCDebug(KIPIPLUGINS_LOG) << "Error:" << errCode << errMsg;
-        }
+            break;
     }
-
-    if (errCode == 15)  // 15: empty list
-        errCode = 0;
-
-    emit signalBusy(false);
-    emit signalListAlbumTmplDone(errCode, errorToText(errCode, errMsg), albumTList);
 }
 
-void SmugTalker::parseResponseListCategories(const QByteArray& data)
+void SmugTalker::parseEndElement()
 {
-    int errCode = -1;
-    QString errMsg;
-    QDomDocument doc(QString::fromLatin1("categories.get"));
-
-    if (!doc.setContent(data))
-        return;
-
-    qCDebug(KIPIPLUGINS_LOG) << "Parse Categories response:" << endl << data;
-
-    QList <SmugCategory> categoriesList;
-    QDomElement e = doc.documentElement();
-
-    for (QDomNode node = e.firstChild(); !node.isNull(); node = node.nextSibling())
+    // The multi-part upload response gives the image ID as text.
+    if (m_parsing == SMUG_ADDPHOTO && m_lastImageID == -1 && m_xml.name() == QLatin1String("ImageID"))
     {
-        if (!node.isElement())
-            continue;
-
-        e = node.toElement();
+        m_lastImageID = m_xmlText.trimmed().toLongLong();
+    }
+}
 
-        if (e.tagName() == QString::fromLatin1("Categories"))
-        {
-            for (QDomNode nodeC = e.firstChild(); !nodeC.isNull(); nodeC = nodeC.nextSibling())
-            {
-                if (!nodeC.isElement())
-                    continue;
+void SmugTalker::parseResponseLogin()
+{
+    emit signalLoginProgress(3);
+    emit signalLoginProgress(4);
 
-                QDomElement e = nodeC.toElement();
+    if (m_errCode != 0) // if login failed, reset user properties
+    {
+        m_sessionID.clear();
+        m_user.clear();
+    }
 
-                if (e.tagName() == QString::fromLatin1("Category"))
-                {
-                    SmugCategory category;
-                    category.id   = e.attribute(QString::fromLatin1("id")).toLongLong();
-                    category.name = htmlToText(e.attribute(QString::fromLatin1("Name")));
-                    categoriesList.append(category);
-                }
-            }
+    emit signalBusy(false);
+    emit signalLoginDone(m_errCode, errorToText(m_errCode, m_errMsg));
+}
 
-            errCode = 0;
-        }
-        else if (e.tagName() == QString::fromLatin1("err"))
-        {
-            errCode = e.attribute(QString::fromLatin1("code")).toInt();
-            errMsg  = e.attribute(QString::fromLatin1("msg"));
-            qCDebug(KIPIPLUGINS_LOG) << "Error:" << errCode << errMsg;
-        }
-    }
+void SmugTalker::parseResponseLogout()
+{
+    // consider we are logged out in any case
+    m_sessionID.clear();
+    m_user.clear();
 
-    if (errCode == 15)  // 15: empty list
-        errCode = 0;
+    emit signalBusy(false);
+}
 
+void SmugTalker::parseResponseAddPhoto()
+{
     emit signalBusy(false);
-    emit signalListCategoriesDone(errCode, errorToText(errCode, errMsg), categoriesList);
+    emit signalAddPhotoDone(m_errCode, errorToText(m_errCode, m_errMsg));
 }
 
-void SmugTalker::parseResponseListSubCategories(const QByteArray& data)
+void SmugTalker::parseResponseCreateAlbum()
 {
-    int errCode = -1;
-    QString errMsg;
-    QDomDocument doc(QString::fromLatin1("subcategories.get"));
+    const QString newAlbumKey = m_newAlbumKey;
 
-    if (!doc.setContent(data))
-        return;
+    emit signalBusy(false);
+    emit signalCreateAlbumDone(m_errCode, errorToText(m_errCode, m_errMsg),
+                               m_newAlbumID, newAlbumKey);
+}
 
-    qCDebug(KIPIPLUGINS_LOG) << "Parse SubCategories response:" << endl << data;
+void SmugTalker::parseResponseListAlbums()
+{
+    // The window can start another request from the signal: do not pass the members.
+    QList<SmugAlbum> albumsList = m_albumsList;
+    std::sort(albumsList.begin(), albumsList.end(), SmugAlbum::lessThan);
 
-    QList <SmugCategory> categoriesList;
-    QDomElement e = doc.documentElement();
+    emit signalBusy(false);
+    emit signalListAlbumsDone(m_errCode, errorToText(m_errCode, m_errMsg), albumsList);
+}
 
-    for (QDomNode node = e.firstChild(); !node.isNull(); node = node.nextSibling())
-    {
-        if (!node.isElement())
-            continue;
+void SmugTalker::parseResponseListPhotos()
+{
+    QList<SmugPhoto> photosList = m_photosList;
 
-        e = node.toElement();
+    emit signalBusy(false);
+    emit signalListPhotosDone(m_errCode, errorToText(m_errCode, m_errMsg), photosList);
+}
 
-        if (e.tagName() == QString::fromLatin1("SubCategories"))
-        {
-            for (QDomNode nodeC = e.firstChild(); !nodeC.isNull(); nodeC = nodeC.nextSibling())
-            {
-                if (!nodeC.isElement())
-                    continue;
+void SmugTalker::parseResponseListAlbumTmpl()
+{
+    QList<SmugAlbumTmpl> albumTList = m_albumTList;
 
-                e = nodeC.toElement();
+    emit signalBusy(false);
+    emit signalListAlbumTmplDone(m_errCode, errorToText(m_errCode, m_errMsg), albumTList);
+}
 
-                if (e.tagName() == QString::fromLatin1("SubCategory"))
-                {
-                    SmugCategory category;
-                    category.id   = e.attribute(QString::fromLatin1("id")).toLongLong();
-                    category.name = htmlToText(e.attribute(QString::fromLatin1("Name")));
-                    categoriesList.append(category);
-                }
-            }
+void SmugTalker::parseResponseListCategories()
+{
+    QList<SmugCategory> categoriesList = m_categoriesList;
 
-            errCode = 0;
-        }
-        else if (e.tagName() == QString::fromLatin1("err"))
-        {
-            errCode = e.attribute(QString::fromLatin1("code")).toInt();
-            errMsg  = e.attribute(QString::fromLatin1("msg"));
-            qCDebug(KIPIPLUGINS_LOG) << "Error:" << errCode << errMsg;
-        }
-    }
+    emit signalBusy(false);
+    emit signalListCategoriesDone(m_errCode, errorToText(m_errCode, m_errMsg), categoriesList);
+}
 
-    if (errCode == 15)  // 15: empty list
-        errCode = 0;
+void SmugTalker::parseResponseListSubCategories()
+{
+    QList<SmugCategory> categoriesList = m_categoriesList;
 
     emit signalBusy(false);
-    emit signalListSubCategoriesDone(errCode, errorToText(errCode, errMsg), categoriesList);
+    emit signalListSubCategoriesDone(m_errCode, errorToText(m_errCode, m_errMsg), categoriesList);
 }
 
-
 QString SmugTalker::htmlToText(const QString& htmlText)
 {
     QTextDocument txtDoc;
@@ -28,14 +28,26 @@
 
 #include <QList>
 #include <QString>
+#include <QUrl>
 #include <QObject>
+#include <QHash>
+#include <QPair>
 #include <QNetworkReply>
 #include <QNetworkAccessManager>
+#include <QXmlStreamReader>
 
 // local includes
 
 #include "smugitem.h"
 
+namespace KIPIPlugins
+{
+    class KPDownloader;
+    class KPListingCache;
+}
+
+using namespace KIPIPlugins;
+
 namespace KIPISmugPlugin
 {
 
@@ -49,6 +61,7 @@ public:
     ~SmugTalker();
 
     SmugUser getUser() const;
+    qint64   getLastImageID() const;
 
     bool    loggedIn() const;
     void    cancel();
@@ -70,7 +83,7 @@ public:
     bool    addPhoto(const QString& imgPath, qint64 albumID,
                      const QString& albumKey,
                      const QString& caption);
-    void    getPhoto(const QString& imgPath);
+    void    getPhoto(const QUrl& url, const QString& localPath);
 
 Q_SIGNALS:
 
@@ -80,7 +93,7 @@ Q_SIGNALS:
     void signalLoginDone(int errCode, const QString& errMsg);
     void signalAddPhotoDone(int errCode, const QString& errMsg);
     void signalGetPhotoDone(int errCode, const QString& errMsg,
-                            const QByteArray& photoData);
+                            const QString& localPath);
     void signalCreateAlbumDone(int errCode, const QString& errMsg, qint64 newAlbumID,
                                const QString& newAlbumKey);
     void signalListAlbumsDone(int errCode, const QString& errMsg,
@@ -98,19 +111,26 @@ private:
 
     QString htmlToText(const QString& htmlText);
     QString errorToText(int errCode, const QString& errMsg);
-    void parseResponseLogin(const QByteArray& data);
-    void parseResponseLogout(const QByteArray& data);
-    void parseResponseAddPhoto(const QByteArray& data);
-    void parseResponseCreateAlbum(const QByteArray& data);
-    void parseResponseListAlbums(const QByteArray& data);
-    void parseResponseListPhotos(const QByteArray& data);
-    void parseResponseListAlbumTmpl(const QByteArray& data);
-    void parseResponseListCategories(const QByteArray& data);
-    void parseResponseListSubCategories(const QByteArray& data);
+    void parseStartElement();
+    void parseEndElement();
+    void parseResponseLogin();
+    void parseResponseLogout();
+    void parseResponseAddPhoto();
+    void parseResponseCreateAlbum();
+    void parseResponseListAlbums();
+    void parseResponseListPhotos();
+    void parseResponseListAlbumTmpl();
+    void parseResponseListCategories();
+    void parseResponseListSubCategories();
+    void readResponse(const QByteArray& data);
+    void endResponse();
+    void emitResponse();
 
 private Q_SLOTS:
 
     void slotFinished(QNetworkReply* reply);
+    void slotReadyRead();
+    void slotDownloadDone(const QString& path, int errCode, const QString& errMsg);
 
 private:
 
@@ -124,10 +144,18 @@ private:
         SMUG_LISTCATEGORIES,
         SMUG_LISTSUBCATEGORIES,
         SMUG_CREATEALBUM,
-        SMUG_ADDPHOTO,
-        SMUG_GETPHOTO
+        SMUG_ADDPHOTO
     };
 
+    static bool isCachedListing(State state);
+    void startResponse(State state, QNetworkReply* const reply = 0);
+
+    bool listFromCache(State state, const QString& listing, const QNetworkRequest& request);
+    int  parseListing(State state, const QByteArray& data);
+    void revalidated(QNetworkReply* const reply);
+
+private:
+
     QWidget*               m_parent;
 
     QByteArray             m_buffer;
@@ -139,12 +167,33 @@ private:
     QString                m_sessionID;
 
     SmugUser               m_user;
+    qint64                 m_lastImageID;
 
     QNetworkAccessManager* m_netMngr;
 
     QNetworkReply*         m_reply;
+    KPDownloader*          m_downloader;
 
     State                  m_state;
+
+    /// The response being parsed, with the results found so far.
+    State                  m_parsing;
+    QXmlStreamReader       m_xml;
+    QString                m_xmlText;
+    int                    m_xmlDepth;
+    int                    m_errCode;
+    QString                m_errMsg;
+    QList<SmugAlbum>       m_albumsList;
+    QList<SmugPhoto>       m_photosList;
+    QList<SmugAlbumTmpl>   m_albumTList;
+    QList<SmugCategory>    m_categoriesList;
+    qint64                 m_newAlbumID;
+    QString                m_newAlbumKey;
+
+    /// Listings already shown from the cache, asked again in background.
+    KPListingCache*        m_listingCache;
+    QString                m_listing;
+    QHash<QNetworkReply*, QPair<State, QString> > m_revalidations;
 };
 
 } // namespace KIPISmugPlugin
@@ -59,6 +59,7 @@
 #include "kpimageinfo.h"
 #include "kpversion.h"
 #include "kpprogresswidget.h"
+#include "kpuploadhistory.h"
 #include "smugitem.h"
 #include "smugtalker.h"
 #include "smugwidget.h"
@@ -75,6 +76,8 @@ SmugWindow::SmugWindow(const QString& tmpFolder, bool import, QWidget* const /*p
     m_import      = import;
     m_imagesCount = 0;
     m_imagesTotal = 0;
+    m_hashing     = false;
+    m_history     = new KPUploadHistory(QString::fromLatin1("SmugMug"));
     m_widget      = new SmugWidget(this, iface(), import);
 
     setMainWidget(m_widget);
@@ -101,6 +104,9 @@ SmugWindow::SmugWindow(const QString& tmpFolder, bool import, QWidget* const /*p
     }
 
 
+    connect(m_history, SIGNAL(filesHashed(QStringList)),
+            this, SLOT(slotFilesHashed()) );
+
     connect(m_widget, SIGNAL(signalUserChangeRequest(bool)),
             this, SLOT(slotUserChangeRequest(bool)) );
 
@@ -170,8 +176,8 @@ SmugWindow::SmugWindow(const QString& tmpFolder, bool import, QWidget* const /*p
     connect(m_talker, SIGNAL(signalAddPhotoDone(int,QString)),
             this, SLOT(slotAddPhotoDone(int,QString)));
 
-    connect(m_talker, SIGNAL(signalGetPhotoDone(int,QString,QByteArray)),
-            this, SLOT(slotGetPhotoDone(int,QString,QByteArray)));
+    connect(m_talker, SIGNAL(signalGetPhotoDone(int,QString,QString)),
+            this, SLOT(slotGetPhotoDone(int,QString,QString)));
 
     connect(m_talker, SIGNAL(signalCreateAlbumDone(int,QString,qint64,QString)),
             this, SLOT(slotCreateAlbumDone(int,QString,qint64,QString)));
@@ -227,6 +233,7 @@ SmugWindow::SmugWindow(const QString& tmpFolder, bool import, QWidget* const /*p
 SmugWindow::~SmugWindow()
 {
     delete m_talker;
+    delete m_history;
 }
 
 void SmugWindow::closeEvent(QCloseEvent* e)
@@ -268,8 +275,11 @@ void SmugWindow::setUiInProgressState(bool inProgress)
 
 void SmugWindow::slotCancelClicked()
 {
+    m_hashing = false;
     m_talker->cancel();
     m_transferQueue.clear();
+    m_downloads.clear();
+    m_downloadErrors.clear();
     m_widget->m_imgList->cancelProcess();
     setUiInProgressState(false);
 }
@@ -454,9 +464,25 @@ void SmugWindow::slotListPhotosDone(int errCode, const QString &errMsg,
 
     m_transferQueue.clear();
 
+    // SmugMug lists the MD5 sum of each image: use it to rebuild the upload history of the album.
+    QMap<QByteArray, QString> remoteItems;
+
     for (int i = 0; i < photosList.size(); ++i)
     {
-        m_transferQueue.push_back(QUrl::fromLocalFile(photosList.at(i).originalURL));
+        m_transferQueue.push_back(QUrl(photosList.at(i).originalURL));
+
+        if (!photosList.at(i).md5.isEmpty())
+        {
+            remoteItems.insert(QByteArray::fromHex(photosList.at(i).md5.toLatin1()),
+                               QString::number(photosList.at(i).id));
+        }
+    }
+
+    if (!m_talker->getUser().nickName.isEmpty())
+    {
+        QString dataStr = m_widget->m_albumsCoB->itemData(m_widget->m_albumsCoB->currentIndex()).toString();
+        QString albumID = dataStr.left(dataStr.indexOf(QLatin1Char(':')));
+        m_history->rebuildTarget(m_talker->getUser().nickName, albumID, remoteItems);
     }
 
     if (m_transferQueue.isEmpty())
@@ -468,8 +494,8 @@ void SmugWindow::slotListPhotosDone(int errCode, const QString &errMsg,
     m_widget->progressBar()->setMaximum(m_imagesTotal);
     m_widget->progressBar()->setValue(0);
 
-    // start download with first photo in queue
-    downloadNextPhoto();
+    // start downloads of all photos in queue
+    downloadPhotos();
 }
 
 void SmugWindow::slotListAlbumTmplDone(int errCode, const QString &errMsg,
@@ -706,11 +732,31 @@ void SmugWindow::slotStartTransfer()
         setUiInProgressState(true);
 
         qCDebug(KIPIPLUGINS_LOG) << "m_currentAlbumID" << m_currentAlbumID;
-        uploadNextPhoto();
+
+        // Read the new files on a worker thread, the upload starts in slotFilesHashed().
+
+        QStringList paths;
+
+        foreach (const QUrl& url, m_transferQueue)
+        {
+            paths << url.toLocalFile();
+        }
+
+        m_hashing = true;
+        m_history->hashFiles(paths);
         qCDebug(KIPIPLUGINS_LOG) << "slotStartTransfer done";
     }
 }
 
+void SmugWindow::slotFilesHashed()
+{
+    if (!m_hashing)
+        return;
+
+    m_hashing = false;
+    uploadNextPhoto();
+}
+
 bool SmugWindow::prepareImageForUpload(const QString& imgPath)
 {
     QImage image;
@@ -766,6 +812,19 @@ bool SmugWindow::prepareImageForUpload(const QString& imgPath)
 
 void SmugWindow::uploadNextPhoto()
 {
+    // Skip files already sent to this album, before preparing anything.
+    while (!m_transferQueue.isEmpty() &&
+           m_history->isUploaded(m_transferQueue.first().toLocalFile(),
+                                 m_talker->getUser().nickName,
+                                 QString::number(m_currentAlbumID)))
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "Skipping" << m_transferQueue.first() << "already uploaded";
+        m_widget->m_imgList->processed(m_transferQueue.first(), true);
+        m_transferQueue.pop_front();
+        m_imagesCount++;
+        m_widget->progressBar()->setValue(m_imagesCount);
+    }
+
     if (m_transferQueue.isEmpty())
     {
         setUiInProgressState(false);
@@ -818,6 +877,10 @@ void SmugWindow::slotAddPhotoDone(int errCode, const QString& errMsg)
 
     if (errCode == 0)
     {
+        m_history->addUpload(m_transferQueue.first().toLocalFile(),
+                             m_talker->getUser().nickName,
+                             QString::number(m_currentAlbumID),
+                             QString::number(m_talker->getLastImageID()));
         m_transferQueue.pop_front();
         m_imagesCount++;
     }
@@ -838,7 +901,7 @@ void SmugWindow::slotAddPhotoDone(int errCode, const QString& errMsg)
     uploadNextPhoto();
 }
 
-void SmugWindow::downloadNextPhoto()
+void SmugWindow::downloadPhotos()
 {
     if (m_transferQueue.isEmpty())
     {
@@ -849,67 +912,53 @@ void SmugWindow::downloadNextPhoto()
     m_widget->progressBar()->setMaximum(m_imagesTotal);
     m_widget->progressBar()->setValue(m_imagesCount);
 
-    QString imgPath = m_transferQueue.first().url();
+    // Queue all downloads at once, the talker runs several of them in parallel.
+    while (!m_transferQueue.isEmpty())
+    {
+        QUrl url        = m_transferQueue.takeFirst();
+        QFileInfo info(url.fileName());
+        QString imgPath = m_widget->getDestinationPath() + QLatin1Char('/') + url.fileName();
+        int i           = 0;
+
+        // Do not let two photos with the same name be written to the same file.
+        while (m_downloads.contains(imgPath))
+        {
+            imgPath = m_widget->getDestinationPath() + QLatin1Char('/') + info.completeBaseName() +
+                      QString::fromLatin1("_%1.").arg(++i) + info.suffix();
+        }
 
-    m_talker->getPhoto(imgPath);
+        m_downloads.insert(imgPath);
+        m_talker->getPhoto(url, imgPath);
+    }
 }
 
 void SmugWindow::slotGetPhotoDone(int errCode, const QString& errMsg,
-                                  const QByteArray& photoData)
+                                  const QString& imgPath)
 {
-    QString imgPath = m_widget->getDestinationPath() + QLatin1Char('/')
-                      + m_transferQueue.first().fileName();
-
-    if (errCode == 0)
+    if (!m_downloads.remove(imgPath))
     {
-        QString errText;
-        QFile imgFile(imgPath);
+        // Transfer cancelled.
+        return;
+    }
 
-        if (!imgFile.open(QIODevice::WriteOnly))
-        {
-            errText = imgFile.errorString();
-        }
-        else if (imgFile.write(photoData) != photoData.size())
-        {
-            errText = imgFile.errorString();
-        }
-        else
-        {
-            imgFile.close();
-        }
+    m_imagesCount++;
+    m_widget->progressBar()->setValue(m_imagesCount);
 
-        if (errText.isEmpty())
-        {
-            m_transferQueue.pop_front();
-            m_imagesCount++;
-        }
-        else
-        {
-            if (QMessageBox::question(this, i18n("Processing Failed"),
-                                      i18n("Failed to save photo: %1\n"
-                                           "Do you want to continue?", errText))
-                != QMessageBox::Yes)
-            {
-                m_transferQueue.clear();
-                setUiInProgressState(false);
-                return;
-            }
-        }
+    if (errCode != 0)
+    {
+        m_downloadErrors << i18n("Failed to download photo %1: %2", QFileInfo(imgPath).fileName(), errMsg);
     }
-    else
+
+    if (m_downloads.isEmpty())
     {
-        if (QMessageBox::question(this, i18n("Processing Failed"),
-                                  i18n("Failed to download photo: %1\n"
-                                       "Do you want to continue?", errMsg))
-                != QMessageBox::Yes)
+        setUiInProgressState(false);
+
+        if (!m_downloadErrors.isEmpty())
         {
-            m_transferQueue.clear();
-            setUiInProgressState(false);
-            return;
+            QMessageBox::warning(this, i18n("Processing Failed"), m_downloadErrors.join(QLatin1Char('\n')));
+            m_downloadErrors.clear();
         }
     }
-
-    downloadNextPhoto();
 }
 
 void SmugWindow::slotCreateAlbumDone(int errCode, const QString& errMsg,
@@ -31,6 +31,8 @@
 #include <QList>
 #include <QUrl>
 #include <QCloseEvent>
+#include <QSet>
+#include <QStringList>
 
 // Libkipi includes
 
@@ -45,6 +47,11 @@
 using namespace KIPI;
 using namespace KIPIPlugins;
 
+namespace KIPIPlugins
+{
+    class KPUploadHistory;
+}
+
 namespace KIPISmugPlugin
 {
 
@@ -77,7 +84,7 @@ private Q_SLOTS:
     void slotLoginProgress(int step, int maxStep, const QString& label);
     void slotLoginDone(int errCode, const QString& errMsg);
     void slotAddPhotoDone(int errCode, const QString& errMsg);
-    void slotGetPhotoDone(int errCode, const QString& errMsg, const QByteArray& photoData);
+    void slotGetPhotoDone(int errCode, const QString& errMsg, const QString& imgPath);
     void slotCreateAlbumDone(int errCode, const QString& errMsg, qint64 newAlbumID, const QString& newAlbumKey);
     void slotListAlbumsDone(int errCode, const QString& errMsg, const QList <SmugAlbum>& albumsList);
     void slotListPhotosDone(int errCode, const QString& errMsg, const QList <SmugPhoto>& photosList);
@@ -90,6 +97,7 @@ private Q_SLOTS:
     void slotNewAlbumRequest();
 
     void slotStartTransfer();
+    void slotFilesHashed();
     void slotCancelClicked();
     void slotStopAndCloseProgressBar();
     void slotDialogFinished();
@@ -102,7 +110,7 @@ private:
 
     bool prepareImageForUpload(const QString& imgPath);
     void uploadNextPhoto();
-    void downloadNextPhoto();
+    void downloadPhotos();
 
     void readSettings();
     void writeSettings();
@@ -120,6 +128,9 @@ private:
     QString          m_tmpDir;
     QString          m_tmpPath;
 
+    /// True while the files of m_transferQueue are hashed, before the upload.
+    bool             m_hashing;
+
     bool             m_anonymousImport;
     QString          m_anonymousNick;
     QString          m_email;
@@ -130,9 +141,14 @@ private:
     qint64           m_currentCategoryID;
 
     KPLoginDialog*   m_loginDlg;
+    KPUploadHistory* m_history;
 
     QList<QUrl>      m_transferQueue;
 
+    /// Local paths of downloads in progress.
+    QSet<QString>    m_downloads;
+    QStringList      m_downloadErrors;
+
     SmugTalker*      m_talker;
     SmugWidget*      m_widget;
     SmugNewAlbum*    m_albumDlg;
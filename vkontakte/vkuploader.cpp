@@ -0,0 +1,346 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-28
+ * Description : a kipi plugin to export images to VKontakte web service,
+ *               upload of the photos by batches, several at once.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "vkuploader.h"
+
+// Qt includes
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QImage>
+#include <QImageReader>
+#include <QVector>
+#include <QFutureWatcher>
+#include <QtConcurrentMap>
+
+// libkvkontakte includes
+
+#include <Vkontakte/UploadPhotosJob>
+#include <Vkontakte/VkApi>
+
+// Local includes
+
+#include "kipiplugins_debug.h"
+#include "kputil.h"
+
+namespace KIPIVkontaktePlugin
+{
+
+/// Maximum number of files in one POST request to an upload server.
+static const int    s_maxPostFiles = 5;
+
+/// VKontakte refuses photos with a larger sum of width and height, or a larger file.
+static const int    s_maxSideSum   = 14000;
+static const qint64 s_maxFileSize  = 50 * 1024 * 1024;
+
+/** Return the file to upload for the image 'index': the image itself, or a scaled down
+ *  copy in the temporary folder when it is too large. Run on worker threads.
+ */
+class PrepareImage
+{
+public:
+
+    typedef QString result_type;
+
+    PrepareImage(const QStringList& files, const QDir& tmpDir)
+        : m_files(files),
+          m_tmpDir(tmpDir)
+    {
+    }
+
+    QString operator()(int index) const
+    {
+        const QString path = m_files.at(index);
+        const QSize size   = QImageReader(path).size();
+
+        if ((!size.isValid() || size.width() + size.height() <= s_maxSideSum) &&
+            QFileInfo(path).size() <= s_maxFileSize)
+        {
+            return path;
+        }
+
+        QImage image(path);
+
+        if (image.isNull())
+        {
+            // Let the server report the error.
+            return path;
+        }
+
+        if (image.width() + image.height() > s_maxSideSum)
+        {
+            const double factor = (double)s_maxSideSum / (image.width() + image.height());
+            image               = image.scaled(image.size() * factor, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+
+        const QString tmpPath = m_tmpDir.filePath(QString::number(index) + QLatin1Char('_') +
+                                                  QFileInfo(path).baseName() + QLatin1String(".jpg"));
+
+        qCDebug(KIPIPLUGINS_LOG) << "Scaling down" << path << "to" << image.size();
+
+        if (!image.save(tmpPath, "JPEG", 90))
+        {
+            return path;
+        }
+
+        return tmpPath;
+    }
+
+private:
+
+    QStringList m_files;
+    QDir        m_tmpDir;
+};
+
+class VkontakteUploader::Private
+{
+public:
+
+    struct Batch
+    {
+        int first;
+        int count;
+    };
+
+public:
+
+    Private()
+    {
+        vkapi       = 0;
+        watcher     = 0;
+        maxParallel = 3;
+        aid         = 0;
+        next        = 0;
+        uploaded    = 0;
+    }
+
+    Vkontakte::VkApi*        vkapi;
+    QFutureWatcher<QString>* watcher;
+    int                      maxParallel;
+    int                      aid;
+
+    QStringList              files;
+    /// The file to upload for each image, empty until the image is prepared.
+    QVector<QString>         prepared;
+    /// First image not sent yet.
+    int                      next;
+    /// Images of the finished batches.
+    int                      uploaded;
+
+    QHash<KJob*, Batch>      running;
+    QHash<KJob*, int>        percents;
+    QStringList              errors;
+};
+
+VkontakteUploader::VkontakteUploader(Vkontakte::VkApi* const vkapi, QObject* const parent)
+    : QObject(parent),
+      d(new Private)
+{
+    d->vkapi   = vkapi;
+    d->watcher = new QFutureWatcher<QString>(this);
+
+    connect(d->watcher, SIGNAL(resultReadyAt(int)),
+            this, SLOT(slotPrepared(int)));
+}
+
+VkontakteUploader::~VkontakteUploader()
+{
+    cancel();
+    d->watcher->waitForFinished();
+    removeTemporaryDir("vkontakte");
+    delete d;
+}
+
+void VkontakteUploader::setMaxParallel(int count)
+{
+    d->maxParallel = qMax(1, count);
+}
+
+void VkontakteUploader::start(const QStringList& files, int aid)
+{
+    cancel();
+
+    d->aid      = aid;
+    d->files    = files;
+    d->next     = 0;
+    d->uploaded = 0;
+    d->prepared = QVector<QString>(files.count());
+    d->errors.clear();
+
+    if (files.isEmpty())
+    {
+        emit signalFinished(d->errors);
+        return;
+    }
+
+    QList<int> indexes;
+
+    for (int i = 0 ; i < files.count() ; ++i)
+    {
+        indexes << i;
+    }
+
+    d->watcher->setFuture(QtConcurrent::mapped(indexes, PrepareImage(files, makeTemporaryDir("vkontakte"))));
+
+    emit signalProgress(0);
+    startNext();
+}
+
+void VkontakteUploader::cancel()
+{
+    d->watcher->cancel();
+
+    QList<KJob*> running = d->running.keys();
+    d->running.clear();
+    d->percents.clear();
+
+    foreach (KJob* const job, running)
+    {
+        disconnect(job, 0, this, 0);
+        job->kill();
+    }
+
+    d->files.clear();
+    d->prepared.clear();
+    d->next = 0;
+}
+
+bool VkontakteUploader::isRunning() const
+{
+    return (!d->running.isEmpty() || d->next < d->files.count());
+}
+
+void VkontakteUploader::slotPrepared(int index)
+{
+    if (index < d->prepared.count())
+    {
+        d->prepared[index] = d->watcher->resultAt(index);
+        startNext();
+    }
+}
+
+void VkontakteUploader::startNext()
+{
+    while (d->running.count() < d->maxParallel && d->next < d->files.count())
+    {
+        // Images are prepared in parallel: wait until the whole batch is ready.
+        const int count = qMin(s_maxPostFiles, d->files.count() - d->next);
+        QStringList batch;
+
+        for (int i = d->next ; i < d->next + count ; ++i)
+        {
+            if (d->prepared.at(i).isEmpty())
+                return;
+
+            batch << d->prepared.at(i);
+        }
+
+        Vkontakte::UploadPhotosJob* const job = new Vkontakte::UploadPhotosJob(d->vkapi->accessToken(),
+                                                                               batch,
+                                                                               false,
+                                                                               d->aid);
+
+        connect(job, SIGNAL(result(KJob*)),
+                this, SLOT(slotBatchDone(KJob*)));
+
+        connect(job, SIGNAL(progress(int)),
+                this, SLOT(slotBatchProgress(int)));
+
+        Private::Batch info;
+        info.first = d->next;
+        info.count = count;
+
+        d->running.insert(job, info);
+        d->percents.insert(job, 0);
+        d->next += count;
+        job->start();
+    }
+
+    if (d->running.isEmpty() && d->next >= d->files.count() && !d->files.isEmpty())
+    {
+        d->files.clear();
+        d->prepared.clear();
+        d->next = 0;
+
+        emit signalProgress(100);
+        emit signalFinished(d->errors);
+    }
+}
+
+void VkontakteUploader::slotBatchProgress(int percent)
+{
+    KJob* const job = qobject_cast<KJob*>(sender());
+
+    if (!d->percents.contains(job))
+        return;
+
+    d->percents[job] = percent;
+    emitProgress();
+}
+
+void VkontakteUploader::slotBatchDone(KJob* kjob)
+{
+    if (!d->running.contains(kjob))
+        return;
+
+    const Private::Batch batch = d->running.take(kjob);
+    d->percents.remove(kjob);
+    d->uploaded               += batch.count;
+
+    if (kjob->error())
+    {
+        qCDebug(KIPIPLUGINS_LOG) << "Upload of a batch failed:" << kjob->errorText();
+        d->errors << kjob->errorText();
+    }
+
+    for (int i = batch.first ; i < batch.first + batch.count ; ++i)
+    {
+        if (d->prepared.at(i) != d->files.at(i))
+        {
+            QFile::remove(d->prepared.at(i));
+        }
+    }
+
+    emitProgress();
+    startNext();
+}
+
+void VkontakteUploader::emitProgress()
+{
+    if (d->files.isEmpty())
+        return;
+
+    qint64 percent = (qint64)d->uploaded * 100;
+
+    for (QHash<KJob*, Private::Batch>::const_iterator it = d->running.constBegin() ;
+         it != d->running.constEnd() ; ++it)
+    {
+        percent += (qint64)d->percents.value(it.key()) * it.value().count;
+    }
+
+    emit signalProgress((int)(percent / d->files.count()));
+}
+
+} // namespace KIPIVkontaktePlugin
@@ -0,0 +1,93 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-28
+ * Description : a kipi plugin to export images to VKontakte web service,
+ *               upload of the photos by batches, several at once.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#ifndef VKUPLOADER_H
+#define VKUPLOADER_H
+
+// Qt includes
+
+#include <QObject>
+#include <QStringList>
+
+class KJob;
+
+namespace Vkontakte
+{
+    class VkApi;
+}
+
+namespace KIPIVkontaktePlugin
+{
+
+/**
+ * Upload photos to an album, by batches of the maximum number of files the
+ * VKontakte API accepts in one POST request.
+ *
+ * Each batch is an Vkontakte::UploadPhotosJob, which gets its own upload server:
+ * several batches are in flight, so the upload server of a batch is asked while
+ * the previous batches are transferring. The images too large for VKontakte
+ * are scaled down on worker threads beforehand.
+ */
+class VkontakteUploader : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit VkontakteUploader(Vkontakte::VkApi* const vkapi, QObject* const parent = 0);
+    ~VkontakteUploader();
+
+    /// Set the number of batches uploaded at the same time. Default is 3.
+    void setMaxParallel(int count);
+
+    void start(const QStringList& files, int aid);
+    void cancel();
+    bool isRunning() const;
+
+Q_SIGNALS:
+
+    void signalProgress(int percent);
+
+    /// Emitted when all batches are done, with the error of each failed batch.
+    void signalFinished(const QStringList& errors);
+
+private Q_SLOTS:
+
+    void slotPrepared(int index);
+    void slotBatchProgress(int percent);
+    void slotBatchDone(KJob* kjob);
+
+private:
+
+    void startNext();
+    void emitProgress();
+
+private:
+
+    class Private;
+    Private* const d;
+};
+
+} // namespace KIPIVkontaktePlugin
+
+#endif // VKUPLOADER_H
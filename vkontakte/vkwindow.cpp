@@ -53,7 +53,6 @@
 
 // libkvkontakte includes
 
-#include <Vkontakte/UploadPhotosJob>
 #include <Vkontakte/VkApi>
 
 // LibKIPI includes
@@ -70,6 +69,7 @@
 #include "kpprogresswidget.h"
 #include "albumchooserwidget.h"
 #include "authinfowidget.h"
+#include "vkuploader.h"
 
 namespace KIPIVkontaktePlugin
 {
@@ -79,6 +79,7 @@ VkontakteWindow::VkontakteWindow(bool import, QWidget* const parent)
 {
     m_albumsBox = NULL;
     m_vkapi     = new Vkontakte::VkApi(this);
+    m_uploader  = new VkontakteUploader(m_vkapi, this);
 
     // read settings from file
     readSettings();
@@ -210,6 +211,12 @@ VkontakteWindow::VkontakteWindow(bool import, QWidget* const parent)
     connect(m_vkapi, SIGNAL(authenticated()), // TBD: busy status handling needs improvement
             this, SLOT(updateBusyStatusReady()));
 
+    connect(m_uploader, SIGNAL(signalProgress(int)),
+            m_progressBar, SLOT(setValue(int)));
+
+    connect(m_uploader, SIGNAL(signalFinished(QStringList)),
+            this, SLOT(slotPhotoUploadDone(QStringList)));
+
     updateBusyStatus(true);
 }
 
@@ -283,6 +290,7 @@ void VkontakteWindow::readSettings()
     m_vkapi->setAppId(m_appId);
     m_vkapi->setRequiredPermissions(Vkontakte::AppPermissions::Photos);
     m_vkapi->setInitialAccessToken(grp.readEntry("AccessToken", ""));
+    m_uploader->setMaxParallel(grp.readEntry("Parallel Uploads", 3));
 }
 
 void VkontakteWindow::writeSettings()
@@ -348,9 +356,9 @@ void VkontakteWindow::updateHeaderLabel()
 
 //---------------------------------------------------------------------------
 
-void VkontakteWindow::handleVkError(KJob* kjob)
+void VkontakteWindow::handleVkError(const QString& errorText)
 {
-    QMessageBox::critical(this, i18nc("@title:window", "Request to VKontakte failed"), kjob->errorText());
+    QMessageBox::critical(this, i18nc("@title:window", "Request to VKontakte failed"), errorText);
 }
 
 //---------------------------------------------------------------------------
@@ -375,19 +383,8 @@ void VkontakteWindow::slotStartTransfer()
         foreach(const QUrl& url, m_imgList->imageUrls(true))
             files.append(url.toLocalFile());
 
-        Vkontakte::UploadPhotosJob* const job = new Vkontakte::UploadPhotosJob(m_vkapi->accessToken(),
-                                                                               files,
-                                                                               false /*m_checkKeepOriginal->isChecked()*/,
-                                                                               aid);
-
-        connect(job, SIGNAL(result(KJob*)),
-                this, SLOT(slotPhotoUploadDone(KJob*)));
-
-        connect(job, SIGNAL(progress(int)),
-                m_progressBar, SLOT(setValue(int)));
-
-        m_jobs.append(job);
-        job->start();
+        // Sent by batches, several at once, see VkontakteUploader.
+        m_uploader->start(files, aid);
     }
 
     m_progressBar->show();
@@ -395,15 +392,11 @@ void VkontakteWindow::slotStartTransfer()
     m_progressBar->progressThumbnailChanged(QIcon(QLatin1String(":/icons/kipi-icon.svg")).pixmap(22, 22));
 }
 
-void VkontakteWindow::slotPhotoUploadDone(KJob* kjob)
+void VkontakteWindow::slotPhotoUploadDone(const QStringList& errors)
 {
-    Vkontakte::UploadPhotosJob* const job = dynamic_cast<Vkontakte::UploadPhotosJob*>(kjob);
-    Q_ASSERT(job);
-    m_jobs.removeAll(job);
-
-    if (job == 0 || job->error())
+    if (!errors.isEmpty())
     {
-        handleVkError(job);
+        handleVkError(errors.join(QLatin1String("\n")));
     }
 
     m_progressBar->hide();
@@ -34,7 +34,6 @@
 #include "kptooldialog.h"
 
 class QLabel;
-class KJob;
 
 namespace KIPI
 {
@@ -61,6 +60,7 @@ namespace KIPIVkontaktePlugin
 
 class AlbumChooserWidget;
 class AuthInfoWidget;
+class VkontakteUploader;
 
 class VkontakteWindow : public KPToolDialog
 {
@@ -84,7 +84,7 @@ Q_SIGNALS:
 protected Q_SLOTS:
 
     // requesting photo information
-    void slotPhotoUploadDone(KJob* kjob);
+    void slotPhotoUploadDone(const QStringList& errors);
 
     void slotStartTransfer();
 
@@ -106,7 +106,7 @@ protected:
 
     void reset();
 
-    void handleVkError(KJob* kjob);
+    void handleVkError(const QString& errorText);
 
     void closeEvent(QCloseEvent* event) Q_DECL_OVERRIDE;
 
@@ -134,8 +134,8 @@ protected:
 
     KPProgressWidget*              m_progressBar;
 
-    /// Pointers to running jobs
-    QList<KJob*>                   m_jobs;
+    /// Upload of the photos
+    VkontakteUploader*             m_uploader;
 
     Vkontakte::VkApi*              m_vkapi;
 
@@ -0,0 +1,231 @@
+/* ============================================================
+ *
+ * This file is a part of KDE project
+ *
+ *
+ * Date        : 2018-03-28
+ * Description : unit tests of the Yandex RSA encryption.
+ *
+ * Copyright (C) 2018 by agent <agent at local>
+ *
+ * This program is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General
+ * Public License as published by the Free Software Foundation;
+ * either version 2, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * ============================================================ */
+
+#include "yandexrsatest.h"
+
+// C++ includes
+
+#include <vector>
+
+// Qt includes
+
+#include <QByteArray>
+#include <QSysInfo>
+#include <QTest>
+
+// Local includes
+
+#include "yandexrsa.h"
+
+using namespace YandexAuth;
+
+QTEST_GUILESS_MAIN(YandexRSATest)
+
+/* The expected values below were computed with the previous implementation of the
+ * encryption, the 32 bits one from pegwit, before it was moved to 64 bits limbs and
+ * Montgomery multiplication. They must not change: the Yandex server decrypts them.
+ */
+
+/// 1024 bits modulus, its most significant bit, and so the one of its top limb, is set.
+static const char* const s_modulus1024 = "A019966FE60D971BD8F93CF1F90325B7B6BFB6803DF9F7DF55C58E20C9D8DA8B"
+                                       "2FA0327B91226CCB3700BA634C9B234AFDDF5D749BF92925CF12BC4154AF73E0"
+                                       "FB8F600BDEFD65C8DED6FA0721022A2B852ECEC60FF1E551F36A56A1C1CCE505"
+                                       "DADC18F741D8E799822A252C6910099E631E118EBBFD1EF01AAF70B788E7BEE1";
+
+/// 200 bits modulus, the top limb is only partly used.
+static const char* const s_modulus200  = "A59B63E11DE8AB0A8C5CDE0DE58F4C0893DFF3CD3FF473C8B7";
+
+/// 128 bits modulus, exactly two full limbs.
+static const char* const s_modulus128  = "FBA7C2AF39A5E5FC8B6A6F9834BE2751";
+
+static QByteArray message300()
+{
+    QByteArray msg;
+
+    for (int i = 0 ; i < 300 ; ++i)
+    {
+        msg.append((char)(i * 7 + 3));
+    }
+
+    return msg;
+}
+
+static QByteArray message40()
+{
+    QByteArray msg;
+
+    for (int i = 0 ; i < 40 ; ++i)
+    {
+        msg.append((char)(255 - i * 5));
+    }
+
+    return msg;
+}
+
+/** Encrypt 'msg' as YandexAuth::makeCredentials() does, with the key "modulus#exponent".
+ */
+static QByteArray encrypt(const QByteArray& key, const QByteArray& msg)
+{
+    CCryptoProviderRSA rsa;
+    rsa.ImportPublicKey(key.constData());
+
+    std::vector<char> out(msg.size() * 2 + 1024);
+    std::size_t size = 0;
+    rsa.Encrypt(msg.constData(), msg.size(), &out[0], size);
+
+    return QByteArray(&out[0], (int)size);
+}
+
+static vlong fromHex(const QByteArray& hex)
+{
+    const QByteArray bin = QByteArray::fromHex(hex);
+    vlong v;
+    v.load(reinterpret_cast<const unsigned char*>(bin.constData()), bin.size());
+
+    return v;
+}
+
+static QByteArray toHex(const vlong& v)
+{
+    QByteArray bin((v.bits() + 31) / 32 * 4, 0);
+    v.store(reinterpret_cast<unsigned char*>(bin.data()), bin.size());
+
+    return bin.toHex().toUpper();
+}
+
+void YandexRSATest::testEncrypt_data()
+{
+    QTest::addColumn<QByteArray>("key");
+    QTest::addColumn<QByteArray>("message");
+    QTest::addColumn<QByteArray>("expected");
+
+    // Three portions of 127 bytes, each one xored with the previous cipher.
+    QTest::newRow("1024 bits, exponent 65537")
+        << QByteArray(s_modulus1024) + "#10001"
+        << message300()
+        << QByteArray("7F0080006C1E7DD0253218086094CFD7EBDF2E6EE0C3A25FCBF0791314786D7B"
+                       "6FDCC2CD1642ECA92D5313B85601BC3B3CF67111AF4CBCB1CB8AA4EB7CA4E271"
+                       "EBE9BFBA4BF8BD325990AC4FFEBB8D3894CB92AEEE85BB0E75E55F7BA115209A"
+                       "A4D00BE96FD31474EE6988E6D1E06F00349A754D8CC029EE1B4C829E2E2CEEDC"
+                       "0F4440E97F00800001CA146EE3694C054C7AAFF98FD4B2377647318930AD2588"
+                       "7F715439E639ADAAF8AC4399C6BBD153C82E1C4B1EF482D2DE5D6E3897B12CE6"
+                       "2795A3009817FE00948BC49CED9C4FD12D1AD07833105123E3178DB11EFEF5BD"
+                       "0BE9653C3110350EA1E1A881DEBA64AA5D35501C4366806E11B361E79E5FAD11"
+                       "FBEC885F654E17DD2E008000585CA2D3181B44CFEF674C8E386715498E604853"
+                       "5AA75EE92CFEE6B1C66294E5CA0CBAB5CAA57EE4404104B9B78B3AC987A9980D"
+                       "9C465CEFBA0075C3AEB16ABED4B1443510355B7EAE526BBF4B594F493B852035"
+                       "3A22A52251A3B933A8795E2EF2FD5FE78907E834B8C1FB30DCEBEAD0DD809D43"
+                       "FD5051CE05A55EFABBD89CF6");
+
+    QTest::newRow("1024 bits, exponent 1")
+        << QByteArray(s_modulus1024) + "#1"
+        << message300()
+        << QByteArray("7F00800000030A11181F262D343B424950575E656C737A81888F969DA4ABB2B9"
+                       "C0C7CED5DCE3EAF1F8FF060D141B222930373E454C535A61686F767D848B9299"
+                       "A0A7AEB5BCC3CAD1D8DFE6EDF4FB020910171E252C333A41484F565D646B7279"
+                       "80878E959CA3AAB1B8BFC6CDD4DBE2E9F0F7FE050C131A21282F363D444B5259"
+                       "60676E757F008000007C80808080808080808080808080808080808080808080"
+                       "8080808080808080808080808080808080808080808080808080808080808080"
+                       "8080808080808080808080808080808080808080808080808080808080808080"
+                       "8080808080808080808080808080808080808080808080808080808080808080"
+                       "80808080808080802E0030000000F580838A91989FA6ADB4BBC2C9D0D7DEE5EC"
+                       "F3FA01080F161D242B323940474E555C636A71787F868D949BA2A9B0");
+
+    QTest::newRow("200 bits, exponent 65537")
+        << QByteArray(s_modulus200) + "#10001"
+        << message40()
+        << QByteArray("18001C000000002FB9D2717A3A6F15DCB8058B455B704A6437627C06173D1DFB"
+                       "10001C000000007C7C878E762BB13F7B20D48449F0B367F7772A0DE3B72D8EB8");
+
+    QTest::newRow("128 bits, exponent 3")
+        << QByteArray(s_modulus128) + "#3"
+        << QByteArray("kipi-plugins")
+        << QByteArray("0C0010007C207E6B48BF3A1E0FBD07CBDA78A8EF");
+}
+
+void YandexRSATest::testEncrypt()
+{
+    QFETCH(QByteArray, key);
+    QFETCH(QByteArray, message);
+    QFETCH(QByteArray, expected);
+
+    // The lengths of the portions are written in the host byte order.
+    if (QSysInfo::ByteOrder != QSysInfo::LittleEndian)
+    {
+        QSKIP("The expected values were computed on a little endian host");
+    }
+
+    QCOMPARE(encrypt(key, message).toHex().toUpper(), expected);
+}
+
+void YandexRSATest::testPublicKey_data()
+{
+    QTest::addColumn<QByteArray>("key");
+    QTest::addColumn<QByteArray>("plain");
+    QTest::addColumn<QByteArray>("expected");
+
+    QTest::newRow("input above modulus, same limbs")
+        << QByteArray(s_modulus128) + "#10001"
+        << QByteArray("FBA7C2AF39A5E5FC8B6A6F9834BE2756")
+        << QByteArray("2D49C5DBED099A5DEC4A53BEC0ACEE53");
+
+    QTest::newRow("input longer than modulus")
+        << QByteArray(s_modulus128) + "#3"
+        << QByteArray("0100000000000000000000000000000000000000000000003039")
+        << QByteArray("3ACFDE083E00BE4440D34EF917C52E30");
+
+    QTest::newRow("input is modulus - 1")
+        << QByteArray(s_modulus1024) + "#10001"
+        << QByteArray(s_modulus1024).left(255) + "0"
+        << QByteArray("A019966FE60D971BD8F93CF1F90325B7B6BFB6803DF9F7DF55C58E20C9D8DA8B"
+                       "2FA0327B91226CCB3700BA634C9B234AFDDF5D749BF92925CF12BC4154AF73E0"
+                       "FB8F600BDEFD65C8DED6FA0721022A2B852ECEC60FF1E551F36A56A1C1CCE505"
+                       "DADC18F741D8E799822A252C6910099E631E118EBBFD1EF01AAF70B788E7BEE0");
+
+    QTest::newRow("input is modulus + 2, exponent 1")
+        << QByteArray(s_modulus1024) + "#1"
+        << QByteArray(s_modulus1024).left(255) + "3"
+        << QByteArray("00000002");
+}
+
+void YandexRSATest::testPublicKey()
+{
+    QFETCH(QByteArray, key);
+    QFETCH(QByteArray, plain);
+    QFETCH(QByteArray, expected);
+
+    public_key pk;
+    pk.MakeMe(key.constData());
+
+    QCOMPARE(toHex(pk.encrypt(fromHex(plain))), expected);
+}
+
+void YandexRSATest::benchmarkEncrypt()
+{
+    const QByteArray key = QByteArray(s_modulus1024) + "#10001";
+    const QByteArray msg = message300();
+
+    QBENCHMARK
+    {
+        encrypt(key, msg);
+    }
+}
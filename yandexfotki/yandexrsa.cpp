@@ -26,7 +26,9 @@
  *    http://company.yandex.com/
  *
  * Included by Roman Tsisyk <roman at tsisyk dot com>
- * All unneeded parts was commented out and can be removed
+ * Only the encryption with the public key is kept. The big numbers
+ * use 64 bits limbs, Montgomery multiplication and sliding window
+ * exponentiation.
  *
  * ============================================================ */
 
@@ -36,744 +38,388 @@
 
 #include <cstdlib> // std::size_t
 #include <cstring>
+#include <algorithm>
 
 namespace YandexAuth
 {
 
-static vlong modexp( const vlong& x, const vlong& e, const vlong& m );    // m must be odd
-//static vlong gcd( const vlong &X, const vlong &Y ); // greatest common denominator
-static vlong modinv( const vlong& a, const vlong& m ); // modular inverse
-
 // VLONG.CPP -----------------------------------
 
-class flex_unit // Provides storage allocation and index checking
-{
-public:
-
-    unsigned* a;  // array of units
-    unsigned z; // units allocated
-
-    unsigned n; // used units (read-only)
-    flex_unit();
-    ~flex_unit();
-    void clear(); // set n to zero
-    unsigned get( unsigned i ) const;       // get ith unsigned
-    void set( unsigned i, unsigned x ); // set ith unsigned
-    void reserve( unsigned x );         // storage hint
-
-    // Time critical routine
-    void fast_mul( flex_unit& x, flex_unit& y, unsigned n );
-};
-
-class vlong_value : public flex_unit
-{
-public:
-    unsigned share; // share count, used by vlong to delay physical copying
-    int is_zero() const;
-    int test( unsigned i ) const;
-    unsigned bits() const;
-    int cf( vlong_value& x ) const;
-    void shl();
-    void shr();
-    void shr( unsigned n );
-    void add( vlong_value& x );
-    void subtract( vlong_value& x );
-    void init( unsigned x );
-    void copy( vlong_value& x );
-    operator unsigned(); // Unsafe conversion to unsigned
-    vlong_value();
-    void mul( vlong_value& x, vlong_value& y );
-    void divide( vlong_value& x, vlong_value& y, vlong_value& rem );
-};
+typedef vlong::limb limb;
+
+#define BPL ( 8*sizeof(limb) ) // Number of bits in a limb
+
+// Double precision multiply: hi:result = x*y + a + c, which never overflows
+static inline limb mul_add_limb( limb x, limb y, limb a, limb c, limb& hi )
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 t = (unsigned __int128)x * y + a + c;
+    hi = (limb)( t >> BPL );
+    return (limb)t;
+#else
+    const limb mask = 0xFFFFFFFF;
+    limb ll  = ( x & mask ) * ( y & mask );
+    limb lh  = ( x & mask ) * ( y >> 32 );
+    limb hl  = ( x >> 32 ) * ( y & mask );
+    limb hh  = ( x >> 32 ) * ( y >> 32 );
+    limb mid = ( ll >> 32 ) + ( lh & mask ) + ( hl & mask );
+    limb lo  = ( mid << 32 ) | ( ll & mask );
+    hi       = hh + ( lh >> 32 ) + ( hl >> 32 ) + ( mid >> 32 );
+    lo      += a;
+    hi      += ( lo < a );
+    lo      += c;
+    hi      += ( lo < c );
+    return lo;
+#endif
+}
 
-unsigned flex_unit::get( unsigned i ) const
+static bool less_n( const limb* x, const limb* y, std::size_t n )
 {
-    if ( i >= n )
+    while (n)
     {
-        return 0;
-    }
-
-    return a[i];
-}
+        n -= 1;
 
-void flex_unit::clear()
-{
-    n = 0;
-}
+        if ( x[n] != y[n] )
+        {
+            return x[n] < y[n];
+        }
+    }
 
-flex_unit::flex_unit()
-{
-    z = 0;
-    a = 0;
-    n = 0;
+    return false;
 }
 
-flex_unit::~flex_unit()
+static void sub_n( limb* r, const limb* x, const limb* y, std::size_t n )
 {
-    unsigned i=z;
+    // r = x - y, modulo 2**(n*BPL)
+    limb borrow = 0;
 
-    while (i)
+    for (std::size_t i=0; i<n; i+=1)
     {
-        i-=1;    // burn
-        a[i] = 0;
+        limb u = x[i] - y[i];
+        limb b = ( u > x[i] );
+        r[i]   = u - borrow;
+        borrow = b | ( r[i] > u );
     }
-
-    delete [] a;
 }
 
-void flex_unit::reserve( unsigned x )
+vlong::vlong( limb x )
 {
-    if (x > z)
+    if (x)
     {
-        unsigned* na = new unsigned[x];
-
-        for (unsigned i=0; i<n; i+=1)
-        {
-            na[i] = a[i];
-        }
-
-        delete [] a;
-        a = na;
-        z = x;
+        a.push_back(x);
     }
 }
 
-void flex_unit::set( unsigned i, unsigned x )
+void vlong::normalise()
 {
-    if ( i < n )
-    {
-        a[i] = x;
-
-        if (x==0) while (n && a[n-1]==0)
-            {
-                n-=1;    // normalise
-            }
-    }
-    else if ( x )
+    while ( !a.empty() && a.back() == 0 )
     {
-        reserve(i+1);
-
-        for (unsigned j=n; j<i; j+=1)
-        {
-            a[j] = 0;
-        }
-
-        a[i] = x;
-        n = i+1;
+        a.pop_back();
     }
 }
 
-// Macros for doing double precision multiply
-#define BPU ( 8*sizeof(unsigned) )       // Number of bits in an unsigned
-#define lo(x) ( (x) & ((1<<(BPU/2))-1) ) // lower half of unsigned
-#define hi(x) ( (x) >> (BPU/2) )         // upper half
-#define lh(x) ( (x) << (BPU/2) )         // make upper half
-
-void flex_unit::fast_mul( flex_unit& x, flex_unit& y, unsigned keep )
+void vlong::mul_add( limb m, limb c )
 {
-    // *this = (x*y) % (2**keep)
-    unsigned i,j,limit = (keep+BPU-1)/BPU; // size of result in words
-    reserve(limit);
-
-    for (i=0; i<limit; i+=1)
+    for (std::size_t i=0; i<a.size(); i+=1)
     {
-        a[i] = 0;
+        a[i] = mul_add_limb( a[i], m, 0, c, c );
     }
 
-    unsigned min = x.n;
-
-    if (min>limit)
+    if (c)
     {
-        min = limit;
+        a.push_back(c);
     }
-
-    for (i=0; i<min; i+=1)
-    {
-        unsigned m = x.a[i];
-        unsigned c = 0; // carry
-        unsigned min = i+y.n;
-
-        if (min>limit)
-        {
-            min = limit;
-        }
-
-        for ( j=i; j<min; j+=1 )
-        {
-            // This is the critical loop
-            // Machine dependent code could help here
-            // c:a[j] = a[j] + c + m*y.a[j-i];
-            unsigned w, v = a[j], p = y.a[j-i];
-            v += c;
-            c = ( v < c );
-            w = lo(p)*lo(m);
-            v += w;
-            c += ( v < w );
-            w = lo(p)*hi(m);
-            c += hi(w);
-            w = lh(w);
-            v += w;
-            c += ( v < w );
-            w = hi(p)*lo(m);
-            c += hi(w);
-            w = lh(w);
-            v += w;
-            c += ( v < w );
-            c += hi(p) * hi(m);
-            a[j] = v;
-        }
-
-        while ( c && j<limit )
-        {
-            a[j] += c;
-            c = a[j] < c;
-            j += 1;
-        }
-    }
-
-    // eliminate unwanted bits
-    keep %= BPU;
-
-    if (keep)
-    {
-        a[limit-1] &= (1<<keep)-1;
-    }
-
-    // calculate n
-    while (limit && a[limit-1]==0)
-    {
-        limit-=1;
-    }
-
-    n = limit;
 }
 
-vlong_value::operator unsigned()
+void vlong::load( const unsigned char* buf, std::size_t n )
 {
-    return get(0);
-}
+    a.assign( ( n + sizeof(limb) - 1 ) / sizeof(limb), 0 );
 
-int vlong_value::is_zero() const
-{
-    return n==0;
-}
-
-int vlong_value::test( unsigned i ) const
-{
-    return ( get(i/BPU) & (1<<(i%BPU)) ) != 0;
-}
-
-unsigned vlong_value::bits() const
-{
-    unsigned x = n*BPU;
-
-    while (x && test(x-1)==0)
+    for (std::size_t i=0; i<n; i+=1)
     {
-        x -= 1;
+        a[i / sizeof(limb)] |= (limb)buf[n-1-i] << ( 8 * ( i % sizeof(limb) ) );
     }
 
-    return x;
+    normalise();
 }
 
-int vlong_value::cf( vlong_value& x ) const
+void vlong::store( unsigned char* buf, std::size_t n ) const
 {
-    if ( n > x.n )
+    for (std::size_t i=0; i<n; i+=1)
     {
-        return +1;
+        std::size_t k = i / sizeof(limb);
+        buf[n-1-i]    = k < a.size() ? (unsigned char)( a[k] >> ( 8 * ( i % sizeof(limb) ) ) ) : 0;
     }
+}
 
-    if ( n < x.n )
+unsigned vlong::bits() const
+{
+    if ( a.empty() )
     {
-        return -1;
+        return 0;
     }
 
-    unsigned i = n;
+    unsigned x = (unsigned)( a.size() - 1 ) * BPL;
 
-    while (i)
+    for (limb top = a.back(); top; top >>= 1)
     {
-        i -= 1;
-
-        if ( get(i) > x.get(i) )
-        {
-            return +1;
-        }
-
-        if ( get(i) < x.get(i) )
-        {
-            return -1;
-        }
+        x += 1;
     }
 
-    return 0;
+    return x;
 }
 
-void vlong_value::shl()
+bool vlong::test( unsigned i ) const
 {
-    unsigned carry = 0;
-    unsigned N = n; // necessary, since n can change
+    std::size_t k = i / BPL;
 
-    for (unsigned i=0; i<=N; i+=1)
-    {
-        unsigned u = get(i);
-        set(i,(u<<1)+carry);
-        carry = u>>(BPU-1);
-    }
+    return k < a.size() && ( ( a[k] >> ( i % BPL ) ) & 1 );
 }
 
-void vlong_value::shr()
+bool vlong::is_zero() const
 {
-    unsigned carry = 0;
-    unsigned i=n;
-
-    while (i)
-    {
-        i -= 1;
-        unsigned u = get(i);
-        set(i,(u>>1)+carry);
-        carry = u<<(BPU-1);
-    }
+    return a.empty();
 }
 
-void vlong_value::shr( unsigned x )
+class monty // class for montgomery modular exponentiation
 {
-    unsigned delta = x/BPU;
-    x %= BPU;
-
-    for (unsigned i=0; i<n; i+=1)
-    {
-        unsigned u = get(i+delta);
-
-        if (x)
-        {
-            u >>= x;
-            u += get(i+delta+1) << (BPU-x);
-        }
+public:
 
-        set(i,u);
-    }
-}
+    explicit monty( const vlong& M ); // M must be odd
+    vlong exp( const vlong& x, const vlong& e );
 
-void vlong_value::add( vlong_value& x )
-{
-    unsigned carry = 0;
-    unsigned max = n;
+private:
 
-    if (max<x.n)
-    {
-        max = x.n;
-    }
+    void mul( limb* r, const limb* x, const limb* y ); // r = x*y/R mod m, r can be x or y
+    void shl_mod( limb* r, limb bit );                 // r = ( 2*r + bit ) mod m, requires r < m
+    void reduce( limb* r, const vlong& x );            // r = x mod m
 
-    reserve(max);
+private:
 
-    for (unsigned i=0; i<max+1; i+=1)
-    {
-        unsigned u = get(i);
-        u = u + carry;
-        carry = ( u < carry );
-        unsigned ux = x.get(i);
-        u = u + ux;
-        carry += ( u < ux );
-        set(i,u);
-    }
-}
+    std::vector<limb> m;   // modulus, N limbs
+    std::vector<limb> R2;  // R*R mod m, with R = 2**(N*BPL)
+    std::vector<limb> T;   // work register, N+2 limbs
+    std::size_t       N;
+    limb              n1;  // -1/m mod 2**BPL
+};
 
-void vlong_value::subtract( vlong_value& x )
+monty::monty( const vlong& M )
+    : m(M.a),
+      N(M.a.size())
 {
-    unsigned carry = 0;
-    unsigned N = n;
+    T.resize(N+2);
 
-    for (unsigned i=0; i<N; i+=1)
-    {
-        unsigned ux = x.get(i);
-        ux += carry;
+    // Newton iteration, each step doubles the number of correct low bits,
+    // and any odd number is its own inverse modulo 8.
+    limb inv = m[0];
 
-        if ( ux >= carry )
-        {
-            unsigned u = get(i);
-            unsigned nu = u - ux;
-            carry = nu > u;
-            set(i,nu);
-        }
+    for (int i=0; i<5; i+=1)
+    {
+        inv *= 2 - m[0] * inv;
     }
-}
 
-void vlong_value::init( unsigned x )
-{
-    clear();
-    set(0,x);
-}
+    n1 = 0 - inv;
 
-void vlong_value::copy( vlong_value& x )
-{
-    clear();
-    unsigned i=x.n;
+    // R*R mod m, doubling 1 modulo m
+    R2.assign(N, 0);
+    R2[0] = 1;
 
-    while (i)
+    for (std::size_t i=0; i<2*N*BPL; i+=1)
     {
-        i -= 1;
-        set( i, x.get(i) );
+        shl_mod( &R2[0], 0 );
     }
 }
 
-vlong_value::vlong_value()
+void monty::shl_mod( limb* r, limb bit )
 {
-    share = 0;
-}
+    limb carry = bit;
 
-void vlong_value::mul( vlong_value& x, vlong_value& y )
-{
-    fast_mul( x, y, x.bits()+y.bits() );
-}
-
-void vlong_value::divide( vlong_value& x, vlong_value& y, vlong_value& rem )
-{
-    init(0);
-    rem.copy(x);
-    vlong_value m,s;
-    m.copy(y);
-    s.init(1);
-
-    while ( rem.cf(m) > 0 )
+    for (std::size_t j=0; j<N; j+=1)
     {
-        m.shl();
-        s.shl();
+        limb u = r[j];
+        r[j]   = ( u << 1 ) | carry;
+        carry  = u >> ( BPL - 1 );
     }
 
-    while ( rem.cf(y) >= 0 )
+    if ( carry || !less_n( r, &m[0], N ) )
     {
-        while ( rem.cf(m) < 0 )
-        {
-            m.shr();
-            s.shr();
-        }
-
-        rem.subtract( m );
-        add( s );
+        sub_n( r, r, &m[0], N );
     }
 }
 
-// Implementation of vlong
-
-void vlong::load( unsigned* a, unsigned n )
+void monty::reduce( limb* r, const vlong& x )
 {
-    docopy();
-    value->clear();
+    // Only needed when x does not fit in N limbs, bit after bit is fast enough
+    std::fill( r, r+N, 0 );
 
-    for (unsigned i=0; i<n; i+=1)
+    for (unsigned i = x.bits(); i > 0; i-=1)
     {
-        value->set(i,a[i]);
+        shl_mod( r, x.test(i-1) ? 1 : 0 );
     }
 }
 
-void vlong::store( unsigned* a, unsigned n ) const
+void monty::mul( limb* r, const limb* x, const limb* y )
 {
-    for (unsigned i=0; i<n; i+=1)
+    // Coarsely integrated operand scanning: one limb of y is multiplied,
+    // then one limb is reduced, so that T never exceeds N+2 limbs.
+    limb* t = &T[0];
+    std::fill( T.begin(), T.end(), 0 );
+
+    for (std::size_t i=0; i<N; i+=1)
     {
-        a[i] = value->get(i);
-    }
-}
+        // T += x * y[i]
+        limb c = 0;
 
-unsigned vlong::get_nunits() const
-{
-    return value->n;
-}
+        for (std::size_t j=0; j<N; j+=1)
+        {
+            // This is the critical loop
+            t[j] = mul_add_limb( x[j], y[i], t[j], c, c );
+        }
 
-unsigned vlong::bits() const
-{
-    return value->bits();
-}
+        limb s = t[N] + c;
+        t[N+1] = ( s < c );
+        t[N]   = s;
 
-void vlong::docopy()
-{
-    if ( value->share )
-    {
-        value->share -= 1;
-        vlong_value* nv = new vlong_value;
-        nv->copy(*value);
-        value = nv;
-    }
-}
+        // T = ( T + q*m ) / 2**BPL, q is chosen so that the low limb is zero
+        limb q = t[0] * n1;
+        mul_add_limb( q, m[0], t[0], 0, c );
 
-int vlong::cf( const vlong& x ) const
-{
-    int neg = negative && !value->is_zero();
-    //int neg2 = x.negative && !x.value->is_zero();
+        for (std::size_t j=1; j<N; j+=1)
+        {
+            t[j-1] = mul_add_limb( q, m[j], t[j], c, c );
+        }
 
-    if ( neg == (x.negative && !x.value->is_zero()) )
-        //if ( neg == neg2)
-    {
-        return value->cf( *x.value );
+        s      = t[N] + c;
+        t[N-1] = s;
+        t[N]   = t[N+1] + ( s < c );
     }
 
-    else if ( neg )
+    // T < 2*m
+    if ( t[N] || !less_n( t, &m[0], N ) )
     {
-        return -1;
+        sub_n( r, t, &m[0], N );
     }
     else
     {
-        return +1;
+        std::copy( t, t+N, r );
     }
 }
 
-vlong::vlong (unsigned x)
+vlong monty::exp( const vlong& x, const vlong& e )
 {
-    value = new vlong_value;
-    negative = 0;
-    value->init(x);
-}
+    // Sliding window: the exponent is scanned from its most significant bit,
+    // by windows of up to k bits ending with a one, so that only the odd
+    // powers of x have to be precomputed.
+    const unsigned bits = e.bits();
+    const unsigned k    = bits > 671 ? 6 : bits > 239 ? 5 : bits > 79 ? 4 : bits > 23 ? 3 : bits > 5 ? 2 : 1;
 
-vlong::vlong ( const vlong& x ) // copy constructor
-{
-    negative = x.negative;
-    value = x.value;
-    value->share += 1;
-}
+    // x**1, x**3, ..., x**(2**k-1), in montgomery form
+    // x may be above m, mul() only needs it to fit in N limbs.
+    std::vector< std::vector<limb> > odd( 1u << (k-1), std::vector<limb>(N, 0) );
 
-vlong& vlong::operator =(const vlong& x)
-{
-    if ( value->share )
+    if ( x.a.size() > N )
     {
-        value->share -=1;
+        reduce( &odd[0][0], x );
     }
     else
     {
-        delete value;
+        std::copy( x.a.begin(), x.a.end(), odd[0].begin() );
     }
 
-    value = x.value;
-    value->share += 1;
-    negative = x.negative;
-    return *this;
-}
+    mul( &odd[0][0], &odd[0][0], &R2[0] );
 
-vlong::~vlong()
-{
-    if ( value->share )
+    if ( odd.size() > 1 )
     {
-        value->share -=1;
-    }
-    else
-    {
-        delete value;
-    }
-}
-
-vlong::operator unsigned () // conversion to unsigned
-{
-    return *value;
-}
+        std::vector<limb> x2(N);
+        mul( &x2[0], &odd[0][0], &odd[0][0] );
 
-vlong& vlong::operator +=(const vlong& x)
-{
-    if ( negative == x.negative )
-    {
-        docopy();
-        value->add( *x.value );
-    }
-    else if ( value->cf( *x.value ) >= 0 )
-    {
-        docopy();
-        value->subtract( *x.value );
-    }
-    else
-    {
-        vlong tmp = *this;
-        *this = x;
-        *this += tmp;
+        for (std::size_t i=1; i<odd.size(); i+=1)
+        {
+            mul( &odd[i][0], &odd[i-1][0], &x2[0] );
+        }
     }
 
-    return *this;
-}
+    std::vector<limb> result(N, 0);
+    bool started = false;
+    int  i       = (int)bits - 1;
 
-vlong& vlong::operator -=(const vlong& x)
-{
-    if ( negative != x.negative )
-    {
-        docopy();
-        value->add( *x.value );
-    }
-    else if ( value->cf( *x.value ) >= 0 )
+    while ( i >= 0 )
     {
-        docopy();
-        value->subtract( *x.value );
-    }
-    else
-    {
-        vlong tmp = *this;
-        *this = x;
-        *this -= tmp;
-        negative = 1 - negative;
-    }
+        if ( !e.test(i) )
+        {
+            if (started)
+            {
+                mul( &result[0], &result[0], &result[0] );
+            }
 
-    return *this;
-}
+            i -= 1;
+            continue;
+        }
 
-vlong operator +( const vlong& x, const vlong& y )
-{
-    vlong result = x;
-    result += y;
-    return result;
-}
+        int l = i - (int)k + 1;
 
-vlong operator -( const vlong& x, const vlong& y )
-{
-    vlong result = x;
-    result -= y;
-    return result;
-}
+        if ( l < 0 )
+        {
+            l = 0;
+        }
 
-vlong operator *( const vlong& x, const vlong& y )
-{
-    vlong result;
-    result.value->mul( *x.value, *y.value );
-    result.negative = x.negative ^ y.negative;
-    return result;
-}
+        while ( !e.test(l) )
+        {
+            l += 1;
+        }
 
-vlong operator /( const vlong& x, const vlong& y )
-{
-    vlong result;
-    vlong_value rem;
-    result.value->divide( *x.value, *y.value, rem );
-    result.negative = x.negative ^ y.negative;
-    return result;
-}
+        unsigned w = 0;
 
-#if defined(__DEBUG__)
-void print_vlong( const vlong_value& v, const char* name )
-{
-    printf("%s value(%d): ", name, v.n * sizeof(unsigned int));
+        for (int j=i; j>=l; j-=1)
+        {
+            if (started)
+            {
+                mul( &result[0], &result[0], &result[0] );
+            }
 
-    for (int i = 0; i < v.n; ++i)
-    {
-        printf("%08X", v.a[i]);
-    }
+            w = ( w << 1 ) | ( e.test(j) ? 1 : 0 );
+        }
 
-    printf("\n");
-}
-#endif
+        if (started)
+        {
+            mul( &result[0], &result[0], &odd[w >> 1][0] );
+        }
+        else
+        {
+            result  = odd[w >> 1];
+            started = true;
+        }
 
-vlong operator %( const vlong& x, const vlong& y )
-{
-    vlong result;
-    vlong_value divide;
-    divide.divide( *x.value, *y.value, *result.value );
-    result.negative = x.negative; // not sure about this?
-    return result;
-}
-/*
-static vlong gcd( const vlong &X, const vlong &Y )
-{
-    vlong x=X, y=Y;
-    while (1)
-    {
-        if ( y == (vlong)0 ) return x;
-        x = x % y;
-        if ( x == (vlong)0 ) return y;
-        y = y % x;
+        i = l - 1;
     }
-}
-*/
 
-static vlong modinv( const vlong& a, const vlong& m ) // modular inverse
-// returns i in range 1..m-1 such that i*a = 1 mod m
-// a must be in range 1..m-1
-{
-    vlong j=1,i=0,b=m,c=a,x,y;
+    vlong r;
 
-    while ( c != (vlong)0 )
+    if ( !started )
     {
-        x = b / c;
-        y = b - x*c;
-        b = c;
-        c = y;
-        y = j;
-        j = i - j*x;
-        i = y;
+        // x**0
+        r.a.assign(1, 1);
+        return r;
     }
 
-    if ( i < (vlong)0 )
-    {
-        i += m;
-    }
+    // back from montgomery form
+    std::vector<limb> one(N, 0);
+    one[0] = 1;
+    mul( &result[0], &result[0], &one[0] );
 
-    return i;
+    r.a = result;
+    r.normalise();
+    return r;
 }
 
-class monty // class for montgomery modular exponentiation
-{
-    vlong R,R1,m,n1;
-    vlong T,k;   // work registers
-    unsigned N;  // bits for R
-    void mul( vlong& x, const vlong& y );
-public:
-    vlong exp( const vlong& x, const vlong& e );
-    monty( const vlong& M );
-};
-
-monty::monty( const vlong& M )
-{
-    m = M;
-    N = 0;
-    R = 1;
-
-    while ( R < M )
-    {
-        R += R;
-        N += 1;
-    }
-
-    R1 = modinv( R-m, m );
-    n1 = R - modinv( m, R );
-}
-
-void monty::mul( vlong& x, const vlong& y )
+static vlong modexp( const vlong& x, const vlong& e, const vlong& m )
 {
-    // T = x*y;
-    T.value->fast_mul( *x.value, *y.value, N*2 );
-
-    // k = ( T * n1 ) % R;
-    k.value->fast_mul( *T.value, *n1.value, N );
-
-    // x = ( T + k*m ) / R;
-    x.value->fast_mul( *k.value, *m.value, N*2 );
-    x += T;
-    x.value->shr( N );
-
-    if (x>=m)
+    // montgomery reduction needs an odd modulus, as any RSA one
+    if ( m.bits() < 2 || !m.test(0) )
     {
-        x -= m;
+        return vlong();
     }
-}
-
-vlong monty::exp( const vlong& x, const vlong& e )
-{
-    vlong result = R-m, t = ( x * R ) % m;
-    unsigned bits = e.value->bits();
-    unsigned i = 0;
-
-    while (1)
-    {
-        if ( e.value->test(i) )
-        {
-            mul( result, t);
-        }
-
-        i += 1;
 
-        if ( i == bits )
-        {
-            break;
-        }
-
-        mul( t, t );
-    }
-
-    return ( result * R1 ) % m;
-}
-
-static vlong modexp( const vlong& x, const vlong& e, const vlong& m )
-{
     monty me(m);
     return me.exp( x,e );
 }
@@ -782,76 +428,9 @@ static vlong modexp( const vlong& x, const vlong& e, const vlong& m )
 
 vlong public_key::encrypt( const vlong& plain )
 {
-#if defined(__DEBUG__)
-
-    if ( plain >= m )
-    {
-        printf("ERROR: plain too big for this key\n");
-    }
-
-#endif
     return modexp( plain, e, m );
 }
 
-/*
-vlong private_key::decrypt( const vlong& cipher )
-{
-    // Calculate values for performing decryption
-    // These could be cached, but the calculation is quite fast
-    vlong d = modinv( e, (p-(vlong)1)*(q-(vlong)1) );
-    vlong u = modinv( p, q );
-    vlong dp = d % (p-(vlong)1);
-    vlong dq = d % (q-(vlong)1);
-
-    // Apply chinese remainder theorem
-    vlong a = modexp( cipher % p, dp, p );
-    vlong b = modexp( cipher % q, dq, q );
-    if ( b < a ) b += q;
-    return a + p * ( ((b-a)*u) % q );
-}
-
-void vlong_pair_2_str (char *me_str,vlong &m,vlong &e)
-{
-    const char *hex_str = "0123456789ABCDEF";
-
-    char tmp_str[MAX_CRYPT_BITS/2+1];
-
-    unsigned int x;
-    unsigned int me_len = 0;
-    unsigned int i;
-    unsigned int j;
-    vlong m1 = m;
-    vlong e1 = e;
-    vlong zero = 0;
-
-    i = 0;
-    while (m1 != zero)
-    {
-        x = m1 % (vlong) 16;
-        m1 = m1 / (vlong) 16;
-        tmp_str[i++] = hex_str[x];
-    }
-
-    for (j=0; j < i; ++j)
-        me_str[me_len++] = tmp_str[i-1-j];
-
-    me_str[me_len++] = '#';
-
-    i = 0;
-    while (e1 != zero)
-    {
-        x = e1 %(vlong)16;
-        e1 = e1 / (vlong)16;
-        tmp_str[i++] = hex_str[x];
-    }
-
-    for (j=0; j < i; ++j)
-        me_str[me_len++] = tmp_str[i-1-j];
-
-    me_str[me_len] = 0;
-}
-*/
-
 void str_2_vlong_pair (const char* me_str,vlong& m,vlong& e)
 {
     int i;
@@ -876,59 +455,31 @@ void str_2_vlong_pair (const char* me_str,vlong& m,vlong& e)
 
     for (i = 0; i<dash_pos; ++i)
     {
-        m = m * (vlong)16;
-
         if (me_str[i] > '9')
         {
-            m = m + (vlong) (me_str[i]-'A'+10);
+            m.mul_add(16, (unsigned) (me_str[i]-'A'+10));
         }
         else
         {
-            m = m + (vlong) (me_str[i]-'0');
+            m.mul_add(16, (unsigned) (me_str[i]-'0'));
         }
     }
 
     for (i = dash_pos+1; i<me_len; ++i)
     {
-        e = e * (vlong)16;
-
         if (me_str[i] > '9')
         {
-            e = e + (vlong) (me_str[i]-'A'+10);
+            e.mul_add(16, (unsigned) (me_str[i]-'A'+10));
         }
         else
         {
-            e = e + (vlong) (me_str[i]-'0');
+            e.mul_add(16, (unsigned) (me_str[i]-'0'));
         }
     }
 
 
 }
 
-/*
-void private_key::MakeMeStr(char * me_str)
-{
-    vlong_pair_2_str (me_str,m,e);
-}
-
-void private_key::MakePqStr(char * me_str)
-{
-    vlong_pair_2_str (me_str,p,q);
-}
-
-
-void private_key::MakePq (const char *me_str)
-{
-    str_2_vlong_pair (me_str,p,q);
-    {
-    m = p*q;
-    e = 50001; // must be odd since p-1 and q-1 are even
-    while ( gcd(p-(vlong)1,e) != (vlong)1 || gcd(q-(vlong)1,e) != (vlong)1 ) e += 2;
-    }
-
-}
-*/
-
 void public_key::MakeMe(const char* me_str)
 {
     str_2_vlong_pair (me_str,m,e);
@@ -942,98 +493,25 @@ CCryptoProviderRSA::~CCryptoProviderRSA()
 {
 }
 
-void inline _rmemcpy (char* dst,const char* src,size_t size)
-{
-    src += size;
-
-    while (size--)
-    {
-        *dst++ = *(--src);
-    }
-}
-/*
-void CCryptoProviderRSA::GetBlockSize(int &enbs, int &debs)
-{
-    enbs=0;
-    debs=0;
-}
-*/
 void CCryptoProviderRSA::EncryptPortion(const char* pt, size_t pt_size, char* ct, size_t& ct_size)
 {
     vlong plain, cipher;
 
-    const size_t bytes_per_unit = BPU / 8;
-
-    size_t padding = (pt_size & 3) ? (4 - (pt_size & 3)) : 0;
-    char tmp[MAX_CRYPT_BITS/4];
-
-    // ensure big-endianness
-    _rmemcpy(tmp, pt, pt_size);
-    memset(tmp + pt_size, 0, padding);
-    plain.load(reinterpret_cast<unsigned int*>(tmp), (int)(pt_size+padding) / bytes_per_unit);
+    // big-endian numbers
+    plain.load(reinterpret_cast<const unsigned char*>(pt), pt_size);
 
     cipher = prkface.encrypt(plain);
-    ct_size = cipher.get_nunits() * bytes_per_unit;
 
-    // ensure big-endianness
-    cipher.store(reinterpret_cast<unsigned int*>(tmp), (int)ct_size / bytes_per_unit);
-    _rmemcpy(ct, tmp, ct_size);
+    // whole 32 bits words, as the reference implementation
+    ct_size = (cipher.bits() + 31) / 32 * 4;
+    cipher.store(reinterpret_cast<unsigned char*>(ct), ct_size);
 }
 
-/*
-void CCryptoProviderRSA::DecryptPortion(const char *ct, size_t ct_size, char *pt, size_t &pt_size)
-{
-    vlong plain, cipher;
-
-    const size_t bytes_per_unit = BPU / 8;
-
-    char tmp[MAX_CRYPT_BITS/4];
-
-    // ensure big-endianness
-    _rmemcpy(tmp, ct, ct_size);
-
-    cipher.load((unsigned int*)tmp, (int)ct_size / bytes_per_unit);
-    plain = prkface.decrypt(cipher);
-
-    // ensure big-endianness
-    plain.store((unsigned int*)tmp, plain.get_nunits());
-    _rmemcpy(pt, tmp, pt_size);
-}
-*/
-
 void CCryptoProviderRSA::ImportPublicKey(const char* pk)
 {
     prkface.MakeMe(pk);
 }
 
-/*
-void CCryptoProviderRSA::ImportPrivateKey(const char *pk)
-{
-    prkface.MakePq(pk);
-}
-
-void CCryptoProviderRSA::ExportPublicKey(char *pk)
-{
-    prkface.MakeMeStr(pk);
-}
-
-void CCryptoProviderRSA::ExportPrivateKey(char *pk)
-{
-    prkface.MakePqStr(pk);
-}
-
-#if defined(__DEBUG__)
-void printbuf(const char * buf, int size)
-{
-    for(const char * p = buf; p < buf + size; ++p)
-    {
-        printf("%02X", *p & 0x000000ff);
-    }
-    printf("\n");
-}
-#endif
-*/
-
 void CCryptoProviderRSA::Encrypt(const char* inbuf, size_t in_size,char* outbuf, size_t& out_size)
 {
     size_t i,cp_size;
@@ -1088,57 +566,4 @@ void CCryptoProviderRSA::Encrypt(const char* inbuf, size_t in_size,char* outbuf,
     return;
 }
 
-/*
-void CCryptoProviderRSA::Decrypt(const char *inbuf, size_t in_size,char *outbuf, size_t &out_size)
-{
-    size_t i, cp_size,pt_size;
-
-    char portbuf[MAX_CRYPT_BITS/8];
-    char cpbuf[MAX_CRYPT_BITS/4];
-
-    unsigned short lmi, lmo;
-
-    // must ensure that any data block would be < key's modulus
-    // hence -1
-    // TODO: size_t here ?
-    int portion_len = (prkface.m.bits() - 1)  / 8;
-    char prev_crypted[portion_len];
-    memset(&prev_crypted, 0, portion_len);
-
-    const char *inp=inbuf;
-    out_size = 0;
-
-    while(in_size)
-    {
-        memcpy (&lmi,inp,sizeof (unsigned short)); inp += sizeof(unsigned short); in_size -= sizeof(unsigned short);
-        memcpy (&lmo,inp,sizeof (unsigned short)); inp += sizeof(unsigned short); in_size -= sizeof(unsigned short);
-
-        if (lmo>in_size)
-            break;
-
-        memcpy (cpbuf,inp,lmo);
-        cp_size = lmo;
-        pt_size = lmi;
-
-        DecryptPortion(cpbuf, cp_size, portbuf, pt_size);
-
-        if (lmi>pt_size)
-            lmi=(unsigned short)pt_size;
-
-        for (i=0; i<lmi; ++i)
-            portbuf[i] ^= prev_crypted[i];
-
-        for (i=0; i< portion_len; ++i)
-            prev_crypted[i] = i < cp_size ? cpbuf[i] : 0;
-
-        memcpy (outbuf+out_size,portbuf,lmi);
-        out_size += lmi;
-
-        inp+=lmo;
-        in_size-=lmo;
-    }
-    return;
-}
-*/
-
 } // namespace YandexAuth
@@ -26,7 +26,9 @@
  *    http://company.yandex.com/
  *
  * Included by Roman Tsisyk <roman at tsisyk dot com>
- * All unneeded parts was commented out and can be removed
+ * Only the encryption with the public key is kept. The big numbers
+ * use 64 bits limbs, Montgomery multiplication and sliding window
+ * exponentiation.
  *
  * ============================================================ */
 
@@ -36,69 +38,33 @@
 // C++ includes
 
 #include <cstdlib> // std::size_t
+#include <cstdint>
+#include <vector>
 
 namespace YandexAuth
 {
 // VLONG.HPP ---------------------------------
 
-class vlong // very long integer - can be used like long
+class vlong // very long unsigned integer, only what RSA encryption needs
 {
 public:
 
-    // Standard arithmetic operators
-    friend vlong operator +( const vlong& x, const vlong& y );
-    friend vlong operator -( const vlong& x, const vlong& y );
-    friend vlong operator *( const vlong& x, const vlong& y );
-    friend vlong operator /( const vlong& x, const vlong& y );
-    friend vlong operator %( const vlong& x, const vlong& y );
-    vlong& operator +=( const vlong& x );
-    vlong& operator -=( const vlong& x );
-
-    // Standard comparison operators
-    friend inline int operator !=( const vlong& x, const vlong& y )
-    {
-        return x.cf( y ) != 0;
-    }
-    friend inline int operator ==( const vlong& x, const vlong& y )
-    {
-        return x.cf( y ) == 0;
-    }
-    friend inline int operator >=( const vlong& x, const vlong& y )
-    {
-        return x.cf( y ) >= 0;
-    }
-    friend inline int operator <=( const vlong& x, const vlong& y )
-    {
-        return x.cf( y ) <= 0;
-    }
-    friend inline int operator > ( const vlong& x, const vlong& y )
-    {
-        return x.cf( y ) > 0;
-    }
-    friend inline int operator < ( const vlong& x, const vlong& y )
-    {
-        return x.cf( y ) < 0;
-    }
-
-    // Construction and conversion operations
-    vlong ( unsigned x=0 );
-    vlong ( const vlong& x ); // copy constructor
-    ~vlong();
-
-    operator unsigned ();
-    vlong& operator =(const vlong& x);
-
-    void     load( unsigned* a, unsigned n );  // load value, a[0] is lsw
-    void     store( unsigned* a, unsigned n ) const;  // low level save, a[0] is lsw
-    unsigned get_nunits() const;
+    typedef std::uint64_t limb;
+
+    vlong( limb x=0 );
+
+    void     mul_add( limb m, limb c );                          // *this = *this * m + c
+    void     load( const unsigned char* buf, std::size_t n );    // load value, buf[0] is the most significant byte
+    void     store( unsigned char* buf, std::size_t n ) const;   // save the n low bytes, buf[0] is the most significant one
     unsigned bits() const;
+    bool     test( unsigned i ) const;
+    bool     is_zero() const;
 
 private:
 
-    class vlong_value* value;
-    int   negative;
-    int   cf( const vlong& x ) const;
-    void  docopy();
+    void normalise();
+
+    std::vector<limb> a;  // limbs, a[0] is the least significant one, no leading zero
 
     friend class monty;
 };
@@ -110,7 +76,7 @@ class public_key
 public:
 
     vlong m,e;
-    vlong encrypt( const vlong& plain ); // Requires 0 <= plain < m
+    vlong encrypt( const vlong& plain ); // plain >= m is reduced modulo m
     void  MakeMe(const char*);
 };
 
@@ -119,16 +85,6 @@ class private_key : public public_key
 public:
 
     vlong p,q;
-    /*
-        vlong decrypt( const vlong& cipher );
-        void create( const char * r1, const char * r2 );
-        // r1 and r2 should be null terminated random strings
-        // each of length around 35 characters (for a 500 bit modulus)
-
-        void MakeMeStr(char *);
-        void MakePq(const char *);
-        void MakePqStr(char *);
-    */
 };
 
 #define MAX_CRYPT_BITS 1024
@@ -138,9 +94,7 @@ class CCryptoProviderRSA
     class private_key prkface;
 
     void EncryptPortion(const char* pt, std::size_t, char* ct, std::size_t&);
-    /*
-        void DecryptPortion(const char *ct, std::size_t,char *pt, std::size_t &);
-    */
+
 public:
 
     CCryptoProviderRSA();
@@ -148,13 +102,6 @@ public:
 
     virtual void Encrypt(const char*, std::size_t,char*, std::size_t&);
     virtual void ImportPublicKey(const char*);
-    /*
-        virtual void Decrypt(const char *, std::size_t,char *, std::size_t &);
-        virtual void ExportPublicKey(char *);
-        virtual void ExportPrivateKey(char *);
-        virtual void ImportPrivateKey(const char *);
-        virtual void GetBlockSize(int&, int&);
-    */
 };
 
 } // namespace YandexAuth
@@ -29,6 +29,8 @@
 #include <QDomDocument>
 #include <QDomElement>
 #include <QDomNode>
+#include <QDomNamedNodeMap>
+#include <QDomAttr>
 #include <QPointer>
 #include <QFile>
 #include <QFileInfo>
@@ -62,6 +64,10 @@ YandexFotkiTalker::YandexFotkiTalker(QObject* const parent)
     : QObject(parent),
       m_state(STATE_UNAUTHENTICATED),
       m_lastPhoto(0),
+      m_xmlDepth(0),
+      m_inEntry(false),
+      m_photosPageStart(0),
+      m_photosErrors(false),
       m_netMngr(0),
       m_reply(0)
 {
@@ -201,6 +207,18 @@ void YandexFotkiTalker::listPhotosNext()
 
     m_reply = m_netMngr->get(netRequest);
 
+    // the feed is parsed while it is received, see readPhotosFeed()
+    connect(m_reply, SIGNAL(readyRead()),
+            this, SLOT(slotReadyRead()));
+
+    m_xml.clear();
+    m_xmlText.clear();
+    m_xmlDepth        = 0;
+    m_inEntry         = false;
+    m_photosNextUrl.clear();
+    m_photosPageStart = m_photos.size();
+    m_photosErrors    = false;
+
     m_buffer.resize(0);
 }
 
@@ -485,7 +503,10 @@ void YandexFotkiTalker::slotFinished(QNetworkReply* reply)
         return;
     }
 
-    m_buffer.append(reply->readAll());
+    if (m_state == STATE_LISTPHOTOS)
+        readPhotosFeed(reply->readAll());
+    else
+        m_buffer.append(reply->readAll());
 
     switch(m_state)
     {
@@ -779,8 +800,6 @@ void YandexFotkiTalker::parseResponseListAlbums()
         qCDebug(KIPIPLUGINS_LOG) << "Found album:" << m_albums.last();
     }
 
-    // TODO: pagination like listPhotos
-
     // if an error has occurred and we didn't find anything => notify user
     if (errorOccurred && m_albums.empty())
     {
@@ -791,6 +810,8 @@ void YandexFotkiTalker::parseResponseListAlbums()
     // we have next page
     if (!m_albumsNextUrl.isNull())
     {
+        // Show the albums found so far while the next page is coming.
+        emit signalListAlbumsDone(m_albums);
         return listAlbumsNext();
     }
     else
@@ -803,57 +824,80 @@ void YandexFotkiTalker::parseResponseListAlbums()
 
 bool YandexFotkiTalker::parsePhotoXml(const QDomElement& entryElem, YandexFotkiPhoto& photo)
 {
+    PhotoEntry entry;
+    entry.line = entryElem.lineNumber();
 
-    const QDomElement urn             = entryElem.firstChildElement(QString::fromLatin1("id"));
-    const QDomElement author          = entryElem.firstChildElement(QString::fromLatin1("author"));
-    const QDomElement title           = entryElem.firstChildElement(QString::fromLatin1("title"));
-    const QDomElement summary         = entryElem.firstChildElement(QString::fromLatin1("summary"));
-    const QDomElement published       = entryElem.firstChildElement(QString::fromLatin1("published"));
-    const QDomElement edited          = entryElem.firstChildElement(QString::fromLatin1("app:edited"));
-    const QDomElement updated         = entryElem.firstChildElement(QString::fromLatin1("updated"));
-    const QDomElement created         = entryElem.firstChildElement(QString::fromLatin1("f:created"));
-    const QDomElement accessAttr      = entryElem.firstChildElement(QString::fromLatin1("f:access"));
-    const QDomElement hideOriginal    = entryElem.firstChildElement(QString::fromLatin1("f:hide_original"));
-    const QDomElement disableComments = entryElem.firstChildElement(QString::fromLatin1("f:disable_comments"));
-    const QDomElement adult           = entryElem.firstChildElement(QString::fromLatin1("f:xxx"));
-    const QDomElement content         = entryElem.firstChildElement(QString::fromLatin1("content"));
-
-    QDomElement linkSelf;
-    QDomElement linkEdit;
-    QDomElement linkMedia;
-    QDomElement linkAlbum;
-
-    QDomElement linkElem = entryElem.firstChildElement(QString::fromLatin1("link"));
-
-    for ( ; !linkElem.isNull();
-          linkElem = linkElem.nextSiblingElement(QString::fromLatin1("link")))
+    for (QDomElement child = entryElem.firstChildElement() ; !child.isNull() ;
+         child = child.nextSiblingElement())
     {
+        const QString name         = child.tagName();
+        const QDomNamedNodeMap map = child.attributes();
+        QXmlStreamAttributes attrs;
 
-        if (linkElem.attribute(QString::fromLatin1("rel")) == QString::fromLatin1("self"))
-            linkSelf = linkElem;
-        else if (linkElem.attribute(QString::fromLatin1("rel")) == QString::fromLatin1("edit"))
-            linkEdit = linkElem;
-        else if (linkElem.attribute(QString::fromLatin1("rel")) == QString::fromLatin1("edit-media"))
-            linkMedia = linkElem;
-        else if (linkElem.attribute(QString::fromLatin1("rel")) == QString::fromLatin1("album"))
-            linkAlbum = linkElem;
+        for (int i = 0 ; i < map.count() ; ++i)
+        {
+            const QDomAttr attr = map.item(i).toAttr();
+            attrs.append(attr.name(), attr.value());
+        }
+
+        if (name == QString::fromLatin1("link"))
+        {
+            entry.links.append(attrs);
+        }
+        else if (name == QString::fromLatin1("category"))
+        {
+            entry.categories.append(attrs);
+        }
+        else if (!entry.attributes.contains(name))
+        {
+            entry.attributes.insert(name, attrs);
+            entry.texts.insert(name, child.text());
+        }
+    }
+
+    return parsePhotoEntry(entry, photo);
+}
+
+bool YandexFotkiTalker::parsePhotoEntry(const PhotoEntry& entry, YandexFotkiPhoto& photo)
+{
+    const QXmlStreamAttributes accessAttr = entry.attributes.value(QString::fromLatin1("f:access"));
+    const QXmlStreamAttributes content    = entry.attributes.value(QString::fromLatin1("content"));
+
+    QString linkSelf;
+    QString linkEdit;
+    QString linkMedia;
+    QString linkAlbum;
+
+    foreach (const QXmlStreamAttributes& link, entry.links)
+    {
+        const QStringRef rel  = link.value(QString::fromLatin1("rel"));
+        const QString    href = link.value(QString::fromLatin1("href")).toString();
+
+        if (rel == QString::fromLatin1("self"))
+            linkSelf = href;
+        else if (rel == QString::fromLatin1("edit"))
+            linkEdit = href;
+        else if (rel == QString::fromLatin1("edit-media"))
+            linkMedia = href;
+        else if (rel == QString::fromLatin1("album"))
+            linkAlbum = href;
         // else skip <link>
     }
 
     // XML sanity checks
-    if (urn.isNull() || title.isNull() ||
+    if (!entry.texts.contains(QString::fromLatin1("id")) || !entry.texts.contains(QString::fromLatin1("title")) ||
         linkSelf.isNull() || linkEdit.isNull() ||
         linkMedia.isNull() || linkAlbum.isNull() ||
         !content.hasAttribute(QString::fromLatin1("src")) ||
         !accessAttr.hasAttribute(QString::fromLatin1("value")))
     {
 
-        qCDebug(KIPIPLUGINS_LOG) << "Invalid XML data, error on line" << entryElem.lineNumber();
+        qCDebug(KIPIPLUGINS_LOG) << "Invalid XML data, error on line" << entry.line;
         // simple skip this record, no addtional messages to user
         return false;
     }
 
-    const QString accessString = accessAttr.attribute(QString::fromLatin1("value"));
+    const QString accessString = accessAttr.value(QString::fromLatin1("value")).toString();
 
     YandexFotkiPhoto::Access access;
 
@@ -869,29 +913,33 @@ bool YandexFotkiTalker::parsePhotoXml(const QDomElement& entryElem, YandexFotkiP
         access = YandexFotkiPhoto::ACCESS_PUBLIC;
     }
 
-    photo.m_urn    = urn.text();
-    photo.m_author = author.text();
-
-    photo.setTitle(title.text());
-    photo.setSummary(summary.text());
-    photo.m_apiEditUrl    = linkEdit.attribute(QString::fromLatin1("href"));
-    photo.m_apiSelfUrl    = linkSelf.attribute(QString::fromLatin1("href"));
-    photo.m_apiMediaUrl   = linkMedia.attribute(QString::fromLatin1("href"));
-    photo.m_apiAlbumUrl   = linkAlbum.attribute(QString::fromLatin1("href"));
-    photo.m_publishedDate = QDateTime::fromString(published.text(), QString::fromLatin1("yyyy-MM-ddTHH:mm:ssZ"));
-    photo.m_editedDate    = QDateTime::fromString(edited.text(), QString::fromLatin1("yyyy-MM-ddTHH:mm:ssZ"));
-    photo.m_updatedDate   = QDateTime::fromString(updated.text(), QString::fromLatin1("yyyy-MM-ddTHH:mm:ssZ"));
-    photo.m_createdDate   = QDateTime::fromString(created.text(), QString::fromLatin1("yyyy-MM-ddTHH:mm:ss"));
+    photo.m_urn    = entry.texts.value(QString::fromLatin1("id"));
+    photo.m_author = entry.texts.value(QString::fromLatin1("author"));
+
+    photo.setTitle(entry.texts.value(QString::fromLatin1("title")));
+    photo.setSummary(entry.texts.value(QString::fromLatin1("summary")));
+    photo.m_apiEditUrl    = linkEdit;
+    photo.m_apiSelfUrl    = linkSelf;
+    photo.m_apiMediaUrl   = linkMedia;
+    photo.m_apiAlbumUrl   = linkAlbum;
+    photo.m_publishedDate = QDateTime::fromString(entry.texts.value(QString::fromLatin1("published")),
+                                                  QString::fromLatin1("yyyy-MM-ddTHH:mm:ssZ"));
+    photo.m_editedDate    = QDateTime::fromString(entry.texts.value(QString::fromLatin1("app:edited")),
+                                                  QString::fromLatin1("yyyy-MM-ddTHH:mm:ssZ"));
+    photo.m_updatedDate   = QDateTime::fromString(entry.texts.value(QString::fromLatin1("updated")),
+                                                  QString::fromLatin1("yyyy-MM-ddTHH:mm:ssZ"));
+    photo.m_createdDate   = QDateTime::fromString(entry.texts.value(QString::fromLatin1("f:created")),
+                                                  QString::fromLatin1("yyyy-MM-ddTHH:mm:ss"));
 
     photo.setAccess(access);
-    photo.setHideOriginal(hideOriginal.attribute(
-        QString::fromLatin1("value"), QString::fromLatin1("false")) == QString::fromLatin1("true"));
-    photo.setDisableComments(disableComments.attribute(
-        QString::fromLatin1("value"), QString::fromLatin1("false")) == QString::fromLatin1("true"));
-    photo.setAdult(adult.attribute(
-        QString::fromLatin1("value"), QString::fromLatin1("false")) == QString::fromLatin1("true"));
+    photo.setHideOriginal(entry.attributes.value(QString::fromLatin1("f:hide_original"))
+                          .value(QString::fromLatin1("value")) == QString::fromLatin1("true"));
+    photo.setDisableComments(entry.attributes.value(QString::fromLatin1("f:disable_comments"))
+                             .value(QString::fromLatin1("value")) == QString::fromLatin1("true"));
+    photo.setAdult(entry.attributes.value(QString::fromLatin1("f:xxx"))
+                   .value(QString::fromLatin1("value")) == QString::fromLatin1("true"));
 
-    photo.m_remoteUrl = content.attribute(QString::fromLatin1("src"));
+    photo.m_remoteUrl = content.value(QString::fromLatin1("src")).toString();
 
     /*
      * FIXME: tags part of the API is not documented by Yandex
@@ -899,72 +947,124 @@ bool YandexFotkiTalker::parsePhotoXml(const QDomElement& entryElem, YandexFotkiP
 
     // reload all tags from the response
     photo.tags.clear();
-    QDomElement category = entryElem.firstChildElement(QString::fromLatin1("category"));
 
-    for ( ; !category.isNull();
-         category = category.nextSiblingElement(QString::fromLatin1("category")))
+    foreach (const QXmlStreamAttributes& category, entry.categories)
     {
         if (category.hasAttribute(QString::fromLatin1("term")) &&
             category.hasAttribute(QString::fromLatin1("scheme")) &&
             // FIXME: I have no idea how to make its better, usable API is needed
-            category.attribute(QString::fromLatin1("scheme")) == m_apiTagsUrl)
+            category.value(QString::fromLatin1("scheme")) == m_apiTagsUrl)
         {
-            photo.tags.append(category.attribute(QString::fromLatin1("term")));
+            photo.tags.append(category.value(QString::fromLatin1("term")).toString());
         }
     }
 
     return true;
 }
 
-void YandexFotkiTalker::parseResponseListPhotos()
+void YandexFotkiTalker::slotReadyRead()
 {
-    QDomDocument doc(QString::fromLatin1("feed"));
-
-    if (!doc.setContent(m_buffer))
-    {
-        qCCritical(KIPIPLUGINS_LOG) << "Invalid XML, parse error: " << m_buffer;
-        return setErrorState(STATE_LISTPHOTOS_ERROR);
-    }
-
-    int initialSize    = m_photos.size();
-    bool errorOccurred = false;
+    if (sender() != m_reply || m_state != STATE_LISTPHOTOS)
+        return;
 
-    const QDomElement rootElem = doc.documentElement();
+    readPhotosFeed(m_reply->readAll());
+}
 
-    // find next page link
-    m_photosNextUrl.clear();
-    QDomElement linkElem = rootElem.firstChildElement(QString::fromLatin1("link"));
+/*
+ * The photos feed can be large: it is parsed while it is received, and only the
+ * children of the current <entry> are kept until the photo is complete. When the
+ * data received so far are consumed, the reader stops with a premature end of
+ * document error, and continues from there with the next data.
+ */
+void YandexFotkiTalker::readPhotosFeed(const QByteArray& data)
+{
+    m_xml.addData(data);
 
-    for ( ; !linkElem.isNull();
-          linkElem = linkElem.nextSiblingElement(QString::fromLatin1("link")))
+    while (!m_xml.atEnd())
     {
-        if (linkElem.attribute(QString::fromLatin1("rel")) == QString::fromLatin1("next") &&
-            !linkElem.attribute(QString::fromLatin1("href")).isNull())
+        m_xml.readNext();
+
+        if (m_xml.isStartElement())
         {
-            m_photosNextUrl = linkElem.attribute(QString::fromLatin1("href"));
-            break;
+            m_xmlDepth++;
+
+            const QString name               = m_xml.qualifiedName().toString();
+            const QXmlStreamAttributes attrs = m_xml.attributes();
+
+            if (m_xmlDepth == 2 && name == QString::fromLatin1("entry"))
+            {
+                m_inEntry    = true;
+                m_entry      = PhotoEntry();
+                m_entry.line = m_xml.lineNumber();
+            }
+            else if (m_xmlDepth == 2 && name == QString::fromLatin1("link"))
+            {
+                // find next page link
+                if (m_photosNextUrl.isNull() &&
+                    attrs.value(QString::fromLatin1("rel")) == QString::fromLatin1("next") &&
+                    !attrs.value(QString::fromLatin1("href")).isNull())
+                {
+                    m_photosNextUrl = attrs.value(QString::fromLatin1("href")).toString();
+                }
+            }
+            else if (m_xmlDepth == 3 && m_inEntry)
+            {
+                m_xmlText.clear();
+
+                if (name == QString::fromLatin1("link"))
+                    m_entry.links.append(attrs);
+                else if (name == QString::fromLatin1("category"))
+                    m_entry.categories.append(attrs);
+                else if (!m_entry.attributes.contains(name))
+                    m_entry.attributes.insert(name, attrs);
+            }
         }
-    }
-
-    QDomElement entryElem = rootElem.firstChildElement(QString::fromLatin1("entry"));
-    for ( ; !entryElem.isNull();
-          entryElem = entryElem.nextSiblingElement(QString::fromLatin1("entry")))
-    {
-        YandexFotkiPhoto photo;
-
-        if (parsePhotoXml(entryElem, photo))
+        else if (m_xml.isCharacters() && !m_xml.isWhitespace())
         {
-            m_photos.append(photo);
+            if (m_inEntry && m_xmlDepth >= 3)
+                m_xmlText += m_xml.text();
         }
-        else
+        else if (m_xml.isEndElement())
         {
-            // set error mark and conintinue
-            errorOccurred = true;
+            if (m_xmlDepth == 3 && m_inEntry)
+            {
+                const QString name = m_xml.qualifiedName().toString();
+
+                if (!m_entry.texts.contains(name))
+                    m_entry.texts.insert(name, m_xmlText);
+            }
+            else if (m_xmlDepth == 2 && m_inEntry)
+            {
+                m_inEntry = false;
+                YandexFotkiPhoto photo;
+
+                if (parsePhotoEntry(m_entry, photo))
+                {
+                    m_photos.append(photo);
+                }
+                else
+                {
+                    // set error mark and conintinue
+                    m_photosErrors = true;
+                }
+            }
+
+            m_xmlDepth--;
         }
     }
+}
+
+void YandexFotkiTalker::parseResponseListPhotos()
+{
+    if (m_xml.hasError())
+    {
+        qCCritical(KIPIPLUGINS_LOG) << "Invalid XML, parse error: " << m_xml.errorString()
+                                    << "at line" << m_xml.lineNumber();
+        return setErrorState(STATE_LISTPHOTOS_ERROR);
+    }
 
     // if an error has occurred and we didn't find anything => notify user
-    if (errorOccurred && initialSize == m_photos.size())
+    if (m_photosErrors && m_photosPageStart == m_photos.size())
     {
         qCCritical(KIPIPLUGINS_LOG) << "No photos found, some XML errors have occurred";
         return setErrorState(STATE_LISTPHOTOS_ERROR);
@@ -29,6 +29,8 @@
 #include <QPointer>
 #include <QNetworkReply>
 #include <QNetworkAccessManager>
+#include <QXmlStreamReader>
+#include <QHash>
 
 // Local includes
 
@@ -196,9 +198,27 @@ Q_SIGNALS:
     void signalUpdatePhotoDone(YandexFotkiPhoto& );
     void signalUpdateAlbumDone();
 
+protected:
+
+    /// Child elements of the Atom <entry> of a photo, read from a DOM or from a stream.
+    struct PhotoEntry
+    {
+        PhotoEntry()
+            : line(0)
+        {
+        }
+
+        QHash<QString, QString>              texts;      // first text by element name
+        QHash<QString, QXmlStreamAttributes> attributes; // first attributes by element name
+        QList<QXmlStreamAttributes>          links;
+        QList<QXmlStreamAttributes>          categories;
+        qint64                               line;
+    };
+
 protected Q_SLOTS:
 
     void slotFinished(QNetworkReply* reply);
+    void slotReadyRead();
 
     void parseResponseGetSession();
     //void parseResponseCheckToken();
@@ -257,6 +277,10 @@ protected:
     // for photos pagination in listPhotos()
     void listPhotosNext(); // see listPhotos();
 
+    // photos feed parsed while it is received
+    void readPhotosFeed(const QByteArray& data);
+    bool parsePhotoEntry(const PhotoEntry& entry, YandexFotkiPhoto& photo);
+
 protected:
 
     /*
@@ -275,6 +299,15 @@ protected:
     QList<YandexFotkiPhoto> m_photos;
     QString                 m_photosNextUrl;
 
+    // state of the photos feed parser
+    QXmlStreamReader        m_xml;
+    QString                 m_xmlText;
+    int                     m_xmlDepth;
+    bool                    m_inEntry;
+    PhotoEntry              m_entry;
+    int                     m_photosPageStart;
+    bool                    m_photosErrors;
+
     QNetworkAccessManager*  m_netMngr;
 
     QNetworkReply*          m_reply;
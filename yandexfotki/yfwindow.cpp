@@ -751,6 +751,9 @@ void YandexFotkiWindow::slotGetTokenDone()
 
 void YandexFotkiWindow::slotListAlbumsDone(const QList<YandexFotkiAlbum>& albumsList)
 {
+    // Partial lists are sent while the next pages are fetched: keep the selection.
+    const int current = m_albumsCombo->currentIndex();
+
     m_albumsCombo->clear();
 
     foreach(const YandexFotkiAlbum& album, albumsList)
@@ -769,8 +772,15 @@ void YandexFotkiWindow::slotListAlbumsDone(const QList<YandexFotkiAlbum>& albums
         m_albumsCombo->addItem(QIcon::fromTheme(albumIcon), album.toString());
     }
 
+    if (current >= 0 && current < m_albumsCombo->count())
+    {
+        m_albumsCombo->setCurrentIndex(current);
+    }
+
     m_albumsCombo->setEnabled(true);
-    updateControls(true);
+
+    // Uploads can only start once the talker is done with the listing.
+    updateControls(m_talker.state() != YandexFotkiTalker::STATE_LISTALBUMS);
 }
 
 void YandexFotkiWindow::slotUpdatePhotoDone(YandexFotkiPhoto& photo)